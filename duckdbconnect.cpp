@@ -0,0 +1,665 @@
+/** \file
+ * \brief DuckDB connector for GQL
+ *
+ * DuckDB runs in process and is well suited for the wide aggregations used by
+ * dashboards. Besides tables in the database file, the default table can be a
+ * Parquet or CSV file (e.g. `-d data.parquet`) which DuckDB reads directly.
+ *
+ * The result is read column-wise through the data chunk API, so values are
+ * taken from the native vectors without converting them to text first.
+ *
+ * \author Claudio Fleiner
+ * \copyright 2018 Claudio Fleiner
+ *
+ * **License:**
+ *
+ * > This program is free software: you can redistribute it and/or modify
+ * > it under the terms of the GNU Affero General Public License as published by
+ * > the Free Software Foundation, either version 3 of the License, or
+ * > (at your option) any later version.
+ * >
+ * > This program is distributed in the hope that it will be useful,
+ * > but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * > MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * > GNU Affero General Public License for more details.
+ * >
+ * > You should have received a copy of the GNU Affero General Public License
+ * > along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <ctime>
+#include <unordered_map>
+#include <exception>
+#include <jsoncpp/json/json.h>
+#include <glog/logging.h>
+#include <boost/algorithm/string.hpp>
+#include <duckdb.h>
+#include "libgqlsql.h"
+
+/// Functions that have the same name and meaning in DuckDB
+const static std::set<std::string> sameFunctions { "year","month","day","hour","minute","second","quarter" };
+
+/// Quote an identifier for DuckDB
+static std::string quoteIdentDuckDB(const std::string &s)
+{
+    return "\""+boost::replace_all_copy(s,"\"","\"\"")+"\"";
+}
+
+/// Quote an string for DuckDB
+static std::string quoteString(const std::string &s)
+{
+    return "'"+boost::replace_all_copy(s,"'","''")+"'";
+}
+
+/// Write one expression as valid DuckDB expression, see duckdbExpr().
+static void duckdbNode(const GQL_SQL::GQLParser::Query::Expr &qe,GQL_SQL::GQLParser::ExprWriter &w,
+                       std::set<std::string>&tables)
+{
+    switch(qe.tp()) {
+    case GQL_SQL::GQLParser::TokenType::ASC:
+    case GQL_SQL::GQLParser::TokenType::BY:
+    case GQL_SQL::GQLParser::TokenType::COMMA:
+    case GQL_SQL::GQLParser::TokenType::DESC:
+    case GQL_SQL::GQLParser::TokenType::EOL:
+    case GQL_SQL::GQLParser::TokenType::ERROR:
+    case GQL_SQL::GQLParser::TokenType::FORMAT:
+    case GQL_SQL::GQLParser::TokenType::GROUP:
+    case GQL_SQL::GQLParser::TokenType::LABEL:
+    case GQL_SQL::GQLParser::TokenType::LIMIT:
+    case GQL_SQL::GQLParser::TokenType::OFFSET:
+    case GQL_SQL::GQLParser::TokenType::OPTIONS:
+    case GQL_SQL::GQLParser::TokenType::ORDER:
+    case GQL_SQL::GQLParser::TokenType::PIVOT:
+    case GQL_SQL::GQLParser::TokenType::P_CLOSE:
+    case GQL_SQL::GQLParser::TokenType::P_OPEN:
+    case GQL_SQL::GQLParser::TokenType::SELECT:
+    case GQL_SQL::GQLParser::TokenType::TIMESTAMP:
+    case GQL_SQL::GQLParser::TokenType::WHERE:
+    case GQL_SQL::GQLParser::TokenType::_UNDEFINED:
+        LOG(FATAL) << "got unusable token type " << qe.tp();
+
+    case GQL_SQL::GQLParser::TokenType::GQL_FALSE:
+        w.text("FALSE");
+        break;
+    case GQL_SQL::GQLParser::TokenType::GQL_TRUE:
+        w.text("TRUE");
+        break;
+
+    case GQL_SQL::GQLParser::TokenType::IS_NULL:
+        w.text("(");
+        w.sub(qe.sub()[0]);
+        w.text(" IS NULL)");
+        break;
+
+    case GQL_SQL::GQLParser::TokenType::IS_NOT_NULL:
+        w.text("(");
+        w.sub(qe.sub()[0]);
+        w.text(" IS NOT NULL)");
+        break;
+
+    case GQL_SQL::GQLParser::TokenType::PLUS:
+    case GQL_SQL::GQLParser::TokenType::MINUS:
+        if(qe.sub().size()==1) {
+            if(qe.tp()==GQL_SQL::GQLParser::TokenType::PLUS) {
+                w.sub(qe.sub()[0]);
+            } else {
+                w.text("(-");
+                w.sub(qe.sub()[0]);
+                w.text(")");
+            }
+            break;
+        }
+        FALLTHROUGH
+    case GQL_SQL::GQLParser::TokenType::TIMES:
+    case GQL_SQL::GQLParser::TokenType::DIV:
+    case GQL_SQL::GQLParser::TokenType::LT:
+    case GQL_SQL::GQLParser::TokenType::LE:
+    case GQL_SQL::GQLParser::TokenType::GT:
+    case GQL_SQL::GQLParser::TokenType::GE:
+    case GQL_SQL::GQLParser::TokenType::EQ:
+    case GQL_SQL::GQLParser::TokenType::NE:
+        assert(qe.sub().size()==2);
+        w.text("(");
+        w.sub(qe.sub()[0]);
+        w.text(qe.data());
+        w.sub(qe.sub()[1]);
+        w.text(")");
+        break;
+
+    case GQL_SQL::GQLParser::TokenType::DATE:
+        w.text("DATE "+quoteString(qe.sub()[0]->data()));
+        break;
+
+    case GQL_SQL::GQLParser::TokenType::DATETIME:
+        w.text("TIMESTAMP "+quoteString(qe.sub()[0]->data()));
+        break;
+
+    case GQL_SQL::GQLParser::TokenType::TIMEOFDAY:
+        w.text("TIME "+quoteString(qe.sub()[0]->data()));
+        break;
+
+    case GQL_SQL::GQLParser::TokenType::LIKE:
+        assert(qe.sub().size()==2);
+        w.text("(");
+        w.sub(qe.sub()[0]);
+        w.text(" like ");
+        w.sub(qe.sub()[1]);
+        w.text(")");
+        break;
+    case GQL_SQL::GQLParser::TokenType::AND:
+    case GQL_SQL::GQLParser::TokenType::OR:
+        {
+            // a chain of the same operator is written without nesting, the
+            // parser stack of the database may be too small for long filters
+            assert(qe.sub().size()==2);
+            const auto &l=qe.sub()[0];
+            bool parens=!(w.flags()&GQL_SQL::GQLParser::ExprWriter::NO_PARENS);
+            if(parens) { w.text("("); }
+            w.sub(l,l->tp()==qe.tp()?GQL_SQL::GQLParser::ExprWriter::NO_PARENS:0);
+            w.text(qe.tp()==GQL_SQL::GQLParser::TokenType::AND?" and ":" or ");
+            w.sub(qe.sub()[1]);
+            if(parens) { w.text(")"); }
+        }
+        break;
+    case GQL_SQL::GQLParser::TokenType::IN_SET:
+        w.text("(");
+        w.sub(qe.sub()[0]);
+        w.text(" IN (");
+        for(size_t i=1;i<qe.sub().size();i++) {
+            if(i>1) { w.text(","); }
+            w.sub(qe.sub()[i]);
+        }
+        w.text("))");
+        break;
+    case GQL_SQL::GQLParser::TokenType::NOT:
+        assert(qe.sub().size()==1);
+        w.text("(not ");
+        w.sub(qe.sub()[0]);
+        w.text(")");
+        break;
+    case GQL_SQL::GQLParser::TokenType::NUMBER:
+        w.text(qe.data());
+        break;
+    case GQL_SQL::GQLParser::TokenType::STRING:
+        w.text(quoteString(qe.data()));
+        break;
+
+    case GQL_SQL::GQLParser::TokenType::STARTS:
+        w.text("starts_with(");
+        w.sub(qe.sub()[0]);
+        w.text(",");
+        w.sub(qe.sub()[1]);
+        w.text(")");
+        break;
+
+    case GQL_SQL::GQLParser::TokenType::MATCHES:
+        w.text("regexp_full_match(");
+        w.sub(qe.sub()[0]);
+        w.text(",");
+        w.sub(qe.sub()[1]);
+        w.text(")");
+        break;
+
+    case GQL_SQL::GQLParser::TokenType::ENDS:
+        w.text("ends_with(");
+        w.sub(qe.sub()[0]);
+        w.text(",");
+        w.sub(qe.sub()[1]);
+        w.text(")");
+        break;
+
+    case GQL_SQL::GQLParser::TokenType::CONTAINS:
+        w.text("contains(");
+        w.sub(qe.sub()[0]);
+        w.text(",");
+        w.sub(qe.sub()[1]);
+        w.text(")");
+        break;
+
+    case GQL_SQL::GQLParser::TokenType::IDENTIFIER:
+        if(qe.sub().size()==0 && !qe.noarg()) {
+            auto dot=qe.data().find(".");
+            if(dot!=std::string::npos && qe.data().rfind(".")==dot) {
+                auto tbl=qe.data().substr(0,dot);
+                tables.insert(tbl);
+                w.text(quoteIdentDuckDB(tbl));
+                w.text(".");
+                w.text(quoteIdentDuckDB(qe.data().substr(dot+1)));
+            } else {
+                w.text(quoteIdentDuckDB(qe.data()));
+                tables.insert("");
+            }
+        } else {
+            const char *suffix=")";
+            const char *sep=", ";
+            if(sameFunctions.count(qe.data())) {
+                w.text(qe.data()+"(");
+            } else if(qe.data()=="millisecond") {
+                w.text("(millisecond(");
+                suffix=")%1000)";
+            } else if(qe.data()=="dayOfWeek") {
+                w.text("(dayofweek(");
+                suffix=")+1)";
+            } else if(qe.data()=="now") {
+                w.text("CAST(now() AS TIMESTAMP");
+            } else if(qe.data()=="dateDiff") {
+                // dateDiff(a,b) is a-b in days
+                assert(qe.sub().size()==2);
+                w.text("date_diff('day',CAST(");
+                w.sub(qe.sub()[1]);
+                w.text(" AS DATE),CAST(");
+                w.sub(qe.sub()[0]);
+                w.text(" AS DATE))");
+                return;
+            } else if(qe.data()=="toDate") {
+                w.text("CAST(");
+                suffix=" AS DATE)";
+            } else {
+                w.text(qe.data()+"(");
+            }
+            int first=1;
+            for(const auto &e:qe.sub()) {
+                if(!first) { w.text(sep); }
+                first=0;
+                w.sub(e);
+            }
+            w.text(suffix);
+        }
+    }
+}
+
+/// Append qe as valid DuckDB expression to r.
+static void duckdbExpr(std::string &r,const GQL_SQL::GQLParser::Query::Expr::CPtr &qe,std::set<std::string>&tables)
+{
+    GQL_SQL::GQLParser::ExprWriter w(r);
+    w.run(*qe,[&](const GQL_SQL::GQLParser::Query::Expr &e,GQL_SQL::GQLParser::ExprWriter &ew) {
+        duckdbNode(e,ew,tables);
+    });
+}
+
+/// Create the DuckDB query string.
+/// Note that pivot is done by DB::pivotTable() as for the other backends
+/// and not with the DuckDB PIVOT statement: the GQL pivot defines the
+/// labels, types and formats of the created columns, which PIVOT does not
+/// return.
+void GQL_SQL::GQLParser::ParserDuckDB::createResult()
+{
+    if(!query_) { return; }
+    std::string r="";
+    std::set<std::string> tables;
+    if(query_->selectStar) {
+        r="select * ";
+    } else if(query_->select.size()>0) {
+        r="select ";
+        for(auto i:query_->pivot) {
+            if(r!="select ") { r+=", "; }
+            r+=" "+quoteIdentDuckDB(i.token.to_string());
+        }
+        if(query_->pivot.size()) {
+            for(auto i:query_->group) {
+                r+=", "+quoteIdentDuckDB(i.token.to_string());
+            }
+        }
+
+        for(unsigned int i=0;i<query_->select.size();i++) {
+            if(r!="select ") { r+=", "; }
+            auto s=query_->select[i];
+            duckdbExpr(r,s.expr,tables);
+        }
+    }
+    std::string qstring="";
+    if(query_->where) {
+        qstring=" where ";
+        duckdbExpr(qstring,query_->where,tables);
+    }
+    r+=" from ";
+    bool addedTable=false;
+    if(tables.size()==0||tables.count("")>0||tables.count(defTable_)>0) {
+        r+=quoteIdentDuckDB(defTable_);
+        tables.erase("");
+        tables.erase(defTable_);
+        addedTable=true;
+    }
+
+    for(auto t:tables) {
+        if(allowedTables_.count(t)==0) {
+            throw GQLError(ErrorReasons::ACCESS_DENIED,"table \""+t+"\" does not exists or is not accessible");
+        }
+        if(addedTable) { r+=", "; }
+        addedTable=true;
+        r+=quoteIdentDuckDB(t);
+    }
+    r+=qstring;
+
+    // For a manual pivot we need to group by the pivot columns
+    bool first=1;
+    for(auto i:query_->pivot) {
+        if(!first) { r+=","; }
+        else { r+=" GROUP BY ";first=false; }
+        first=false;
+        r+=" "+quoteIdentDuckDB(i.token.to_string());
+    }
+
+    for(auto i:query_->group) {
+        if(!first) { r+=","; }
+        else { r+=" GROUP BY ";first=false; }
+        first=false;
+        r+=" "+quoteIdentDuckDB(i.token.to_string());
+    }
+
+    first=1;
+    for(const auto &o:query_->order) {
+        if(!first) { r+=", "; }
+        else { r+=" ORDER BY "; }
+        first=false;
+        duckdbExpr(r,o.expr,tables);
+        if(o.desc) { r+=" DESC"; }
+    }
+    // pivot queries are limited after pivoting, see DB::pivotTable()
+    bool pivot=query_->hasPivotClause();
+    uint64_t limit=sqlLimit();
+    if(limit) {
+        r+=" LIMIT "+std::to_string(limit);
+    }
+    if(query_->offset&&!pivot) {
+        r+=" OFFSET "+std::to_string(query_->offset);
+    }
+    res_.result=r;
+}
+
+/// We are the DuckDB connector
+std::string GQL_SQL::GQLParser::ParserDuckDB::target() const { return "DuckDB"; }
+
+GQL_SQL::GQLParser::ParserDuckDB::~ParserDuckDB() { }
+
+/// Return the characters of a DuckDB string, strings of up to 12 bytes are stored inline
+static const char *duckdbChars(const duckdb_string_t &s)
+{
+    return s.value.inlined.length<=12?s.value.inlined.inlined:s.value.pointer.ptr;
+}
+
+/// Convert a DuckDB string to a std::string
+static std::string duckdbString(const duckdb_string_t &s)
+{
+    return std::string(duckdbChars(s),s.value.inlined.length);
+}
+
+/// Connect to (open) a DuckDB database, read-only
+void GQL_SQL::DBQuery::DuckDB::connect()
+{
+    if(connection_) { return; }
+    duckdb_config config;
+    if(duckdb_create_config(&config)!=DuckDBSuccess) { return; }
+    duckdb_set_config(config,"access_mode","READ_ONLY");
+    char *error=0;
+    duckdb_database database;
+    // an empty name is an in-memory database (only useful with parquet/csv files)
+    duckdb_state state=duckdb_open_ext(db_==""?0:db_.c_str(),&database,config,&error);
+    duckdb_destroy_config(&config);
+    if(state!=DuckDBSuccess) {
+        LOG(ERROR) << "cannot open duckdb '" << db_ << "': " << (error?error:"");
+        duckdb_free(error);
+        return;
+    }
+    duckdb_connection connection;
+    if(duckdb_connect(database,&connection)!=DuckDBSuccess) {
+        LOG(ERROR) << "cannot connect to duckdb '" << db_ << "'";
+        duckdb_close(&database);
+        return;
+    }
+    database_=database;
+    connection_=connection;
+    parser_=std::shared_ptr<GQLParser::Parser>(new GQLParser::ParserDuckDB(deftable_,tables_,extendedFunctions_));
+    parser_->maxRowsSet(maxRows_);
+
+    if(!schemaCached()) {
+        schema_.clear();
+        for(const auto &t:schemaTables()) {
+            TableSchema &ts=schema_[t];
+            duckdb_result res;
+            if(duckdb_query(connection_,("DESCRIBE "+quoteIdentDuckDB(t)).c_str(),&res)==DuckDBSuccess) {
+                duckdb_data_chunk chunk;
+                while((chunk=duckdb_fetch_chunk(res))!=0) {
+                    // column_name, column_type, ...
+                    auto *names=static_cast<duckdb_string_t *>(duckdb_vector_get_data(duckdb_data_chunk_get_vector(chunk,0)));
+                    auto *types=static_cast<duckdb_string_t *>(duckdb_vector_get_data(duckdb_data_chunk_get_vector(chunk,1)));
+                    for(idx_t r=0;r<duckdb_data_chunk_get_size(chunk);r++) {
+                        ts[duckdbString(names[r])]=duckdbString(types[r]);
+                    }
+                    duckdb_destroy_data_chunk(&chunk);
+                }
+            }
+            duckdb_destroy_result(&res);
+        }
+        schemaCache();
+    }
+    parser_->schemaSet(schema_);
+}
+
+/// Return true if the db is open
+bool GQL_SQL::DBQuery::DuckDB::isConnected() const
+{
+    return connection_!=0;
+}
+
+GQL_SQL::DBQuery::DuckDB::~DuckDB() {
+    asyncStop();
+    if(connection_) {
+        duckdb_connection connection=connection_;
+        duckdb_database database=database_;
+        duckdb_disconnect(&connection);
+        duckdb_close(&database);
+    }
+}
+
+/// Stop the running query, duckdb_query() then fails
+void GQL_SQL::DBQuery::DuckDB::interrupt() const
+{
+    if(connection_) { duckdb_interrupt(connection_); }
+}
+
+/// Seconds since the epoch of the given local date and time
+static double localEpoch(int32_t year,int month,int day,int hour,int min,int sec)
+{
+    struct tm t;
+    memset(&t,0,sizeof(t));
+    t.tm_year=year-1900;
+    t.tm_mon=month-1;
+    t.tm_mday=day;
+    t.tm_hour=hour;
+    t.tm_min=min;
+    t.tm_sec=sec;
+    t.tm_isdst=-1;
+    return static_cast<double>(mktime(&t));
+}
+
+/// Convert a 128 bit integer to a double
+static double hugeintToDouble(const duckdb_hugeint &h)
+{
+    return static_cast<double>(h.upper)*18446744073709551616.0+static_cast<double>(h.lower);
+}
+
+/// Return the data from the query in json format.
+/// The data is read chunk by chunk directly from the column vectors.
+void GQL_SQL::DBQuery::DuckDB::getdata(const Result &q,Json::Value &tbl) const
+{
+    LOG(INFO) << "search: " << q.result;
+    duckdb_result result;
+    if(duckdb_query(connection_,q.result.c_str(),&result)!=DuckDBSuccess) {
+        std::string msg=duckdb_result_error(&result);
+        duckdb_destroy_result(&result);
+        throw GQLError(ErrorReasons::INVALID_QUERY,msg);
+    }
+    ON_EXIT(duckdb_destroy_result(&result););
+
+    idx_t colcount=duckdb_column_count(&result);
+    tbl["cols"]=Json::Value();
+    Json::Value &cols=tbl["cols"];
+    cols.resize(static_cast<Json::ArrayIndex>(colcount));
+    std::vector<duckdb_type> types(colcount);
+    std::vector<double> decimalScale(colcount,0);
+    for(idx_t i=0;i<colcount;i++) {
+        Json::ArrayIndex ci=static_cast<Json::ArrayIndex>(i);
+        cols[ci]["id"]=duckdb_column_name(&result,i);
+        types[i]=duckdb_column_type(&result,i);
+        switch(types[i]) {
+        case DUCKDB_TYPE_BOOLEAN:
+            cols[ci]["type"]=TYPE_BOOLEAN;
+            break;
+        case DUCKDB_TYPE_TINYINT:
+        case DUCKDB_TYPE_SMALLINT:
+        case DUCKDB_TYPE_INTEGER:
+        case DUCKDB_TYPE_BIGINT:
+        case DUCKDB_TYPE_UTINYINT:
+        case DUCKDB_TYPE_USMALLINT:
+        case DUCKDB_TYPE_UINTEGER:
+        case DUCKDB_TYPE_UBIGINT:
+        case DUCKDB_TYPE_HUGEINT:
+        case DUCKDB_TYPE_FLOAT:
+        case DUCKDB_TYPE_DOUBLE:
+            cols[ci]["type"]=TYPE_NUMBER;
+            break;
+        case DUCKDB_TYPE_DECIMAL:
+            {
+                cols[ci]["type"]=TYPE_NUMBER;
+                duckdb_logical_type lt=duckdb_column_logical_type(&result,i);
+                decimalScale[i]=pow(10.0,duckdb_decimal_scale(lt));
+                // decimals are stored as integers of the internal type
+                types[i]=duckdb_decimal_internal_type(lt);
+                duckdb_destroy_logical_type(&lt);
+            }
+            break;
+        case DUCKDB_TYPE_DATE:
+            cols[ci]["type"]=TYPE_DATE;
+            break;
+        case DUCKDB_TYPE_TIME:
+            cols[ci]["type"]=TYPE_TIME;
+            break;
+        case DUCKDB_TYPE_TIMESTAMP:
+        case DUCKDB_TYPE_TIMESTAMP_S:
+        case DUCKDB_TYPE_TIMESTAMP_MS:
+        case DUCKDB_TYPE_TIMESTAMP_NS:
+        case DUCKDB_TYPE_TIMESTAMP_TZ:
+            cols[ci]["type"]=TYPE_DATETIME;
+            break;
+        case DUCKDB_TYPE_VARCHAR:
+            cols[ci]["type"]=TYPE_STRING;
+            break;
+        default:
+            throw GQLError(ErrorReasons::INVALID_QUERY,"column '"+cols[ci]["id"].asString()
+                            +"' has a type that is not supported, use a cast in the view or query");
+        }
+    }
+
+    tbl["rows"]=Json::Value(Json::arrayValue);
+    Json::Value &res=tbl["rows"];
+    Json::ArrayIndex rcnt=0;
+    uint64_t used=0;
+    std::vector<void *> data(colcount);
+    std::vector<uint64_t *> validity(colcount);
+    duckdb_data_chunk chunk;
+    while((chunk=duckdb_fetch_chunk(result))!=0) {
+        ON_EXIT(duckdb_destroy_data_chunk(&chunk););
+        idx_t size=duckdb_data_chunk_get_size(chunk);
+        for(idx_t c=0;c<colcount;c++) {
+            duckdb_vector vec=duckdb_data_chunk_get_vector(chunk,c);
+            data[c]=duckdb_vector_get_data(vec);
+            validity[c]=duckdb_vector_get_validity(vec);
+        }
+        res.resize(rcnt+static_cast<Json::ArrayIndex>(size));
+        for(idx_t r=0;r<size;r++,rcnt++) {
+            Json::Value &v=res[rcnt]["c"];
+            v.resize(static_cast<Json::ArrayIndex>(colcount));
+            for(idx_t c=0;c<colcount;c++) {
+                Json::Value &cell=v[static_cast<Json::ArrayIndex>(c)]["v"];
+                if(validity[c]&&!duckdb_validity_row_is_valid(validity[c],r)) {
+                    cell=Json::Value::null;
+                    continue;
+                }
+                double scale=decimalScale[c]; // 0 if not a decimal
+                switch(types[c]) {
+                case DUCKDB_TYPE_BOOLEAN:
+                    cell=static_cast<bool *>(data[c])[r];
+                    break;
+                case DUCKDB_TYPE_TINYINT:
+                    cell=Json::Value(static_cast<Json::Int>(static_cast<int8_t *>(data[c])[r]));
+                    break;
+                case DUCKDB_TYPE_SMALLINT:
+                    if(scale) { cell=static_cast<int16_t *>(data[c])[r]/scale; }
+                    else { cell=Json::Value(static_cast<Json::Int>(static_cast<int16_t *>(data[c])[r])); }
+                    break;
+                case DUCKDB_TYPE_INTEGER:
+                    if(scale) { cell=static_cast<int32_t *>(data[c])[r]/scale; }
+                    else { cell=Json::Value(static_cast<Json::Int>(static_cast<int32_t *>(data[c])[r])); }
+                    break;
+                case DUCKDB_TYPE_BIGINT:
+                    if(scale) { cell=static_cast<double>(static_cast<int64_t *>(data[c])[r])/scale; }
+                    else { cell=Json::Value(static_cast<Json::Int64>(static_cast<int64_t *>(data[c])[r])); }
+                    break;
+                case DUCKDB_TYPE_UTINYINT:
+                    cell=Json::Value(static_cast<Json::UInt>(static_cast<uint8_t *>(data[c])[r]));
+                    break;
+                case DUCKDB_TYPE_USMALLINT:
+                    cell=Json::Value(static_cast<Json::UInt>(static_cast<uint16_t *>(data[c])[r]));
+                    break;
+                case DUCKDB_TYPE_UINTEGER:
+                    cell=Json::Value(static_cast<Json::UInt>(static_cast<uint32_t *>(data[c])[r]));
+                    break;
+                case DUCKDB_TYPE_UBIGINT:
+                    cell=Json::Value(static_cast<Json::UInt64>(static_cast<uint64_t *>(data[c])[r]));
+                    break;
+                case DUCKDB_TYPE_HUGEINT:
+                    cell=hugeintToDouble(static_cast<duckdb_hugeint *>(data[c])[r])/(scale?scale:1);
+                    break;
+                case DUCKDB_TYPE_FLOAT:
+                    cell=static_cast<double>(static_cast<float *>(data[c])[r]);
+                    break;
+                case DUCKDB_TYPE_DOUBLE:
+                    cell=static_cast<double *>(data[c])[r];
+                    break;
+                case DUCKDB_TYPE_DATE:
+                    {
+                        duckdb_date_struct d=duckdb_from_date(static_cast<duckdb_date *>(data[c])[r]);
+                        cell=localEpoch(d.year,d.month,d.day,0,0,0);
+                    }
+                    break;
+                case DUCKDB_TYPE_TIME:
+                    cell=static_cast<double>(static_cast<duckdb_time *>(data[c])[r].micros)/1e6;
+                    break;
+                case DUCKDB_TYPE_TIMESTAMP:
+                case DUCKDB_TYPE_TIMESTAMP_S:
+                case DUCKDB_TYPE_TIMESTAMP_MS:
+                case DUCKDB_TYPE_TIMESTAMP_NS:
+                    {
+                        duckdb_timestamp ts=static_cast<duckdb_timestamp *>(data[c])[r];
+                        if(types[c]==DUCKDB_TYPE_TIMESTAMP_S) { ts.micros*=1000000; }
+                        else if(types[c]==DUCKDB_TYPE_TIMESTAMP_MS) { ts.micros*=1000; }
+                        else if(types[c]==DUCKDB_TYPE_TIMESTAMP_NS) { ts.micros/=1000; }
+                        duckdb_timestamp_struct t=duckdb_from_timestamp(ts);
+                        cell=localEpoch(t.date.year,t.date.month,t.date.day,t.time.hour,t.time.min,t.time.sec)
+                                +t.time.micros/1e6;
+                    }
+                    break;
+                case DUCKDB_TYPE_TIMESTAMP_TZ:
+                    // stored as UTC
+                    cell=static_cast<double>(static_cast<duckdb_timestamp *>(data[c])[r].micros)/1e6;
+                    break;
+                case DUCKDB_TYPE_VARCHAR:
+                    {
+                        const duckdb_string_t &s=static_cast<duckdb_string_t *>(data[c])[r];
+                        const char *p=duckdbChars(s);
+                        cell=Json::Value(p,p+s.value.inlined.length);
+                    }
+                    break;
+                default:
+                    break;
+                }
+            }
+            budget(rcnt+1,v,used);
+        }
+    }
+}
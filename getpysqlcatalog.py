@@ -34,17 +34,18 @@ known_types={
         "timestamptz":"DATETIME",
         "date":"DATE",
         "time":"TIME",
+        "timetz":"TIME",
 }
 
 
 typere=re.compile(r"{\s*oid\s*=>\s*'(\d+)'[^}]*typname\s*=>\s*'([^']*)[^}]*}")
+types=[]
 for m in typere.finditer(r.text):
     oid=int(m.group(1))
     name=m.group(2)
-    if name in known_types:
-        print "{",oid,",PG_TYPES::"+known_types[name]+"},",
-    elif name[0]=='_' and name[1:] in known_types:
-        print "{",oid,",PG_TYPES::"+known_types[name[1:]]+"},",
-    else:
-        print "{",oid,",PG_TYPES::STRING},",
-    print "/*",name,"*/"
+    # arrays (_int4 etc) are returned as text like {1,2,3}, so keep them as strings
+    types.append((oid,known_types.get(name,"STRING"),name))
+
+# the C++ code does a binary search, the table must be sorted by oid
+for oid,tp,name in sorted(types):
+    print("{ %d ,PG_TYPES::%s}, /* %s */" % (oid,tp,name))
@@ -0,0 +1,510 @@
+/** \file
+ * \brief Apache Arrow IPC stream output for GQL results
+ *
+ * Writes the result of a query as an Arrow IPC stream (schema message,
+ * record batches, end of stream marker) so that machine consumers like
+ * pandas or DuckDB can read the data without any text parsing.
+ *
+ * The Arrow metadata is encoded as flatbuffers. As only a handful of
+ * tables are needed a tiny encoder is implemented here instead of
+ * depending on the Arrow or flatbuffers libraries.
+ *
+ * \author Claudio Fleiner
+ * \copyright 2018 Claudio Fleiner
+ *
+ * **License:**
+ *
+ * > This program is free software: you can redistribute it and/or modify
+ * > it under the terms of the GNU Affero General Public License as published by
+ * > the Free Software Foundation, either version 3 of the License, or
+ * > (at your option) any later version.
+ * >
+ * > This program is distributed in the hope that it will be useful,
+ * > but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * > MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * > GNU Affero General Public License for more details.
+ * >
+ * > You should have received a copy of the GNU Affero General Public License
+ * > along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * **References:**
+ *
+ * - https://arrow.apache.org/docs/format/Columnar.html#serialization-and-interprocess-communication-ipc
+ * - https://github.com/apache/arrow/blob/main/format/Schema.fbs
+ * - https://github.com/apache/arrow/blob/main/format/Message.fbs
+ */
+
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <ctime>
+#include <memory>
+#include <algorithm>
+#include <vector>
+#include <jsoncpp/json/json.h>
+
+#include "libgqlsql.h"
+
+namespace {
+
+/// A node of the flatbuffer tree to be serialized (table, vector or string)
+struct FBNode {
+    typedef std::shared_ptr<FBNode> Ptr; ///< shared pointer for FBNode
+
+    enum class Kind { TABLE, TABLES, STRUCTS, STRING };
+
+    //! a single field of a table
+    struct Field {
+        uint16_t slot;   ///< field number as defined in the schema
+        uint8_t size;    ///< size of a scalar, 0 for offsets to other nodes
+        uint64_t value;  ///< value of a scalar
+        Ptr child;       ///< referenced node for offsets
+    };
+
+    Kind kind=Kind::TABLE;      ///< what this node represents
+    std::vector<Field> fields;  ///< table fields
+    std::vector<Ptr> elems;     ///< elements for vector of tables
+    std::string data;           ///< raw bytes for strings and vectors of structs
+    uint32_t count=0;           ///< number of structs in a vector of structs
+
+    //! add a scalar field to a table
+    FBNode *scalar(uint16_t _slot,uint8_t _size,uint64_t _value) {
+        fields.push_back(Field{_slot,_size,_value,0});
+        return this;
+    }
+    //! add a reference to another node to a table
+    FBNode *ref(uint16_t _slot,Ptr _child) {
+        fields.push_back(Field{_slot,0,0,_child});
+        return this;
+    }
+};
+
+/// Create an empty flatbuffer table
+static FBNode::Ptr fbTable() { return std::make_shared<FBNode>(); }
+
+/// Create a flatbuffer string
+static FBNode::Ptr fbString(const std::string &s)
+{
+    auto n=std::make_shared<FBNode>();
+    n->kind=FBNode::Kind::STRING;
+    n->data=s;
+    return n;
+}
+
+/// Create a flatbuffer vector of tables
+static FBNode::Ptr fbTables(const std::vector<FBNode::Ptr> &elems)
+{
+    auto n=std::make_shared<FBNode>();
+    n->kind=FBNode::Kind::TABLES;
+    n->elems=elems;
+    return n;
+}
+
+/// Create a flatbuffer vector of structs consisting of 64bit integers only
+/// (FieldNode and Buffer in the Arrow schema)
+static FBNode::Ptr fbStructs(const std::vector<int64_t> &values,uint32_t perStruct)
+{
+    auto n=std::make_shared<FBNode>();
+    n->kind=FBNode::Kind::STRUCTS;
+    n->count=static_cast<uint32_t>(values.size()/perStruct);
+    for(auto v:values) {
+        for(int i=0;i<8;i++) { n->data+=static_cast<char>((static_cast<uint64_t>(v)>>(8*i))&0xff); }
+    }
+    return n;
+}
+
+/// Serializes a flatbuffer tree front to back. Children are always written
+/// after their parents so that all offsets point forward as required.
+class FBWriter {
+    public:
+        //! serialize the tree with the given root and return the buffer
+        std::string finish(FBNode::Ptr root) {
+            buf_.clear();
+            put(0,4);
+            write(root,0);
+            align(8);
+            return buf_;
+        }
+
+    private:
+        void align(size_t a) { while(buf_.size()%a) { buf_+='\0'; } }
+        ///< pad the buffer to the given alignment
+
+        size_t put(uint64_t v,size_t size) {
+            size_t pos=buf_.size();
+            for(size_t i=0;i<size;i++) { buf_+=static_cast<char>((v>>(8*i))&0xff); }
+            return pos;
+        }
+        ///< append a little endian scalar, returns its position
+
+        void patch(size_t pos,uint32_t v) {
+            for(size_t i=0;i<4;i++) { buf_[pos+i]=static_cast<char>((v>>(8*i))&0xff); }
+        }
+        ///< overwrite a 32bit value at the given position
+
+        void write(FBNode::Ptr n,size_t ref) {
+            size_t pos=0;
+            std::vector<std::pair<size_t,FBNode::Ptr>> children;
+            switch(n->kind) {
+            case FBNode::Kind::STRING:
+                align(4);
+                pos=put(n->data.size(),4);
+                buf_+=n->data;
+                buf_+='\0';
+                break;
+            case FBNode::Kind::STRUCTS:
+                // the length is followed by 8 byte aligned structs
+                while((buf_.size()+4)%8) { buf_+='\0'; }
+                pos=put(n->count,4);
+                buf_+=n->data;
+                break;
+            case FBNode::Kind::TABLES:
+                align(4);
+                pos=put(n->elems.size(),4);
+                for(auto e:n->elems) { children.push_back({put(0,4),e}); }
+                break;
+            case FBNode::Kind::TABLE:
+                {
+                    uint16_t slots=0;
+                    for(auto &f:n->fields) { slots=std::max<uint16_t>(slots,static_cast<uint16_t>(f.slot+1)); }
+                    // compute the table layout: soffset first, then the
+                    // fields ordered by size to keep the padding small
+                    std::vector<const FBNode::Field*> order;
+                    for(auto &f:n->fields) { order.push_back(&f); }
+                    std::stable_sort(order.begin(),order.end(),[](const FBNode::Field *a,const FBNode::Field *b) {
+                        return (a->size?a->size:4)>(b->size?b->size:4);
+                    });
+                    std::vector<uint16_t> offsets(slots,0);
+                    size_t tsize=4;
+                    for(auto f:order) {
+                        size_t s=f->size?f->size:4;
+                        while(tsize%s) { tsize++; }
+                        offsets[f->slot]=static_cast<uint16_t>(tsize);
+                        tsize+=s;
+                    }
+                    align(2);
+                    size_t vtable=put(4+2*static_cast<uint64_t>(slots),2);
+                    put(tsize,2);
+                    for(auto o:offsets) { put(o,2); }
+                    align(8);
+                    pos=put(static_cast<uint32_t>(static_cast<int32_t>(buf_.size()-vtable)),4);
+                    buf_.resize(pos+tsize,'\0');
+                    for(auto &f:n->fields) {
+                        size_t at=pos+offsets[f.slot];
+                        if(f.size) {
+                            for(size_t i=0;i<f.size;i++) { buf_[at+i]=static_cast<char>((f.value>>(8*i))&0xff); }
+                        } else {
+                            children.push_back({at,f.child});
+                        }
+                    }
+                }
+                break;
+            }
+            patch(ref,static_cast<uint32_t>(pos-ref));
+            for(auto &c:children) { write(c.second,c.first); }
+        }
+        ///< write a node and all its children, patching the offset at ref
+
+        std::string buf_; ///< the serialized buffer
+};
+
+// Values taken from the Arrow flatbuffer schema (Schema.fbs and Message.fbs)
+static const uint16_t METADATA_V5=4;           ///< MetadataVersion.V5
+static const uint8_t HEADER_SCHEMA=1;          ///< MessageHeader.Schema
+static const uint8_t HEADER_RECORDBATCH=3;     ///< MessageHeader.RecordBatch
+static const uint8_t TYPE_INT=2;               ///< Type.Int
+static const uint8_t TYPE_FLOAT=3;             ///< Type.FloatingPoint
+static const uint8_t TYPE_UTF8=5;              ///< Type.Utf8
+static const uint8_t TYPE_BOOL=6;              ///< Type.Bool
+static const uint8_t TYPE_DATE=8;              ///< Type.Date
+static const uint8_t TYPE_TIME=9;              ///< Type.Time
+static const uint8_t TYPE_TIMESTAMP=10;        ///< Type.Timestamp
+static const uint16_t PRECISION_DOUBLE=2;      ///< Precision.DOUBLE
+static const uint16_t DATEUNIT_DAY=0;          ///< DateUnit.DAY
+static const uint16_t TIMEUNIT_MILLISECOND=1;  ///< TimeUnit.MILLISECOND
+
+/// Number of rows written per record batch
+static const uint32_t BATCH_ROWS=65536;
+
+/// Arrow types used for the GQL column types
+enum class ArrowType { INT64, DOUBLE, UTF8, BOOL, DATE32, TIME32, TIMESTAMP };
+
+/// days since 1970-01-01 for a date in the proleptic gregorian calendar
+static int64_t daysFromCivil(int64_t y,unsigned m,unsigned d)
+{
+    y-=m<=2;
+    const int64_t era=(y>=0?y:y-399)/400;
+    const unsigned yoe=static_cast<unsigned>(y-era*400);
+    const unsigned doy=(153*(m>2?m-3:m+9)+2)/5+d-1;
+    const unsigned doe=yoe*365+yoe/4-yoe/100+doy;
+    return era*146097+static_cast<int64_t>(doe)-719468;
+}
+
+/// Convert a date or datetime cell to milliseconds since the epoch
+/// (wall clock time, no time zone). Accepts both the raw values
+/// (seconds since the epoch in the local time zone) and the GQL
+/// 'Date(y,m,d,...)' strings.
+static int64_t toMillis(const Json::Value &v)
+{
+    int y=1970,m=0,d=1,h=0,mi=0,s=0,ms=0;
+    if(v.isString()) {
+        sscanf(v.asCString(),"Date(%d,%d,%d,%d,%d,%d,%d)",&y,&m,&d,&h,&mi,&s,&ms);
+    } else {
+        double secs=v.asDouble();
+        time_t ts=static_cast<time_t>(floor(secs));
+        struct tm tm;
+        localtime_r(&ts,&tm);
+        y=tm.tm_year+1900;m=tm.tm_mon;d=tm.tm_mday;
+        h=tm.tm_hour;mi=tm.tm_min;s=tm.tm_sec;
+        ms=static_cast<int>(llround((secs-floor(secs))*1000.0));
+    }
+    return daysFromCivil(y,static_cast<unsigned>(m+1),static_cast<unsigned>(d))*86400000LL
+           +((h*60LL+mi)*60LL+s)*1000LL+ms;
+}
+
+/// Convert a timeofday cell to milliseconds since midnight, accepts both
+/// seconds since midnight and the GQL [h,m,s,ms] array.
+static int64_t toTimeMillis(const Json::Value &v)
+{
+    if(v.isArray()) {
+        return ((v[0].asInt64()*60+v[1].asInt64())*60+v[2].asInt64())*1000+v[3].asInt64();
+    }
+    return llround(v.asDouble()*1000.0);
+}
+
+/// GQL functions that always return whole numbers
+static const char *const integerFunctions[]={
+    "count(","year(","month(","day(","hour(","minute(","second(","millisecond(","quarter(","dayOfWeek("
+};
+
+/// Returns the Arrow type to use for a column. It only depends on the
+/// column, never on the values, so a query always gets the same schema:
+/// counts and date parts (the id is the select expression) are INT64, all
+/// other numbers DOUBLE.
+static ArrowType arrowType(const Json::Value &col)
+{
+    std::string type=col["type"].asString();
+    if(type==GQL_SQL::DBQuery::TYPE_BOOLEAN) { return ArrowType::BOOL; }
+    if(type==GQL_SQL::DBQuery::TYPE_DATE) { return ArrowType::DATE32; }
+    if(type==GQL_SQL::DBQuery::TYPE_DATETIME) { return ArrowType::TIMESTAMP; }
+    if(type==GQL_SQL::DBQuery::TYPE_TIME) { return ArrowType::TIME32; }
+    if(type!=GQL_SQL::DBQuery::TYPE_NUMBER) { return ArrowType::UTF8; }
+    std::string id=col["id"].asString();
+    for(const char *f:integerFunctions) {
+        if(id.compare(0,strlen(f),f)==0 && id.find(')')==id.size()-1) { return ArrowType::INT64; }
+    }
+    return ArrowType::DOUBLE;
+}
+
+/// Convert a number cell to a double, false if it is a string that is not
+/// a number
+static bool toDouble(const Json::Value &v,double &d)
+{
+    if(!v.isString()) {
+        d=v.asDouble();
+        return true;
+    }
+    const char *s=v.asCString();
+    char *end;
+    d=strtod(s,&end);
+    return end!=s && *end==0;
+}
+
+/// Create the Arrow type table for a field, returns the union type
+static uint8_t arrowTypeTable(ArrowType t,FBNode::Ptr &tbl)
+{
+    tbl=fbTable();
+    switch(t) {
+    case ArrowType::INT64: tbl->scalar(0,4,64)->scalar(1,1,1);return TYPE_INT;
+    case ArrowType::DOUBLE: tbl->scalar(0,2,PRECISION_DOUBLE);return TYPE_FLOAT;
+    case ArrowType::UTF8: return TYPE_UTF8;
+    case ArrowType::BOOL: return TYPE_BOOL;
+    case ArrowType::DATE32: tbl->scalar(0,2,DATEUNIT_DAY);return TYPE_DATE;
+    case ArrowType::TIME32: tbl->scalar(0,2,TIMEUNIT_MILLISECOND)->scalar(1,4,32);return TYPE_TIME;
+    case ArrowType::TIMESTAMP: tbl->scalar(0,2,TIMEUNIT_MILLISECOND);return TYPE_TIMESTAMP;
+    }
+    return TYPE_UTF8;
+}
+
+/// Write a message (metadata and body) using the encapsulated IPC format
+static void writeMessage(std::ostream &o,uint8_t headerType,FBNode::Ptr header,const std::string &body)
+{
+    auto msg=fbTable();
+    msg->scalar(0,2,METADATA_V5)
+       ->scalar(1,1,headerType)
+       ->ref(2,header)
+       ->scalar(3,8,body.size());
+    std::string meta=FBWriter().finish(msg);
+    uint32_t len=static_cast<uint32_t>(meta.size());
+    o.write("\xff\xff\xff\xff",4);
+    char lenbuf[4]={ static_cast<char>(len&0xff),static_cast<char>((len>>8)&0xff),
+                     static_cast<char>((len>>16)&0xff),static_cast<char>((len>>24)&0xff) };
+    o.write(lenbuf,4);
+    o.write(meta.data(),static_cast<std::streamsize>(meta.size()));
+    o.write(body.data(),static_cast<std::streamsize>(body.size()));
+}
+
+/// Collects the buffers of a record batch body
+struct Body {
+    std::string data;              ///< the body itself
+    std::vector<int64_t> buffers;  ///< offset/length pairs
+    std::vector<int64_t> nodes;    ///< length/null count pairs
+
+    //! add a buffer, padded to 8 bytes
+    void add(const std::string &b) {
+        buffers.push_back(static_cast<int64_t>(data.size()));
+        buffers.push_back(static_cast<int64_t>(b.size()));
+        data+=b;
+        while(data.size()%8) { data+='\0'; }
+    }
+    //! add a little endian value to a buffer
+    template<typename T> static void append(std::string &b,T v) {
+        char c[sizeof(T)];
+        memcpy(c,&v,sizeof(T));
+        b.append(c,sizeof(T));
+    }
+};
+
+/// Returns true for strings that are accepted as true in boolean columns
+static bool isTrue(const Json::Value &v)
+{
+    if(v.isString()) {
+        std::string s=v.asString();
+        return s=="1"||s=="true"||s=="True"||s=="TRUE";
+    }
+    return v.asBool();
+}
+
+/// Returns the string representation of a cell for utf8 columns
+static std::string toUtf8(const Json::Value &v)
+{
+    if(v.isString()) { return v.asString(); }
+    if(v.isBool()) { return v.asBool()?"true":"false"; }
+    if(v.isIntegral()) { return v.isInt64()?std::to_string(v.asInt64()):std::to_string(v.asUInt64()); }
+    return Json::valueToString(v.asDouble());
+}
+
+/// Append the buffers of one column for the rows [start,end) to the body
+static void writeColumn(Body &body,ArrowType t,const Json::Value &rows,
+                        Json::ArrayIndex c,Json::ArrayIndex start,Json::ArrayIndex end)
+{
+    Json::ArrayIndex n=end-start;
+    std::string validity((n+7)/8,'\0');
+    std::string values;
+    std::string offsets;
+    int64_t nulls=0;
+    if(t==ArrowType::BOOL) { values.assign((n+7)/8,'\0'); }
+    if(t==ArrowType::UTF8) { Body::append<int32_t>(offsets,0); }
+
+    for(Json::ArrayIndex r=start;r<end;r++) {
+        const Json::Value &v=rows[r]["c"][c]["v"];
+        Json::ArrayIndex i=r-start;
+        bool isnull=v.isNull();
+        double d=0.0;
+        // strings that are not numbers are written as null
+        if((t==ArrowType::DOUBLE||t==ArrowType::INT64) && !isnull && !toDouble(v,d)) { isnull=true; d=0.0; }
+        if(isnull) { nulls++; } else { validity[i/8]=static_cast<char>(validity[i/8]|(1<<(i%8))); }
+        switch(t) {
+        case ArrowType::INT64:
+            Body::append<int64_t>(values,isnull?0:v.isString()?static_cast<int64_t>(d):v.asInt64());
+            break;
+        case ArrowType::DOUBLE:
+            Body::append<double>(values,d);
+            break;
+        case ArrowType::BOOL:
+            if(!isnull&&isTrue(v)) { values[i/8]=static_cast<char>(values[i/8]|(1<<(i%8))); }
+            break;
+        case ArrowType::DATE32:
+            {
+                int64_t ms=isnull?0:toMillis(v);
+                Body::append<int32_t>(values,static_cast<int32_t>((ms-(((ms%86400000)+86400000)%86400000))/86400000));
+            }
+            break;
+        case ArrowType::TIMESTAMP:
+            Body::append<int64_t>(values,isnull?0:toMillis(v));
+            break;
+        case ArrowType::TIME32:
+            Body::append<int32_t>(values,isnull?0:static_cast<int32_t>(toTimeMillis(v)));
+            break;
+        case ArrowType::UTF8:
+            if(!isnull) { values+=toUtf8(v); }
+            Body::append<int32_t>(offsets,static_cast<int32_t>(values.size()));
+            break;
+        }
+    }
+    body.nodes.push_back(n);
+    body.nodes.push_back(nulls);
+    body.add(nulls?validity:std::string());
+    if(t==ArrowType::UTF8) { body.add(offsets); }
+    body.add(values);
+}
+
+/// Build an error table with the reason and message of every error
+static Json::Value errorTable(const Json::Value &res)
+{
+    Json::Value tbl;
+    tbl["cols"][0]["id"]="reason";
+    tbl["cols"][0]["type"]=GQL_SQL::DBQuery::TYPE_STRING;
+    tbl["cols"][1]["id"]="message";
+    tbl["cols"][1]["type"]=GQL_SQL::DBQuery::TYPE_STRING;
+    tbl["rows"]=Json::Value(Json::arrayValue);
+    for(const auto &e:res["errors"]) {
+        Json::Value row;
+        row["c"][0]["v"]=e["reason"];
+        row["c"][1]["v"]=e["message"];
+        tbl["rows"].append(row);
+    }
+    return tbl;
+}
+
+}
+
+/// Output the result of a GQL query as an Arrow IPC stream
+void GQL_SQL::DBQuery::outputArrow(std::ostream &o,const Json::Value &res)
+{
+    Json::Value errors;
+    if(res.isMember("errors")) { errors=errorTable(res); }
+    const Json::Value &tbl=res.isMember("errors")?errors:res["table"];
+    const Json::Value &cols=tbl["cols"];
+    const Json::Value &rows=tbl["rows"];
+
+    std::vector<ArrowType> types;
+    std::vector<FBNode::Ptr> fields;
+    for(Json::ArrayIndex c=0;c<cols.size();c++) {
+        types.push_back(arrowType(cols[c]));
+        FBNode::Ptr typeTable;
+        uint8_t tt=arrowTypeTable(types.back(),typeTable);
+        std::string name=cols[c]["label"].asString();
+        if(name=="") { name=cols[c]["id"].asString(); }
+        auto field=fbTable();
+        field->ref(0,fbString(name))
+             ->scalar(1,1,1)
+             ->scalar(2,1,tt)
+             ->ref(3,typeTable)
+             ->ref(5,fbTables(std::vector<FBNode::Ptr>()));
+        fields.push_back(field);
+    }
+    auto schema=fbTable();
+    schema->ref(1,fbTables(fields));
+    writeMessage(o,HEADER_SCHEMA,schema,"");
+
+    Json::ArrayIndex start=0;
+    do {
+        Json::ArrayIndex end=std::min<Json::ArrayIndex>(rows.size(),start+BATCH_ROWS);
+        Body body;
+        for(Json::ArrayIndex c=0;c<cols.size();c++) {
+            writeColumn(body,types[c],rows,c,start,end);
+        }
+        auto batch=fbTable();
+        batch->scalar(0,8,end-start)
+             ->ref(1,fbStructs(body.nodes,2))
+             ->ref(2,fbStructs(body.buffers,2));
+        writeMessage(o,HEADER_RECORDBATCH,batch,body.data);
+        start=end;
+    } while(start<rows.size());
+
+    // end of stream marker
+    o.write("\xff\xff\xff\xff\0\0\0\0",8);
+}
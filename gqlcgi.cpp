@@ -31,6 +31,7 @@
 #else
 #include <boost/locale/encoding_utf.hpp>
 #endif
+#include <array>
 #include "libgqlsql.h"
 #include "glog/logging.h"
 
@@ -42,6 +43,78 @@ void GQL_SQL::DBQuery::outputJson(std::ostream &o,const Json::Value &tbl)
     writer->write(tbl, &o);
 }
 
+/// write a single json value without any indentation. Scalars are written
+/// directly, only arrays and objects go through the (slower) json writer.
+static void outputJsonValue(std::ostream &o,const Json::Value &v)
+{
+    switch(v.type()) {
+    case Json::nullValue: o << "null";break;
+    case Json::booleanValue: o << (v.asBool()?"true":"false");break;
+    case Json::intValue: o << v.asLargestInt();break;
+    case Json::uintValue: o << v.asLargestUInt();break;
+    case Json::realValue: o << Json::valueToString(v.asDouble());break;
+    case Json::stringValue: o << Json::valueToQuotedString(v.asCString());break;
+    case Json::arrayValue:
+    case Json::objectValue: GQL_SQL::DBQuery::outputJson(o,v);break;
+    }
+}
+
+/// write the table in columnar form: every column contains its values in
+/// a flat array 'v' and, if any cell has a formatted value, a parallel
+/// array 'f' (null where a cell has no formatted value).
+static void outputColumns(std::ostream &o,const Json::Value &tbl)
+{
+    const Json::Value &cols=tbl["cols"];
+    const Json::Value &rows=tbl["rows"];
+    o << "{\"nrows\":" << rows.size() << ",\"cols\":[";
+    for(Json::ArrayIndex c=0;c<cols.size();c++) {
+        if(c>0) { o << ','; }
+        const Json::Value &col=cols[c];
+        o << '{';
+        for(auto it=col.begin();it!=col.end();++it) {
+            o << Json::valueToQuotedString(it.name().c_str()) << ':';
+            outputJsonValue(o,*it);
+            o << ',';
+        }
+        bool hasf=false;
+        o << "\"v\":[";
+        for(Json::ArrayIndex r=0;r<rows.size();r++) {
+            if(r>0) { o << ','; }
+            const Json::Value &cell=rows[r]["c"][c];
+            hasf=hasf||cell.isMember("f");
+            outputJsonValue(o,cell["v"]);
+        }
+        o << ']';
+        if(hasf) {
+            o << ",\"f\":[";
+            for(Json::ArrayIndex r=0;r<rows.size();r++) {
+                if(r>0) { o << ','; }
+                outputJsonValue(o,rows[r]["c"][c]["f"]);
+            }
+            o << ']';
+        }
+        o << '}';
+    }
+    o << "]}";
+}
+
+void GQL_SQL::DBQuery::outputJsonColumns(std::ostream &o,const Json::Value &res)
+{
+    o << '{';
+    bool first=true;
+    for(auto it=res.begin();it!=res.end();++it) {
+        if(!first) { o << ','; }
+        first=false;
+        o << Json::valueToQuotedString(it.name().c_str()) << ':';
+        if(it.name()=="table") {
+            outputColumns(o,*it);
+        } else {
+            outputJsonValue(o,*it);
+        }
+    }
+    o << '}';
+}
+
 /// convert a a string using quotes compatible with CSV format
 static std::string outputQField(const Json::Value &r)
 {
@@ -77,85 +150,107 @@ static std::string outputTField(const Json::Value &r)
 }
 
 
-/// convert a a string to a valid html string by replacing '<', '>' and '&'
-/// with the corresponding &XXX; token.
-static std::string toHtml(std::string r)
+/// Replacement for every byte that must be escaped in html, 0 for all others
+static const std::array<const char *,256> htmlEscape=[]() {
+    std::array<const char *,256> t{};
+    t['&']="&amp;";
+    t['<']="&lt;";
+    t['>']="&gt;";
+    return t;
+}();
+
+/// Number of table rows after which the output is flushed so that browsers
+/// can render large tables progressively
+static const int HTML_FLUSH_ROWS=500;
+
+/// write the bytes [s,e) to the stream, replacing '<', '>' and '&' with
+/// the corresponding &XXX; token.
+static void outputHtmlText(std::ostream &o,const char *s,const char *e)
 {
-    std::string res="";
-    size_t pos=0;
-    while(true) {
-        auto next=r.find_first_of("&<>",pos);
-        if(next==std::string::npos) {
-            if(pos==0) { return r; }
-            res+=r.substr(pos);
-            break;
-        }
-        res+=r.substr(pos,next-pos);
-        switch(r[next]) {
-        case '&': res+="&amp;";break;
-        case '<': res+="&lt;";break;
-        case '>': res+="&gt;";break;
+    const char *start=s;
+    for(;s<e;s++) {
+        const char *r=htmlEscape[static_cast<unsigned char>(*s)];
+        if(r) {
+            o.write(start,s-start);
+            o << r;
+            start=s+1;
         }
-        pos=next+1;
     }
-    return res;
+    o.write(start,e-start);
+}
+
+/// write a json value as html text to the stream without copying strings
+static void outputHtmlText(std::ostream &o,const Json::Value &v)
+{
+    const char *s;
+    const char *e;
+    if(v.isString() && v.getString(&s,&e)) {
+        outputHtmlText(o,s,e);
+    } else {
+        std::string str=v.asString();
+        outputHtmlText(o,str.data(),str.data()+str.size());
+    }
 }
 
 
-/// Output the result of a query in HTML format
+/// Output the result of a query in HTML format.
+/// The stream is flushed every HTML_FLUSH_ROWS rows (instead of after every
+/// line) so that large tables are sent in chunks.
 void GQL_SQL::DBQuery::outputHtml(std::ostream &o,const std::string name,const Json::Value &res)
 {
-    o << "<!DOCTYPE html PUBLIC \"-//W3C//DTD HTML 4.01//EN\">" << std::endl
-      << "<html>" << std::endl
-      << "<head>" << std::endl
-      << "<META http-equiv=\"Content-Type\" content=\"text/html; charset=UTF-8\">" << std::endl
-      << "<title>" << toHtml(name) << "</title>" << std::endl
-      << "</head>" << std::endl
-      << "<body>" << std::endl;
+    o << "<!DOCTYPE html PUBLIC \"-//W3C//DTD HTML 4.01//EN\">\n"
+      << "<html>\n"
+      << "<head>\n"
+      << "<META http-equiv=\"Content-Type\" content=\"text/html; charset=UTF-8\">\n"
+      << "<title>";
+    outputHtmlText(o,name.data(),name.data()+name.size());
+    o << "</title>\n"
+      << "</head>\n"
+      << "<body>\n";
 
     if(res.isMember("errors")) {
-        for(auto e:res["errors"]) {
-            o << "<h1 color='#f00'>"
-              << toHtml(e["reason"].asString())
-              << ": "
-              << toHtml(e["message"].asString())
-              << "</h1></body>"
-              << std::endl;
+        for(const auto &e:res["errors"]) {
+            o << "<h1 color='#f00'>";
+            outputHtmlText(o,e["reason"]);
+            o << ": ";
+            outputHtmlText(o,e["message"]);
+            o << "</h1></body>" << std::endl;
         }
         return;
     }
 
-    o  << "<table border=\"1\" cellpadding=\"2\" cellspacing=\"0\">" << std::endl
-       << "<tr style=\"font-weight: bold; background-color: #aaa;\">" << std::endl;
+    o  << "<table border=\"1\" cellpadding=\"2\" cellspacing=\"0\">\n"
+       << "<tr style=\"font-weight: bold; background-color: #aaa;\">\n";
 
-    auto tbl=res["table"];
-    for(auto c:tbl["cols"]) {
+    const Json::Value &tbl=res["table"];
+    for(const auto &c:tbl["cols"]) {
         o << "<td>";
-        if(c.isMember("label") && c["label"]!="") { o << toHtml(c["label"].asString()); }
-        else { o << toHtml(c["id"].asString()); }
+        if(c.isMember("label") && c["label"]!="") { outputHtmlText(o,c["label"]); }
+        else { outputHtmlText(o,c["id"]); }
         o << "</td>";
     }
-    o << std::endl << "</tr>" << std::endl;;
-    
-    static const std::string trcolor[] = { "#f0f0f0","#ffffff" };
+    o << "\n</tr>\n";
+    o.flush();
+
+    static const char *const trstart[] = {
+        "<tr style=\"background-color: #f0f0f0\">\n",
+        "<tr style=\"background-color: #ffffff\">\n"
+    };
 
     int cnt=0;
-    for(auto r:tbl["rows"]) {
-        o << "<tr style=\"background-color: " << trcolor[cnt%2] << "\">" << std::endl;
-        for(auto c:r["c"]) {
+    for(const auto &r:tbl["rows"]) {
+        if(cnt>0 && cnt%HTML_FLUSH_ROWS==0) { o.flush(); }
+        o << trstart[cnt%2];
+        for(const auto &c:r["c"]) {
             o << "<td>";
-            if(c.isMember("f")) {
-                o << toHtml(c["f"].asString());
-            } else {
-                o << toHtml(c["v"].asString());
-            }
+            outputHtmlText(o,c.isMember("f")?c["f"]:c["v"]);
             o << "</td>";
         }
-        o << std::endl << "</tr>" << std::endl;;
+        o << "\n</tr>\n";
         cnt++;
     }
-    o << "</table>" << std::endl
-      << "</body>" << std::endl
+    o << "</table>\n"
+      << "</body>\n"
       << "</html>" << std::endl;
 }
 
@@ -187,7 +282,7 @@ void GQL_SQL::DBQuery::outputTsv(std::ostream &o,const Json::Value &res)
 {
     o << "\xfe\xff";
     if(res.isMember("errors")) {
-        for(auto e:res["errors"]) {
+        for(const auto &e:res["errors"]) {
             out16(o,e["reason"].asString());
             out16(o,"\t");
             out16(o,e["message"].asString());
@@ -195,8 +290,8 @@ void GQL_SQL::DBQuery::outputTsv(std::ostream &o,const Json::Value &res)
         }
     }
     bool first=true;
-    auto tbl=res["table"];
-    for(auto c:tbl["cols"]) {
+    const Json::Value &tbl=res["table"];
+    for(const auto &c:tbl["cols"]) {
         if(!first) { out16(o,"\t"); }
         first=false;
         if(c.isMember("label") && c["label"]!="") { out16(o,outputTField(c["label"].asString())); }
@@ -204,9 +299,9 @@ void GQL_SQL::DBQuery::outputTsv(std::ostream &o,const Json::Value &res)
     }
     out16(o,"\n");
     
-    for(auto r:tbl["rows"]) {
+    for(const auto &r:tbl["rows"]) {
         bool fc=true;
-        for(auto c:r["c"]) {
+        for(const auto &c:r["c"]) {
             if(!fc) { out16(o,"\t"); }
             fc=false;
             if(c.isMember("f")) {
@@ -224,7 +319,7 @@ void GQL_SQL::DBQuery::outputCsv(std::ostream &o,const Json::Value &res)
 {
     bool first=true;
     if(res.isMember("errors")) {
-        for(auto e:res["errors"]) {
+        for(const auto &e:res["errors"]) {
             o << outputQField(e["reason"]);
             o << ",";
             o << outputQField(e["message"]);
@@ -232,8 +327,8 @@ void GQL_SQL::DBQuery::outputCsv(std::ostream &o,const Json::Value &res)
         }
         return;
     }
-    auto tbl=res["table"];
-    for(auto c:tbl["cols"]) {
+    const Json::Value &tbl=res["table"];
+    for(const auto &c:tbl["cols"]) {
         if(!first) { o << ','; }
         first=false;
         if(c.isMember("label") && c["label"]!="") { o << outputQField(c["label"]); }
@@ -241,9 +336,9 @@ void GQL_SQL::DBQuery::outputCsv(std::ostream &o,const Json::Value &res)
     }
     o << std::endl;
     
-    for(auto r:tbl["rows"]) {
+    for(const auto &r:tbl["rows"]) {
         bool fc=true;
-        for(auto c:r["c"]) {
+        for(const auto &c:r["c"]) {
             if(!fc) { o <<","; }
             fc=false;
             if(c.isMember("f")) {
@@ -259,10 +354,11 @@ void GQL_SQL::DBQuery::outputCsv(std::ostream &o,const Json::Value &res)
 /// Store the result of the parsing of the URL fo the Query
 struct CgiQuery {
     std::string query;           ///< actual query
+    std::vector<std::string> queries; ///< all queries if tq is given more than once
     std::string reqId;           ///< Query ID set by user
     std::string version;         ///< version (ignored)
     std::string sig;             ///< signature (ignored)
-    std::string out;             ///< output format (either html, json, csv or tsv-excel)
+    std::string out;             ///< output format (either html, json, jsoncol, csv or tsv-excel)
     std::string responseHandler; ///< name of response handler function
     std::string outFileName;     ///< output file to use when browser requests the data
 
@@ -341,6 +437,7 @@ static void parseTQX(CgiQuery *cq, const std::string &query)
 static void parseTQ(CgiQuery *cq, const std::string &query) 
 {
     cq->query=parseUrlFormat(query);
+    cq->queries.push_back(cq->query);
 }
 
 void CgiQuery::parseQuery()
@@ -399,16 +496,59 @@ static std::string encodePercent(const std::string &q)
 
 }
 
+/// Return the reqId as number, 0 if it is not a number
+static Json::Int64 reqIdNumber(const std::string &reqId)
+{
+    try {
+        return std::stoll(reqId);
+    } catch(const std::exception &) {
+        return 0;
+    }
+}
+
+/// Several tq parameters: run all queries as one batch and return a json array
+/// with one response per query to a single response handler call. The reqId of
+/// the responses are reqId, reqId+1, ... The out format jsoncol is supported,
+/// all other formats return json.
+static void handleCgiBatch(GQL_SQL::DBQuery::DB::Ptr db,CgiQuery &q)
+{
+    Json::Value results;
+    db->executeBatch(q.queries,results);
+    Json::Int64 reqId=reqIdNumber(q.reqId);
+    if(q.outFileName=="") { q.outFileName="json.txt"; }
+    if(q.responseHandler=="") { q.responseHandler="google.visualization.Query.setResponse"; }
+    std::cout << "Content-Disposition: attachment; filename=\"" << encodePercent(q.outFileName)
+              << "\"; filename*=UTF-8''" << encodePercent(q.outFileName) << "\r\n";
+    std::cout << "Content-type: application/javascript; charset=utf-8\r\n\r\n";
+    std::cout << "/*O_o*/\n" << q.responseHandler << "([";
+    for(Json::ArrayIndex i=0;i<results.size();i++) {
+        Json::Value &r=results[i];
+        r["reqId"]=reqId+i;
+        if(i>0) { std::cout << ","; }
+        if(q.out=="jsoncol") {
+            GQL_SQL::DBQuery::outputJsonColumns(std::cout,r);
+        } else {
+            GQL_SQL::DBQuery::outputJson(std::cout,r);
+        }
+    }
+    std::cout << "]);";
+}
+
 /// Handle the CGI query and send the data to stdout
 void GQL_SQL::DBQuery::handleCgi(GQL_SQL::DBQuery::DB::Ptr db)
 {
     CgiQuery q;
 
-    Json::Value r;
-    db->execute(q.query,r);
     std::cout << "Cache-Control: no-cache, no-store, max-age=0, must-revalidate\r\n";
     std::cout << "X-Content-Type-Options: nosniff\r\n";
     std::cout << "X-Robots-Tag: noindex, nofollow, nosnippet\r\n";
+    if(q.queries.size()>1) {
+        handleCgiBatch(db,q);
+        return;
+    }
+
+    Json::Value r;
+    db->execute(q.query,r);
     if(q.out=="html") {
         std::cout << "Content-type: text/html; charset=utf-8\r\n\r\n";
         // FIXME: UTF8 would depend on the db, but for now no support for other encodings exists
@@ -425,19 +565,27 @@ void GQL_SQL::DBQuery::handleCgi(GQL_SQL::DBQuery::DB::Ptr db)
                   << "\"; filename*=UTF-8''" << encodePercent(q.outFileName) << "\r\n";
         std::cout << "Content-type: text/csv; charset=utf-8\r\n\r\n";
         outputCsv(std::cout,r);
+    } else if(q.out=="arrow") {
+        if(q.outFileName=="") { q.outFileName="data.arrows"; }
+        std::cout << "Content-Disposition: attachment; filename=\"" << encodePercent(q.outFileName)
+                  << "\"; filename*=UTF-8''" << encodePercent(q.outFileName) << "\r\n";
+        std::cout << "Content-type: application/vnd.apache.arrow.stream\r\n\r\n";
+        outputArrow(std::cout,r);
     } else {
-        try {
-            r["reqId"]=std::stoll(q.reqId);
-        } catch(const std::exception &) {
-            r["reqId"]=0;
-        }
+        r["reqId"]=reqIdNumber(q.reqId);
         if(q.outFileName=="") { q.outFileName="json.txt"; }
         if(q.responseHandler=="") { q.responseHandler="google.visualization.Query.setResponse"; }
         std::cout << "Content-Disposition: attachment; filename=\"" << encodePercent(q.outFileName)
                   << "\"; filename*=UTF-8''" << encodePercent(q.outFileName) << "\r\n";
         std::cout << "Content-type: application/javascript; charset=utf-8\r\n\r\n";
         std::cout << "/*O_o*/\n" << q.responseHandler << "(";
-        outputJson(std::cout,r);
+        if(q.out=="jsoncol") {
+            // compact columnar layout, needs a client side shim to create a
+            // DataTable (see test/chart.html)
+            outputJsonColumns(std::cout,r);
+        } else {
+            outputJson(std::cout,r);
+        }
         std::cout << ");";
     }
 }
@@ -52,27 +52,41 @@ static const char *prgname=0;
         << "    --tables (-t) : list of space, comma or semi-colon separated acceptable tables" << std::endl
         << "    --extended (-e): allow any function to be passed through SQL" << std::endl
         << "    --locale (-l): locale to use" << std::endl
-        << "    --format (-f) html|csv|tsv|json: change output format (for cmds only)" << std::endl
+        << "    --format (-f) html|csv|tsv|json|jsoncol|arrow: change output format (for cmds only)" << std::endl
         << "    --help (h): print this text" << std::endl
         << std::endl
         << "The remainder of the arguments are used to connect to the db, currently supported:" << std::endl
         << "- mysql: mysql://user@pw:host:port/db" << std::endl
         << "- mariadb: mariadb://user@pw:host:port/db" << std::endl
         << "- postgresql: postgresql://user@pw:host:port/db" << std::endl
+        << "- sqlite: sqlite:///path/to/file.db" << std::endl
+#ifdef HAVE_DUCKDB
+        << "- duckdb: duckdb:///path/to/file.db" << std::endl
+#endif
+        << "- memory: memory://path/to/table.json or memory://path/to/table.csv" << std::endl
         << std::endl
         << "or a configuration file which  must contain a json formatted map with the" << std::endl
         << "following entries (command line options overwrite those):" << std::endl
         << "{" << std::endl
-        << "    \"type\":     either 'mysql', 'mariadb' or 'postgresql'" << std::endl
+        << "    \"type\":     'mysql', 'mariadb', 'postgresql', 'sqlite', 'duckdb' or 'memory'" << std::endl
         << "    \"user\":     username" << std::endl
         << "    \"server\":   server" << std::endl
         << "    \"port\":     port (optional)" << std::endl
         << "    \"password\": username" << std::endl
-        << "    \"db\":       database" << std::endl
+        << "    \"db\":       database (file name for sqlite)" << std::endl
         << "    \"default\":  default table (optional, cmd line arg overwrites)" << std::endl
         << "    \"tables\":   array of acceptable table names (optional), cmd line overwrites" << std::endl
         << "    \"extended\": true if any function name should be accepted." << std::endl
+        << "    \"prepare\":  false to pass literals in the SQL query instead of using" << std::endl
+        << "                prepared statements with parameters (default true)" << std::endl
+        << "    \"statement_cache\": number of prepared statements kept per connection" << std::endl
+        << "    \"schema_ttl\": seconds the table columns are cached (default 300, 0 disables)" << std::endl
+        << "    \"schema_cache\": json file to share the cached table columns between processes" << std::endl
+        << "    \"timeout\":  milliseconds a query may run (default 0, no limit)" << std::endl
+        << "    \"max_rows\": rows a query may read from the database (default 0, no limit)" << std::endl
+        << "    \"max_memory\": approximate bytes of data a query may read (default 0, no limit)" << std::endl
         << "    \"locale\":   locale to use" << std::endl
+        << "    \"fixtures\": map of table name to fixture (memory only)" << std::endl
         << "}" << std::endl
         << std::endl
         << "Additional arguments are taken as GQL search requests and result" << std::endl
@@ -158,6 +172,14 @@ static GQL_SQL::DBQuery::DB::Ptr createDB(const std::string &config, const std::
             db=GQL_SQL::DBQuery::DB::Ptr(new GQL_SQL::DBQuery::MySQL(jconfig));
         } else if(jconfig["type"]=="postgresql") {
             db=GQL_SQL::DBQuery::DB::Ptr(new GQL_SQL::DBQuery::PostgreSQL(jconfig));
+        } else if(jconfig["type"]=="sqlite") {
+            db=GQL_SQL::DBQuery::DB::Ptr(new GQL_SQL::DBQuery::SQLite(jconfig));
+#ifdef HAVE_DUCKDB
+        } else if(jconfig["type"]=="duckdb") {
+            db=GQL_SQL::DBQuery::DB::Ptr(new GQL_SQL::DBQuery::DuckDB(jconfig));
+#endif
+        } else if(jconfig["type"]=="memory") {
+            db=GQL_SQL::DBQuery::DB::Ptr(new GQL_SQL::DBQuery::Memory(jconfig));
         } else {
             usage(std::string("unknown db type ")+jconfig["type"].asString());
         }
@@ -170,6 +192,14 @@ static GQL_SQL::DBQuery::DB::Ptr createDB(const std::string &config, const std::
             db=GQL_SQL::DBQuery::DB::Ptr(new GQL_SQL::DBQuery::MySQL(u));
         } else if(u.scheme()=="postgresql") {
             db=GQL_SQL::DBQuery::DB::Ptr(new GQL_SQL::DBQuery::PostgreSQL(u));
+        } else if(u.scheme()=="sqlite") {
+            db=GQL_SQL::DBQuery::DB::Ptr(new GQL_SQL::DBQuery::SQLite(u));
+#ifdef HAVE_DUCKDB
+        } else if(u.scheme()=="duckdb") {
+            db=GQL_SQL::DBQuery::DB::Ptr(new GQL_SQL::DBQuery::DuckDB(u));
+#endif
+        } else if(u.scheme()=="memory") {
+            db=GQL_SQL::DBQuery::DB::Ptr(new GQL_SQL::DBQuery::Memory(u));
         } else {
             usage(std::string("unknown scheme ")+u.scheme());
         }
@@ -251,7 +281,7 @@ int main(int argc, char*argv[])
     }
     cgi=optind>=argc;
 
-    if(format!=""&&format!="json"&&format!="csv"&&format!="tsv"&&format!="html") {
+    if(format!=""&&format!="json"&&format!="jsoncol"&&format!="arrow"&&format!="csv"&&format!="tsv"&&format!="html") {
         usage(std::string("unsupported format '")+format+"'");
     }
     if(cgi&&format!="") {
@@ -283,12 +313,19 @@ int main(int argc, char*argv[])
     if(cgi) {
         handleCgi(db);
     } else {
-        for(int c=optind;c<argc;c++) {
-            Json::Value r;
-            db->execute(argv[c],r);
+        // all queries are sent to the DB together
+        std::vector<std::string> queries(argv+optind,argv+argc);
+        Json::Value results;
+        db->executeBatch(queries,results);
+        for(const auto &r:results) {
             if(format=="json"||format=="") {
                 GQL_SQL::DBQuery::outputJson(std::cout,r);
                 std::cout << std::endl;
+            } else if(format=="jsoncol") {
+                GQL_SQL::DBQuery::outputJsonColumns(std::cout,r);
+                std::cout << std::endl;
+            } else if(format=="arrow") {
+                GQL_SQL::DBQuery::outputArrow(std::cout,r);
             } else if(format=="html") {
                 GQL_SQL::DBQuery::outputHtml(std::cout,defTable,r);
             } else if(format=="csv") {
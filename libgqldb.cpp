@@ -23,8 +23,17 @@
 #include <math.h>
 #include <string>
 #include <cstdint>
+#include <limits>
+#include <algorithm>
 #include <unordered_map>
 #include <exception>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <ctime>
+#include <cstdio>
+#include <unistd.h>
 #include <glog/logging.h>
 #include <jsoncpp/json/json.h>
 #include <boost/algorithm/string.hpp>
@@ -65,10 +74,10 @@ std::ostream& operator<<(std::ostream& outs, ErrorReasons er)
 
 namespace DBQuery {
 
-void DB::pivotTable(const Json::Value &tbl,Json::Value &res) const
+void DB::pivotTable(const Result &q,const Json::Value &tbl,Json::Value &res) const
 {
-    VLOG(1) << "pivotTable: " << parser_->query()->pivot.size() << std::endl;
-    if(!parser_->query()->hasPivotClause()) { return; }
+    VLOG(1) << "pivotTable: " << q.query->pivot.size() << std::endl;
+    if(!q.query->hasPivotClause()) { return; }
 
     // each pivot row is at the beginning of the select and ordered
 
@@ -88,8 +97,8 @@ void DB::pivotTable(const Json::Value &tbl,Json::Value &res) const
     VLOG(1) << "rows: " << rows.size() << std::endl;
     for(uint32_t r=0;r<rows.size();r++) {
         std::string key;
-        auto rw=rows[r]["c"];
-        for(uint32_t c=0;c<parser_->query()->pivot.size();c++) {
+        const Json::Value &rw=rows[r]["c"];
+        for(uint32_t c=0;c<q.query->pivot.size();c++) {
             if(c>0) { key+=","; }
             if(rw[c].isMember("f")) {
                 key+=rw[c]["f"].asString();
@@ -107,39 +116,43 @@ void DB::pivotTable(const Json::Value &tbl,Json::Value &res) const
 
     std::map<std::string,uint64_t> groups;
     // map group column name to position
-    for(auto n:parser_->query()->group) {
+    for(const auto &n:q.query->group) {
         auto s=groups.size();
-        groups[n.token]=s;
+        groups[n.token.to_string()]=s;
         VLOG(1) << "GROUP: " << n.token << std::endl;
     }
 
     res["cols"]=Json::Value();
     Json::Value &newcols=res["cols"];
 
-    for(uint32_t c=static_cast<uint32_t>(parser_->query()->pivot.size()+parser_->query()->group.size());c<cols.size();c++) {
+    for(uint32_t c=static_cast<uint32_t>(q.query->pivot.size()+q.query->group.size());c<cols.size();c++) {
         uint32_t index=newcols.size();
         if(groups.count(cols[c]["id"].asString())) {
             newcols[index]=cols[c];
         } else {
-            for(auto n:clsname) {
+            for(const auto &n:clsname) {
                 Json::Value nc=cols[c];
                 auto lb=nc["label"].asString();
                 if(lb.size()==0) { lb=nc["id"].asString(); }
                 nc["id"]=n+" "+nc["id"].asString();
                 nc["label"]=n+" "+lb;
-                newcols[index++]=nc;
+                newcols[index++].swap(nc);
             }
         }
     }
 
     std::map<std::string,Json::Value> lines;
-    uint32_t grstart=static_cast<uint32_t>(parser_->query()->pivot.size());
-    uint32_t grend=static_cast<uint32_t>(grstart+parser_->query()->group.size());
+    uint32_t grstart=static_cast<uint32_t>(q.query->pivot.size());
+    uint32_t grend=static_cast<uint32_t>(grstart+q.query->group.size());
     std::vector<std::string> order;
+    // limit and offset apply to the pivoted rows, so only lines for the
+    // first offset+limit groups are built, rows of later groups are skipped
+    size_t wanted=std::numeric_limits<size_t>::max();
+    if(q.query->limit && q.query->limit<=wanted-q.query->offset) { wanted=q.query->offset+q.query->limit; }
 
     for(uint32_t r=0;r<rows.size();r++) {
         std::string key;
-        auto rw=rows[r]["c"];
+        const Json::Value &rw=rows[r]["c"];
         for(uint32_t c=grstart;c<grend;c++) {
             key+="\t";
             if(rw[c].isMember("f")) {
@@ -150,27 +163,26 @@ void DB::pivotTable(const Json::Value &tbl,Json::Value &res) const
         }
 
         if(lines.count(key)==0) {
+            if(order.size()>=wanted) { continue; }
             Json::Value v;
             for(uint32_t c=grend;c<cols.size();c++) {
                 uint32_t index=v.size();
                 if(groups.count(cols[c]["id"].asString())) {
                     v[index]=rw[c];
                 } else {
-                    for(auto n:clsname) {
-                        Json::Value nc;
-                        nc["v"]=Json::Value::null;
-                        v[index++]=nc;
+                    for(size_t n=0;n<clsname.size();n++) {
+                        v[index++]["v"]=Json::Value::null;
                     }
                 }
             }
 
-            lines[key]=v;
+            lines[key].swap(v);
             order.push_back(key);
         }
 
         std::string pkey="";
-        auto row=rows[r]["c"];
-        for(uint32_t c=0;c<parser_->query()->pivot.size();c++) {
+        const Json::Value &row=rows[r]["c"];
+        for(uint32_t c=0;c<q.query->pivot.size();c++) {
             if(c>0) { pkey+=","; }
             if(row[c].isMember("f")) {
                 pkey+=row[c]["f"].asString();
@@ -178,7 +190,8 @@ void DB::pivotTable(const Json::Value &tbl,Json::Value &res) const
                 pkey+=row[c]["v"].asString();
              }
         }
-        Json::Value line=lines[key];
+        Json::Value &line=lines[key];
+        uint64_t pcol=cls[pkey];
 
         uint32_t index=0;
         VLOG(2) << "grend=" << grend << std::endl;
@@ -186,24 +199,23 @@ void DB::pivotTable(const Json::Value &tbl,Json::Value &res) const
             if(groups.count(cols[c]["id"].asString())) {
                 index++;
             } else {
-                VLOG(2) << "Set INDEX " << index << "+" << cls[pkey] << "=" << index+cls[pkey] << " = " << row[c] << std::endl;
-                line[static_cast<int>(index+cls[pkey])]=row[c];
+                VLOG(2) << "Set INDEX " << index << "+" << pcol << "=" << index+pcol << " = " << row[c] << std::endl;
+                line[static_cast<int>(index+pcol)]=row[c];
                 index+=cls.size();
             }
         }
-        lines[key]=line;
     }
 
     res["rows"]=Json::Value();
     Json::Value &newrows=res["rows"];
-    for(auto o:order) {
-        Json::Value c;
-        c["c"]=lines[o];
-        newrows[newrows.size()]=c;
+    size_t start=std::min<size_t>(q.query->offset,order.size());
+    newrows.resize(static_cast<Json::ArrayIndex>(order.size()-start));
+    for(Json::ArrayIndex r=0;r<order.size()-start;r++) {
+        newrows[r]["c"].swap(lines[order[start+r]]);
     }
 }
 
-DB::DB(Json::Value i)
+DB::DB(const Json::Value &i)
 {
     type_=i["type"].asString();
     if(i.isMember("user")) { user_=i["user"].asString(); }
@@ -213,8 +225,15 @@ DB::DB(Json::Value i)
     if(i.isMember("port")) { port_=i["port"].asUInt(); }
     if(i.isMember("db")) { db_=i["db"].asString(); }
     if(i.isMember("extended")) { extendedFunctions_=i["db"].asBool(); }
+    if(i.isMember("prepare")) { prepare_=i["prepare"].asBool(); }
+    if(i.isMember("statement_cache")) { statementCacheSize_=i["statement_cache"].asUInt(); }
+    if(i.isMember("schema_ttl")) { schemaTTL_=i["schema_ttl"].asUInt(); }
+    if(i.isMember("timeout")) { timeout_=i["timeout"].asUInt(); }
+    if(i.isMember("max_rows")) { maxRows_=i["max_rows"].asUInt64(); }
+    if(i.isMember("max_memory")) { maxMemory_=i["max_memory"].asUInt64(); }
+    if(i.isMember("schema_cache")) { schemaFile_=i["schema_cache"].asString(); }
     if(i.isMember("tables")) {
-        for(auto n:i["tables"]) {
+        for(const auto &n:i["tables"]) {
             tables_.insert(n.asString());
         }
     }
@@ -231,6 +250,134 @@ DB::DB(const URI &uri)
     if(db_[0]=='/') { db_=db_.substr(1); }
 }
 
+/// A cached schema and the time it was read from the DB
+struct SchemaEntry {
+    time_t loaded=0;  ///< time the schema was read from the DB
+    Schema schema;    ///< column names and types
+};
+
+/// Schemas shared by all DB objects of the process, by DB (see schemaKey())
+static std::map<std::string,SchemaEntry> schemaCacheMap;
+/// Protects schemaCacheMap
+static std::mutex schemaCacheMutex;
+
+/// Key of a DB and the tables read from it in the schema cache
+static std::string schemaKey(const std::string &type,const std::string &server,uint32_t port,const std::string &db,
+                             const std::set<std::string> &tables)
+{
+    std::string key=type+"://"+server+":"+std::to_string(port)+"/"+db+"?tables=";
+    const char *sep="";
+    for(const auto &t:tables) {
+        key+=sep+t;
+        sep=",";
+    }
+    return key;
+}
+
+std::set<std::string> DB::schemaTables() const
+{
+    std::set<std::string> t=tables_;
+    t.insert(deftable_);
+    return t;
+}
+
+bool DB::schemaCached()
+{
+    if(schemaTTL_==0) { return false; }
+    std::string key=schemaKey(type_,server_,port_,db_,schemaTables());
+    time_t now=time(0);
+    SchemaEntry entry;
+    bool found=false;
+    {
+        std::lock_guard<std::mutex> lock(schemaCacheMutex);
+        auto it=schemaCacheMap.find(key);
+        if(it!=schemaCacheMap.end() && now-it->second.loaded<static_cast<time_t>(schemaTTL_)) {
+            entry=it->second;
+            found=true;
+        }
+    }
+    if(!found && schemaFile_!="") {
+        Json::Value all;
+        std::ifstream f(schemaFile_);
+        try {
+            if(f) { f >> all; }
+        } catch(const std::exception &ex) {
+            LOG(WARNING) << "ignoring schema cache " << schemaFile_ << ": " << ex.what();
+        }
+        if(all.isObject() && all.isMember(key) && all[key].isObject()
+           && now-all[key]["loaded"].asInt64()<static_cast<Json::Int64>(schemaTTL_)) {
+            entry.loaded=static_cast<time_t>(all[key]["loaded"].asInt64());
+            const Json::Value &tbls=all[key]["tables"];
+            for(auto t=tbls.begin();t!=tbls.end();++t) {
+                TableSchema &ts=entry.schema[t.name()];
+                for(auto c=t->begin();c!=t->end();++c) {
+                    ts[c.name()]=c->asString();
+                }
+            }
+            found=true;
+            std::lock_guard<std::mutex> lock(schemaCacheMutex);
+            schemaCacheMap[key]=entry;
+        }
+    }
+    if(!found) { return false; }
+    for(const auto &t:schemaTables()) {
+        if(entry.schema.count(t)==0) { return false; }
+    }
+    schema_.swap(entry.schema);
+    return true;
+}
+
+void DB::schemaCache() const
+{
+    if(schemaTTL_==0) { return; }
+    std::string key=schemaKey(type_,server_,port_,db_,schemaTables());
+    SchemaEntry entry;
+    entry.loaded=time(0);
+    entry.schema=schema_;
+    {
+        std::lock_guard<std::mutex> lock(schemaCacheMutex);
+        schemaCacheMap[key]=entry;
+    }
+    if(schemaFile_=="") { return; }
+
+    Json::Value all;
+    {
+        std::ifstream f(schemaFile_);
+        try {
+            if(f) { f >> all; }
+        } catch(const std::exception &) {
+            all=Json::Value();
+        }
+    }
+    if(!all.isObject()) { all=Json::Value(Json::objectValue); }
+    Json::Value &e=all[key];
+    e=Json::Value(Json::objectValue);
+    e["loaded"]=Json::Value(static_cast<Json::Int64>(entry.loaded));
+    Json::Value &tbls=e["tables"];
+    tbls=Json::Value(Json::objectValue);
+    for(const auto &t:schema_) {
+        Json::Value &cols=tbls[t.first];
+        cols=Json::Value(Json::objectValue);
+        for(const auto &c:t.second) {
+            cols[c.first]=c.second;
+        }
+    }
+    // write to a temporary file first so other processes never read a partial file
+    std::string tmp=schemaFile_+"."+std::to_string(getpid());
+    {
+        std::ofstream o(tmp);
+        o << all;
+        if(!o) {
+            LOG(WARNING) << "cannot write schema cache " << tmp;
+            return;
+        }
+    }
+    if(rename(tmp.c_str(),schemaFile_.c_str())!=0) {
+        LOG(WARNING) << "cannot write schema cache " << schemaFile_;
+        unlink(tmp.c_str());
+    }
+}
+
 /// Used to guess boolean strings when applying boolen format
 static std::set<std::string> validTrue {"1","true","True","TRUE" };
 /// Used to guess boolean strings when applying boolen format
@@ -380,7 +527,7 @@ static std::string typeConvert[][6] = {
 static void setLabelFormat(Json::Value &cols,::GQL_SQL::GQLParser::Query::CPtr query) 
 {
     if(query->selectStar) {
-        for(auto s:query->select) {
+        for(const auto &s:query->select) {
             if(s.label!=""||s.format!="") {
                 std::string id=s.expr->to_string();
                 for (uint32_t i = 0; i < cols.size(); i++) {
@@ -402,7 +549,7 @@ static void setLabelFormat(Json::Value &cols,::GQL_SQL::GQLParser::Query::CPtr q
         // If this ever changes cnt must be set to 0 when doing DB pivoting
         // (other changes include the handling of the row formatting)
         
-        for(auto s:query->select) {
+        for(const auto &s:query->select) {
             if(s.label!="") {
                 cols[cnt]["label"]=s.label;
             }
@@ -419,7 +566,7 @@ static void setLabelFormat(Json::Value &cols,::GQL_SQL::GQLParser::Query::CPtr q
     }
 
     for(uint32_t cnt=0;cnt<cols.size();cnt++) {
-        auto c=cols[cnt];
+        Json::Value &c=cols[cnt];
         c["format"]=Json::Value::null;
         if(!c.isMember("label")) {
             c["label"]="";
@@ -444,12 +591,9 @@ static void setLabelFormat(Json::Value &cols,::GQL_SQL::GQLParser::Query::CPtr q
             VLOG(2) << "Format: " << pat << " - " <<  c["format"];
         }
         if(!c["format"].isNull()) {
-            auto f=c["format"];
-            c["format"]=c["type"];
-            c["type"]=f;
+            c["format"].swap(c["type"]);
             // type now has the correct output format, while format has the MYSQL format
         }
-        cols[cnt]=c;
     }
 }
 
@@ -515,7 +659,7 @@ static void applyBooleanFormat(Json::Value &rows,
 
     for(uint32_t r=0;r<rows.size();r++) {
         Json::Value &cell=rows[r]["c"][c];
-        auto v=cell["v"];
+        const Json::Value &v=cell["v"];
         bool vd;
         if(v.isString()) {
             if(validTrue.count(v.asString())) { vd=1; }
@@ -544,23 +688,18 @@ static void applyStringFormat(Json::Value &rows,
     ON_EXIT(if(fmt) { free(fmt); });
     for(uint32_t r=0;r<rows.size();r++) {
         Json::Value &cell=rows[r]["c"][c];
-        auto v=cell["v"];
-        std::string str;
+        const Json::Value &v=cell["v"];
         if(v.isNumeric()) {
             if(!fmt) {
                 UErrorCode status = U_ZERO_ERROR;
                 fmt=NumberFormat::createInstance(status);
             }
-            str=applyPattern(v.asDouble(),fmt);
-            cell["v"]=str;
+            cell["v"]=applyPattern(v.asDouble(),fmt);
         } else if(v.isBool()) {
-            str=v.asBool()?"TRUE":"FALSE";
-            cell["v"]=str;
-        } else {
-            str=v.asString();
+            cell["v"]=v.asBool()?"TRUE":"FALSE";
         }
         if(no_values) {
-            cell["f"]=cell["v"];
+            cell["f"].swap(cell["v"]);
             cell.removeMember("v");
         }
         if(no_format) { cell.removeMember("f"); }
@@ -589,7 +728,7 @@ static void applyNumberFormat(Json::Value &rows,
     // now need to apply this to every single entry
     for(uint32_t r=0;r<rows.size();r++) {
         Json::Value &cell=rows[r]["c"][c];
-        auto v=cell["v"];
+        const Json::Value &v=cell["v"];
         if(v.isString()) {
             if(!no_values) {
                 auto vd=std::stod(v.asString());
@@ -681,7 +820,6 @@ static void applyDateTimeFormat(const std::string &type,
                 vd=parseTimestamp.parse(uv,udres);
             }
         } else if(v.isString()) {
-            cell["v"]=v;
             vd=std::stod(v.asString());
         } else if(v.isIntegral()&&!v.isDouble()) {
             vd=v.asInt()*1000.0;
@@ -759,37 +897,102 @@ static void applyFormat(Json::Value &tbl,bool no_values,bool no_format)
     }
 }
 
+/// GQL type of a column declared with the DB type decl, "" if it is not known
+static std::string declType(const std::string &decl)
+{
+    std::string d=boost::to_upper_copy(decl);
+    if(d.find("BOOL")!=std::string::npos) { return TYPE_BOOLEAN; }
+    if(d.find("DATETIME")!=std::string::npos||d.find("TIMESTAMP")!=std::string::npos) { return TYPE_DATETIME; }
+    if(d.find("DATE")!=std::string::npos) { return TYPE_DATE; }
+    if(d.find("TIME")!=std::string::npos) { return TYPE_TIME; }
+    if(d.find("CHAR")!=std::string::npos||d.find("TEXT")!=std::string::npos||d.find("CLOB")!=std::string::npos) { return TYPE_STRING; }
+    if(d.find("INT")!=std::string::npos||d.find("DEC")!=std::string::npos||d.find("NUM")!=std::string::npos
+       ||d.find("REAL")!=std::string::npos||d.find("DOUBLE")!=std::string::npos||d.find("FLOAT")!=std::string::npos) {
+        return TYPE_NUMBER;
+    }
+    return "";
+}
+
+/// GQL type of the select expression e if it is a column of the schema or an
+/// aggregate of one, "" otherwise
+static std::string exprType(const Schema &schema,const std::string &deftable,const GQLParser::Query::Expr &e)
+{
+    if(e.tp()!=GQLParser::TokenType::IDENTIFIER) { return ""; }
+    if(e.sub().size()==1&&GQLParser::Query::isAggFunc(e.data())) {
+        if(e.data()=="min"||e.data()=="max") { return exprType(schema,deftable,*e.sub()[0]); }
+        return TYPE_NUMBER;
+    }
+    if(e.sub().size()>0||e.noarg()) { return ""; }
+    std::string table=deftable;
+    std::string column=e.data();
+    auto dot=column.find('.');
+    if(dot!=std::string::npos && column.rfind('.')==dot) {
+        table=column.substr(0,dot);
+        column=column.substr(dot+1);
+    }
+    auto t=schema.find(table);
+    if(t==schema.end()) { return ""; }
+    for(const auto &c:t->second) {
+        if(boost::algorithm::iequals(c.first,column)) { return declType(c.second); }
+    }
+    return "";
+}
+
+bool DB::emptyResult(const Result &r,Json::Value &tbl) const
+{
+    const GQLParser::Query &q=*r.query;
+    if(!q.filtersAll()||q.selectStar||q.hasPivotClause()) { return false; }
+    Json::Value cols(Json::arrayValue);
+    for(const auto &s:q.select) {
+        // aggregates without 'group by' return one row
+        if(q.group.empty()&&s.expr->sub().size()>0&&GQLParser::Query::isAggFunc(s.expr->data())) { return false; }
+        std::string type=exprType(schema_,deftable_,*s.expr);
+        if(type=="") { return false; }
+        Json::Value c(Json::objectValue);
+        c["type"]=type;
+        cols.append(c);
+    }
+    tbl["cols"].swap(cols);
+    tbl["rows"]=Json::Value(Json::arrayValue);
+    return true;
+}
+
 /// Execute a query and return the GQL expected json.
+void DB::finish(const Result &r,Json::Value &tbl,Json::Value &res) const
+{
+    res["table"]=Json::Value();
+    res["status"]="ok";
+    if(r.query->hasPivotClause()) {
+        // the original got created in a separate table in order to
+        // avoid copying as much as possible, pivot into the actual result
+        setLabelFormat(tbl["cols"],r.query);
+        applyFormat(tbl,r.query->no_values,0);
+           // 0: keep format, needed for pivot
+        pivotTable(r,tbl,res["table"]);
+    } else {
+        res["table"].swap(tbl);
+        setLabelFormat(res["table"]["cols"],r.query);
+        applyFormat(res["table"],r.query->no_values, r.query->no_format);
+    }
+}
+
 void DB::execute(const std::string &gql,Json::Value &res) const
 {
+    std::lock_guard<std::mutex> lock(executeMutex_);
     res["version"]="0.7";
     if(!isConnected()) {
         setError(res,ErrorReasons::ACCESS_DENIED,"db connection failed");
     } else {
         try {
             if(parser_->parse(gql)) {
-                Result r=parser_->res();
+                const Result &r=parser_->res();
                 LOG(INFO) << "Result: " << r;
 
-                res["table"]=Json::Value();
-                res["status"]="ok";
-                if(parser_->query()->hasPivotClause()) {
-                    Json::Value tbl=Json::Value();
-                        // in order to avoid copying as much as possible
-                        // create the original in a separate table and then
-                        // pivot into the actual result
-                    getdata(r.result,tbl);
-                    setLabelFormat(tbl["cols"],parser_->query());
-                    applyFormat(tbl,parser_->query()->no_values,0);
-                       // 0: keep format, needed for pivot
-                    pivotTable(tbl,res["table"]);
-                } else {
-                    getdata(r.result,res["table"]);
-                    setLabelFormat(res["table"]["cols"],parser_->query());
-                    applyFormat(res["table"],parser_->query()->no_values, parser_->query()->no_format);
-                }
+                Json::Value tbl=Json::Value();
+                if(!emptyResult(r,tbl)) { guarded([&]() { getdata(r,tbl); }); }
+                finish(r,tbl,res);
             } else {
-                Result r=parser_->res();
+                const Result &r=parser_->res();
                 setError(res,ErrorReasons::INVALID_QUERY,r.errormsg);
             }
         } catch(const GQLError &er) {
@@ -800,7 +1003,229 @@ void DB::execute(const std::string &gql,Json::Value &res) const
     }
 }
 
-DB::~DB() { }
+void DB::getdataBatch(std::vector<BatchQuery> &queries) const
+{
+    for(auto &q:queries) {
+        try {
+            getdata(q.result,q.tbl);
+        } catch(...) {
+            q.error=std::current_exception();
+        }
+    }
+}
+
+void DB::executeBatch(const std::vector<std::string> &gql,Json::Value &res) const
+{
+    std::lock_guard<std::mutex> lock(executeMutex_);
+    res=Json::Value(Json::arrayValue);
+    res.resize(static_cast<Json::ArrayIndex>(gql.size()));
+    for(auto &r:res) { r["version"]="0.7"; }
+    if(!isConnected()) {
+        for(auto &r:res) { setError(r,ErrorReasons::ACCESS_DENIED,"db connection failed"); }
+        return;
+    }
+
+    // parse everything first so the DB gets all valid queries at once
+    std::vector<BatchQuery> queries;
+    std::vector<Json::ArrayIndex> index;
+    queries.reserve(gql.size());
+    for(Json::ArrayIndex i=0;i<gql.size();i++) {
+        try {
+            if(parser_->parse(gql[i])) {
+                LOG(INFO) << "Result: " << parser_->res();
+                Json::Value tbl;
+                if(emptyResult(parser_->res(),tbl)) {
+                    finish(parser_->res(),tbl,res[i]);
+                    continue;
+                }
+                queries.push_back(BatchQuery{parser_->res(),Json::Value(),nullptr});
+                index.push_back(i);
+            } else {
+                setError(res[i],ErrorReasons::INVALID_QUERY,parser_->res().errormsg);
+            }
+        } catch(const GQLError &er) {
+            setError(res[i],er.er(),er.msg());
+        } catch(const std::exception &ex) {
+            setError(res[i],ErrorReasons::INVALID_REQUEST,ex.what());
+        }
+    }
+
+    try {
+        guarded([&]() { getdataBatch(queries); });
+    } catch(const GQLError &) {
+        // stopped by cancel() or the timeout: all queries fail
+        for(auto &q:queries) { q.error=std::current_exception(); }
+    }
+
+    for(size_t q=0;q<queries.size();q++) {
+        Json::Value &r=res[index[q]];
+        try {
+            if(queries[q].error) { std::rethrow_exception(queries[q].error); }
+            finish(queries[q].result,queries[q].tbl,r);
+        } catch(const GQLError &er) {
+            setError(r,er.er(),er.msg());
+        } catch(const std::exception &ex) {
+            setError(r,ErrorReasons::INVALID_REQUEST,ex.what());
+        }
+    }
+}
+
+void DB::guarded(const std::function<void()> &get) const
+{
+    {
+        std::lock_guard<std::mutex> lock(stopMutex_);
+        running_=true;
+        stop_=Stop::NONE;
+        interrupted_=false;
+    }
+    std::thread timer;
+    if(timeout_) {
+        timer=std::thread([this]() {
+            std::unique_lock<std::mutex> lock(stopMutex_);
+            if(!stopCond_.wait_for(lock,std::chrono::milliseconds(timeout_),[this]() { return !running_; })
+               && stop_==Stop::NONE) {
+                stopRunning(lock,Stop::TIMEOUT);
+            }
+        });
+    }
+
+    std::exception_ptr error;
+    try {
+        get();
+    } catch(...) {
+        error=std::current_exception();
+    }
+    Stop stop;
+    {
+        std::unique_lock<std::mutex> lock(stopMutex_);
+        running_=false;
+        stopCond_.notify_all();
+        // the connection must not be used for the next query while interrupt() runs
+        stopCond_.wait(lock,[this]() { return interrupting_==0; });
+        stop=stop_;
+    }
+    if(timer.joinable()) { timer.join(); }
+
+    // the data of a stopped query is incomplete even if getdata() returned
+    switch(stop) {
+    case Stop::NONE: break;
+    case Stop::CANCEL: throw GQLError(ErrorReasons::OTHER,"query cancelled");
+    case Stop::TIMEOUT: throw GQLError(ErrorReasons::OTHER,"query timed out after "+std::to_string(timeout_)+" ms");
+    }
+    if(error) { std::rethrow_exception(error); }
+}
+
+void DB::stopRunning(std::unique_lock<std::mutex> &lock,Stop why) const
+{
+    stop_=why;
+    interrupted_=true;
+    // interrupt() may take a round trip to the server, do not block cancel() and guarded() meanwhile
+    interrupting_++;
+    lock.unlock();
+    interrupt();
+    lock.lock();
+    interrupting_--;
+    stopCond_.notify_all();
+}
+
+void DB::cancel() const
+{
+    std::unique_lock<std::mutex> lock(stopMutex_);
+    if(!running_||stop_!=Stop::NONE) { return; }
+    stopRunning(lock,Stop::CANCEL);
+}
+
+void DB::timeoutSet(uint32_t ms)
+{
+    timeout_=ms;
+    if(parser_) { parser_->timeoutSet(ms); }
+}
+
+void DB::maxRowsSet(uint64_t n)
+{
+    maxRows_=n;
+    if(parser_) { parser_->maxRowsSet(n); }
+}
+
+/// Approximate size of a row {"c":[...]} or a cell {"v":value}: the object,
+/// the map node with its key and the value. Strings add their length.
+static const uint64_t NODE_BYTES=3*sizeof(Json::Value)+4*sizeof(void *);
+
+void DB::budget(Json::ArrayIndex rows,const Json::Value &row,uint64_t &used) const
+{
+    if(maxRows_&&rows>maxRows_) {
+        throw GQLError(ErrorReasons::OTHER,"the result has more than "+std::to_string(maxRows_)+" rows");
+    }
+    if(!maxMemory_) { return; }
+    used+=NODE_BYTES*(1+row.size());
+    for(const auto &c:row) {
+        const char *begin,*end;
+        if(c["v"].isString()&&c["v"].getString(&begin,&end)) {
+            used+=static_cast<uint64_t>(end-begin);
+        }
+    }
+    if(used>maxMemory_) {
+        throw GQLError(ErrorReasons::OTHER,"the result needs more than "+std::to_string(maxMemory_)+" bytes");
+    }
+}
+
+std::future<Json::Value> DB::executeAsync(const std::string &gql) const
+{
+    auto result=std::make_shared<std::promise<Json::Value>>();
+    auto f=result->get_future();
+    executeAsync(gql,[result](Json::Value &res) { result->set_value(std::move(res)); });
+    return f;
+}
+
+void DB::executeAsync(const std::string &gql,std::function<void(Json::Value &res)> done) const
+{
+    std::lock_guard<std::mutex> lock(asyncMutex_);
+    if(!asyncThread_.joinable()) {
+        asyncStop_=false;
+        asyncThread_=std::thread([this]() { asyncRun(); });
+    }
+    asyncQueue_.push_back([this,gql,done]() {
+        Json::Value res;
+        execute(gql,res);
+        done(res);
+    });
+    asyncCond_.notify_one();
+}
+
+void DB::asyncRun() const
+{
+    std::unique_lock<std::mutex> lock(asyncMutex_);
+    for(;;) {
+        asyncCond_.wait(lock,[this]() { return asyncStop_ || !asyncQueue_.empty(); });
+        if(asyncQueue_.empty()) { return; }
+        auto query=std::move(asyncQueue_.front());
+        asyncQueue_.pop_front();
+        lock.unlock();
+        try {
+            query();
+        } catch(const std::exception &ex) {
+            // execute() does not throw, this is an exception of the callback
+            LOG(ERROR) << "executeAsync callback failed: " << ex.what();
+        } catch(...) {
+            LOG(ERROR) << "executeAsync callback failed with an unknown exception";
+        }
+        lock.lock();
+    }
+}
+
+void DB::asyncStop() const
+{
+    {
+        std::lock_guard<std::mutex> lock(asyncMutex_);
+        asyncStop_=true;
+    }
+    asyncCond_.notify_one();
+    if(asyncThread_.joinable()) { asyncThread_.join(); }
+}
+
+DB::~DB() {
+    asyncStop();
+}
 
 
 }
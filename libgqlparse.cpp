@@ -21,8 +21,9 @@
 
 #include <iostream>
 #include <cstdint>
-#include <unordered_map>
+#include <cstdio>
 #include <exception>
+#include <new>
 #include <jsoncpp/json/json.h>
 #include <glog/logging.h>
 #include <boost/algorithm/string.hpp>
@@ -64,49 +65,95 @@ namespace GQLParser {
 
 SyntaxError::~SyntaxError() { }
 
-/// Map strings to token types for keywords.
-const static std::unordered_map<std::string,TokenType> keyword {
-        { "and",TokenType::AND },
-        { "asc",TokenType::ASC },
-        { "by",TokenType::BY },
-        { "date",TokenType::DATE },
-        { "datetime",TokenType::DATETIME },
-        { "desc",TokenType::DESC },
-        { "false",TokenType::GQL_FALSE },
-        { "format",TokenType::FORMAT },
-        { "group",TokenType::GROUP },
-        { "label",TokenType::LABEL },
-        { "limit",TokenType::LIMIT },
-        { "not",TokenType::NOT },
-        { "offset",TokenType::OFFSET },
-        { "options",TokenType::OPTIONS },
-        { "or",TokenType::OR },
-        { "order",TokenType::ORDER },
-        { "pivot",TokenType::PIVOT },
-        { "select",TokenType::SELECT },
-        { "timeofday",TokenType::TIMEOFDAY },
-        { "timestamp",TokenType::TIMESTAMP },
-        { "true",TokenType::GQL_TRUE },
-        { "where",TokenType::WHERE },
-
-        { "=",TokenType::EQ },
-        { "!=",TokenType::NE },
-        { "<>",TokenType::NE },
-        { "<",TokenType::LT },
-        { "<=",TokenType::LE },
-        { ">=",TokenType::GE },
-        { ">",TokenType::GT },
-
-        { "-",TokenType::MINUS },
-        { "+",TokenType::PLUS },
-        { "*",TokenType::TIMES },
-        { "/",TokenType::DIV },
-        { "(",TokenType::P_OPEN },
-        { ")",TokenType::P_CLOSE },
-
-        { ",",TokenType::COMMA },
+/// A GQL keyword and its token type
+struct Keyword {
+    TokenType tt;    ///< token type of the keyword, _UNDEFINED if it is not a keyword
+    StringView name; ///< lower case spelling, used as token string
 };
 
+/// ASCII lower case, locale independent
+static constexpr char lower(char c) noexcept { return c>='A'&&c<='Z'?static_cast<char>(c-'A'+'a'):c; }
+
+/// Case insensitive hash for strings of at least two characters. The factors are
+/// chosen such that no two keywords have the same hash (perfect hash), which the
+/// compiler checks as they are used as case labels in keywordFind().
+static constexpr size_t keywordHash(const char *s,size_t n) noexcept
+{
+    return (n*10+static_cast<unsigned char>(lower(s[0]))*2u+static_cast<unsigned char>(lower(s[n-1]))*4u
+                 +static_cast<unsigned char>(lower(s[1])))%64;
+}
+
+/// Hash of a keyword literal
+template<size_t N> static constexpr size_t keywordHash(const char (&kw)[N]) noexcept
+{
+    return keywordHash(kw,N-1);
+}
+
+/// Returns the keyword if s is kw (case insensitive)
+template<size_t N> static Keyword keywordMatch(StringView s,const char (&kw)[N],TokenType tt) noexcept
+{
+    if(s.size()!=N-1) { return Keyword{TokenType::_UNDEFINED,StringView()}; }
+    for(size_t i=0;i<N-1;i++) {
+        if(lower(s[i])!=kw[i]) { return Keyword{TokenType::_UNDEFINED,StringView()}; }
+    }
+    return Keyword{tt,StringView(kw,N-1)};
+}
+
+/// Classify s as keyword (case insensitive), tt is _UNDEFINED if s is no keyword
+static Keyword keywordFind(StringView s) noexcept
+{
+    if(s.size()<2) { return Keyword{TokenType::_UNDEFINED,StringView()}; }
+    switch(keywordHash(s.data(),s.size())) {
+    case keywordHash("and"): return keywordMatch(s,"and",TokenType::AND);
+    case keywordHash("asc"): return keywordMatch(s,"asc",TokenType::ASC);
+    case keywordHash("by"): return keywordMatch(s,"by",TokenType::BY);
+    case keywordHash("date"): return keywordMatch(s,"date",TokenType::DATE);
+    case keywordHash("datetime"): return keywordMatch(s,"datetime",TokenType::DATETIME);
+    case keywordHash("desc"): return keywordMatch(s,"desc",TokenType::DESC);
+    case keywordHash("false"): return keywordMatch(s,"false",TokenType::GQL_FALSE);
+    case keywordHash("format"): return keywordMatch(s,"format",TokenType::FORMAT);
+    case keywordHash("group"): return keywordMatch(s,"group",TokenType::GROUP);
+    case keywordHash("label"): return keywordMatch(s,"label",TokenType::LABEL);
+    case keywordHash("limit"): return keywordMatch(s,"limit",TokenType::LIMIT);
+    case keywordHash("not"): return keywordMatch(s,"not",TokenType::NOT);
+    case keywordHash("offset"): return keywordMatch(s,"offset",TokenType::OFFSET);
+    case keywordHash("options"): return keywordMatch(s,"options",TokenType::OPTIONS);
+    case keywordHash("or"): return keywordMatch(s,"or",TokenType::OR);
+    case keywordHash("order"): return keywordMatch(s,"order",TokenType::ORDER);
+    case keywordHash("pivot"): return keywordMatch(s,"pivot",TokenType::PIVOT);
+    case keywordHash("select"): return keywordMatch(s,"select",TokenType::SELECT);
+    case keywordHash("timeofday"): return keywordMatch(s,"timeofday",TokenType::TIMEOFDAY);
+    case keywordHash("timestamp"): return keywordMatch(s,"timestamp",TokenType::TIMESTAMP);
+    case keywordHash("true"): return keywordMatch(s,"true",TokenType::GQL_TRUE);
+    case keywordHash("where"): return keywordMatch(s,"where",TokenType::WHERE);
+    default: return Keyword{TokenType::_UNDEFINED,StringView()};
+    }
+}
+
+/// Returns the type of a one or two character operator, ERROR if s is none
+static TokenType operatorType(StringView s) noexcept
+{
+    if(s.size()==2) {
+        if(s=="!="||s=="<>") { return TokenType::NE; }
+        if(s=="<=") { return TokenType::LE; }
+        if(s==">=") { return TokenType::GE; }
+        return TokenType::ERROR;
+    }
+    switch(s.size()==1?s[0]:0) {
+    case '=': return TokenType::EQ;
+    case '<': return TokenType::LT;
+    case '>': return TokenType::GT;
+    case '-': return TokenType::MINUS;
+    case '+': return TokenType::PLUS;
+    case '*': return TokenType::TIMES;
+    case '/': return TokenType::DIV;
+    case '(': return TokenType::P_OPEN;
+    case ')': return TokenType::P_CLOSE;
+    case ',': return TokenType::COMMA;
+    default: return TokenType::ERROR;
+    }
+}
+
 
 Token Tokenizer::next() {
     current_=nextt();
@@ -117,28 +164,33 @@ Token Tokenizer::nextt() {
     while(pos_<str_.length() && (str_[pos_]==' ' || str_[pos_]=='\t' || str_[pos_]=='\n')) { pos_++; }
     auto startpos=pos_+1;
     auto n=nexti();
-    if(n=="") { return Token(startpos,TokenType::EOL); }
+    if(n.empty()) { return Token(startpos,TokenType::EOL); }
 
     if(n[0]=='"' || n[0]=='\'') {
-        if(n[n.length()-1]!=n[0]) {
+        if(n.size()<2 || n[n.length()-1]!=n[0]) {
             return Token(startpos,TokenType::ERROR,n);
         }
         return Token(startpos,TokenType::STRING,n.substr(1,n.length()-2));
     }
     if(n[0]=='`') {
-        if(n[n.length()-1]!=n[0]) {
+        if(n.size()<2 || n[n.length()-1]!=n[0]) {
             return Token(startpos,TokenType::ERROR,n);
         }
         return Token(startpos,TokenType::IDENTIFIER,n.substr(1,n.length()-2));
     }
 
-    std::string lower=boost::algorithm::to_lower_copy(n);
     if((n[0]>='0'&&n[0]<='9')||n[0]=='.') {
-        return Token(startpos,TokenType::NUMBER,lower);
+        return Token(startpos,TokenType::NUMBER,n);
+    }
+
+    Keyword k=keywordFind(n);
+    if(k.tt!=TokenType::_UNDEFINED) {
+        return Token(startpos,k.tt,k.name);
     }
 
-    if(keyword.count(lower)>0) {
-        return Token(startpos,keyword.at(lower),lower);
+    TokenType op=operatorType(n);
+    if(op!=TokenType::ERROR) {
+        return Token(startpos,op,n);
     }
 
     for(auto c:n) {
@@ -162,9 +214,9 @@ inline static bool isnumber(char c) noexcept {
     return (c>='0'&&c<='9')||c=='.';
 }
 
-std::string Tokenizer::nexti() {
+StringView Tokenizer::nexti() {
     while(pos_<str_.length() && (str_[pos_]==' ' || str_[pos_]=='\t' || str_[pos_]=='\n')) { pos_++; }
-    if(pos_>=str_.length()) { return ""; }
+    if(pos_>=str_.length()) { return StringView(); }
 
     // parse a string literal
     if(str_[pos_]=='\'' || str_[pos_]=='"' || str_[pos_]=='`') {
@@ -174,7 +226,7 @@ std::string Tokenizer::nexti() {
         while(pos_<str_.length()&&str_[pos_]!=start) {
             pos_++;
         }
-        pos_++;
+        if(pos_<str_.length()) { pos_++; }
         return str_.substr(first,pos_-first);
     }
 
@@ -182,7 +234,7 @@ std::string Tokenizer::nexti() {
     // parse a numeric literal
     if(isnumber(str_[pos_])) {
         auto start=pos_;
-        while(isnumber(str_[pos_])) { pos_++; }
+        while(pos_<str_.length()&&isnumber(str_[pos_])) { pos_++; }
         return str_.substr(start,pos_-start);
     }
 
@@ -190,7 +242,7 @@ std::string Tokenizer::nexti() {
     // Note that at this point the current character cannot be a number
     if(isid(str_[pos_])) {
         auto start=pos_;
-        while(isid(str_[pos_])) { pos_++; }
+        while(pos_<str_.length()&&isid(str_[pos_])) { pos_++; }
         return str_.substr(start,pos_-start);
     }
 
@@ -198,7 +250,7 @@ std::string Tokenizer::nexti() {
     // check for special multi-character key words ('<=' etc)
     if(str_.length()>pos_) {
         auto op2=str_.substr(pos_-1,2);
-        if(keyword.count(op2)>0) { pos_++;return op2; }
+        if(operatorType(op2)!=TokenType::ERROR) { pos_++;return op2; }
     }
 
     return str_.substr(pos_-1,1);
@@ -263,6 +315,7 @@ std::ostream& operator<<(std::ostream& outs, TokenType t)
     case TokenType::CONTAINS: outs << "CONTAINS";break;
     case TokenType::MATCHES: outs << "MATCHES";break;
     case TokenType::LIKE: outs << "LIKE";break;
+    case TokenType::IN_SET: outs << "IN_SET";break;
 
     }
     return outs;
@@ -274,9 +327,11 @@ bool GQLParser::Parser::parse(const std::string &cmd)
     query_=0;
     res_=Result();
     try {
-        query_=Query::parse(cmd,extendedFunctions_);
+        query_=Query::parse(cmd,extendedFunctions_,dateRanges());
         res_.target=target();
+        checkColumns();
         createResult();
+        res_.query=query_;
         return 1;
     } catch(const SyntaxError &ex) {
         res_.errormsg=ex.what();
@@ -290,27 +345,135 @@ bool GQLParser::Parser::parse(const std::string &cmd)
 
 GQLParser::Parser::~Parser() { }
 
+uint64_t GQLParser::Parser::sqlLimit() const
+{
+    uint64_t limit=query_->hasPivotClause()?0:query_->limit;
+    if(maxRows_&&(limit==0||limit>maxRows_)) { limit=maxRows_+1; }
+    return limit;
+}
+
+void GQLParser::Parser::schemaSet(const Schema &schema)
+{
+    columns_.clear();
+    for(const auto &t:schema) {
+        // tables that do not exist are reported by the DB
+        if(t.second.empty()) { continue; }
+        auto &cols=columns_[t.first];
+        for(const auto &c:t.second) {
+            cols.insert(boost::algorithm::to_lower_copy(c.first));
+        }
+    }
+}
+
+void GQLParser::Parser::checkColumn(const std::string &id) const
+{
+    // column names are compared case insensitive, the DB has the final word
+    auto dot=id.find(".");
+    std::string table=defTable_;
+    std::string column=id;
+    if(dot!=std::string::npos && id.rfind(".")==dot) {
+        table=id.substr(0,dot);
+        column=id.substr(dot+1);
+    }
+    auto t=columns_.find(table);
+    if(t==columns_.end()) { return; }
+    if(t->second.count(boost::algorithm::to_lower_copy(column))==0) {
+        throw GQLError(ErrorReasons::INVALID_QUERY,"column `"+id+"` does not exist");
+    }
+}
+
+void GQLParser::Parser::checkColumns() const
+{
+    if(columns_.empty()) { return; }
+    std::vector<Query::Expr::CPtr> todo;
+    for(const auto &s:query_->select) { todo.push_back(s.expr); }
+    for(const auto &o:query_->order) { todo.push_back(o.expr); }
+    if(query_->where) { todo.push_back(query_->where); }
+    while(!todo.empty()) {
+        auto e=todo.back();
+        todo.pop_back();
+        if(!e) { continue; }
+        if(e->tp()==TokenType::IDENTIFIER && e->sub().size()==0 && !e->noarg()) {
+            checkColumn(e->data());
+        }
+        for(const auto &c:e->sub()) { todo.push_back(c); }
+    }
+    for(const auto &g:query_->group) { checkColumn(g.token.to_string()); }
+    for(const auto &p:query_->pivot) { checkColumn(p.token.to_string()); }
+}
+
 bool Query::Expr::operator==(const Query::Expr &other) const
 {
-    bool n=tp_==other.tp_
-           && data_==other.data_
-           && noarg_==other.noarg_
-           && sub_.size()==other.sub_.size();
-    if(!n) { return n; }
-    for(unsigned int i=0;i<sub_.size();i++) {
-        if((*sub_[i])!=(*other.sub_[i])) { return 0; }
+    // compared with an explicit stack, expressions can be very deep
+    std::vector<std::pair<const Expr *,const Expr *>> todo { { this,&other } };
+    while(!todo.empty()) {
+        const Expr *a=todo.back().first;
+        const Expr *b=todo.back().second;
+        todo.pop_back();
+        bool n=a->tp_==b->tp_
+               && a->data_==b->data_
+               && a->noarg_==b->noarg_
+               && a->n_==b->n_;
+        if(!n) { return n; }
+        auto as=a->sub();
+        auto bs=b->sub();
+        for(unsigned int i=0;i<a->n_;i++) { todo.push_back(std::make_pair(as[i].get(),bs[i].get())); }
     }
     return 1;
 }
 
+void Query::Expr::push(std::shared_ptr<const Expr> e)
+{
+    if(!e) { return; }
+    if(arena_ && arena_->holds(e.get())) {
+        // do not own expressions of the same arena, that would be a reference cycle
+        e=CPtr(CPtr(),e.get());
+    }
+    if(n_<2 && more_.empty()) {
+        in_[n_++]=std::move(e);
+        return;
+    }
+    if(more_.empty()) {
+        more_.reserve(4);
+        more_.push_back(std::move(in_[0]));
+        more_.push_back(std::move(in_[1]));
+    }
+    more_.push_back(std::move(e));
+    n_++;
+}
+
+Query::Expr::Ptr Query::Arena::make(TokenType _tp,StringView _data,
+                                    const Expr::CPtr &_ex1,const Expr::CPtr &_ex2)
+{
+    if(size_%BLOCK==0) {
+        blocks_.emplace_back(new Slot[BLOCK]);
+    }
+    Expr *e=new (&blocks_.back()[size_%BLOCK]) Expr(this,_tp,_data,_ex1,_ex2);
+    size_++;
+    return Expr::Ptr(Expr::Ptr(),e);
+}
+
+Query::Arena::~Arena()
+{
+    for(size_t i=size_;i>0;i--) {
+        reinterpret_cast<Expr *>(&blocks_[(i-1)/BLOCK][(i-1)%BLOCK])->~Expr();
+    }
+}
+
+Query::Expr::CPtr Query::own(const Expr::CPtr &e) const
+{
+    if(!arena_->holds(e.get())) { return e; }
+    return Expr::CPtr(arena_,e.get());
+}
+
 /// Helper function to throw an error
 [[noreturn]] static void throw_error(const Tokenizer &tok,const std::string &instead="")
 {
     if(instead=="") {
-        std::string res="unexpected token '"+tok.current().token+"'";
+        std::string res="unexpected token '"+tok.current().token.to_string()+"'";
         throw SyntaxError(res,tok.current().pos);
     } else {
-        std::string res="expected "+instead+" but got '"+tok.current().token+"' instead";
+        std::string res="expected "+instead+" but got '"+tok.current().token.to_string()+"' instead";
         throw SyntaxError(res,tok.current().pos);
     }
 }
@@ -337,249 +500,275 @@ static bool consume_opt(Tokenizer &tok,TokenType tt,Args... args) {
 }
 
 
-// The following functions implement a simple LL(1) parser using
-// functions calls.
-
-static Query::Expr::CPtr parseExpr(Tokenizer &tok);
-
-/// parse a value like literal, function call, expression in parenthesis, ....
-static Query::Expr::CPtr parseVal(Tokenizer &tok)
-{
-    Query::Expr::CPtr r=0;
-    TokenType tt=tok.current().tt;
-    std::string token=tok.current().token;
-    switch(tok.current().tt) {
-    case GQL_SQL::GQLParser::TokenType::LIKE:
-    case GQL_SQL::GQLParser::TokenType::MATCHES:
-    case GQL_SQL::GQLParser::TokenType::STARTS:
-    case GQL_SQL::GQLParser::TokenType::ENDS:
-    case GQL_SQL::GQLParser::TokenType::CONTAINS:
-    case GQL_SQL::GQLParser::TokenType::COMMA:
-    case GQL_SQL::GQLParser::TokenType::IS_NULL:
-    case GQL_SQL::GQLParser::TokenType::IS_NOT_NULL:
-    case GQL_SQL::GQLParser::TokenType::ERROR:
-    case GQL_SQL::GQLParser::TokenType::EOL:
-    case GQL_SQL::GQLParser::TokenType::ASC:
-    case GQL_SQL::GQLParser::TokenType::DESC:
-    case GQL_SQL::GQLParser::TokenType::BY:
-    case GQL_SQL::GQLParser::TokenType::FORMAT:
-    case GQL_SQL::GQLParser::TokenType::GROUP:
-    case GQL_SQL::GQLParser::TokenType::ORDER:
-    case GQL_SQL::GQLParser::TokenType::LABEL:
-    case GQL_SQL::GQLParser::TokenType::LIMIT:
-    case GQL_SQL::GQLParser::TokenType::OPTIONS:
-    case GQL_SQL::GQLParser::TokenType::OFFSET:
-    case GQL_SQL::GQLParser::TokenType::AND:
-    case GQL_SQL::GQLParser::TokenType::OR:
-    case GQL_SQL::GQLParser::TokenType::PIVOT:
-    case GQL_SQL::GQLParser::TokenType::SELECT:
-    case GQL_SQL::GQLParser::TokenType::TIMESTAMP:
-    case GQL_SQL::GQLParser::TokenType::WHERE:
-    case GQL_SQL::GQLParser::TokenType::EQ:
-    case GQL_SQL::GQLParser::TokenType::NE:
-    case GQL_SQL::GQLParser::TokenType::LT:
-    case GQL_SQL::GQLParser::TokenType::GT:
-    case GQL_SQL::GQLParser::TokenType::GE:
-    case GQL_SQL::GQLParser::TokenType::LE:
-    case GQL_SQL::GQLParser::TokenType::TIMES:
-    case GQL_SQL::GQLParser::TokenType::P_CLOSE:
-    case GQL_SQL::GQLParser::TokenType::DIV:
-    case GQL_SQL::GQLParser::TokenType::NOT:
-        return 0;
+// The expression parser is an operator precedence parser that uses explicit
+// stacks for operands and pending operators instead of recursion, so that
+// very long or deeply nested expressions cannot exhaust the call stack.
+// From loosest to tightest binding the operators are: '+' and '-', '*' and
+// '/', 'and' and 'or', 'not', the comparisons (a chain of comparisons also
+// takes '+') as well as 'is null', 'like', 'starts with', ... and finally
+// the unary '+' and '-'.
+
+/// Kind of an entry of the operator stack of parseExpr()
+enum class Pending {
+    BOTTOM, ///< start of the expression
+    PAREN,  ///< open parenthesis
+    FUNC,   ///< argument list of a function call
+    BINARY, ///< '+', '-', '*', '/', 'and', 'or'
+    NOT,    ///< 'not'
+    RCOMP,  ///< 'like', 'contains', 'matches', 'starts with', 'ends with', the right side is a comparison
+    COMP,   ///< comparison chain ('<', '=', ... and '+')
+    SIGN    ///< unary '+' or '-'
+};
 
-    case GQL_SQL::GQLParser::TokenType::_UNDEFINED:
-        LOG(FATAL) << "got unusable token type _UNDEFINED";
+/// Entry of the operator stack of parseExpr()
+struct PendingOp {
+    Pending kind;           ///< kind of the entry
+    int prec;               ///< precedence of BINARY operators, higher binds tighter
+    TokenType tt;           ///< token type of the expression to create
+    StringView data;        ///< data of the expression to create
+    Query::Expr::Ptr func;  ///< function expression for FUNC
+};
 
-    case TokenType::PLUS:
-    case TokenType::MINUS:
-        {
-            tok.next();
-            auto e=parseVal(tok);
-            if(!e) { throw_error(tok); }
-            r=Query::Expr::make(tt,token,e);
-        }
-        break;
+/// State of the expression parser. It is shared by all expressions of a query
+/// so that the stacks are only allocated once.
+struct ExprParser {
+    explicit ExprParser(Query::Arena &_arena) : arena(_arena) { vals.reserve(16); ops.reserve(16); }
+    ///< parser creating the expressions in _arena
+    Query::Arena &arena;               ///< arena for the expressions
+    std::vector<Query::Expr::CPtr> vals; ///< operand stack
+    std::vector<PendingOp> ops;        ///< operator stack
+    unsigned equalities=0;             ///< number of '=' parsed, see foldInSets()
+    unsigned constants=0;              ///< number of constant sub expressions, see simplify()
+    unsigned dateFunctions=0;          ///< number of calls of year() and toDate(), see dateRanges()
+};
 
-    case TokenType::P_OPEN:
-        {
-            tok.next();
-            auto e=parseExpr(tok);
-            if(!e) { throw_error(tok); }
-            consume(tok,TokenType::P_CLOSE);
-            return e;
-        }
+/// precedence of a binary operator or 0 if tt is none
+static int binaryPrec(TokenType tt) noexcept
+{
+    switch(tt) {
+    case TokenType::PLUS: case TokenType::MINUS: return 1;
+    case TokenType::TIMES: case TokenType::DIV: return 2;
+    case TokenType::AND: case TokenType::OR: return 3;
+    default: return 0;
+    }
+}
+
+/// true if tt is a comparison operator
+static bool isComparison(TokenType tt) noexcept
+{
+    return tt==TokenType::LE||tt==TokenType::LT||tt==TokenType::GE
+         ||tt==TokenType::GT||tt==TokenType::EQ||tt==TokenType::NE;
+}
 
+/// true if e is a literal
+static bool isLiteral(const Query::Expr &e) noexcept
+{
+    switch(e.tp()) {
     case TokenType::GQL_TRUE:
     case TokenType::GQL_FALSE:
     case TokenType::STRING:
     case TokenType::NUMBER:
-        tok.next();
-        r=Query::Expr::make(tt,token);
-        break;
-
     case TokenType::DATE:
     case TokenType::TIMEOFDAY:
     case TokenType::DATETIME:
-        tok.next();
-        r=Query::Expr::make(tt,token,
-                            Query::Expr::make(tok.current().tt,tok.current().token));
-        consume(tok,TokenType::STRING);
-        break;
+        return 1;
+    default:
+        return 0;
+    }
+}
 
-    case TokenType::IDENTIFIER:
-        {
-            Token fname=tok.current();
-            tok.next();
-            auto e=Query::Expr::make(tt,token);
-            if(consume_opt(tok,TokenType::P_OPEN)) {
-                if(Query::isAggFunc(fname.token)) {
-                    e->push(Query::Expr::make(tok.current().tt,tok.current().token));
-                    consume(tok,TokenType::IDENTIFIER);
-                } else if(tok.current().tt!=TokenType::P_CLOSE) {
-                    do {
-                        auto e2=parseExpr(tok);
-                        if(!e2) { throw_error(tok); }
-                        e->push(e2);
-                    } while(consume_opt(tok,TokenType::COMMA));
-                }
-                if(e->sub().size()==0) { e->noargSet(); }
-                consume(tok,TokenType::P_CLOSE);
-            }
-            r=e;
-        }
-        break;
+/// Apply the operator on top of the operator stack to its operand(s)
+static void reduce(ExprParser &p)
+{
+    const PendingOp &op=p.ops.back();
+    auto r=p.vals.back();
+    p.vals.pop_back();
+    if(op.kind==Pending::NOT||op.kind==Pending::SIGN) {
+        if(isLiteral(*r)||r->tp()==TokenType::NOT) { p.constants++; }
+        p.vals.push_back(p.arena.make(op.tt,op.data,r));
+    } else {
+        if(isLiteral(*r)&&isLiteral(*p.vals.back())) { p.constants++; }
+        p.vals.back()=p.arena.make(op.tt,op.data,p.vals.back(),r);
     }
-    return r;
+    p.ops.pop_back();
 }
 
-/// parse a comparison like '<=' or boolean expression like 'starts with'
-static Query::Expr::CPtr parseComp(Tokenizer &tok)
-{
-    auto r=parseVal(tok);
-    if(!r) { return 0; }
-    Token cur=tok.current();
-    if(cur.tt==TokenType::LE
-          ||cur.tt==TokenType::LT
-          ||cur.tt==TokenType::GE
-          ||cur.tt==TokenType::GT
-          ||cur.tt==TokenType::EQ
-          ||cur.tt==TokenType::NE) {
-        while(consume_opt(tok,TokenType::PLUS,TokenType::LE,TokenType::LT,TokenType::GE,
-                          TokenType::GT,TokenType::EQ,TokenType::NE)) {
-            auto e=parseVal(tok);
-            if(!e) { throw_error(tok); }
-            r=Query::Expr::make(cur.tt,cur.token,r,e);
-            cur=tok.current();
+/// parse an expression, returns 0 if there is none.
+static Query::Expr::CPtr parseExpr(Tokenizer &tok,ExprParser &p)
+{
+    Query::Arena &a=p.arena;
+    std::vector<Query::Expr::CPtr> &vals=p.vals;
+    std::vector<PendingOp> &ops=p.ops;
+    vals.clear();
+    ops.clear();
+    ops.push_back(PendingOp{Pending::BOTTOM,0,TokenType::_UNDEFINED,StringView(),0});
+    bool operand=1; // true if an operand is expected next
+    for(;;) {
+        if(operand) {
+            Token cur=tok.current();
+            Pending top=ops.back().kind;
+            if(cur.tt==TokenType::NOT && (top==Pending::BOTTOM||top==Pending::PAREN||top==Pending::FUNC||top==Pending::BINARY)) {
+                // 'not not x' is x
+                bool odd=0;
+                while(consume_opt(tok,TokenType::NOT)) { odd=!odd; }
+                if(odd) { ops.push_back(PendingOp{Pending::NOT,0,cur.tt,cur.token,0}); }
+                continue;
+            }
+            switch(cur.tt) {
+            case TokenType::_UNDEFINED:
+                LOG(FATAL) << "got unusable token type _UNDEFINED";
+
+            case TokenType::PLUS:
+            case TokenType::MINUS:
+                tok.next();
+                ops.push_back(PendingOp{Pending::SIGN,0,cur.tt,cur.token,0});
+                continue;
+
+            case TokenType::P_OPEN:
+                tok.next();
+                ops.push_back(PendingOp{Pending::PAREN,0,cur.tt,cur.token,0});
+                continue;
+
+            case TokenType::GQL_TRUE:
+            case TokenType::GQL_FALSE:
+                p.constants++;
+                // fall through
+            case TokenType::STRING:
+            case TokenType::NUMBER:
+                tok.next();
+                vals.push_back(a.make(cur.tt,cur.token));
+                break;
+
+            case TokenType::DATE:
+            case TokenType::TIMEOFDAY:
+            case TokenType::DATETIME:
+                tok.next();
+                vals.push_back(a.make(cur.tt,cur.token,a.make(tok.current().tt,tok.current().token)));
+                consume(tok,TokenType::STRING);
+                break;
+
+            case TokenType::IDENTIFIER:
+                {
+                    tok.next();
+                    auto e=a.make(cur.tt,cur.token);
+                    if(consume_opt(tok,TokenType::P_OPEN)) {
+                        if(Query::isAggFunc(cur.token.to_string())) {
+                            e->push(a.make(tok.current().tt,tok.current().token));
+                            consume(tok,TokenType::IDENTIFIER);
+                        } else if(tok.current().tt!=TokenType::P_CLOSE) {
+                            if(cur.token=="year"||cur.token=="toDate") { p.dateFunctions++; }
+                            ops.push_back(PendingOp{Pending::FUNC,0,cur.tt,cur.token,e});
+                            continue;
+                        }
+                        if(e->sub().size()==0) { e->noargSet(); }
+                        consume(tok,TokenType::P_CLOSE);
+                    }
+                    vals.push_back(e);
+                }
+                break;
+
+            default:
+                // no operand, which is only fine if the expression is optional
+                if(top==Pending::BOTTOM) { return 0; }
+                throw_error(tok);
+            }
+            operand=0;
         }
-        return r;
-    } else if(cur.isIdent("is")) {
-        cur=tok.next();
-        if(cur.isIdent("null")) {
+
+        // an operand was parsed, first apply the unary signs
+        while(ops.back().kind==Pending::SIGN) { reduce(p); }
+        Token cur=tok.current();
+        if(ops.back().kind==Pending::COMP) {
+            if(isComparison(cur.tt)||cur.tt==TokenType::PLUS) {
+                reduce(p);
+                if(cur.tt==TokenType::EQ) { p.equalities++; }
+                tok.next();
+                ops.push_back(PendingOp{Pending::COMP,0,cur.tt,cur.token,0});
+                operand=1;
+                continue;
+            }
+            reduce(p);
+        } else if(isComparison(cur.tt)) {
+            if(cur.tt==TokenType::EQ) { p.equalities++; }
             tok.next();
-            return Query::Expr::make(TokenType::IS_NULL,"is null",r);
-        }
-        if(consume_opt(tok,TokenType::NOT)) {
-            cur=tok.current();
+            ops.push_back(PendingOp{Pending::COMP,0,cur.tt,cur.token,0});
+            operand=1;
+            continue;
+        } else if(cur.isIdent("is")) {
+            cur=tok.next();
+            if(isLiteral(*vals.back())) { p.constants++; }
             if(cur.isIdent("null")) {
                 tok.next();
-                return Query::Expr::make(TokenType::IS_NOT_NULL,"is not null",r);
+                vals.back()=a.make(TokenType::IS_NULL,"is null",vals.back());
+            } else {
+                if(!consume_opt(tok,TokenType::NOT) || !tok.current().isIdent("null")) {
+                    throw_error(tok,"'null' or 'not'");
+                }
+                tok.next();
+                vals.back()=a.make(TokenType::IS_NOT_NULL,"is not null",vals.back());
             }
-        }
-        throw_error(tok,"'null' or 'not'");
-    } else if(cur.isIdent("contains")
-       ||cur.isIdent("matches")
-       ||cur.isIdent("like")) {
-        TokenType tt=cur.isIdent("contains")?TokenType::CONTAINS:
-                     cur.isIdent("matches")?TokenType::MATCHES:
-                                            TokenType::LIKE;
-
-        tok.next();
-        auto r2=parseComp(tok);
-        if(!r2) { throw_error(tok); }
-        return Query::Expr::make(tt,cur.token,r,r2);
-
-    } else if(cur.isIdent("starts")
-       ||cur.isIdent("ends")) {
-        TokenType tt=cur.isIdent("starts")?TokenType::STARTS:TokenType::ENDS;
-        auto ptok=cur;
-        cur=tok.next();
-        if(cur.isIdent("with")) {
+            cur=tok.current();
+        } else if(cur.isIdent("contains")
+           ||cur.isIdent("matches")
+           ||cur.isIdent("like")) {
+            TokenType tt=cur.isIdent("contains")?TokenType::CONTAINS:
+                         cur.isIdent("matches")?TokenType::MATCHES:
+                                                TokenType::LIKE;
+            tok.next();
+            ops.push_back(PendingOp{Pending::RCOMP,0,tt,cur.token,0});
+            operand=1;
+            continue;
+        } else if(cur.isIdent("starts")
+           ||cur.isIdent("ends")) {
+            TokenType tt=cur.isIdent("starts")?TokenType::STARTS:TokenType::ENDS;
+            auto ptok=cur;
+            cur=tok.next();
+            if(!cur.isIdent("with")) { throw_error(tok,"expected 'with'"); }
             tok.next();
-            auto r2=parseComp(tok);
-            if(!r2) { throw_error(tok); }
-            return Query::Expr::make(tt,ptok.token,r,r2);
+            ops.push_back(PendingOp{Pending::RCOMP,0,tt,ptok.token,0});
+            operand=1;
+            continue;
         }
-        throw_error(tok,"expected 'with'");
-    }
-    return r;
-}
 
-/// parse a 'not X' expression
-static Query::Expr::CPtr parseNot(Tokenizer &tok)
-{
-    TokenType tt=tok.current().tt;
-    std::string token=tok.current().token;
-    bool cnt=0;
-    while(tok.current().tt==TokenType::NOT) {
-        consume(tok,TokenType::NOT);
-        cnt=1-cnt;
-    }
-    auto r=parseComp(tok);
-    if(cnt) {
-        r=Query::Expr::make(tt,token,r);
-    }
-    return r;
-}
- 
-/// parse the 'AND' and 'OR' expresssion
-static Query::Expr::CPtr parseBool(Tokenizer &tok)
-{
-    auto r=parseNot(tok);
-    if(!r) { return 0; }
-    Token token=tok.current();
-    while(consume_opt(tok,TokenType::AND,TokenType::OR)) {
-        auto e=parseNot(tok);
-        if(!e) { throw_error(tok); }
-        r=Query::Expr::make(token.tt,token.token,r,e);
-        token=tok.current();
-    }
-    return r;
-}
+        // the comparison is complete, which also completes those it is the right side of
+        while(ops.back().kind==Pending::RCOMP) { reduce(p); }
+        if(ops.back().kind==Pending::NOT) { reduce(p); }
 
-/// parse multiplication and division
-static Query::Expr::CPtr parseMult(Tokenizer &tok)
-{
-    auto r=parseBool(tok);
-    if(!r) { return 0; }
-    Token token=tok.current();
-    while(consume_opt(tok,TokenType::TIMES,TokenType::DIV)) {
-        auto e=parseBool(tok);
-        if(!e) { throw_error(tok); }
-        r=Query::Expr::make(token.tt,token.token,r,e);
-        token=tok.current();
-    }
-    return r;
-}
+        int prec=binaryPrec(cur.tt);
+        if(prec) {
+            while(ops.back().kind==Pending::BINARY && ops.back().prec>=prec) { reduce(p); }
+            tok.next();
+            ops.push_back(PendingOp{Pending::BINARY,prec,cur.tt,cur.token,0});
+            operand=1;
+            continue;
+        }
 
-/// parse add and subtract
-static Query::Expr::CPtr parseAdd(Tokenizer &tok)
-{
-    auto r=parseMult(tok);
-    if(!r) { return 0; }
-    Token token=tok.current();
-    while(consume_opt(tok,TokenType::PLUS,TokenType::MINUS)) {
-        auto e=parseMult(tok);
-        if(!e) { throw_error(tok); }
-        r=Query::Expr::make(token.tt,token.token,r,e);
-        token=tok.current();
+        // end of the (sub) expression
+        while(ops.back().kind==Pending::BINARY) { reduce(p); }
+        switch(ops.back().kind) {
+        case Pending::PAREN:
+            consume(tok,TokenType::P_CLOSE);
+            ops.pop_back();
+            break;
+        case Pending::FUNC:
+            {
+                auto e=ops.back().func;
+                e->push(vals.back());
+                vals.pop_back();
+                if(consume_opt(tok,TokenType::COMMA)) {
+                    operand=1;
+                    break;
+                }
+                consume(tok,TokenType::P_CLOSE);
+                vals.push_back(e);
+                ops.pop_back();
+            }
+            break;
+        default:
+            assert(ops.back().kind==Pending::BOTTOM && vals.size()==1);
+            return vals.back();
+        }
     }
-    return r;
-}
-
-/// parse an expression
-static Query::Expr::CPtr parseExpr(Tokenizer &tok)
-{
-    return parseAdd(tok);
 }
 /// this is the end of the expression parser
 
@@ -596,26 +785,26 @@ static std::vector<Token>  parseIdents(Tokenizer &tok)
 
 
 /// parse the 'select' clause, including the special 'select *'
-static void parseSelect(Query *q, Tokenizer &tok)
+static void parseSelect(Query *q, Tokenizer &tok, ExprParser &ep)
 {
     q->selectStar=1;
     if(!consume_opt(tok,TokenType::SELECT)) { return; }
     if(consume_opt(tok,TokenType::TIMES)) { return; }
     q->selectStar=0;
     do {
-        auto e=parseExpr(tok);
+        auto e=parseExpr(tok,ep);
         if(!e) { throw_error(tok); }
         Query::SelectExpr se;
-        se.expr=e;
+        se.expr=q->own(e);
         q->select.push_back(se);
     } while(consume_opt(tok,TokenType::COMMA));
 }
 
 /// parse the 'where' clause
-static void parseWhere(Query *q, Tokenizer &tok)
+static void parseWhere(Query *q, Tokenizer &tok, ExprParser &ep)
 {
     if(!consume_opt(tok,TokenType::WHERE)) { return; }
-    q->where=parseExpr(tok);
+    q->where=q->own(parseExpr(tok,ep));
 }
 
 /// parse the 'group by' clause
@@ -634,27 +823,27 @@ static void parsePivot(Query *q, Tokenizer &tok)
 }
 
 /// parse the 'order' clause
-static void parseOrder(Query *q, Tokenizer &tok)
+static void parseOrder(Query *q, Tokenizer &tok, ExprParser &ep)
 {
     if(!consume_opt(tok,TokenType::ORDER)) { return; }
     consume(tok,TokenType::BY);
     do {
-        auto e=parseExpr(tok);
+        auto e=parseExpr(tok,ep);
         if(!e) { throw_error(tok); }
         Query::OrderExpr oe;
-        oe.expr=e;
+        oe.expr=q->own(e);
         oe.desc=consume_opt(tok,TokenType::DESC);
         q->order.push_back(oe);
     } while(consume_opt(tok,TokenType::COMMA));
 
-    parseExpr(tok);
+    parseExpr(tok,ep);
 }
 
 /// parse the 'limit' clause
 static void parseLimit(Query *q, Tokenizer &tok)
 {
     if(!consume_opt(tok,TokenType::LIMIT)) { return; }
-    std::string n=tok.current().token;
+    std::string n=tok.current().token.to_string();
     consume(tok,TokenType::NUMBER);
     q->limit=std::stoull(n);
 }
@@ -664,23 +853,23 @@ static void parseLimit(Query *q, Tokenizer &tok)
 static void parseOffset(Query *q, Tokenizer &tok)
 {
     if(!consume_opt(tok,TokenType::OFFSET)) { return; }
-    std::string n=tok.current().token;
+    std::string n=tok.current().token.to_string();
     consume(tok,TokenType::NUMBER);
     q->offset=std::stoull(n);
 }
 
 /// parse the 'label' clause and match it with the 'select' expression
-static void parseLabel(Query *q, Tokenizer &tok)
+static void parseLabel(Query *q, Tokenizer &tok, ExprParser &ep)
 {
     if(!consume_opt(tok,TokenType::LABEL)) { return; }
     do {
-        auto e=parseExpr(tok);
+        auto e=parseExpr(tok,ep);
         if(!e) { throw_error(tok); }
-        std::string label=tok.current().token;
+        std::string label=tok.current().token.to_string();
         consume(tok,TokenType::STRING);
         if(q->selectStar) {
             Query::SelectExpr se;
-            se.expr=e;
+            se.expr=q->own(e);
             se.label=label;
             q->select.push_back(se);
         } else {
@@ -701,13 +890,13 @@ static void parseLabel(Query *q, Tokenizer &tok)
 }
 
 /// parse the 'format' clause and match it with the 'select' expression
-static void parseFormat(Query *q, Tokenizer &tok)
+static void parseFormat(Query *q, Tokenizer &tok, ExprParser &ep)
 {
     if(!consume_opt(tok,TokenType::FORMAT)) { return; }
     do {
-        auto e=parseExpr(tok);
+        auto e=parseExpr(tok,ep);
         if(!e) { throw_error(tok); }
-        std::string format=tok.current().token;
+        std::string format=tok.current().token.to_string();
         consume(tok,TokenType::STRING);
 
         bool found=0;
@@ -721,7 +910,7 @@ static void parseFormat(Query *q, Tokenizer &tok)
         if(!found) {
             if(q->selectStar) {
                 Query::SelectExpr se;
-                se.expr=e;
+                se.expr=q->own(e);
                 se.format=format;
                 q->select.push_back(se);
             } else {
@@ -806,7 +995,7 @@ static int32_t funcArgs(const std::string &_name)
 }
 
 /// Do some simple semantic validations for a single expressions
-static void checkSemantics(const Query *q,Query::Expr::CPtr ex)
+static void checkSemantics(const Query *q,const Query::Expr::CPtr &ex)
 {
     if(!ex) { return; }
     if(ex->sub().size()==0&&!ex->noarg()) { return; }
@@ -828,29 +1017,469 @@ static void checkSemantics(const Query *q)
     for(auto &o:q->order) { checkSemantics(q,o.expr); }
 }
 
+/// True if e compares a column with a literal, lit is set to the index of the literal
+static bool columnEquality(const Query::Expr &e,size_t &lit)
+{
+    if(e.tp()!=TokenType::EQ) { return 0; }
+    for(lit=0;lit<2;lit++) {
+        const Query::Expr &c=*e.sub()[1-lit];
+        if(c.tp()!=TokenType::IDENTIFIER||c.sub().size()>0||c.noarg()) { continue; }
+        switch(e.sub()[lit]->tp()) {
+        case TokenType::NUMBER:
+        case TokenType::STRING:
+        case TokenType::DATE:
+        case TokenType::DATETIME:
+        case TokenType::TIMEOFDAY:
+            return 1;
+        default:
+            break;
+        }
+    }
+    return 0;
+}
+
+/// Key of the IN set a comparison of a column with a literal belongs to
+static std::string inSetKey(const Query::Expr &e,size_t lit)
+{
+    return static_cast<char>(e.sub()[lit]->tp())+e.sub()[1-lit]->data();
+}
+
+/// Replace the comparisons of the same column with literals of the same type in
+/// the 'or' chain terms[first...] by a single IN_SET expression, which takes the
+/// place of the first of these comparisons.
+static void foldTerms(Query::Arena &a,std::vector<Query::Expr::CPtr> &terms,size_t first)
+{
+    struct Set { size_t n; Query::Expr::Ptr in; };
+    std::unordered_map<std::string,Set> sets;
+    size_t lit;
+    bool fold=0;
+    for(size_t i=first;i<terms.size();i++) {
+        if(columnEquality(*terms[i],lit) && ++sets[inSetKey(*terms[i],lit)].n>1) { fold=1; }
+    }
+    if(!fold) { return; }
+    size_t out=first;
+    for(size_t i=first;i<terms.size();i++) {
+        const Query::Expr &e=*terms[i];
+        if(columnEquality(e,lit)) {
+            Set &set=sets[inSetKey(e,lit)];
+            if(set.n>1 && set.in) {
+                set.in->push(e.sub()[lit]);
+                continue;
+            } else if(set.n>1) {
+                set.in=a.make(TokenType::IN_SET,"in",e.sub()[1-lit],e.sub()[lit]);
+                terms[out++]=set.in;
+                continue;
+            }
+        }
+        terms[out++]=terms[i];
+    }
+    terms.resize(out);
+}
+
+/// Walk the 'not', 'and' and 'or' chains of root without recursion, they may be
+/// very long. fold(terms,first,tt) may rewrite the operands terms[first...] of a
+/// chain of tt, it is also called for root if it is no chain. The operand stack
+/// of the parser, which is not used any more, holds the chains.
+template<typename F> static Query::Expr::CPtr rewriteChains(ExprParser &p,const Query::Expr::CPtr &root,F fold)
+{
+    // the operands of a 'not', 'and' or 'or' chain are stored in terms from first
+    // on, followed by the rewritten operands from out on
+    struct Chain { Query::Expr::CPtr e; size_t first; size_t next; size_t out; };
+    std::vector<Chain> chains;
+    std::vector<Query::Expr::CPtr> &terms=p.vals;
+    chains.reserve(8);
+    terms.clear();
+
+    auto enter=[&](const Query::Expr::CPtr &e) {
+        TokenType tt=e->tp();
+        if(tt!=TokenType::AND&&tt!=TokenType::OR&&tt!=TokenType::NOT) {
+            terms.push_back(e);
+            return;
+        }
+        size_t first=terms.size();
+        Query::Expr::CPtr c=e;
+        if(tt!=TokenType::NOT) {
+            // the parser creates left deep chains, the operands are found from the right
+            while(c->tp()==tt) {
+                terms.push_back(c->sub()[1]);
+                c=c->sub()[0];
+            }
+        }
+        terms.push_back(tt==TokenType::NOT?c->sub()[0]:c);
+        std::reverse(terms.begin()+static_cast<std::ptrdiff_t>(first),terms.end());
+        chains.push_back(Chain{e,first,first,terms.size()});
+    };
+
+    enter(root);
+    if(chains.empty()) { fold(terms,0,root->tp()); }
+    while(!chains.empty()) {
+        Chain &ch=chains.back();
+        if(ch.next<ch.out) {
+            Query::Expr::CPtr c=terms[ch.next++];
+            enter(c);
+            continue;
+        }
+        TokenType tt=ch.e->tp();
+        fold(terms,ch.out,tt);
+        bool same=terms.size()-ch.out==ch.out-ch.first;
+        for(size_t i=0;same&&ch.out+i<terms.size();i++) { same=terms[ch.out+i]==terms[ch.first+i]; }
+        Query::Expr::CPtr r=ch.e;
+        if(!same) {
+            r=terms[ch.out];
+            if(tt==TokenType::NOT) {
+                r=p.arena.make(tt,ch.e->data(),r);
+            }
+            for(size_t i=ch.out+1;i<terms.size();i++) {
+                r=p.arena.make(tt,ch.e->data(),r,terms[i]);
+            }
+        }
+        terms.resize(ch.first);
+        chains.pop_back();
+        terms.push_back(r);
+    }
+    return terms.back();
+}
+
+/// Rewrite the where clause so that the DB can use an index for long lists of
+/// alternatives: 'a=1 or a=2 or b=3 or a=4' becomes 'a in (1,2,4) or b=3'.
+static Query::Expr::CPtr foldInSets(ExprParser &p,const Query::Expr::CPtr &root)
+{
+    return rewriteChains(p,root,[&p](std::vector<Query::Expr::CPtr> &terms,size_t first,TokenType tt) {
+        if(tt==TokenType::OR) { foldTerms(p.arena,terms,first); }
+    });
+}
+
+/// true if e is an integer literal small enough that sums and products of two
+/// of them cannot overflow, its value is stored in v
+static bool intConstant(const Query::Expr &e,int64_t &v)
+{
+    if(e.tp()==TokenType::MINUS && e.sub().size()==1) {
+        if(!intConstant(*e.sub()[0],v)) { return 0; }
+        v=-v;
+        return 1;
+    }
+    const std::string &d=e.data();
+    if(e.tp()!=TokenType::NUMBER || d.empty() || d.size()>9) { return 0; }
+    v=0;
+    for(char c:d) {
+        if(c<'0'||c>'9') { return 0; }
+        v=v*10+(c-'0');
+    }
+    return 1;
+}
+
+/// Integer literal with the value v, negative values are written as '-n'
+static Query::Expr::CPtr intLiteral(Query::Arena &a,int64_t v)
+{
+    if(v<0) { return a.make(TokenType::MINUS,"-",a.make(TokenType::NUMBER,std::to_string(-v))); }
+    return a.make(TokenType::NUMBER,std::to_string(v));
+}
+
+/// 'true' or 'false'
+static Query::Expr::CPtr boolLiteral(Query::Arena &a,bool b)
+{
+    return b?a.make(TokenType::GQL_TRUE,"true"):a.make(TokenType::GQL_FALSE,"false");
+}
+
+/// Constant folding of e whose sub expressions are already simplified to sub[0...n-1],
+/// returns the replacement or 0 if e cannot be simplified.
+static Query::Expr::CPtr simplifyExpr(Query::Arena &a,const Query::Expr &e,const Query::Expr::CPtr *sub,size_t n)
+{
+    int64_t x,y;
+    TokenType tt=e.tp();
+    switch(tt) {
+    case TokenType::PLUS:
+    case TokenType::MINUS:
+    case TokenType::TIMES:
+    case TokenType::DIV:
+        if(n==1) {
+            // '-(-1)' and '+1', but '-1' is kept
+            if(!intConstant(*sub[0],x)||(tt==TokenType::MINUS&&sub[0]->tp()==TokenType::NUMBER)) { return 0; }
+            return intLiteral(a,tt==TokenType::MINUS?-x:x);
+        }
+        if(n!=2||!intConstant(*sub[0],x)||!intConstant(*sub[1],y)) { return 0; }
+        switch(tt) {
+        case TokenType::PLUS: return intLiteral(a,x+y);
+        case TokenType::MINUS: return intLiteral(a,x-y);
+        case TokenType::TIMES: return intLiteral(a,x*y);
+        default:
+            // the division of GQL is not an integer division
+            if(y==0||x%y!=0) { return 0; }
+            return intLiteral(a,x/y);
+        }
+
+    case TokenType::EQ:
+    case TokenType::NE:
+    case TokenType::LT:
+    case TokenType::LE:
+    case TokenType::GT:
+    case TokenType::GE:
+        if(intConstant(*sub[0],x)&&intConstant(*sub[1],y)) {
+            switch(tt) {
+            case TokenType::EQ: return boolLiteral(a,x==y);
+            case TokenType::NE: return boolLiteral(a,x!=y);
+            case TokenType::LT: return boolLiteral(a,x<y);
+            case TokenType::LE: return boolLiteral(a,x<=y);
+            case TokenType::GT: return boolLiteral(a,x>y);
+            default: return boolLiteral(a,x>=y);
+            }
+        }
+        // the order of different strings depends on the collation of the DB
+        if(sub[0]->tp()==TokenType::STRING&&sub[1]->tp()==TokenType::STRING&&sub[0]->data()==sub[1]->data()) {
+            return boolLiteral(a,tt==TokenType::EQ||tt==TokenType::LE||tt==TokenType::GE);
+        }
+        return 0;
+
+    case TokenType::NOT:
+        if(sub[0]->tp()==TokenType::GQL_TRUE||sub[0]->tp()==TokenType::GQL_FALSE) {
+            return boolLiteral(a,sub[0]->tp()==TokenType::GQL_FALSE);
+        }
+        if(sub[0]->tp()==TokenType::NOT) { return sub[0]->sub()[0]; }
+        return 0;
+
+    case TokenType::AND:
+    case TokenType::OR:
+        // 'x and false' is false even if x is null, 'x and true' is x
+        for(size_t i=0;i<2;i++) {
+            TokenType st=sub[i]->tp();
+            if(st!=TokenType::GQL_TRUE&&st!=TokenType::GQL_FALSE) { continue; }
+            if((st==TokenType::GQL_TRUE)==(tt==TokenType::OR)) { return sub[i]; }
+            return sub[1-i];
+        }
+        return 0;
+
+    case TokenType::IS_NULL:
+    case TokenType::IS_NOT_NULL:
+        if(isLiteral(*sub[0])) { return boolLiteral(a,tt==TokenType::IS_NOT_NULL); }
+        return 0;
+
+    default:
+        return 0;
+    }
+}
+
+/// Fold the constant parts of the where clause root: '1=1 and x>3' becomes 'x>3',
+/// 'x>10*60' becomes 'x>600'. The tree is rewritten bottom up without recursion.
+static Query::Expr::CPtr simplify(Query::Arena &a,const Query::Expr::CPtr &root)
+{
+    // the rewritten sub expressions of e are stored from first on in done
+    struct Frame { Query::Expr::CPtr e; size_t next; size_t first; };
+    std::vector<Frame> frames;
+    std::vector<Query::Expr::CPtr> done;
+    frames.push_back(Frame{root,0,0});
+    while(!frames.empty()) {
+        Frame &f=frames.back();
+        if(f.next<f.e->sub().size()) {
+            Query::Expr::CPtr c=f.e->sub()[f.next++];
+            frames.push_back(Frame{c,0,done.size()});
+            continue;
+        }
+        const Query::Expr &e=*f.e;
+        size_t n=done.size()-f.first;
+        Query::Expr::CPtr r=simplifyExpr(a,e,done.data()+f.first,n);
+        if(!r) {
+            r=f.e;
+            for(size_t i=0;i<n;i++) {
+                if(done[f.first+i]==e.sub()[i]) { continue; }
+                auto c=a.make(e.tp(),e.data());
+                for(size_t j=0;j<n;j++) { c->push(done[f.first+j]); }
+                if(e.noarg()) { c->noargSet(); }
+                r=c;
+                break;
+            }
+        }
+        done.resize(f.first);
+        frames.pop_back();
+        done.push_back(r);
+    }
+    return done.back();
+}
+
+/// Column c if e is 'f(c)', 0 otherwise
+static Query::Expr::CPtr dateArg(const Query::Expr &e,const char *f)
+{
+    if(e.tp()!=TokenType::IDENTIFIER||e.sub().size()!=1||e.data()!=f) { return 0; }
+    const Query::Expr::CPtr &c=e.sub()[0];
+    if(c->tp()!=TokenType::IDENTIFIER||c->sub().size()>0||c->noarg()) { return 0; }
+    return c;
+}
+
+//! A comparison 'f(column) op value' of a date function with a literal
+struct DateComparison {
+    Query::Expr::CPtr column;   ///< argument of the function
+    TokenType op;               ///< operator, as if the function is on the left side
+    const Query::Expr *value;   ///< the other operand
+};
+
+/// true if e compares the date function f of a column with a literal, sets dc
+static bool dateComparison(const Query::Expr &e,const char *f,DateComparison &dc)
+{
+    if(!isComparison(e.tp())) { return 0; }
+    for(size_t s=0;s<2;s++) {
+        dc.column=dateArg(*e.sub()[s],f);
+        if(!dc.column) { continue; }
+        dc.value=e.sub()[1-s].get();
+        dc.op=e.tp();
+        if(s==1) {
+            switch(dc.op) {
+            case TokenType::LT: dc.op=TokenType::GT;break;
+            case TokenType::LE: dc.op=TokenType::GE;break;
+            case TokenType::GT: dc.op=TokenType::LT;break;
+            case TokenType::GE: dc.op=TokenType::LE;break;
+            default: break;
+            }
+        }
+        return 1;
+    }
+    return 0;
+}
+
+/// yyyy-MM-dd
+static std::string isoDate(int y,int m,int d)
+{
+    char buf[16];
+    snprintf(buf,sizeof(buf),"%04d-%02d-%02d",y,m,d);
+    return buf;
+}
+
+/// number of days of month m of year y
+static int monthDays(int y,int m)
+{
+    static const int days[]={ 31,28,31,30,31,30,31,31,30,31,30,31 };
+    if(m==2&&y%4==0&&(y%100!=0||y%400==0)) { return 29; }
+    return days[m-1];
+}
+
+/// Range of a year, true if y is a year that can be written as a date literal
+static bool yearRange(int64_t y,std::string &lo,std::string &hi)
+{
+    if(y<1||y>9998) { return 0; }
+    lo=isoDate(static_cast<int>(y),1,1);
+    hi=isoDate(static_cast<int>(y)+1,1,1);
+    return 1;
+}
+
+/// Range of the day of a date literal, false if it is not a valid yyyy-MM-dd date
+static bool dayRange(const Query::Expr &e,std::string &lo,std::string &hi)
+{
+    if(e.tp()!=TokenType::DATE) { return 0; }
+    int y,m,d,n=0;
+    const std::string &s=e.sub()[0]->data();
+    if(sscanf(s.c_str(),"%4d-%2d-%2d%n",&y,&m,&d,&n)!=3||static_cast<size_t>(n)!=s.size()) { return 0; }
+    if(y<1||y>9998||m<1||m>12||d<1||d>monthDays(y,m)) { return 0; }
+    lo=isoDate(y,m,d);
+    if(++d>monthDays(y,m)) { d=1;m++; }
+    if(m>12) { m=1;y++; }
+    hi=isoDate(y,m,d);
+    return 1;
+}
+
+/// 'column>=date lo and column<date hi', an empty bound is left out
+static Query::Expr::CPtr dateRange(Query::Arena &a,const Query::Expr::CPtr &c,const std::string &lo,const std::string &hi)
+{
+    Query::Expr::CPtr l=lo.empty()?0:a.make(TokenType::GE,">=",c,a.make(TokenType::DATE,"date",a.make(TokenType::STRING,lo)));
+    Query::Expr::CPtr h=hi.empty()?0:a.make(TokenType::LT,"<",c,a.make(TokenType::DATE,"date",a.make(TokenType::STRING,hi)));
+    if(!l) { return h; }
+    if(!h) { return l; }
+    return a.make(TokenType::AND,"and",l,h);
+}
+
+/// The range predicate on the column of a comparison with the values in [lo,hi),
+/// 0 if it cannot be written as one ('!=')
+static Query::Expr::CPtr dateRange(Query::Arena &a,const DateComparison &dc,const std::string &lo,const std::string &hi)
+{
+    switch(dc.op) {
+    case TokenType::EQ: return dateRange(a,dc.column,lo,hi);
+    case TokenType::LT: return dateRange(a,dc.column,"",lo);
+    case TokenType::LE: return dateRange(a,dc.column,"",hi);
+    case TokenType::GT: return dateRange(a,dc.column,hi,"");
+    case TokenType::GE: return dateRange(a,dc.column,lo,"");
+    default: return 0;
+    }
+}
+
+/// Replace the comparisons of year() and toDate() of a column with constants in
+/// terms[first...] by ranges of the column, which the DB can find with an index.
+/// In 'and' chains 'year(c)=Y and month(c)=M' becomes the range of the month.
+static void dateRanges(Query::Arena &a,std::vector<Query::Expr::CPtr> &terms,size_t first,TokenType tt)
+{
+    DateComparison y,m;
+    int64_t yv,mv;
+    std::string lo,hi;
+    // the bounds of a range are operands of an 'and' chain
+    auto put=[&terms,tt](size_t i,const Query::Expr::CPtr &r) {
+        if(tt!=TokenType::AND||r->tp()!=TokenType::AND) {
+            terms[i]=r;
+            return;
+        }
+        terms[i]=r->sub()[0];
+        terms.insert(terms.begin()+static_cast<std::ptrdiff_t>(i+1),r->sub()[1]);
+    };
+    for(size_t i=first;tt==TokenType::AND&&i<terms.size();i++) {
+        if(!dateComparison(*terms[i],"month",m)||m.op!=TokenType::EQ||!intConstant(*m.value,mv)||mv<1||mv>12) { continue; }
+        for(size_t j=first;j<terms.size();j++) {
+            if(!dateComparison(*terms[j],"year",y)||y.op!=TokenType::EQ||y.column->data()!=m.column->data()
+               ||!intConstant(*y.value,yv)||!yearRange(yv,lo,hi)) {
+                continue;
+            }
+            int yi=static_cast<int>(yv);
+            int mi=static_cast<int>(mv);
+            terms.erase(terms.begin()+static_cast<std::ptrdiff_t>(i--));
+            if(j>i) { j--; }
+            put(j,dateRange(a,y.column,isoDate(yi,mi,1),mi==12?isoDate(yi+1,1,1):isoDate(yi,mi+1,1)));
+            break;
+        }
+    }
+    for(size_t i=first;i<terms.size();i++) {
+        Query::Expr::CPtr r=0;
+        if(dateComparison(*terms[i],"year",y)&&intConstant(*y.value,yv)&&yearRange(yv,lo,hi)) {
+            r=dateRange(a,y,lo,hi);
+        } else if(dateComparison(*terms[i],"toDate",y)&&dayRange(*y.value,lo,hi)) {
+            r=dateRange(a,y,lo,hi);
+        }
+        if(r) { put(i,r); }
+    }
+}
+
 /// Parse a GQL string and return a query object with the result.
-Query::CPtr Query::parse(const std::string &_query, bool _extendedFunctions)
+Query::CPtr Query::parse(const std::string &_query, bool _extendedFunctions, bool _dateRanges)
 {
-    Query *q=new Query();
+    // owned right away, the query and its arena are freed on syntax errors
+    std::shared_ptr<Query> owner(new Query());
+    Query *q=owner.get();
     q->extendedFunctions=_extendedFunctions;
-    Tokenizer tok(_query);
+    q->text_=_query;
+    Tokenizer tok(q->text_);
     tok.next();
+    ExprParser ep(q->arena());
 
-    parseSelect(q,tok);
-    parseWhere(q,tok);
+    parseSelect(q,tok,ep);
+    parseWhere(q,tok,ep);
     parseGroupBy(q,tok);
     parsePivot(q,tok);
-    parseOrder(q,tok);
+    parseOrder(q,tok,ep);
     parseLimit(q,tok);
     parseOffset(q,tok);
-    parseLabel(q,tok);
-    parseFormat(q,tok);
+    parseLabel(q,tok,ep);
+    parseFormat(q,tok,ep);
     parseOptions(q,tok);
 
     if(tok.current().tt!=TokenType::EOL) { throw_error(tok,"the end of statement"); }
     checkSemantics(q);
+    // only the where clause is folded, the select expressions name the columns
+    if(q->where&&ep.constants>0) {
+        q->where=simplify(q->arena(),q->where);
+        q->where=q->where->tp()==TokenType::GQL_TRUE?0:q->own(q->where);
+    }
+    if(q->where&&_dateRanges&&ep.dateFunctions>0) {
+        q->where=q->own(rewriteChains(ep,q->where,[q](std::vector<Query::Expr::CPtr> &terms,size_t first,TokenType tt) {
+            dateRanges(q->arena(),terms,first,tt);
+        }));
+    }
+    // an IN set needs at least two comparisons
+    if(q->where&&ep.equalities>1) { q->where=q->own(foldInSets(ep,q->where)); }
 
-    return std::shared_ptr<Query>(q);
+    return owner;
 }
 
 bool Query::isAggFunc(const std::string &_name)
@@ -862,7 +1491,7 @@ bool Query::isAggFunc(const std::string &_name)
 /// quote identifiers if needed (for GQL output)
 static std::string quoteIdent(const std::string &s)
 {
-    bool needQuote=s.size()==0||keyword.count(s)>0||(s[0]>='0'&&s[0]<='9');
+    bool needQuote=s.size()==0||keywordFind(s).tt!=TokenType::_UNDEFINED||(s[0]>='0'&&s[0]<='9');
     if(!needQuote) {
         for(auto c:s) {
             needQuote=!((c>='a'&&c<='z')||(c>='A'&&c<='Z')||(c>='0'&&c<='9')||c=='_');
@@ -906,7 +1535,7 @@ std::string Query::to_string() const
         for(auto i:group) {
             if(!first) { r+=","; }
             first=0;
-            r+=" "+quoteIdent(i.token);
+            r+=" "+quoteIdent(i.token.to_string());
         }
     }
     if(pivot.size()>0) {
@@ -915,7 +1544,7 @@ std::string Query::to_string() const
         for(auto i:pivot) {
             if(!first) { r+=","; }
             first=0;
-            r+=" "+quoteIdent(i.token);
+            r+=" "+quoteIdent(i.token.to_string());
         }
     }
     if(order.size()>0) {
@@ -965,18 +1594,20 @@ std::string Query::to_string() const
     return r;
 }
 
-/// return expression in GQL syntax as a string
-std::string Query::Expr::to_string(bool parens) const
+/// Write one expression in GQL syntax, see Query::Expr::to_string()
+static void gqlExpr(const Query::Expr &e,ExprWriter &w)
 {
-    std::string r;
-    switch(tp()) {
+    bool parens=!(w.flags()&ExprWriter::NO_PARENS);
+    switch(e.tp()) {
     case GQLParser::TokenType::PLUS:
     case GQLParser::TokenType::MINUS:
-        if(sub().size()==1) {
-            if(tp()==GQLParser::TokenType::PLUS) {
-                r+=sub()[0]->to_string();
+        if(e.sub().size()==1) {
+            if(e.tp()==GQLParser::TokenType::PLUS) {
+                w.sub(e.sub()[0]);
             } else {
-                r+="(-"+sub()[0]->to_string()+")";
+                w.text("(-");
+                w.sub(e.sub()[0]);
+                w.text(")");
             }
             break;
         }
@@ -989,41 +1620,63 @@ std::string Query::Expr::to_string(bool parens) const
     case GQLParser::TokenType::GE:
     case GQLParser::TokenType::EQ:
     case GQLParser::TokenType::NE:
-        assert(sub().size()==2);
-        if(parens) { r+="("; }
-        r+=(sub()[0]->to_string())+data()+(sub()[1]->to_string());
-        if(parens) { r+=")"; }
+        assert(e.sub().size()==2);
+        if(parens) { w.text("("); }
+        w.sub(e.sub()[0]);
+        w.text(e.data());
+        w.sub(e.sub()[1]);
+        if(parens) { w.text(")"); }
         break;
     case GQLParser::TokenType::AND:
     case GQLParser::TokenType::OR:
-        if(parens) { r+="("; }
-        assert(sub().size()==2);
-        r+=(sub()[0]->to_string())+" "+data()+" "+(sub()[1]->to_string());
-        if(parens) { r+=")"; }
+        if(parens) { w.text("("); }
+        assert(e.sub().size()==2);
+        w.sub(e.sub()[0]);
+        w.text(" ");
+        w.text(e.data());
+        w.text(" ");
+        w.sub(e.sub()[1]);
+        if(parens) { w.text(")"); }
+        break;
+    case GQLParser::TokenType::IN_SET:
+        // GQL has no 'in', write the 'or' chain it was created from
+        if(parens) { w.text("("); }
+        for(size_t i=1;i<e.sub().size();i++) {
+            if(i>1) { w.text(" or "); }
+            w.text("(");
+            w.sub(e.sub()[0]);
+            w.text("=");
+            w.sub(e.sub()[i]);
+            w.text(")");
+        }
+        if(parens) { w.text(")"); }
         break;
     case GQLParser::TokenType::NOT:
-        assert(sub().size()==1);
-        if(parens) { r+="("; }
-        r+="not "+(sub()[0]->to_string());
-        if(parens) { r+=")"; }
+        assert(e.sub().size()==1);
+        if(parens) { w.text("("); }
+        w.text("not ");
+        w.sub(e.sub()[0]);
+        if(parens) { w.text(")"); }
         break;
     case GQLParser::TokenType::NUMBER:
-        r=data();
+        w.text(e.data());
         break;
     case GQLParser::TokenType::STRING:
-        r=quoteString(data());
+        w.text(quoteString(e.data()));
         break;
 
     case GQLParser::TokenType::DATE:
     case GQLParser::TokenType::TIMEOFDAY:
     case GQLParser::TokenType::DATETIME:
-        assert(sub().size()==1);
-        r+=data()+" "+sub()[0]->to_string();
+        assert(e.sub().size()==1);
+        w.text(e.data());
+        w.text(" ");
+        w.sub(e.sub()[0]);
         break;
 
     case GQLParser::TokenType::_UNDEFINED:
     case GQLParser::TokenType::EOL:
-        LOG(FATAL) << "unsuable token type " << tp();
+        LOG(FATAL) << "unsuable token type " << e.tp();
 
     case GQLParser::TokenType::ERROR:
     case GQLParser::TokenType::ASC:
@@ -1053,22 +1706,27 @@ std::string Query::Expr::to_string(bool parens) const
     case GQLParser::TokenType::CONTAINS:
     case GQLParser::TokenType::MATCHES:
     case GQLParser::TokenType::LIKE:
-        r=quoteIdent(data());
-        if(sub().size()==0 && !noarg()) {
+        w.text(quoteIdent(e.data()));
+        if(e.sub().size()==0 && !e.noarg()) {
         } else {
-            r+="(";
+            w.text("(");
             int first=1;
-            for(auto e:sub()) {
-                if(!first) { r+=", "; }
+            for(const auto &c:e.sub()) {
+                if(!first) { w.text(", "); }
                 first=0;
-                r+=e->to_string(0);
-            }
-            if(r[r.size()-1]==' ') {
-                r=r.substr(0,r.length()-1);
+                w.sub(c,ExprWriter::NO_PARENS);
             }
-            r+=")";
+            w.text(")");
         }
     }
+}
+
+/// return expression in GQL syntax as a string
+std::string Query::Expr::to_string(bool parens) const
+{
+    std::string r;
+    ExprWriter w(r);
+    w.run(*this,gqlExpr,parens?0:ExprWriter::NO_PARENS);
     return r;
 }
 
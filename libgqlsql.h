@@ -24,16 +24,30 @@
 #ifndef _LIBGQLSQL_H_
 #define _LIBGQLSQL_H_
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <exception>
+#include <functional>
+#include <future>
+#include <list>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
+#include <boost/utility/string_view.hpp>
 #include <jsoncpp/json/json.h>
 #include <mysql++/mysql++.h>
 #include <pqxx/pqxx>
+#include <sqlite3.h>
 
 #include "libs/uriparser2/uriparser2.h"
 
@@ -69,7 +83,8 @@ namespace GQL_SQL {
         INTERNAL_ERROR=8,               ///< not used
         NOT_SUPPORTED=9,                ///< not used
         ILLEGAL_FORMATTING_PATTERNS=10, ///< Returned if a formatting patterns cannot be parsed
-        OTHER=11,                       ///< not used
+        OTHER=11,                       ///< Returned if a query was cancelled, timed out or
+                                        ///< its result exceeded the row or memory limit
     };
     
     //! convert ErrorReasons enum to string for printing and debugging
@@ -115,6 +130,24 @@ namespace GQL_SQL {
     };
 
 
+    //! Type of a literal passed as a query parameter
+    /** ARRAY is a PostgreSQL array literal holding the values of an IN set */
+    enum class ParamType { STRING, NUMBER, DATE, DATETIME, TIMEOFDAY, ARRAY };
+
+    //! A literal of the where clause that is passed to the DB separately
+    //! instead of being part of the SQL query string (see Parser::parameterizeSet())
+    struct Param {
+        ParamType type;     ///< type of the literal
+        std::string value;  ///< value as written in the GQL query, without quotes
+    };
+
+    typedef std::map<std::string,std::string> TableSchema;
+    ///< Column types of a table as reported by the DB, by column name
+    typedef std::map<std::string,TableSchema> Schema;
+    ///< Schemas of the tables that may be queried, by table name
+
+    namespace GQLParser { class Query; }
+
     //! Result of parsing the query and all the information required to execute it
     struct Result {
         std::string target;      ///< Target SQL engine
@@ -124,6 +157,8 @@ namespace GQL_SQL {
         std::string errormsg;    ///< if the status is not Stats::OK contains an error message
         int errorpos=0;          ///< pointer to the error position in the original query
         std::vector<Column> cols;///< Description of every column of the result
+        std::vector<Param> params;///< Values for the placeholders in result, in order
+        std::shared_ptr<const GQLParser::Query> query; ///< the parsed query
     };
 
     std::ostream& operator<<(std::ostream& outs, const Result &);
@@ -131,6 +166,9 @@ namespace GQL_SQL {
 
     //! Data structures used for parsing GQL strings
     namespace GQLParser {
+        typedef boost::string_view StringView;
+        ///< non owning reference to (a part of) a string, used for tokens
+
         //! List of aggregate functions
         enum class AggFunction { AVG, COUNT, MAX, MIN, SUM };
 
@@ -174,7 +212,11 @@ namespace GQL_SQL {
             COMMA,
 
             // non keywords
-            IS_NULL,IS_NOT_NULL,STARTS,ENDS,CONTAINS,MATCHES,LIKE
+            IS_NULL,IS_NOT_NULL,STARTS,ENDS,CONTAINS,MATCHES,LIKE,
+
+            // created by rewriting the where clause, the first sub expression is
+            // a column, the others are literals of the same type it is compared to
+            IN_SET
         };
 
         //! Exception thrown when there is a problem parsing a string
@@ -202,7 +244,7 @@ namespace GQL_SQL {
             public:
                 Token()=default;
                 ///< default noargs constructor
-                Token(size_t _pos,TokenType _tt,std::string _token="") noexcept : pos(_pos),tt(_tt), token(_token) { }
+                Token(size_t _pos,TokenType _tt,StringView _token=StringView()) noexcept : pos(_pos),tt(_tt), token(_token) { }
                 ///< construct token with string position, type and string
 
                 //! return true if this is either a string, number or boolean literal
@@ -227,7 +269,8 @@ namespace GQL_SQL {
 
                 size_t pos=0;                      ///< position (character) of this token in the query string
                 TokenType tt=TokenType::_UNDEFINED;///< token type (see enum TokenType)
-                std::string token;                 ///< original string for this token.
+                StringView token;                  ///< original string for this token, refers to the query string
+                                                   ///< (keywords refer to their lower case spelling)
         };
         std::ostream& operator<<(std::ostream& outs, const Token &);
         ///< pretty print Token
@@ -235,8 +278,9 @@ namespace GQL_SQL {
         //! Tokenizer class splits up a query string into tokens
         class Tokenizer {
             public:
-                Tokenizer(std::string _str) noexcept : str_(_str) { }
-                ///< Start tokenizer with the given query string 
+                Tokenizer(StringView _str) noexcept : str_(_str) { }
+                ///< Start tokenizer with the given query string. The string is not copied,
+                ///< it must outlive the tokenizer and the tokens it returns.
                 
                 Token next();
                 ///< Return the next token.
@@ -245,7 +289,7 @@ namespace GQL_SQL {
                 ///< Return the current token
 
             private:
-                std::string nexti();
+                StringView nexti();
                 ///< Returns the next token that starts at pos_, ignores any initial white space.
                 ///< Returns an emtpy string for EOT
 
@@ -253,7 +297,7 @@ namespace GQL_SQL {
                 ///< Get the next token and convert it to an actual Token.
                 ///< Helper function for next().
 
-                std::string str_;
+                StringView str_;
                 ///< String to parse
                 unsigned int pos_=0;
                 ///< Current position in the string, updated during parsing
@@ -270,6 +314,8 @@ namespace GQL_SQL {
                 typedef std::shared_ptr<const Query> CPtr;
                 ///< shared pointer for the Query class, for const ptr
 
+                class Arena;
+
                 //! This recursive class describes the AST of an expression.
                 /** Used for select expression, order and where clause */
                 class Expr final {
@@ -279,14 +325,35 @@ namespace GQL_SQL {
                         typedef std::shared_ptr<const Expr> CPtr;
                         ///< shared pointer for the Expr class, for const ptr
 
+                        //! Read only view of the sub expressions of an expression
+                        class Span {
+                            public:
+                                Span(const CPtr *_b,size_t _n) : b_(_b), n_(_n) { }
+                                ///< view of _n expressions starting at _b
+                                inline const CPtr *begin() const { return b_; }
+                                ///< first sub expression
+                                inline const CPtr *end() const { return b_+n_; }
+                                ///< end of the sub expressions
+                                inline size_t size() const { return n_; }
+                                ///< number of sub expressions
+                                inline bool empty() const { return n_==0; }
+                                ///< true if there are no sub expressions
+                                inline const CPtr &operator[](size_t i) const { return b_[i]; }
+                                ///< sub expression i
+                            private:
+                                const CPtr *b_;  ///< first sub expression
+                                size_t n_;       ///< number of sub expressions
+                        };
+
                         //! Create expression with up to two sub expressions.
-                        static inline Ptr make(TokenType _tp,const std::string &_data="",
+                        static inline Ptr make(TokenType _tp,StringView _data=StringView(),
                                  const std::shared_ptr<const Expr> _ex1=0,
                                  const std::shared_ptr<const Expr> _ex2=0) 
-                                        { return Ptr(new Expr(_tp,_data,_ex1,_ex2)); }
+                                        { return Ptr(new Expr(0,_tp,_data,_ex1,_ex2)); }
                                 // make_shared requires a public constructor, so cannot
                                 // be used here. However, this enforces that all Expr
-                                // objects are created correctly.
+                                // objects are created correctly. The parser creates
+                                // the expressions in the Arena of the query instead.
 
                         inline TokenType tp() const { return tp_; }
                         ///< Accessor for TokenType for this expression
@@ -297,10 +364,11 @@ namespace GQL_SQL {
 
                         inline void noargSet() { noarg_=1; }
                         ///< mark this expression as an identifier, i.e. not a function with no args
-                        inline void push(std::shared_ptr<const Expr> e) { if(e) { sub_.push_back(e); } }
+                        void push(std::shared_ptr<const Expr> e);
                         ///< add an additional sub expression
-                        inline const std::vector<std::shared_ptr<const Expr>> &sub() const { return sub_; }
-                        ///< access the list of sub expressions
+                        inline Span sub() const { return Span(more_.empty()?in_:more_.data(),n_); }
+                        ///< access the list of sub expressions. Sub expressions of expressions
+                        ///< in an Arena do not own it and are valid as long as the Arena is.
 
                         bool operator==(const Expr &other) const;
                         ///< Returns true if both expressions are exactly the same
@@ -310,19 +378,60 @@ namespace GQL_SQL {
                         ///< Stringify the expression (returns a valid gql expression)
                     private:
                         //! Create expression with up to two sub expressions.
-                        Expr(TokenType _tp,const std::string &_data="",
+                        Expr(const Arena *_arena,TokenType _tp,StringView _data=StringView(),
                              const std::shared_ptr<const Expr> _ex1=0,
                              const std::shared_ptr<const Expr> _ex2=0) 
-                                    : tp_(_tp), data_(_data) { push(_ex1);push(_ex2); }
+                                    : tp_(_tp), data_(_data.data(),_data.size()), arena_(_arena) { push(_ex1);push(_ex2); }
+                        friend class Arena;
 
                     protected:
                         TokenType tp_;     ///< TokenType that describes this expression
                         std::string data_; ///< string to describe this expression (function name, literal, identifier, operator)
                         bool noarg_=0;     ///< 1 for function calls with no args as opposed to identifier that
                                            ///< that are not functions 
-                        std::vector<std::shared_ptr<const Expr>> sub_;
-                                           ///< ordered list of sub expressions
+                        const Arena *arena_;
+                                           ///< arena holding this expression, 0 if allocated on its own
+                        uint32_t n_=0;     ///< number of sub expressions
+                        CPtr in_[2];       ///< the first two sub expressions, unless more_ is used
+                        std::vector<CPtr> more_;
+                                           ///< all sub expressions if there are more than two
+
+                };
+
+                //! Storage for the expressions of a query
+                /** Expressions are placed in blocks of consecutive memory and freed
+                 *  together with the arena. The pointers returned by make() and the sub
+                 *  expressions of an expression in an arena do not own it, so copying
+                 *  them does not touch any reference count. Query keeps the arena alive
+                 *  for the expressions it holds. */
+                class Arena final {
+                    public:
+                        Arena()=default;
+                        ///< create an empty arena
+                        Arena(const Arena &)=delete;
+                        ///< expressions point into the arena, it cannot be copied
+                        Arena &operator=(const Arena &)=delete;
+                        ///< expressions point into the arena, it cannot be copied
+                        ~Arena();
+                        ///< destroy all expressions of the arena
+
+                        Expr::Ptr make(TokenType _tp,StringView _data=StringView(),
+                                       const Expr::CPtr &_ex1=0,const Expr::CPtr &_ex2=0);
+                        ///< Create an expression in the arena, see Expr::make()
+                        inline bool holds(const Expr *e) const { return e && e->arena_==this; }
+                        ///< true if e was created by this arena
+                        inline size_t size() const { return size_; }
+                        ///< number of expressions in the arena
 
+                    private:
+                        static const size_t BLOCK=32;
+                        ///< number of expressions per block
+                        typedef std::aligned_storage<sizeof(Expr),alignof(Expr)>::type Slot;
+                        ///< uninitialized memory for one expression
+                        std::vector<std::unique_ptr<Slot[]>> blocks_;
+                        ///< the memory of the expressions
+                        size_t size_=0;
+                        ///< number of expressions created
                 };
 
                 //! Describes a single select expression
@@ -361,6 +470,8 @@ namespace GQL_SQL {
                 ///< with the expression being the ID of the column
                 Expr::CPtr where=0;
                 ///< The where expression or nullptr if there is none
+                inline bool filtersAll() const { return where && where->tp()==TokenType::GQL_FALSE; }
+                ///< returns true if the where clause is always false after constant folding
                 std::vector<Token> group;
                 ///< List of 'group by' identifier (columns)
                 std::vector<Token> pivot;
@@ -391,16 +502,33 @@ namespace GQL_SQL {
                  * @param _query   valid GQL query
                  * @param _extendedFunctions whether or not to allow non GQL functions
                  *                           to be passed to the SQL engine.
+                 * @param _dateRanges replace 'year(c)=2023' and similar comparisons
+                 *                    in the where clause by ranges of the column c,
+                 *                    so that the DB can use an index of c
                  * Note that this returns a const pointer and non of the attributes
                  * are expected to be changed.
                  */
-                static CPtr parse(const std::string &_query,bool _extendedFunctions=0);
+                static CPtr parse(const std::string &_query,bool _extendedFunctions=0,bool _dateRanges=1);
 
                 std::string to_string() const;
                 ///< returna GQL conforming string of the query
+
+                inline Arena &arena() { return *arena_; }
+                ///< Arena for the expressions of this query
+                Expr::CPtr own(const Expr::CPtr &e) const;
+                ///< Returns a pointer to e that keeps the arena of this query alive, used
+                ///< for the expressions stored in the query
+                Query(const Query &)=delete;
+                ///< the group and pivot tokens refer to text_, a query cannot be copied
+                Query &operator=(const Query &)=delete;
+                ///< the group and pivot tokens refer to text_, a query cannot be copied
             private:
-                Query() { }
+                Query() : arena_(std::make_shared<Arena>()) { }
                 ///< Constructor, hidden, only way to create an object is via parse()
+                std::shared_ptr<Arena> arena_;
+                ///< holds all expressions created while parsing
+                std::string text_;
+                ///< copy of the parsed query string, tokens stored in the query refer to it
         };
 
 
@@ -409,6 +537,96 @@ namespace GQL_SQL {
         std::ostream& operator<<(std::ostream& outs, const Query::Expr &);
         ///< Pretty print an expression
 
+        //! Writes an expression tree into a single string without recursion
+        /** The tree is walked with an explicit stack, so very deep trees (for example
+         *  thousands of OR'ed terms) neither exhaust the call stack nor copy partial
+         *  results around. run() calls emit(expr,writer) for every expression written,
+         *  which describes its output with text() and sub() calls in output order. */
+        class ExprWriter final {
+            public:
+                explicit ExprWriter(std::string &_out) : out_(_out) { }
+                ///< append the output to _out
+
+                static constexpr unsigned NO_PARENS=1;
+                ///< flag for sub(): write the expression without the enclosing parentheses
+                static constexpr unsigned PATTERN_PREFIX=2;
+                ///< flag for sub(): write a string literal as the pattern (LIKE or GLOB,
+                ///< depending on the target) of the strings starting with it
+                static constexpr unsigned PATTERN_SUFFIX=4;
+                ///< flag for sub(): as PATTERN_PREFIX for the strings ending with the
+                ///< literal, both flags together match the strings containing it
+
+                template<typename F> void run(const Query::Expr &e,F emit,unsigned _flags=0);
+                ///< write e, emit is called as emit(const Query::Expr &,ExprWriter &)
+
+                inline void text(const char *s) {
+                    if(queue_) { stack_.push_back(Piece{0,0,s,std::string()}); } else { out_+=s; }
+                }
+                ///< write a string constant
+                inline void text(StringView s) {
+                    if(queue_) { stack_.push_back(Piece{0,0,0,s.to_string()}); } else { out_.append(s.data(),s.size()); }
+                }
+                ///< write a string, it is copied if it cannot be written right away
+                inline void text(const std::string &s) { text(StringView(s)); }
+                ///< write a string, it is copied if it cannot be written right away
+                inline void sub(const Query::Expr::CPtr &e,unsigned _flags=0) {
+                    if(stack_.capacity()==0) { stack_.reserve(16); }
+                    queue_=1;
+                    stack_.push_back(Piece{e.get(),_flags,0,std::string()});
+                }
+                ///< write the expression e (usually a sub expression) at this place
+                inline unsigned flags() const { return flags_; }
+                ///< flags passed to sub() for the expression being written
+
+            private:
+                //! Part of the output that is still to be written
+                struct Piece {
+                    const Query::Expr *expr; ///< expression to write or 0 for text
+                    unsigned flags;          ///< flags for expr
+                    const char *lit;         ///< string constant to write
+                    std::string str;         ///< string to write if lit and expr are 0
+                };
+                std::string &out_;
+                ///< output string
+                std::vector<Piece> stack_;
+                ///< pieces still to be written, the last one is next
+                bool queue_=0;
+                ///< true once the current expression used sub(), text is queued from then on
+                unsigned flags_=0;
+                ///< flags of the current expression
+
+                template<typename F> void visit(const Query::Expr &e,unsigned _flags,F &emit);
+                ///< call emit for e and put the pieces it queued on the stack
+        };
+
+        template<typename F> void ExprWriter::visit(const Query::Expr &e,unsigned _flags,F &emit)
+        {
+            size_t first=stack_.size();
+            queue_=0;
+            flags_=_flags;
+            emit(e,*this);
+            queue_=0;
+            // queued in output order, but the stack is written from the end
+            std::reverse(stack_.begin()+static_cast<std::ptrdiff_t>(first),stack_.end());
+        }
+
+        template<typename F> void ExprWriter::run(const Query::Expr &e,F emit,unsigned _flags)
+        {
+            size_t base=stack_.size();
+            visit(e,_flags,emit);
+            while(stack_.size()>base) {
+                Piece p=std::move(stack_.back());
+                stack_.pop_back();
+                if(p.expr) {
+                    visit(*p.expr,p.flags,emit);
+                } else if(p.lit) {
+                    out_+=p.lit;
+                } else {
+                    out_+=p.str;
+                }
+            }
+        }
+
         //! Class that does all the parsing of a GQL string
         /** derived classes then convert the parsed data to the required string for
          * the chosen DB backend */
@@ -443,8 +661,32 @@ namespace GQL_SQL {
                 ///< Returns the result of the parsing
                 inline const Query::CPtr query() const { return query_; }
                 ///< Returns the query after parsing the data, in the form of an object tree
+                inline void parameterizeSet(bool _v) { parameterize_=_v; }
+                ///< If set, literals in the where clause are replaced by placeholders
+                ///< and returned in Result::params, so the SQL query only depends on
+                ///< the shape of the GQL query and can be prepared once by the DB.
+                ///< Only supported by targets that can bind parameters.
+                inline bool parameterize() const { return parameterize_; }
+                ///< Query if literals are replaced by placeholders
+                inline void timeoutSet(uint32_t _ms) { timeout_=_ms; }
+                ///< Maximum run time in milliseconds hinted to the DB in the SQL query,
+                ///< 0 for no limit. Only used by targets with per statement hints (MySQL).
+                inline uint32_t timeout() const { return timeout_; }
+                ///< Query the run time hint
+                inline void maxRowsSet(uint64_t _n) { maxRows_=_n; }
+                ///< The DB returns at most _n+1 rows (one more to detect that the result
+                ///< is too large), 0 for no limit. See DB::maxRowsSet().
+                inline uint64_t maxRows() const { return maxRows_; }
+                ///< Query the maximum number of rows
+                void schemaSet(const Schema &_schema);
+                ///< Set the columns of the tables. Queries using a column that does
+                ///< not exist in one of those tables fail during parsing without
+                ///< reaching the DB. Tables not in the schema are not checked.
                 virtual std::string target() const=0;
                 ///< Return a string describing the target for this parser/translator
+                virtual bool dateRanges() const { return true; }
+                ///< Return true if comparisons of date functions with constants are
+                ///< replaced by ranges of the column, see Query::parse()
 
 
             protected:
@@ -462,6 +704,17 @@ namespace GQL_SQL {
                 bool extendedFunctions_=0;
                 ///< Allow function names that are not defined in the GQL spec
                 ///< and pass them through to the underlying SQL engine.
+                bool parameterize_=false;
+                ///< Replace literals of the where clause by placeholders
+                uint32_t timeout_=0;
+                ///< run time hint in milliseconds, see timeoutSet()
+                uint64_t maxRows_=0;
+                ///< maximum number of rows, see maxRowsSet()
+                uint64_t sqlLimit() const;
+                ///< LIMIT of the SQL query, 0 for none: the GQL limit (except for pivot
+                ///< queries, see DB::pivotTable()) lowered to maxRows_+1
+                std::map<std::string,std::set<std::string>> columns_;
+                ///< lower case column names of each table set with schemaSet()
                 Result res_;
                 ///< Result of the parsing, contains the SQL query for the selected target
 
@@ -469,6 +722,10 @@ namespace GQL_SQL {
                 virtual void createResult() = 0;
                 ///< Create the SQL string for the requested target. Overwritten by
                 ///< derived classes
+                void checkColumns() const;
+                ///< Throw an error if the query uses a column not in the schema
+                void checkColumn(const std::string &id) const;
+                ///< Throw an error if id is not a column of the schema
         };
 
         //! Returns a GQL string from a GQl query. This is only really useful for testing.
@@ -479,6 +736,8 @@ namespace GQL_SQL {
                 ///< Inherit constructor
                 virtual std::string target() const override;
                 ///< return the target as a human reabable string
+                virtual bool dateRanges() const override { return false; }
+                ///< GQL does not compare dates with datetimes, the query is kept as is
                 virtual ~ParserGQL() override;
             private:
                 virtual void createResult() override;
@@ -511,6 +770,32 @@ namespace GQL_SQL {
                 ///< Create the SQL query for the PostgreSQL DB
         };
 
+        //! Returs a valid SQLite query from a GQL query given the various options
+        class ParserSQLite final : public Parser {
+            public:
+                using Parser::Parser;
+                ///< Inherit constructor
+                virtual std::string target() const override;
+                ///< return the target as a human reabable string
+                virtual ~ParserSQLite() override;
+            private:
+                virtual void createResult() override;
+                ///< Create the SQL query for SQLite
+        };
+
+        //! Returs a valid DuckDB query from a GQL query given the various options
+        class ParserDuckDB final : public Parser {
+            public:
+                using Parser::Parser;
+                ///< Inherit constructor
+                virtual std::string target() const override;
+                ///< return the target as a human reabable string
+                virtual ~ParserDuckDB() override;
+            private:
+                virtual void createResult() override;
+                ///< Create the SQL query for DuckDB
+        };
+
     }
 
 
@@ -525,6 +810,90 @@ namespace GQL_SQL {
         ///< value that gets the icu gregorian calendar to return 0001/01/01 00:00:00
         ///< (cannot go lower than that).
 
+        //! Counters of a StatementCache
+        struct StatementCacheStats {
+            uint64_t hits=0;        ///< statements found in the cache
+            uint64_t misses=0;      ///< statements that had to be prepared
+            uint64_t evictions=0;   ///< least recently used statements dropped
+            uint64_t reprepares=0;  ///< statements prepared again because the DB lost them
+            inline double hitRate() const {
+                return hits+misses?static_cast<double>(hits)/static_cast<double>(hits+misses):0.0;
+            }
+            ///< fraction of lookups that found a prepared statement
+        };
+
+        //! LRU cache of the prepared statements of one connection, indexed by the SQL query
+        /** H is the statement handle (its name or a pointer). Statements evicted to
+         *  stay within the capacity are passed to the release function so they
+         *  can be freed by the DB. */
+        template<typename H> class StatementCache {
+            public:
+                typedef std::function<void(const H &)> Release;
+                ///< function to free an evicted statement
+
+                StatementCache(size_t _capacity=64,Release _release=Release()) :
+                    capacity_(_capacity>0?_capacity:1), release_(_release) { }
+                ///< Create a cache for up to _capacity statements (at least 1)
+
+                const H *find(const std::string &sql) {
+                    auto i=index_.find(sql);
+                    if(i==index_.end()) { stats_.misses++; return 0; }
+                    stats_.hits++;
+                    lru_.splice(lru_.begin(),lru_,i->second);
+                    return &i->second->second;
+                }
+                ///< Return the statement for sql and mark it as most recently
+                ///< used, or 0 if it has to be prepared.
+                void insert(const std::string &sql,const H &h) {
+                    lru_.emplace_front(sql,h);
+                    index_[sql]=lru_.begin();
+                    while(lru_.size()>capacity_) {
+                        if(release_) { release_(lru_.back().second); }
+                        index_.erase(lru_.back().first);
+                        lru_.pop_back();
+                        stats_.evictions++;
+                    }
+                }
+                ///< Add a newly prepared statement, sql must not be in the cache
+                void lost(const std::string &sql) {
+                    auto i=index_.find(sql);
+                    if(i==index_.end()) { return; }
+                    lru_.erase(i->second);
+                    index_.erase(i);
+                    stats_.reprepares++;
+                }
+                ///< Remove a statement the DB no longer knows (e.g. after a reconnect)
+                ///< without releasing it, it is going to be prepared again.
+                void clear(bool release) {
+                    if(release && release_) {
+                        for(const auto &e:lru_) { release_(e.second); }
+                    }
+                    lru_.clear();
+                    index_.clear();
+                }
+                ///< Remove all statements, and release them if requested
+                inline size_t size() const { return lru_.size(); }
+                ///< number of cached statements
+                inline size_t capacity() const { return capacity_; }
+                ///< maximum number of cached statements
+                inline const StatementCacheStats &stats() const { return stats_; }
+                ///< hit/miss/eviction counters since the cache was created
+
+            private:
+                typedef std::list<std::pair<std::string,H>> List;
+                ///< statements, most recently used first
+                List lru_;
+                ///< statements, most recently used first
+                std::unordered_map<std::string,typename List::iterator> index_;
+                ///< position of each statement in lru_
+                size_t capacity_;
+                ///< maximum number of statements
+                Release release_;
+                ///< function to free evicted statements
+                StatementCacheStats stats_;
+                ///< usage counters
+        };
+
         //! Base class to connect to an SQL DB and run a GQL query
         class DB {
             public:
@@ -547,6 +916,20 @@ namespace GQL_SQL {
                 void execute(const std::string &gql,Json::Value &res) const;
                 ///< Execute the given query and returns a json object with the result
 
+                std::future<Json::Value> executeAsync(const std::string &gql) const;
+                ///< Queue the query and return at once. The query runs on the background
+                ///< thread of this DB, the result is available through the future.
+                void executeAsync(const std::string &gql,std::function<void(Json::Value &res)> done) const;
+                ///< Queue the query and return at once, done is called with the result
+                ///< from the background thread of this DB. Queries of one DB run one
+                ///< after the other in the order they were queued, use several DB
+                ///< objects to run queries in parallel. The DB must not be destroyed
+                ///< while executeAsync() is called from another thread.
+                void executeBatch(const std::vector<std::string> &gql,Json::Value &res) const;
+                ///< Execute several queries, res is an array with one result per query
+                ///< in the same format as execute(). All queries are parsed first and
+                ///< backends that support it send them to the DB together.
+
                 void deftableSet(const std::string &_d) { deftable_=_d; }
                 ///< Set table to query
                 const std::string deftable() { return deftable_; }
@@ -568,10 +951,62 @@ namespace GQL_SQL {
                 inline bool extendedFunctions() const { return extendedFunctions_; }
                 ///< Query if extended functions are allowed
 
+                virtual StatementCacheStats statementCacheStats() const { return StatementCacheStats(); }
+                ///< Counters of the prepared statement cache, all 0 if the DB does
+                ///< not use prepared statements
+
+                void cancel() const;
+                ///< Stop the query that is currently running, it returns an error.
+                ///< May be called from any thread, does nothing if no query runs.
+                void timeoutSet(uint32_t _ms);
+                ///< Stop queries that run longer than _ms milliseconds, 0 for no limit.
+                ///< MySQL and PostgreSQL also get the limit as a hint, so the server
+                ///< stops the query even if this process is killed (e.g. in CGI mode).
+                inline uint32_t timeout() const { return timeout_; }
+                ///< Query the maximum run time of a query in milliseconds
+                void maxRowsSet(uint64_t _n);
+                ///< Fail queries that read more than _n rows from the DB, 0 for no limit.
+                ///< The SQL query is limited to _n+1 rows, so the DB stops early.
+                inline uint64_t maxRows() const { return maxRows_; }
+                ///< Query the maximum number of rows read by a query
+                inline void maxMemorySet(uint64_t _bytes) { maxMemory_=_bytes; }
+                ///< Fail queries whose data needs more than about _bytes bytes while it
+                ///< is read from the DB, 0 for no limit
+                inline uint64_t maxMemory() const { return maxMemory_; }
+                ///< Query the memory limit of a query
+
             protected:
-                virtual void getdata(const std::string &r,Json::Value &tbl) const = 0;
-                ///< run the SQL query and get all the data in json format
-                void pivotTable(const Json::Value &tbl,Json::Value &tres) const;
+                void asyncStop() const;
+                ///< Run all queued queries and stop the background thread. Destructors of
+                ///< derived classes call this before closing the connection.
+                virtual void getdata(const Result &r,Json::Value &tbl) const = 0;
+                ///< run the SQL query r.result with the parameters r.params
+                ///< and get all the data in json format
+
+                //! A query of executeBatch()
+                struct BatchQuery {
+                    Result result;             ///< the parsed query
+                    Json::Value tbl;           ///< the data, as returned by getdata()
+                    std::exception_ptr error;  ///< set if getting the data failed
+                };
+                virtual void getdataBatch(std::vector<BatchQuery> &queries) const;
+                ///< Get the data of several queries. The default calls getdata() for
+                ///< each query, backends that can send several queries in one round
+                ///< trip override this. Errors are stored per query.
+                virtual void interrupt() const { }
+                ///< Ask the DB to stop the running query. Called by cancel() and on a
+                ///< timeout from another thread, getdata() then fails with any exception.
+                ///< The query may have just finished, but guarded() does not return
+                ///< before interrupt() did.
+                inline bool interrupted() const { return interrupted_; }
+                ///< True once the running query should stop, checked by backends that
+                ///< evaluate the query themselves
+                void budget(Json::ArrayIndex _rows,const Json::Value &_row,uint64_t &_used) const;
+                ///< Called by getdata() after adding row number _rows (starting with 1)
+                ///< to the result. Adds the size of _row (the "c" array) to _used and
+                ///< throws a GQLError if maxRows_ or maxMemory_ is exceeded, which ends
+                ///< the query.
+                void pivotTable(const Result &q,const Json::Value &tbl,Json::Value &tres) const;
                 ///< Manually implement the pivot command by manipulating the json result.
                 ///< In order to avoid expensive deep copies a new table is generated
                 ///< and returned which makes this operation very expensive memory wise
@@ -595,26 +1030,94 @@ namespace GQL_SQL {
                 ///< SQL server
                 std::string db_;
                 ///< SQL db to query
-                std::set<std::string> defTableColumns_;
-                ///< list of additional tables that may be queried
+                Schema schema_;
+                ///< columns of the default and additional tables
+                uint32_t schemaTTL_=300;
+                ///< seconds a cached schema is used before reading it again from the DB
+                std::string schemaFile_;
+                ///< if set the schema cache is also stored in this json file and
+                ///< shared by all processes using it
                 uint32_t port_=0;
                 ///< TCP port to use for the DB connection
                 bool extendedFunctions_=false;
                 ///< true if extended SQL functions may be used
-
-                DB(Json::Value _init);
+                bool prepare_=true;
+                ///< use prepared statements with parameters if the DB supports it
+                size_t statementCacheSize_=64;
+                ///< maximum number of prepared statements kept per connection
+                uint32_t timeout_=0;
+                ///< maximum run time of a query in milliseconds, 0 for no limit
+                uint64_t maxRows_=0;
+                ///< maximum number of rows read by a query, 0 for no limit
+                uint64_t maxMemory_=0;
+                ///< maximum size in bytes of the data read by a query, 0 for no limit
+
+                bool schemaCached();
+                ///< Set schema_ from the cache, returns false if the schema for this DB
+                ///< and set of tables is not cached or expired and must be read from the DB
+                void schemaCache() const;
+                ///< Store schema_ in the cache
+                std::set<std::string> schemaTables() const;
+                ///< Tables that are part of the schema: the default and additional tables
+
+                DB(const Json::Value &_init);
                 ///< Initialize DB connection using a set of k/v
                 DB(const URI &_uri);
                 ///< Initialize DB connection using a URL
+
+            private:
+                void finish(const Result &r,Json::Value &tbl,Json::Value &res) const;
+                ///< Apply labels, formats and pivot to the data of a query, sets res["table"]
+                bool emptyResult(const Result &r,Json::Value &tbl) const;
+                ///< Set tbl to the empty result of a query whose where clause is always
+                ///< false without running it. Returns false if the DB is needed to find
+                ///< the column types (or the number of rows, for aggregates).
+                void asyncRun() const;
+                ///< Body of the background thread, runs the queued queries
+                void guarded(const std::function<void()> &_get) const;
+                ///< Run _get, the getdata() of one or more queries, so that cancel() and
+                ///< timeout_ can stop it. Throws a GQLError if it was stopped.
+
+                //! Why the running query was stopped
+                enum class Stop { NONE, CANCEL, TIMEOUT };
+                void stopRunning(std::unique_lock<std::mutex> &_lock,Stop _why) const;
+                ///< Set stop_ to _why and call interrupt() without holding _lock,
+                ///< a lock of stopMutex_
+                mutable std::mutex stopMutex_;
+                ///< protects running_, stop_ and interrupting_
+                mutable std::condition_variable stopCond_;
+                ///< signals the end of a query to the timeout thread and the end of
+                ///< interrupt() to guarded()
+                mutable bool running_=false;
+                ///< true while guarded() runs a query
+                mutable Stop stop_=Stop::NONE;
+                ///< set by cancel() or the timeout thread
+                mutable unsigned interrupting_=0;
+                ///< number of interrupt() calls in progress, guarded() waits for them
+                mutable std::atomic<bool> interrupted_{false};
+                ///< see interrupted()
+                mutable std::mutex executeMutex_;
+                ///< a connection runs one query at a time, held by execute()
+                mutable std::mutex asyncMutex_;
+                ///< protects the members used by executeAsync()
+                mutable std::condition_variable asyncCond_;
+                ///< signals new queries or asyncStop() to the background thread
+                mutable std::deque<std::function<void()>> asyncQueue_;
+                ///< queries waiting for the background thread
+                mutable std::thread asyncThread_;
+                ///< background thread, started by the first executeAsync()
+                mutable bool asyncStop_=false;
+                ///< set by asyncStop() to end the background thread
         };
 
         //! MySQL connect class
         class MySQL : public DB {
             public:
-                MySQL(Json::Value _init) : DB(_init) { }
-                ///< Initialize using json k/v config parameters
-                MySQL(const URI &_uri) : DB(_uri) { }
-                ///< Initialize using a connection URL
+                MySQL(const Json::Value &_init) : DB(_init) { if(!_init.isMember("prepare")) { prepare_=false; } }
+                ///< Initialize using json k/v config parameters. Prepared statements
+                ///< are off unless "prepare" is set, see executePrepared().
+                MySQL(const URI &_uri) : DB(_uri) { prepare_=false; }
+                ///< Initialize using a connection URL, without prepared statements
                 virtual bool isConnected() const override;
                 ///< return status of DB connection
                 virtual void connect() override;
@@ -624,18 +1127,29 @@ namespace GQL_SQL {
                 virtual ~MySQL();
                 ///< destructor
 
+                virtual StatementCacheStats statementCacheStats() const override { return statements_.stats(); }
+                ///< Counters of the prepared statement cache
+
             protected:
-                void getdata(const std::string &q,Json::Value &tbl) const override;
+                void getdata(const Result &q,Json::Value &tbl) const override;
                 ///< Query the database and return the data in a json object
+                void interrupt() const override;
+                ///< Stop the running query with KILL QUERY on a second connection
             private:
+                mysqlpp::StoreQueryResult executePrepared(const Result &q) const;
+                ///< Run a query with parameters as a server side prepared statement
                 mysqlpp::Connection *connection_=0;
                 ///< MySQL connecion object
+                mutable StatementCache<std::string> statements_;
+                ///< names of the statements prepared on this connection, by SQL query
+                mutable uint64_t statementId_=0;
+                ///< used to create unique statement names
         };
 
         //! PostgerSQL connect class
         class PostgreSQL : public DB {
             public:
-                PostgreSQL(Json::Value _init) : DB(_init) { }
+                PostgreSQL(const Json::Value &_init) : DB(_init) { }
                 ///< Initialize using json k/v config parameters
                 PostgreSQL(const URI &_uri) : DB(_uri) { }
                 ///< Initialize using a connection URL
@@ -647,12 +1161,131 @@ namespace GQL_SQL {
                 virtual ~PostgreSQL();
                 ///< destructor
 
+                virtual StatementCacheStats statementCacheStats() const override { return statements_.stats(); }
+                ///< Counters of the prepared statement cache
+
             protected:
-                void getdata(const std::string &q,Json::Value &tbl) const override;
+                void getdata(const Result &q,Json::Value &tbl) const override;
                 ///< Query the database and return the data in a json object
+                void interrupt() const override;
+                ///< Cancel the running query on the server (PQcancel)
+                void getdataBatch(std::vector<BatchQuery> &queries) const override;
+                ///< Send all queries in a single pipeline
             private:
+                std::string statement(const std::string &_sql,bool &_cached) const;
+                ///< Return the name of the statement prepared for _sql, prepares it if
+                ///< needed. _cached is set to true if it was already prepared.
+                pqxx::result executePrepared(const Result &q) const;
+                ///< Run a query with parameters as a prepared statement
+                void resultToJson(const pqxx::result &_rows,Json::Value &_tbl) const;
+                ///< Convert the rows and column types to the json result
+                uint32_t baseType(uint32_t _oid) const;
+                ///< Return the built in type used to convert values of a type that
+                ///< is not built in
+                void serverTimeout() const;
+                ///< Set statement_timeout of the session to timeout_ if it changed
                 pqxx::connection *connection_=0;
                 ///< PostgreSQL connecion object
+                mutable StatementCache<std::string> statements_;
+                ///< names of the statements prepared on this connection, by SQL query
+                mutable uint64_t statementId_=0;
+                ///< used to create unique statement names
+                mutable std::map<uint32_t,uint32_t> baseTypes_;
+                ///< built in type of the types that are not built in, see baseType()
+                mutable uint32_t statementTimeout_=0;
+                ///< statement_timeout set on the session, see serverTimeout()
+        };
+
+        //! SQLite connect class
+        class SQLite : public DB {
+            public:
+                SQLite(const Json::Value &_init) : DB(_init) { }
+                ///< Initialize using json k/v config parameters, "db" is the file name
+                SQLite(const URI &_uri) : DB(_uri) { db_=_uri.host()+_uri.path(); }
+                ///< Initialize using a connection URL, sqlite:///path/to/file.db
+                virtual bool isConnected() const override;
+                ///< return true if the database is open
+                virtual void connect() override;
+                ///< open the database (read-only). Failures should be checked
+                ///< by calling isConnected().
+
+                virtual ~SQLite();
+                ///< destructor
+
+                virtual StatementCacheStats statementCacheStats() const override { return statements_.stats(); }
+                ///< Counters of the prepared statement cache
+
+            protected:
+                void getdata(const Result &q,Json::Value &tbl) const override;
+                ///< Query the database and return the data in a json object
+                void interrupt() const override;
+                ///< Stop the running query with sqlite3_interrupt()
+            private:
+                sqlite3 *connection_=0;
+                ///< SQLite database handle
+                mutable StatementCache<sqlite3_stmt *> statements_;
+                ///< statements with parameters prepared on this connection, by SQL query
+        };
+
+        //! DuckDB connect class.
+        /** Only available if the library was built with DuckDB (HAVE_DUCKDB) */
+        class DuckDB : public DB {
+            public:
+                DuckDB(const Json::Value &_init) : DB(_init) { }
+                ///< Initialize using json k/v config parameters, "db" is the file name
+                DuckDB(const URI &_uri) : DB(_uri) { db_=_uri.host()+_uri.path(); }
+                ///< Initialize using a connection URL, duckdb:///path/to/file.db
+                virtual bool isConnected() const override;
+                ///< return true if the database is open
+                virtual void connect() override;
+                ///< open the database (read-only). Failures should be checked
+                ///< by calling isConnected().
+
+                virtual ~DuckDB();
+                ///< destructor
+
+            protected:
+                void getdata(const Result &q,Json::Value &tbl) const override;
+                ///< Query the database and return the data in a json object
+                void interrupt() const override;
+                ///< Stop the running query with duckdb_interrupt()
+            private:
+                struct _duckdb_database *database_=0;
+                ///< DuckDB database handle (duckdb_database)
+                struct _duckdb_connection *connection_=0;
+                ///< DuckDB connection handle (duckdb_connection)
+        };
+
+        struct MemoryTable;
+
+        //! In-memory connect class.
+        /** The tables are loaded from fixtures (json or csv files, inline json
+         * tables or generator specs) and the query is evaluated without any
+         * SQL engine. Only the default table can be queried. */
+        class Memory : public DB {
+            public:
+                Memory(const Json::Value &_init);
+                ///< Initialize using json k/v config parameters, the tables are
+                ///< defined in the map "fixtures" (table name -> fixture)
+                Memory(const URI &_uri);
+                ///< Initialize using a URL, memory://path/to/fixture.{json,csv}
+                virtual bool isConnected() const override;
+                ///< return true if the fixtures are loaded
+                virtual void connect() override;
+                ///< load all fixtures. Failures should be checked
+                ///< by calling isConnected().
+
+                virtual ~Memory();
+                ///< destructor
+
+            protected:
+                void getdata(const Result &q,Json::Value &tbl) const override;
+                ///< Evaluate the parsed query on the in-memory table
+            private:
+                Json::Value fixtures_;
+                ///< table name -> fixture
+                std::map<std::string,std::shared_ptr<MemoryTable>> data_;
+                ///< loaded tables
         };
 
 
@@ -668,6 +1301,13 @@ namespace GQL_SQL {
         ///< output data in TSV format to the given stream
         void outputJson(std::ostream &o,const Json::Value &tbl);
         ///< output data in Json format to the given stream
+        void outputJsonColumns(std::ostream &o,const Json::Value &tbl);
+        ///< output data in a compact columnar Json format to the given stream.
+        ///< Instead of rows[].c[].v/f every column gets a flat array 'v' of values
+        ///< and an optional parallel array 'f' of formatted values.
+        void outputArrow(std::ostream &o,const Json::Value &res);
+        ///< output data as an Apache Arrow IPC stream to the given stream.
+        ///< Errors are returned as a table with the columns reason and message.
 
     }
 
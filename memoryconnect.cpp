@@ -0,0 +1,841 @@
+/** \file
+ * \brief In-memory connector for GQL
+ *
+ * The tables are loaded from json or csv fixtures or created by a generator
+ * and the GQL query is evaluated directly on the parsed query. This makes it
+ * possible to run and profile the complete pipeline without a database.
+ *
+ * Only the default table can be queried. Dates and times are handled in the
+ * local time zone, the same way the SQL connectors return them.
+ *
+ * \author Claudio Fleiner
+ * \copyright 2018 Claudio Fleiner
+ *
+ * **License:**
+ *
+ * > This program is free software: you can redistribute it and/or modify
+ * > it under the terms of the GNU Affero General Public License as published by
+ * > the Free Software Foundation, either version 3 of the License, or
+ * > (at your option) any later version.
+ * >
+ * > This program is distributed in the hope that it will be useful,
+ * > but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * > MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * > GNU Affero General Public License for more details.
+ * >
+ * > You should have received a copy of the GNU Affero General Public License
+ * > along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <ctime>
+#include <algorithm>
+#include <regex>
+#include <unordered_map>
+#include <jsoncpp/json/json.h>
+#include <glog/logging.h>
+#include <unicode/unistr.h>
+#include "libgqlsql.h"
+
+namespace GQL_SQL {
+namespace DBQuery {
+
+/// A single value of an in-memory table or the result of an expression
+struct MemValue {
+    //! Value types, corresponds to the GQL column types
+    enum class Kind { NONE, NUMBER, STRING, BOOLEAN, DATE, DATETIME, TIME };
+
+    Kind kind=Kind::NONE; ///< type of the value, NONE for null
+    double num=0;         ///< numbers, booleans, seconds since the epoch (dates) or midnight (times)
+    std::string str;      ///< strings
+
+    MemValue() { }
+    ///< null value
+    MemValue(Kind _kind,double _num) : kind(_kind), num(_num) { }
+    ///< number, boolean, date or time
+    MemValue(const std::string &_str) : kind(Kind::STRING), str(_str) { }
+    ///< string value
+
+    inline bool isNull() const { return kind==Kind::NONE; }
+    ///< true for null values
+};
+
+/// An in-memory table
+struct MemoryTable {
+    std::vector<std::string> names;                ///< column names
+    std::vector<MemValue::Kind> kinds;             ///< column types
+    std::unordered_map<std::string,size_t> index;  ///< column number by name
+    std::vector<std::vector<MemValue>> rows;       ///< the data
+};
+
+}
+}
+
+using GQL_SQL::DBQuery::MemValue;
+using GQL_SQL::DBQuery::MemoryTable;
+using GQL_SQL::GQLParser::TokenType;
+using GQL_SQL::GQLParser::Query;
+
+/// Convert a GQL type name to a value kind
+static MemValue::Kind kindFromType(const std::string &type)
+{
+    if(type==GQL_SQL::DBQuery::TYPE_NUMBER) { return MemValue::Kind::NUMBER; }
+    if(type==GQL_SQL::DBQuery::TYPE_STRING) { return MemValue::Kind::STRING; }
+    if(type==GQL_SQL::DBQuery::TYPE_BOOLEAN) { return MemValue::Kind::BOOLEAN; }
+    if(type==GQL_SQL::DBQuery::TYPE_DATE) { return MemValue::Kind::DATE; }
+    if(type==GQL_SQL::DBQuery::TYPE_DATETIME) { return MemValue::Kind::DATETIME; }
+    if(type==GQL_SQL::DBQuery::TYPE_TIME) { return MemValue::Kind::TIME; }
+    throw GQL_SQL::GQLError(GQL_SQL::ErrorReasons::INVALID_REQUEST,"unknown column type '"+type+"'");
+}
+
+/// Convert a value kind to a GQL type name
+static const std::string &typeFromKind(MemValue::Kind kind)
+{
+    switch(kind) {
+    case MemValue::Kind::NUMBER: return GQL_SQL::DBQuery::TYPE_NUMBER;
+    case MemValue::Kind::BOOLEAN: return GQL_SQL::DBQuery::TYPE_BOOLEAN;
+    case MemValue::Kind::DATE: return GQL_SQL::DBQuery::TYPE_DATE;
+    case MemValue::Kind::DATETIME: return GQL_SQL::DBQuery::TYPE_DATETIME;
+    case MemValue::Kind::TIME: return GQL_SQL::DBQuery::TYPE_TIME;
+    case MemValue::Kind::NONE:
+    case MemValue::Kind::STRING: break;
+    }
+    return GQL_SQL::DBQuery::TYPE_STRING;
+}
+
+/// Parse 'yyyy-MM-dd', 'yyyy-MM-dd HH:mm:ss[.SSS]' or 'HH:mm:ss[.SSS]' and
+/// return the seconds since the epoch (local time) or since midnight.
+static MemValue parseDateTime(MemValue::Kind kind,const std::string &s)
+{
+    int y=1970,mo=1,d=1,h=0,mi=0,sec=0,ms=0;
+    int n;
+    if(kind==MemValue::Kind::TIME) {
+        n=sscanf(s.c_str(),"%d:%d:%d.%3d",&h,&mi,&sec,&ms);
+        if(n<3) { throw GQL_SQL::GQLError(GQL_SQL::ErrorReasons::INVALID_QUERY,"invalid time '"+s+"'"); }
+        return MemValue(kind,h*3600+mi*60+sec+ms/1000.0);
+    }
+    n=sscanf(s.c_str(),"%d-%d-%d %d:%d:%d.%3d",&y,&mo,&d,&h,&mi,&sec,&ms);
+    if(n<3) { throw GQL_SQL::GQLError(GQL_SQL::ErrorReasons::INVALID_QUERY,"invalid date '"+s+"'"); }
+    if(kind==MemValue::Kind::DATE) { h=mi=sec=ms=0; }
+    struct tm tm;
+    memset(&tm,0,sizeof(tm));
+    tm.tm_year=y-1900;
+    tm.tm_mon=mo-1;
+    tm.tm_mday=d;
+    tm.tm_hour=h;
+    tm.tm_min=mi;
+    tm.tm_sec=sec;
+    tm.tm_isdst=-1;
+    return MemValue(kind,static_cast<double>(mktime(&tm))+ms/1000.0);
+}
+
+/// Convert a fixture value (json) to a value of the given kind
+static MemValue fromJson(MemValue::Kind kind,const Json::Value &v)
+{
+    if(v.isNull()) { return MemValue(); }
+    switch(kind) {
+    case MemValue::Kind::NUMBER:
+        return MemValue(kind,v.isString()?std::stod(v.asString()):v.asDouble());
+    case MemValue::Kind::BOOLEAN:
+        if(v.isString()) {
+            std::string s=v.asString();
+            return MemValue(kind,s=="1"||s=="true"||s=="True"||s=="TRUE");
+        }
+        return MemValue(kind,v.asBool());
+    case MemValue::Kind::DATE:
+    case MemValue::Kind::DATETIME:
+    case MemValue::Kind::TIME:
+        if(v.isNumeric()) { return MemValue(kind,v.asDouble()); }
+        return parseDateTime(kind,v.asString());
+    case MemValue::Kind::NONE:
+    case MemValue::Kind::STRING:
+        break;
+    }
+    return MemValue(v.asString());
+}
+
+/// Add a column to a table
+static void addColumn(MemoryTable &tbl,const std::string &name,MemValue::Kind kind)
+{
+    tbl.index[name]=tbl.names.size();
+    tbl.names.push_back(name);
+    tbl.kinds.push_back(kind);
+}
+
+/// Load a table in json format: {"cols":[{"id":..,"type":..}],"rows":[[..],..]}.
+/// Rows can also be given in the GQL format {"c":[{"v":..}]}.
+static void loadJson(MemoryTable &tbl,const Json::Value &fixture)
+{
+    for(const auto &c:fixture["cols"]) {
+        addColumn(tbl,c["id"].asString(),kindFromType(c.get("type",GQL_SQL::DBQuery::TYPE_STRING).asString()));
+    }
+    for(const auto &r:fixture["rows"]) {
+        std::vector<MemValue> row;
+        row.reserve(tbl.names.size());
+        for(Json::ArrayIndex c=0;c<tbl.names.size();c++) {
+            row.push_back(fromJson(tbl.kinds[c],r.isObject()?r["c"][c]["v"]:r[c]));
+        }
+        tbl.rows.push_back(row);
+    }
+}
+
+/// Split a line of a csv file into its fields
+static std::vector<std::string> csvFields(const std::string &line,std::vector<bool> &quoted)
+{
+    std::vector<std::string> res;
+    quoted.clear();
+    std::string field;
+    bool inquote=false;
+    bool wasquoted=false;
+    for(size_t i=0;i<line.size();i++) {
+        char c=line[i];
+        if(inquote) {
+            if(c=='"') {
+                if(i+1<line.size()&&line[i+1]=='"') { field+='"';i++; }
+                else { inquote=false; }
+            } else {
+                field+=c;
+            }
+        } else if(c=='"') {
+            inquote=true;
+            wasquoted=true;
+        } else if(c==',') {
+            res.push_back(field);
+            quoted.push_back(wasquoted);
+            field="";
+            wasquoted=false;
+        } else if(c!='\r') {
+            field+=c;
+        }
+    }
+    res.push_back(field);
+    quoted.push_back(wasquoted);
+    return res;
+}
+
+/// Load a csv file. The first line contains the column names, optionally
+/// followed by ':' and the type (e.g. "name:string,dob:date"), the default
+/// type is string. Unquoted empty fields are null.
+static void loadCsv(MemoryTable &tbl,std::istream &in)
+{
+    std::string line;
+    std::vector<bool> quoted;
+    if(!std::getline(in,line)) { return; }
+    for(const auto &h:csvFields(line,quoted)) {
+        auto colon=h.rfind(':');
+        if(colon==std::string::npos) {
+            addColumn(tbl,h,MemValue::Kind::STRING);
+        } else {
+            addColumn(tbl,h.substr(0,colon),kindFromType(h.substr(colon+1)));
+        }
+    }
+    while(std::getline(in,line)) {
+        if(line=="") { continue; }
+        auto fields=csvFields(line,quoted);
+        std::vector<MemValue> row;
+        row.reserve(tbl.names.size());
+        for(size_t c=0;c<tbl.names.size();c++) {
+            if(c>=fields.size()||(fields[c]==""&&!quoted[c])) {
+                row.push_back(MemValue());
+            } else {
+                row.push_back(fromJson(tbl.kinds[c],fields[c]));
+            }
+        }
+        tbl.rows.push_back(row);
+    }
+}
+
+/// Create a table from a generator spec:
+/// {"rows":N,"seed":S,"columns":[{"id":..,"type":..,"distinct":D}]}.
+/// Column values are derived from a hash of seed, row and column so the
+/// same spec always creates the same table.
+static void generate(MemoryTable &tbl,const Json::Value &spec)
+{
+    uint64_t nrows=spec.get("rows",1000).asUInt64();
+    uint64_t seed=spec.get("seed",1).asUInt64();
+    std::vector<uint64_t> distinct;
+    for(const auto &c:spec["columns"]) {
+        addColumn(tbl,c["id"].asString(),kindFromType(c.get("type",GQL_SQL::DBQuery::TYPE_NUMBER).asString()));
+        distinct.push_back(c.get("distinct",0).asUInt64());
+    }
+    MemValue base=parseDateTime(MemValue::Kind::DATE,"2018-01-01");
+    tbl.rows.resize(nrows);
+    for(uint64_t r=0;r<nrows;r++) {
+        auto &row=tbl.rows[r];
+        row.reserve(tbl.names.size());
+        for(size_t c=0;c<tbl.names.size();c++) {
+            // splitmix64
+            uint64_t n=seed+r*0x9e3779b97f4a7c15ULL+c*0xbf58476d1ce4e5b9ULL;
+            n=(n^(n>>30))*0xbf58476d1ce4e5b9ULL;
+            n=(n^(n>>27))*0x94d049bb133111ebULL;
+            n^=n>>31;
+            if(distinct[c]) { n%=distinct[c]; } else { n=r; }
+            double d=static_cast<double>(n);
+            switch(tbl.kinds[c]) {
+            case MemValue::Kind::NUMBER: row.push_back(MemValue(tbl.kinds[c],d));break;
+            case MemValue::Kind::BOOLEAN: row.push_back(MemValue(tbl.kinds[c],static_cast<double>(n%2)));break;
+            case MemValue::Kind::DATE: row.push_back(MemValue(tbl.kinds[c],base.num+86400*d));break;
+            case MemValue::Kind::DATETIME: row.push_back(MemValue(tbl.kinds[c],base.num+61*d));break;
+            case MemValue::Kind::TIME: row.push_back(MemValue(tbl.kinds[c],static_cast<double>(n%86400)));break;
+            case MemValue::Kind::NONE:
+            case MemValue::Kind::STRING: row.push_back(MemValue(tbl.names[c]+"-"+std::to_string(n)));break;
+            }
+        }
+    }
+}
+
+/// Load a fixture: a file name (json or csv), an inline json table or a generator spec
+static std::shared_ptr<MemoryTable> loadFixture(const Json::Value &fixture)
+{
+    auto tbl=std::make_shared<MemoryTable>();
+    if(fixture.isString()) {
+        std::string fname=fixture.asString();
+        std::ifstream f(fname);
+        if(f.fail()) {
+            throw GQL_SQL::GQLError(GQL_SQL::ErrorReasons::ACCESS_DENIED,"cannot read fixture '"+fname+"'");
+        }
+        if(fname.size()>4&&fname.substr(fname.size()-4)==".csv") {
+            loadCsv(*tbl,f);
+        } else {
+            Json::Value data;
+            f >> data;
+            return loadFixture(data);
+        }
+    } else if(fixture.isMember("generate")) {
+        generate(*tbl,fixture["generate"]);
+    } else {
+        loadJson(*tbl,fixture);
+    }
+    return tbl;
+}
+
+/// Compare two values, returns <0, 0 or >0. Nulls are smaller than anything else.
+static int compare(const MemValue &a,const MemValue &b)
+{
+    if(a.isNull()||b.isNull()) { return (a.isNull()?0:1)-(b.isNull()?0:1); }
+    if(a.kind==MemValue::Kind::STRING&&b.kind==MemValue::Kind::STRING) { return a.str.compare(b.str); }
+    if(a.kind==MemValue::Kind::STRING||b.kind==MemValue::Kind::STRING) {
+        // mixed, compare as numbers (like SQL does)
+        double na=a.kind==MemValue::Kind::STRING?atof(a.str.c_str()):a.num;
+        double nb=b.kind==MemValue::Kind::STRING?atof(b.str.c_str()):b.num;
+        return na<nb?-1:na>nb?1:0;
+    }
+    return a.num<b.num?-1:a.num>b.num?1:0;
+}
+
+/// Returns the string representation of a value (for string functions)
+static std::string asString(const MemValue &v)
+{
+    if(v.kind==MemValue::Kind::STRING) { return v.str; }
+    if(v.num==floor(v.num)&&fabs(v.num)<9e15) { return std::to_string(static_cast<int64_t>(v.num)); }
+    return std::to_string(v.num);
+}
+
+/// Returns true if s matches the SQL like pattern p (% and _ wildcards)
+static bool likeMatch(const char *s,const char *p)
+{
+    for(;*p;p++,s++) {
+        if(*p=='%') {
+            while(*p=='%') { p++; }
+            if(!*p) { return true; }
+            for(;*s;s++) {
+                if(likeMatch(s,p)) { return true; }
+            }
+            return false;
+        }
+        if(!*s||(*p!='_'&&*p!=*s)) { return false; }
+    }
+    return !*s;
+}
+
+/// Context in which an expression is evaluated: a single row or a group of rows
+struct EvalContext {
+    const MemoryTable &tbl;                   ///< table queried
+    const std::string &deftable;              ///< name of the table
+    const std::vector<MemValue> *row;         ///< current row (first row of a group)
+    const std::vector<size_t> *group;         ///< rows of the current group, 0 if not grouped
+};
+
+static MemValue eval(const Query::Expr::CPtr &e,const EvalContext &ctx);
+
+/// Returns the column number of a column identifier
+static size_t columnIndex(const std::string &name,const EvalContext &ctx)
+{
+    std::string col=name;
+    auto dot=name.find('.');
+    if(dot!=std::string::npos) {
+        if(name.substr(0,dot)!=ctx.deftable) {
+            throw GQL_SQL::GQLError(GQL_SQL::ErrorReasons::ACCESS_DENIED,
+                                    "table `"+name.substr(0,dot)+"` does not exists or is not accessible");
+        }
+        col=name.substr(dot+1);
+    }
+    auto it=ctx.tbl.index.find(col);
+    if(it==ctx.tbl.index.end()) {
+        throw GQL_SQL::GQLError(GQL_SQL::ErrorReasons::INVALID_QUERY,"Unknown column '"+name+"'");
+    }
+    return it->second;
+}
+
+/// Evaluate an aggregate function over all rows of the current group
+static MemValue aggregate(const std::string &func,const Query::Expr::CPtr &arg,const EvalContext &ctx)
+{
+    size_t col=columnIndex(arg->data(),ctx);
+    const std::vector<size_t> *rows=ctx.group;
+    if(!rows) {
+        throw GQL_SQL::GQLError(GQL_SQL::ErrorReasons::INVALID_QUERY,"aggregate function '"+func+"' used outside of a group");
+    }
+    uint64_t cnt=0;
+    double sum=0;
+    MemValue best;
+    for(auto r:*rows) {
+        const MemValue &v=ctx.tbl.rows[r][col];
+        if(v.isNull()) { continue; }
+        cnt++;
+        sum+=v.num;
+        if(best.isNull()||(func=="max"&&compare(v,best)>0)||(func=="min"&&compare(v,best)<0)) { best=v; }
+    }
+    if(func=="count") { return MemValue(MemValue::Kind::NUMBER,static_cast<double>(cnt)); }
+    if(func=="min"||func=="max") { return best; }
+    if(cnt==0) { return MemValue(); }
+    if(func=="sum") { return MemValue(MemValue::Kind::NUMBER,sum); }
+    return MemValue(MemValue::Kind::NUMBER,sum/static_cast<double>(cnt));
+}
+
+/// Returns the broken down local time of a date/datetime value
+static struct tm localTime(const MemValue &v)
+{
+    struct tm tm;
+    time_t ts=static_cast<time_t>(floor(v.num));
+    if(v.kind==MemValue::Kind::TIME) {
+        memset(&tm,0,sizeof(tm));
+        tm.tm_hour=static_cast<int>(ts/3600);
+        tm.tm_min=static_cast<int>(ts/60%60);
+        tm.tm_sec=static_cast<int>(ts%60);
+    } else {
+        localtime_r(&ts,&tm);
+    }
+    return tm;
+}
+
+/// Evaluate a scalar function
+static MemValue function(const Query::Expr::CPtr &e,const EvalContext &ctx)
+{
+    const std::string &f=e->data();
+    if(Query::isAggFunc(f)) { return aggregate(f,e->sub()[0],ctx); }
+    if(f=="now") { return MemValue(MemValue::Kind::DATETIME,static_cast<double>(time(0))); }
+
+    std::vector<MemValue> args;
+    for(const auto &s:e->sub()) { args.push_back(eval(s,ctx)); }
+    for(const auto &a:args) {
+        if(a.isNull()) { return MemValue(); }
+    }
+
+    MemValue r(MemValue::Kind::NUMBER,0);
+    if(f=="year"||f=="month"||f=="day"||f=="hour"||f=="minute"||f=="second"||f=="quarter"||f=="dayOfWeek") {
+        struct tm tm=localTime(args[0]);
+        if(f=="year") { r.num=tm.tm_year+1900; }
+        else if(f=="month") { r.num=tm.tm_mon+1; }
+        else if(f=="day") { r.num=tm.tm_mday; }
+        else if(f=="hour") { r.num=tm.tm_hour; }
+        else if(f=="minute") { r.num=tm.tm_min; }
+        else if(f=="second") { r.num=tm.tm_sec; }
+        else if(f=="quarter") { r.num=tm.tm_mon/3+1; }
+        else { r.num=tm.tm_wday+1; }
+    } else if(f=="millisecond") {
+        r.num=round((args[0].num-floor(args[0].num))*1000);
+    } else if(f=="dateDiff") {
+        struct tm t1=localTime(args[0]);
+        struct tm t2=localTime(args[1]);
+        t1.tm_hour=t2.tm_hour=12;
+        t1.tm_min=t2.tm_min=t1.tm_sec=t2.tm_sec=0;
+        t1.tm_isdst=t2.tm_isdst=-1;
+        r.num=round(difftime(mktime(&t1),mktime(&t2))/86400);
+    } else if(f=="toDate") {
+        MemValue d=args[0];
+        if(d.kind==MemValue::Kind::STRING) { return parseDateTime(MemValue::Kind::DATE,d.str); }
+        // numbers are milliseconds since the epoch
+        if(d.kind==MemValue::Kind::NUMBER) { d.num/=1000; }
+        struct tm tm=localTime(d);
+        tm.tm_hour=tm.tm_min=tm.tm_sec=0;
+        tm.tm_isdst=-1;
+        r=MemValue(MemValue::Kind::DATE,static_cast<double>(mktime(&tm)));
+    } else if(f=="upper"||f=="lower") {
+        icu::UnicodeString u=icu::UnicodeString::fromUTF8(asString(args[0]));
+        if(f=="upper") { u.toUpper(); } else { u.toLower(); }
+        std::string s;
+        u.toUTF8String(s);
+        r=MemValue(s);
+    } else {
+        throw GQL_SQL::GQLError(GQL_SQL::ErrorReasons::INVALID_QUERY,"function '"+f+"' is not supported by the memory backend");
+    }
+    return r;
+}
+
+/// Evaluate an expression
+static MemValue eval(const Query::Expr::CPtr &e,const EvalContext &ctx)
+{
+    const auto &sub=e->sub();
+    switch(e->tp()) {
+    case TokenType::NUMBER:
+        return MemValue(MemValue::Kind::NUMBER,std::stod(e->data()));
+    case TokenType::STRING:
+        return MemValue(e->data());
+    case TokenType::GQL_TRUE:
+        return MemValue(MemValue::Kind::BOOLEAN,1);
+    case TokenType::GQL_FALSE:
+        return MemValue(MemValue::Kind::BOOLEAN,0);
+    case TokenType::DATE:
+        return parseDateTime(MemValue::Kind::DATE,sub[0]->data());
+    case TokenType::DATETIME:
+    case TokenType::TIMESTAMP:
+        return parseDateTime(MemValue::Kind::DATETIME,sub[0]->data());
+    case TokenType::TIMEOFDAY:
+        return parseDateTime(MemValue::Kind::TIME,sub[0]->data());
+
+    case TokenType::IDENTIFIER:
+        if(sub.size()==0&&!e->noarg()) {
+            return (*ctx.row)[columnIndex(e->data(),ctx)];
+        }
+        return function(e,ctx);
+
+    case TokenType::IS_NULL:
+        return MemValue(MemValue::Kind::BOOLEAN,eval(sub[0],ctx).isNull());
+    case TokenType::IS_NOT_NULL:
+        return MemValue(MemValue::Kind::BOOLEAN,!eval(sub[0],ctx).isNull());
+
+    case TokenType::IN_SET:
+        {
+            MemValue a=eval(sub[0],ctx);
+            if(a.isNull()) { return a; }
+            for(size_t i=1;i<sub.size();i++) {
+                if(compare(a,eval(sub[i],ctx))==0) { return MemValue(MemValue::Kind::BOOLEAN,1); }
+            }
+            return MemValue(MemValue::Kind::BOOLEAN,0);
+        }
+
+    case TokenType::NOT:
+        {
+            MemValue v=eval(sub[0],ctx);
+            if(v.isNull()) { return v; }
+            return MemValue(MemValue::Kind::BOOLEAN,v.num==0);
+        }
+    case TokenType::AND:
+    case TokenType::OR:
+        {
+            MemValue a=eval(sub[0],ctx);
+            MemValue b=eval(sub[1],ctx);
+            bool isand=e->tp()==TokenType::AND;
+            // three valued logic as in SQL
+            if(!a.isNull()&&(a.num!=0)!=isand) { return a; }
+            if(!b.isNull()&&(b.num!=0)!=isand) { return b; }
+            if(a.isNull()||b.isNull()) { return MemValue(); }
+            return MemValue(MemValue::Kind::BOOLEAN,isand);
+        }
+
+    case TokenType::PLUS:
+    case TokenType::MINUS:
+    case TokenType::TIMES:
+    case TokenType::DIV:
+        {
+            MemValue a=eval(sub[0],ctx);
+            if(sub.size()==1) {
+                if(!a.isNull()&&e->tp()==TokenType::MINUS) { a.num=-a.num; }
+                return a;
+            }
+            MemValue b=eval(sub[1],ctx);
+            if(a.isNull()||b.isNull()) { return MemValue(); }
+            double na=a.kind==MemValue::Kind::STRING?atof(a.str.c_str()):a.num;
+            double nb=b.kind==MemValue::Kind::STRING?atof(b.str.c_str()):b.num;
+            switch(e->tp()) {
+            case TokenType::PLUS: return MemValue(MemValue::Kind::NUMBER,na+nb);
+            case TokenType::MINUS: return MemValue(MemValue::Kind::NUMBER,na-nb);
+            case TokenType::TIMES: return MemValue(MemValue::Kind::NUMBER,na*nb);
+            default:
+                if(nb==0) { return MemValue(); }
+                return MemValue(MemValue::Kind::NUMBER,na/nb);
+            }
+        }
+
+    case TokenType::EQ:
+    case TokenType::NE:
+    case TokenType::LT:
+    case TokenType::LE:
+    case TokenType::GT:
+    case TokenType::GE:
+        {
+            MemValue a=eval(sub[0],ctx);
+            MemValue b=eval(sub[1],ctx);
+            if(a.isNull()||b.isNull()) { return MemValue(); }
+            int c=compare(a,b);
+            bool r=false;
+            switch(e->tp()) {
+            case TokenType::EQ: r=c==0;break;
+            case TokenType::NE: r=c!=0;break;
+            case TokenType::LT: r=c<0;break;
+            case TokenType::LE: r=c<=0;break;
+            case TokenType::GT: r=c>0;break;
+            default: r=c>=0;break;
+            }
+            return MemValue(MemValue::Kind::BOOLEAN,r);
+        }
+
+    case TokenType::STARTS:
+    case TokenType::ENDS:
+    case TokenType::CONTAINS:
+    case TokenType::MATCHES:
+    case TokenType::LIKE:
+        {
+            MemValue a=eval(sub[0],ctx);
+            MemValue b=eval(sub[1],ctx);
+            if(a.isNull()||b.isNull()) { return MemValue(); }
+            std::string s=asString(a);
+            std::string p=asString(b);
+            bool r=false;
+            switch(e->tp()) {
+            case TokenType::STARTS: r=s.compare(0,p.size(),p)==0;break;
+            case TokenType::ENDS: r=s.size()>=p.size()&&s.compare(s.size()-p.size(),p.size(),p)==0;break;
+            case TokenType::CONTAINS: r=s.find(p)!=std::string::npos;break;
+            case TokenType::MATCHES:
+                try {
+                    r=std::regex_match(s,std::regex(p));
+                } catch(const std::regex_error &ex) {
+                    throw GQL_SQL::GQLError(GQL_SQL::ErrorReasons::INVALID_QUERY,"invalid regular expression '"+p+"'");
+                }
+                break;
+            default: r=likeMatch(s.c_str(),p.c_str());break;
+            }
+            return MemValue(MemValue::Kind::BOOLEAN,r);
+        }
+
+    default:
+        throw GQL_SQL::GQLError(GQL_SQL::ErrorReasons::INVALID_QUERY,"unsupported expression '"+e->to_string()+"'");
+    }
+}
+
+/// Find the resulting type of an expression without evaluating it
+static MemValue::Kind exprKind(const Query::Expr::CPtr &e,const EvalContext &ctx)
+{
+    switch(e->tp()) {
+    case TokenType::STRING: return MemValue::Kind::STRING;
+    case TokenType::DATE: return MemValue::Kind::DATE;
+    case TokenType::DATETIME:
+    case TokenType::TIMESTAMP: return MemValue::Kind::DATETIME;
+    case TokenType::TIMEOFDAY: return MemValue::Kind::TIME;
+    case TokenType::NUMBER:
+    case TokenType::PLUS:
+    case TokenType::MINUS:
+    case TokenType::TIMES:
+    case TokenType::DIV: return MemValue::Kind::NUMBER;
+    case TokenType::IDENTIFIER:
+        if(e->sub().size()==0&&!e->noarg()) {
+            return ctx.tbl.kinds[columnIndex(e->data(),ctx)];
+        } else if(e->data()=="min"||e->data()=="max") {
+            return exprKind(e->sub()[0],ctx);
+        } else if(e->data()=="upper"||e->data()=="lower") {
+            return MemValue::Kind::STRING;
+        } else if(e->data()=="toDate") {
+            return MemValue::Kind::DATE;
+        } else if(e->data()=="now") {
+            return MemValue::Kind::DATETIME;
+        }
+        return MemValue::Kind::NUMBER;
+    default:
+        return MemValue::Kind::BOOLEAN;
+    }
+}
+
+/// Returns true if the expression contains an aggregate function
+static bool hasAggregate(const Query::Expr::CPtr &e)
+{
+    if(e->tp()==TokenType::IDENTIFIER&&e->sub().size()>0&&Query::isAggFunc(e->data())) { return true; }
+    for(const auto &s:e->sub()) {
+        if(hasAggregate(s)) { return true; }
+    }
+    return false;
+}
+
+/// Convert a value to the json representation used by the SQL connectors
+static Json::Value toJson(const MemValue &v)
+{
+    switch(v.kind) {
+    case MemValue::Kind::NONE: return Json::Value::null;
+    case MemValue::Kind::STRING: return Json::Value(v.str);
+    case MemValue::Kind::BOOLEAN: return Json::Value(v.num!=0);
+    case MemValue::Kind::NUMBER:
+        if(v.num==floor(v.num)&&fabs(v.num)<9e15) { return Json::Value(static_cast<Json::Int64>(v.num)); }
+        return Json::Value(v.num);
+    default:
+        return Json::Value(v.num);
+    }
+}
+
+GQL_SQL::DBQuery::Memory::Memory(const Json::Value &_init) : DB(_init)
+{
+    if(_init.isMember("fixtures")) { fixtures_=_init["fixtures"]; }
+}
+
+GQL_SQL::DBQuery::Memory::Memory(const URI &_uri) : DB(_uri)
+{
+    // memory:///abs/path.json or memory://rel/path.csv, the table name is
+    // the default table (or the file name without extension if not set)
+    std::string path=_uri.host()+_uri.path();
+    std::string name=path.substr(path.rfind('/')+1);
+    name=name.substr(0,name.rfind('.'));
+    fixtures_[name]=path;
+}
+
+/// Load all fixtures
+void GQL_SQL::DBQuery::Memory::connect()
+{
+    data_.clear();
+    try {
+        for(auto it=fixtures_.begin();it!=fixtures_.end();++it) {
+            data_[it.name()]=loadFixture(*it);
+        }
+    } catch(const std::exception &ex) {
+        LOG(ERROR) << "cannot load fixture: " << ex.what();
+        data_.clear();
+        return;
+    }
+    if(deftable_==""&&data_.size()==1) { deftable_=data_.begin()->first; }
+    parser_=std::shared_ptr<GQLParser::Parser>(new GQLParser::ParserGQL(deftable_,tables_,false));
+}
+
+/// Return true if the fixtures are loaded and the default table exists
+bool GQL_SQL::DBQuery::Memory::isConnected() const
+{
+    return parser_&&data_.count(deftable_)>0;
+}
+
+/// Evaluate the query on the in-memory table.
+/// The result has the same layout as the SQL connectors return it: for pivot
+/// queries the pivot and group columns come first and the rows are grouped
+/// by them.
+void GQL_SQL::DBQuery::Memory::getdata(const Result &q,Json::Value &tbl) const
+{
+    LOG(INFO) << "search: " << q.result;
+    auto query=q.query;
+    const MemoryTable &data=*data_.at(deftable_);
+    EvalContext ctx{data,deftable_,0,0};
+
+    // the expressions that make up the result
+    std::vector<Query::Expr::CPtr> exprs;
+    if(query->selectStar) {
+        for(const auto &n:data.names) {
+            exprs.push_back(Query::Expr::make(TokenType::IDENTIFIER,n));
+        }
+    } else {
+        for(const auto &p:query->pivot) {
+            exprs.push_back(Query::Expr::make(TokenType::IDENTIFIER,p.token));
+        }
+        if(query->pivot.size()) {
+            for(const auto &g:query->group) {
+                exprs.push_back(Query::Expr::make(TokenType::IDENTIFIER,g.token));
+            }
+        }
+        for(const auto &s:query->select) { exprs.push_back(s.expr); }
+    }
+
+    // where clause
+    std::vector<size_t> selected;
+    for(size_t r=0;r<data.rows.size();r++) {
+        if((r&1023)==0&&interrupted()) { throw GQLError(ErrorReasons::OTHER,"query interrupted"); }
+        ctx.row=&data.rows[r];
+        if(query->where) {
+            MemValue w=eval(query->where,ctx);
+            if(w.isNull()||w.num==0) { continue; }
+        }
+        selected.push_back(r);
+    }
+
+    // group by: the group keys are the pivot columns followed by the group columns
+    std::vector<size_t> keys;
+    for(const auto &p:query->pivot) { keys.push_back(columnIndex(p.token.to_string(),ctx)); }
+    for(const auto &g:query->group) { keys.push_back(columnIndex(g.token.to_string(),ctx)); }
+    bool grouped=keys.size()>0;
+    for(const auto &e:exprs) { grouped=grouped||hasAggregate(e); }
+
+    std::vector<std::vector<size_t>> groups;
+    if(grouped) {
+        std::stable_sort(selected.begin(),selected.end(),[&](size_t a,size_t b) {
+            for(auto k:keys) {
+                int c=compare(data.rows[a][k],data.rows[b][k]);
+                if(c) { return c<0; }
+            }
+            return false;
+        });
+        for(auto r:selected) {
+            bool same=groups.size()>0;
+            for(size_t i=0;same&&i<keys.size();i++) {
+                same=compare(data.rows[groups.back()[0]][keys[i]],data.rows[r][keys[i]])==0;
+            }
+            if(same) { groups.back().push_back(r); }
+            else { groups.push_back(std::vector<size_t>(1,r)); }
+        }
+        if(groups.size()==0&&keys.size()==0) {
+            // aggregates without group by return a single row
+            groups.push_back(std::vector<size_t>());
+        }
+    } else {
+        for(auto r:selected) { groups.push_back(std::vector<size_t>(1,r)); }
+    }
+
+    // evaluate the result and the order by expressions for each output row
+    std::vector<std::vector<MemValue>> nullValues(1,std::vector<MemValue>(data.names.size()));
+    std::vector<std::vector<MemValue>> out(groups.size());
+    std::vector<std::vector<MemValue>> order(groups.size());
+    for(size_t g=0;g<groups.size();g++) {
+        if((g&1023)==0&&interrupted()) { throw GQLError(ErrorReasons::OTHER,"query interrupted"); }
+        ctx.row=groups[g].size()?&data.rows[groups[g][0]]:&nullValues[0];
+        ctx.group=grouped?&groups[g]:0;
+        for(const auto &e:exprs) { out[g].push_back(eval(e,ctx)); }
+        for(const auto &o:query->order) { order[g].push_back(eval(o.expr,ctx)); }
+    }
+
+    std::vector<size_t> idx(groups.size());
+    for(size_t i=0;i<idx.size();i++) { idx[i]=i; }
+    if(query->order.size()) {
+        std::stable_sort(idx.begin(),idx.end(),[&](size_t a,size_t b) {
+            for(size_t o=0;o<query->order.size();o++) {
+                int c=compare(order[a][o],order[b][o]);
+                if(c) { return query->order[o].desc?c>0:c<0; }
+            }
+            return false;
+        });
+    }
+
+    // pivot queries are limited after pivoting, see DB::pivotTable()
+    bool pivot=query->hasPivotClause();
+    size_t start=pivot?0:std::min<size_t>(query->offset,idx.size());
+    size_t end=query->limit&&!pivot?std::min<size_t>(start+query->limit,idx.size()):idx.size();
+
+    ctx.row=&nullValues[0];
+    ctx.group=0;
+    Json::Value &cols=tbl["cols"];
+    cols.resize(static_cast<Json::ArrayIndex>(exprs.size()));
+    for(Json::ArrayIndex c=0;c<exprs.size();c++) {
+        cols[c]["id"]=query->selectStar?data.names[c]:exprs[c]->to_string();
+        cols[c]["type"]=typeFromKind(exprKind(exprs[c],ctx));
+    }
+    Json::Value &rows=tbl["rows"];
+    rows.resize(static_cast<Json::ArrayIndex>(end-start));
+    uint64_t used=0;
+    for(size_t r=start;r<end;r++) {
+        Json::Value &v=rows[static_cast<Json::ArrayIndex>(r-start)]["c"];
+        v.resize(static_cast<Json::ArrayIndex>(exprs.size()));
+        for(Json::ArrayIndex c=0;c<exprs.size();c++) {
+            v[c]["v"]=toJson(out[idx[r]][c]);
+        }
+        budget(static_cast<Json::ArrayIndex>(r-start+1),v,used);
+    }
+}
+
+GQL_SQL::DBQuery::Memory::~Memory() {
+    asyncStop();
+}
@@ -54,11 +54,75 @@ static std::string quoteString(const std::string &s)
     return quote+s+quote;
 }
 
-/// Convert an expression to a valid MySQL expression.
-static std::string mysqlExpr(GQL_SQL::GQLParser::Query::Expr::CPtr qe,std::set<std::string>&tables)
+/// LIKE pattern for the string s, PATTERN_PREFIX and PATTERN_SUFFIX of flags
+/// tell where to add '%', the wildcards of s are escaped with '!'
+static std::string mysqlLikePattern(const std::string &s,unsigned flags)
 {
-    std::string r;
-    switch(qe->tp()) {
+    std::string p=flags&GQL_SQL::GQLParser::ExprWriter::PATTERN_SUFFIX?"%":"";
+    for(char c:s) {
+        if(c=='%'||c=='_'||c=='!') { p+='!'; }
+        p+=c;
+    }
+    if(flags&GQL_SQL::GQLParser::ExprWriter::PATTERN_PREFIX) { p+='%'; }
+    return p;
+}
+
+/// Replace a literal by a placeholder and add its value to params
+static std::string mysqlParam(GQL_SQL::ParamType tp,const std::string &value,std::vector<GQL_SQL::Param> &params)
+{
+    params.push_back(GQL_SQL::Param{tp,value});
+    switch(tp) {
+    case GQL_SQL::ParamType::DATE: return "CAST(? AS DATE)";
+    case GQL_SQL::ParamType::DATETIME: return "CAST(? AS DATETIME(3))";
+    case GQL_SQL::ParamType::TIMEOFDAY: return "CAST(? AS TIME)";
+    case GQL_SQL::ParamType::STRING:
+    case GQL_SQL::ParamType::NUMBER:
+    case GQL_SQL::ParamType::ARRAY:
+        break;
+    }
+    return "?";
+}
+
+/// Quote a parameter value as a MySQL string literal, escaping all special characters
+static std::string quoteLiteralMySQL(const std::string &s)
+{
+    std::string r="'";
+    for(char c:s) {
+        switch(c) {
+        case '\0': r+="\\0"; break;
+        case '\n': r+="\\n"; break;
+        case '\r': r+="\\r"; break;
+        case '\032': r+="\\Z"; break;
+        case '\\': r+="\\\\"; break;
+        case '\'': r+="\\'"; break;
+        default: r+=c;
+        }
+    }
+    return r+"'";
+}
+
+/// Write 'x starts with', 'ends with' or 'contains' a literal as LIKE, which
+/// can use an index of x for prefixes
+static void mysqlLike(const GQL_SQL::GQLParser::Query::Expr &qe,GQL_SQL::GQLParser::ExprWriter &w)
+{
+    unsigned pattern=GQL_SQL::GQLParser::ExprWriter::PATTERN_PREFIX|GQL_SQL::GQLParser::ExprWriter::PATTERN_SUFFIX;
+    if(qe.tp()==GQL_SQL::GQLParser::TokenType::STARTS) {
+        pattern=GQL_SQL::GQLParser::ExprWriter::PATTERN_PREFIX;
+    } else if(qe.tp()==GQL_SQL::GQLParser::TokenType::ENDS) {
+        pattern=GQL_SQL::GQLParser::ExprWriter::PATTERN_SUFFIX;
+    }
+    w.text("(");
+    w.sub(qe.sub()[0]);
+    w.text(" LIKE ");
+    w.sub(qe.sub()[1],pattern);
+    w.text(" ESCAPE '!')");
+}
+
+/// Write one expression as valid MySQL expression, see mysqlExpr().
+static void mysqlNode(const GQL_SQL::GQLParser::Query::Expr &qe,GQL_SQL::GQLParser::ExprWriter &w,
+                      std::set<std::string>&tables,std::vector<GQL_SQL::Param> *params)
+{
+    switch(qe.tp()) {
     case GQL_SQL::GQLParser::TokenType::ASC:
     case GQL_SQL::GQLParser::TokenType::BY:
     case GQL_SQL::GQLParser::TokenType::COMMA:
@@ -79,30 +143,36 @@ static std::string mysqlExpr(GQL_SQL::GQLParser::Query::Expr::CPtr qe,std::set<s
     case GQL_SQL::GQLParser::TokenType::TIMESTAMP:
     case GQL_SQL::GQLParser::TokenType::WHERE:
     case GQL_SQL::GQLParser::TokenType::_UNDEFINED:
-        LOG(FATAL) << "got unusable token type " << qe->tp();
+        LOG(FATAL) << "got unusable token type " << qe.tp();
 
     case GQL_SQL::GQLParser::TokenType::IS_NULL:
-        r="("+mysqlExpr(qe->sub()[0],tables)+" IS NULL)";
+        w.text("(");
+        w.sub(qe.sub()[0]);
+        w.text(" IS NULL)");
         break;
 
     case GQL_SQL::GQLParser::TokenType::IS_NOT_NULL:
-        r="("+mysqlExpr(qe->sub()[0],tables)+" IS NOT NULL)";
+        w.text("(");
+        w.sub(qe.sub()[0]);
+        w.text(" IS NOT NULL)");
         break;
 
     case GQL_SQL::GQLParser::TokenType::GQL_FALSE:
-        r="FALSE";
+        w.text("FALSE");
         break;
     case GQL_SQL::GQLParser::TokenType::GQL_TRUE:
-        r="TRUE";
+        w.text("TRUE");
         break;
 
     case GQL_SQL::GQLParser::TokenType::PLUS:
     case GQL_SQL::GQLParser::TokenType::MINUS:
-        if(qe->sub().size()==1) {
-            if(qe->tp()==GQL_SQL::GQLParser::TokenType::PLUS) {
-                r+=mysqlExpr(qe->sub()[0],tables);
+        if(qe.sub().size()==1) {
+            if(qe.tp()==GQL_SQL::GQLParser::TokenType::PLUS) {
+                w.sub(qe.sub()[0]);
             } else {
-                r+="(-"+mysqlExpr(qe->sub()[0],tables)+")";
+                w.text("(-");
+                w.sub(qe.sub()[0]);
+                w.text(")");
             }
             break;
         }
@@ -115,103 +185,162 @@ static std::string mysqlExpr(GQL_SQL::GQLParser::Query::Expr::CPtr qe,std::set<s
     case GQL_SQL::GQLParser::TokenType::GE:
     case GQL_SQL::GQLParser::TokenType::EQ:
     case GQL_SQL::GQLParser::TokenType::NE:
-        assert(qe->sub().size()==2);
-        r+="("+mysqlExpr(qe->sub()[0],tables)+qe->data()+mysqlExpr(qe->sub()[1],tables)+")";
+        assert(qe.sub().size()==2);
+        w.text("(");
+        w.sub(qe.sub()[0]);
+        w.text(qe.data());
+        w.sub(qe.sub()[1]);
+        w.text(")");
         break;
 
     case GQL_SQL::GQLParser::TokenType::DATE:
-        r+="date "+qe->sub()[0]->to_string();
+        if(params) { w.text(mysqlParam(GQL_SQL::ParamType::DATE,qe.sub()[0]->data(),*params)); break; }
+        w.text("date "+qe.sub()[0]->to_string());
         break;
 
     case GQL_SQL::GQLParser::TokenType::DATETIME:
-        r+="CONVERT("+qe->sub()[0]->to_string()+",datetime(3))";
+        if(params) { w.text(mysqlParam(GQL_SQL::ParamType::DATETIME,qe.sub()[0]->data(),*params)); break; }
+        w.text("CONVERT("+qe.sub()[0]->to_string()+",datetime(3))");
         break;
 
     case GQL_SQL::GQLParser::TokenType::TIMEOFDAY:
-        r+="time "+qe->sub()[0]->to_string();
+        if(params) { w.text(mysqlParam(GQL_SQL::ParamType::TIMEOFDAY,qe.sub()[0]->data(),*params)); break; }
+        w.text("time "+qe.sub()[0]->to_string());
         break;
 
     case GQL_SQL::GQLParser::TokenType::LIKE:
+        assert(qe.sub().size()==2);
+        w.text("(");
+        w.sub(qe.sub()[0]);
+        w.text(" like ");
+        w.sub(qe.sub()[1]);
+        w.text(")");
+        break;
     case GQL_SQL::GQLParser::TokenType::AND:
     case GQL_SQL::GQLParser::TokenType::OR:
-        assert(qe->sub().size()==2);
-        r+="("+mysqlExpr(qe->sub()[0],tables)+" "+qe->data()+" "+mysqlExpr(qe->sub()[1],tables)+")";
+        {
+            // a chain of the same operator is written without nesting, the
+            // parser stack of the database may be too small for long filters
+            assert(qe.sub().size()==2);
+            const auto &l=qe.sub()[0];
+            bool parens=!(w.flags()&GQL_SQL::GQLParser::ExprWriter::NO_PARENS);
+            if(parens) { w.text("("); }
+            w.sub(l,l->tp()==qe.tp()?GQL_SQL::GQLParser::ExprWriter::NO_PARENS:0);
+            w.text(qe.tp()==GQL_SQL::GQLParser::TokenType::AND?" and ":" or ");
+            w.sub(qe.sub()[1]);
+            if(parens) { w.text(")"); }
+        }
+        break;
+    case GQL_SQL::GQLParser::TokenType::IN_SET:
+        w.text("(");
+        w.sub(qe.sub()[0]);
+        w.text(" IN (");
+        for(size_t i=1;i<qe.sub().size();i++) {
+            if(i>1) { w.text(","); }
+            w.sub(qe.sub()[i]);
+        }
+        w.text("))");
         break;
     case GQL_SQL::GQLParser::TokenType::NOT:
-        assert(qe->sub().size()==1);
-        r+="(not "+mysqlExpr(qe->sub()[0],tables)+")";
+        assert(qe.sub().size()==1);
+        w.text("(not ");
+        w.sub(qe.sub()[0]);
+        w.text(")");
         break;
     case GQL_SQL::GQLParser::TokenType::NUMBER:
-        r=qe->data();
+        if(params) { w.text(mysqlParam(GQL_SQL::ParamType::NUMBER,qe.data(),*params)); break; }
+        w.text(qe.data());
         break;
     case GQL_SQL::GQLParser::TokenType::STRING:
-        r=quoteString(qe->data());
+        if(w.flags()&(GQL_SQL::GQLParser::ExprWriter::PATTERN_PREFIX|GQL_SQL::GQLParser::ExprWriter::PATTERN_SUFFIX)) {
+            std::string pattern=mysqlLikePattern(qe.data(),w.flags());
+            w.text(params?mysqlParam(GQL_SQL::ParamType::STRING,pattern,*params):quoteString(pattern));
+            break;
+        }
+        if(params) { w.text(mysqlParam(GQL_SQL::ParamType::STRING,qe.data(),*params)); break; }
+        w.text(quoteString(qe.data()));
         break;
         
     case GQL_SQL::GQLParser::TokenType::MATCHES:
-        r="(";
-        r+=mysqlExpr(qe->sub()[0],tables);
-        r+=" REGEXP CONCAT('^',";
-        r+=mysqlExpr(qe->sub()[1],tables);
-        r+=",'$'))";
+        w.text("(");
+        w.sub(qe.sub()[0]);
+        w.text(" REGEXP CONCAT('^',");
+        w.sub(qe.sub()[1]);
+        w.text(",'$'))");
         break;
 
     case GQL_SQL::GQLParser::TokenType::ENDS:
-        r="(RIGHT(";
-        r+=mysqlExpr(qe->sub()[0],tables);
-        r+=",LENGTH(";
-        r+=mysqlExpr(qe->sub()[1],tables);
-        r+="))=";
-        r+=mysqlExpr(qe->sub()[1],tables);
-        r+=")";
+        if(qe.sub()[1]->tp()==GQL_SQL::GQLParser::TokenType::STRING) {
+            mysqlLike(qe,w);
+            break;
+        }
+        w.text("(RIGHT(");
+        w.sub(qe.sub()[0]);
+        w.text(",LENGTH(");
+        w.sub(qe.sub()[1]);
+        w.text("))=");
+        w.sub(qe.sub()[1]);
+        w.text(")");
         break;
 
     case GQL_SQL::GQLParser::TokenType::CONTAINS:
     case GQL_SQL::GQLParser::TokenType::STARTS:
+        if(qe.sub()[1]->tp()==GQL_SQL::GQLParser::TokenType::STRING) {
+            mysqlLike(qe,w);
+            break;
+        }
+        FALLTHROUGH
     case GQL_SQL::GQLParser::TokenType::IDENTIFIER:
-        if(qe->sub().size()==0 && !qe->noarg()) {
-            auto dot=qe->data().find(".");
-            if(dot!=std::string::npos && qe->data().rfind(".")==dot) {
-                auto tbl=qe->data().substr(0,dot);
+        if(qe.sub().size()==0 && !qe.noarg()) {
+            auto dot=qe.data().find(".");
+            if(dot!=std::string::npos && qe.data().rfind(".")==dot) {
+                auto tbl=qe.data().substr(0,dot);
                 tables.insert(tbl);
-                r=quoteIdentMYSQL(tbl);
-                r+=".";
-                r+=quoteIdentMYSQL(qe->data().substr(dot+1));
+                w.text(quoteIdentMYSQL(tbl));
+                w.text(".");
+                w.text(quoteIdentMYSQL(qe.data().substr(dot+1)));
             } else {
-                r=quoteIdentMYSQL(qe->data());
+                w.text(quoteIdentMYSQL(qe.data()));
                 tables.insert("");
             }
         } else {
-            std::string suffix="";
-            if(qe->data()=="starts") {
-                r="(INSTR";
+            const char *suffix="";
+            if(qe.data()=="starts") {
+                w.text("(INSTR");
                 suffix="=1)";
-            } else if(qe->data()=="contains") {
-                r="(INSTR";
+            } else if(qe.data()=="contains") {
+                w.text("(INSTR");
                 suffix=">0)";
-            } else if(qe->data()=="millisecond") {
-                r="(microsecond";
+            } else if(qe.data()=="millisecond") {
+                w.text("(microsecond");
                 suffix="/1000)";
-            } else if(qe->data()=="toDate") {
-                r="date";
+            } else if(qe.data()=="toDate") {
+                w.text("date");
             } else {
-                r=qe->data();
+                w.text(qe.data());
             }
-            r+="(";
+            w.text("(");
             int first=1;
-            for(auto e:qe->sub()) {
-                if(!first) { r+=", "; }
+            for(const auto &e:qe.sub()) {
+                if(!first) { w.text(", "); }
                 first=0;
-                r+=mysqlExpr(e,tables);
-            }
-            if(r[r.size()-1]==' ') {
-                r=r.substr(0,r.length()-1);
+                w.sub(e);
             }
-            r+=")";
-            r+=suffix;
+            w.text(")");
+            w.text(suffix);
         }
     }
-    return r;
+}
+
+/// Append qe as valid MySQL expression to r.
+/// If params is set literals are replaced by placeholders and added to params.
+static void mysqlExpr(std::string &r,const GQL_SQL::GQLParser::Query::Expr::CPtr &qe,std::set<std::string>&tables,
+                      std::vector<GQL_SQL::Param> *params)
+{
+    GQL_SQL::GQLParser::ExprWriter w(r);
+    w.run(*qe,[&](const GQL_SQL::GQLParser::Query::Expr &e,GQL_SQL::GQLParser::ExprWriter &ew) {
+        mysqlNode(e,ew,tables,params);
+    });
 }
 
 /// Create the MySQL query string that can then be sent to a MySQL DB
@@ -226,24 +355,24 @@ void GQL_SQL::GQLParser::ParserMySQL::createResult()
         r="select ";
         for(auto i:query_->pivot) {
             if(r!="select ") { r+=", "; }
-            r+=" "+quoteIdentMYSQL(i.token);
+            r+=" "+quoteIdentMYSQL(i.token.to_string());
         }
         if(query_->pivot.size()) {
             for(auto i:query_->group) {
-                r+=", "+quoteIdentMYSQL(i.token);
+                r+=", "+quoteIdentMYSQL(i.token.to_string());
             }
         }
         
         for(unsigned int i=0;i<query_->select.size();i++) {
             if(r!="select ") { r+=", "; }
             auto s=query_->select[i];
-            r+=mysqlExpr(s.expr,tables);
+            mysqlExpr(r,s.expr,tables,0);
         }
     }
     std::string qstring="";
     if(query_->where) {
         qstring=" where ";
-        qstring+=mysqlExpr(query_->where,tables);
+        mysqlExpr(qstring,query_->where,tables,parameterize_?&res_.params:0);
     }
     r+=" from ";
     bool addedTable=false;
@@ -270,14 +399,14 @@ void GQL_SQL::GQLParser::ParserMySQL::createResult()
         if(!first) { r+=","; }
         else { r+=" GROUP BY ";first=false; }
         first=false;
-        r+=" "+quoteIdentMYSQL(i.token);
+        r+=" "+quoteIdentMYSQL(i.token.to_string());
     }
 
     for(auto i:query_->group) {
         if(!first) { r+=","; }
         else { r+=" GROUP BY ";first=false; }
         first=false;
-        r+=" "+quoteIdentMYSQL(i.token);
+        r+=" "+quoteIdentMYSQL(i.token.to_string());
     }
 
     first=1;
@@ -285,17 +414,24 @@ void GQL_SQL::GQLParser::ParserMySQL::createResult()
         if(!first) { r+=", "; }
         else { r+=" ORDER BY "; }
         first=false;
-        r+=mysqlExpr(o.expr,tables);
+        mysqlExpr(r,o.expr,tables,0);
         if(o.desc) { r+=" DESC"; }
     }
-    if(query_->offset) {
-        if(query_->limit) {
-            r+=" LIMIT "+std::to_string(query_->offset)+", "+std::to_string(query_->limit);
+    // pivot queries are limited after pivoting, see DB::pivotTable()
+    bool pivot=query_->hasPivotClause();
+    uint64_t limit=sqlLimit();
+    if(query_->offset&&!pivot) {
+        if(limit) {
+            r+=" LIMIT "+std::to_string(query_->offset)+", "+std::to_string(limit);
         } else {
             r+=" LIMIT "+std::to_string(query_->offset)+", 18446744073709551615";
         }
-    } else if(query_->limit) {
-        r+=" LIMIT "+std::to_string(query_->limit);
+    } else if(limit) {
+        r+=" LIMIT "+std::to_string(limit);
+    }
+    if(timeout_&&r.compare(0,6,"select")==0) {
+        // MySQL 5.7.8+ stops the query on the server, MariaDB ignores the comment
+        r.insert(6," /*+ MAX_EXECUTION_TIME("+std::to_string(timeout_)+") */");
     }
     res_.result=r;
 }
@@ -312,132 +448,208 @@ enum class MYSQL_TPS {
     UINT=2,
     DOUBLE=3,
     DATE=4, // YYYY-MM-DD
-    TIME=5, // YYYY-MM-DD
-    DATETIME=6, // YYYY-MM-DD
+    TIME=5, // HH:MM:SS.mmm
+    DATETIME=6, // YYYY-MM-DD HH:MM:SS.mmm
+};
+
+/// Formats used to parse the dates returned by MySQL
+struct MySQLDateFormats {
+    UErrorCode status=U_ZERO_ERROR;  ///< result of creating the formats
+    SimpleDateFormat datetime{icu::UnicodeString::fromUTF8("yyyy-MM-dd HH:mm:ss.SSS"),status};
+    ///< datetime with milliseconds
+    SimpleDateFormat datetime2{icu::UnicodeString::fromUTF8("yyyy-MM-dd HH:mm:ss"),status};
+    ///< datetime without milliseconds
+    SimpleDateFormat date{icu::UnicodeString::fromUTF8("yyyy-MM-dd"),status};
+    ///< date
+};
+
+/// Converts a non NULL MySQL field to a json value. Each column picks its
+/// specialization once, the row loop calls it through a function pointer.
+template<MYSQL_TPS T>
+static void mysqlConvert(const mysqlpp::String &c,Json::Value &v,const MySQLDateFormats &fmt);
+
+template<>
+void mysqlConvert<MYSQL_TPS::STRING>(const mysqlpp::String &c,Json::Value &v,const MySQLDateFormats &)
+{
+    v=Json::Value(c.data(),c.data()+c.length());
+}
+
+template<>
+void mysqlConvert<MYSQL_TPS::INT>(const mysqlpp::String &c,Json::Value &v,const MySQLDateFormats &)
+{
+    v=Json::Value(static_cast<Json::Int64>(c));
+}
+
+template<>
+void mysqlConvert<MYSQL_TPS::UINT>(const mysqlpp::String &c,Json::Value &v,const MySQLDateFormats &)
+{
+    v=Json::Value(static_cast<Json::UInt64>(c));
+}
+
+template<>
+void mysqlConvert<MYSQL_TPS::DOUBLE>(const mysqlpp::String &c,Json::Value &v,const MySQLDateFormats &)
+{
+    v=Json::Value(static_cast<double>(c));
+}
+
+template<>
+void mysqlConvert<MYSQL_TPS::TIME>(const mysqlpp::String &c,Json::Value &v,const MySQLDateFormats &)
+{
+    int hour=0,min=0,sec=0,milli=0;
+    sscanf(c.c_str(),"%d:%d:%d.%d",&hour,&min,&sec,&milli);
+    v=Json::Value((hour*3600+min*60+sec)+milli/1000.0);
+}
+
+template<>
+void mysqlConvert<MYSQL_TPS::DATE>(const mysqlpp::String &c,Json::Value &v,const MySQLDateFormats &fmt)
+{
+    if(c=="0000-00-00") {
+        v=Json::Value(static_cast<Json::Int64>(GQL_SQL::DBQuery::MIN_DATE));
+        return;
+    }
+    UErrorCode udres=U_ZERO_ERROR;
+    auto ud=fmt.date.parse(c.data(),udres);
+    if(U_SUCCESS(udres)) {
+        v=Json::Value(ud/1000.0);
+    } else {
+        v=Json::Value(0); // FIXME: throw error instead?
+    }
+}
+
+template<>
+void mysqlConvert<MYSQL_TPS::DATETIME>(const mysqlpp::String &c,Json::Value &v,const MySQLDateFormats &fmt)
+{
+    if(c=="0000-00-00 00:00:00.000") {
+        v=Json::Value(static_cast<Json::Int64>(GQL_SQL::DBQuery::MIN_DATE));
+        return;
+    }
+    UErrorCode udres=U_ZERO_ERROR;
+    auto ud=fmt.datetime.parse(c.data(),udres);
+    if(!U_SUCCESS(udres)) {
+        udres=U_ZERO_ERROR;
+        ud=fmt.datetime2.parse(c.data(),udres);
+    }
+    VLOG(2) << "c=" << c.data() << "  ud=" << ud << "  " << u_errorName(udres);
+    if(U_SUCCESS(udres)) {
+        v=Json::Value(ud/1000.0);
+    } else {
+        v=Json::Value(0); // FIXME? throw error instead?
+    }
+}
+
+/// Converter of a non NULL MySQL field
+typedef void (*MySQLConverter)(const mysqlpp::String &c,Json::Value &v,const MySQLDateFormats &fmt);
+
+/// Converters, indexed by MYSQL_TPS
+static const MySQLConverter mysqlconverters[] {
+    mysqlConvert<MYSQL_TPS::STRING>,
+    mysqlConvert<MYSQL_TPS::INT>,
+    mysqlConvert<MYSQL_TPS::UINT>,
+    mysqlConvert<MYSQL_TPS::DOUBLE>,
+    mysqlConvert<MYSQL_TPS::DATE>,
+    mysqlConvert<MYSQL_TPS::TIME>,
+    mysqlConvert<MYSQL_TPS::DATETIME>,
 };
 
+static_assert(sizeof(mysqlconverters)/sizeof(mysqlconverters[0])==static_cast<size_t>(MYSQL_TPS::DATETIME)+1,
+              "mysqlconverters must have one entry per MYSQL_TPS");
+
 /// Return the data from the query in json format
-void GQL_SQL::DBQuery::MySQL::getdata(const std::string &q,Json::Value &tbl) const
+void GQL_SQL::DBQuery::MySQL::getdata(const Result &q,Json::Value &tbl) const
 {
-    LOG(INFO) << "search: " << q;
-    auto query=connection_->query(q);
-    auto rows=query.store();
+    LOG(INFO) << "search: " << q.result;
+    mysqlpp::StoreQueryResult rows;
+    if(q.params.empty()) {
+        auto query=connection_->query(q.result);
+        rows=query.store();
+    } else {
+        rows=executePrepared(q);
+    }
     tbl["cols"]=Json::Value();
     Json::Value &cols=tbl["cols"];
     uint32_t colcount=static_cast<uint32_t>(rows.field_names()->size());
     cols.resize(colcount);
-    std::vector<MYSQL_TPS> convs;
-    convs.resize(colcount);
+    std::vector<MYSQL_TPS> tps;
+    tps.resize(colcount);
 
     for (int32_t i = 0; i < static_cast<int32_t>(colcount); i++) {
         cols[i]["id"]=rows.field_name(i);
         std::string ctype=rows.field_type(i).name();
         std::string stype=rows.field_type(i).sql_name();
         size_t ci=static_cast<size_t>(i);
-        if(ctype=="m") { cols[i]["type"]="number";convs[ci]=MYSQL_TPS::UINT; }
-        else if(ctype=="s"||ctype=="i"||ctype=="ctype"||ctype=="l"||ctype=="j"||stype.find("TINYINT")!=std::string::npos||stype.find("BIGINT")!=std::string::npos||stype.substr(0,3)=="INT") { cols[i]["type"]="number";convs[ci]=MYSQL_TPS::INT; }
-        else if(ctype=="d"||ctype=="f"||stype.find("DOUBLE")!=std::string::npos||stype.find("DECIMAL")!=std::string::npos) { cols[i]["type"]="number";convs[ci]=MYSQL_TPS::DOUBLE; }
-        else if(ctype.find("DateTime")!=std::string::npos) { cols[i]["type"]=TYPE_DATETIME;convs[ci]=MYSQL_TPS::DATETIME; }
-        else if(ctype.find("Date")!=std::string::npos) { cols[i]["type"]=TYPE_DATE;convs[ci]=MYSQL_TPS::DATE; }
-        else if(ctype.find("Time")!=std::string::npos) { cols[i]["type"]=TYPE_TIME;convs[ci]=MYSQL_TPS::TIME; }
+        if(ctype=="m") { cols[i]["type"]="number";tps[ci]=MYSQL_TPS::UINT; }
+        else if(ctype=="s"||ctype=="i"||ctype=="ctype"||ctype=="l"||ctype=="j"||stype.find("TINYINT")!=std::string::npos||stype.find("BIGINT")!=std::string::npos||stype.substr(0,3)=="INT") { cols[i]["type"]="number";tps[ci]=MYSQL_TPS::INT; }
+        else if(ctype=="d"||ctype=="f"||stype.find("DOUBLE")!=std::string::npos||stype.find("DECIMAL")!=std::string::npos) { cols[i]["type"]="number";tps[ci]=MYSQL_TPS::DOUBLE; }
+        else if(ctype.find("DateTime")!=std::string::npos) { cols[i]["type"]=TYPE_DATETIME;tps[ci]=MYSQL_TPS::DATETIME; }
+        else if(ctype.find("Date")!=std::string::npos) { cols[i]["type"]=TYPE_DATE;tps[ci]=MYSQL_TPS::DATE; }
+        else if(ctype.find("Time")!=std::string::npos) { cols[i]["type"]=TYPE_TIME;tps[ci]=MYSQL_TPS::TIME; }
         else { cols[i]["type"]="string"; }
 
 #if 0
         LOG(INFO) << "type=" << ctype 
                     << "  sqlname=" << rows.field_type(i).sql_name() 
                     << "  id=" << rows.field_type(i).id() 
-                    << "  convs=" << static_cast<int>(convs[ci])
+                    << "  convs=" << static_cast<int>(tps[ci])
                     << "  " << cols[i]["id"];
 #endif
     }
+    std::vector<MySQLConverter> convs;
+    convs.reserve(colcount);
+    for(auto t:tps) { convs.push_back(mysqlconverters[static_cast<int>(t)]); }
 
-    icu::UnicodeString upattern=icu::UnicodeString::fromUTF8("yyyy-MM-dd HH:mm:ss.SSS");
-    UErrorCode dateuce=U_ZERO_ERROR;
-    SimpleDateFormat datetimefmt(upattern, dateuce);
-    icu::UnicodeString upattern2=icu::UnicodeString::fromUTF8("yyyy-MM-dd HH:mm:ss");
-    dateuce=U_ZERO_ERROR;
-    SimpleDateFormat datetimefmt2(upattern2, dateuce);
-    upattern=icu::UnicodeString::fromUTF8("yyyy-MM-dd");
-    SimpleDateFormat datefmt(upattern, dateuce);
+    MySQLDateFormats fmt;
     tbl["rows"]=Json::Value();
     Json::Value &res=tbl["rows"];
     res.resize(static_cast<uint32_t>(rows.num_rows()));
     int rcnt=0;
-    for(auto r:rows) {
+    uint64_t used=0;
+    for(const auto &r:rows) {
         res[rcnt]=Json::Value();
         res[rcnt]["c"]=Json::Value();
         Json::Value &v=res[rcnt]["c"];
         v.resize(static_cast<uint32_t>(r.size()));
         int ccnt=0;
-        for(auto c:r) {
-            v[ccnt]=Json::Value();
-            if(c.is_null()) {
-                v[ccnt]["v"]=Json::Value::null;
-            } else {
-                switch(convs[static_cast<size_t>(ccnt)]) {
-                case MYSQL_TPS::UINT:
-                    v[ccnt]["v"]=Json::Value(static_cast<Json::UInt64>(c));
-                    break;
-                case MYSQL_TPS::INT:
-                    v[ccnt]["v"]=Json::Value(static_cast<Json::Int64>(c));
-                    break;
-                case MYSQL_TPS::DOUBLE:
-                    v[ccnt]["v"]=static_cast<double>(c);
-                    break;
-                case MYSQL_TPS::TIME:
-                    {
-                        struct tm t;
-                        memset(&t,0,sizeof(t));
-                        int hour=0,min=0,sec=0,milli=0;
-                        sscanf(c.c_str(),"%d:%d:%d.%d",&hour,&min,&sec,&milli);
-                        v[ccnt]["v"]=(hour*3600+min*60+sec)+milli/1000.0;
-                    }
-                    break;
-                case MYSQL_TPS::DATE:
-                    {
-                        struct tm t;
-                        memset(&t,0,sizeof(t));
-                        ParsePosition pp(0);
-                        UErrorCode udres=U_ZERO_ERROR;
-                        auto ud=datefmt.parse(c.data(),udres);
-                        if(c=="0000-00-00") {
-                            v[ccnt]["v"]=MIN_DATE;
-                        } else if(U_SUCCESS(udres)) {
-                            v[ccnt]["v"]=ud/1000.0;
-                        } else {
-                            v[ccnt]["v"]=0; // FIXME: throw error instead?
-                        }
-                    }
-                    break;
-                case MYSQL_TPS::DATETIME:
-                    {
-                    struct tm t;
-                    memset(&t,0,sizeof(t));
-                    ParsePosition pp(0);
-                    UErrorCode udres=U_ZERO_ERROR;
-                    auto ud=datetimefmt.parse(c.data(),udres);
-                    if(!U_SUCCESS(udres)) {
-                        udres=U_ZERO_ERROR;
-                        ud=datetimefmt2.parse(c.data(),udres);
-                    }
-                    LOG(INFO) << "c=" << c.data() << "  ud=" << ud << "  " << u_errorName(udres);
-                    if(c=="0000-00-00 00:00:00.000") {
-                        v[ccnt]["v"]=MIN_DATE;
-                    } else if(U_SUCCESS(udres)) {
-                        v[ccnt]["v"]=ud/1000.0;
-                    } else {
-                        v[ccnt]["v"]=0; // FIXME? throw error instead?
-                    }
-                    }
-                    break;
-                case MYSQL_TPS::STRING:
-                    v[ccnt]["v"]=(c.data());
-                }
+        for(const auto &c:r) {
+            Json::Value &cell=v[ccnt]["v"];
+            if(!c.is_null()) {
+                convs[static_cast<size_t>(ccnt)](c,cell,fmt);
             }
             ++ccnt;
         }
         ++rcnt;
+        budget(static_cast<Json::ArrayIndex>(rcnt),v,used);
+    }
+}
+
+/// Run a query with parameters. MySQL++ does not support the binary protocol,
+/// so this uses the SQL syntax for prepared statements: each SQL query is
+/// prepared once per connection and then executed with user variables set
+/// to the parameter values.
+mysqlpp::StoreQueryResult GQL_SQL::DBQuery::MySQL::executePrepared(const Result &q) const
+{
+    std::string set="SET ";
+    std::string use="";
+    for(size_t i=0;i<q.params.size();i++) {
+        std::string var="@gql_p"+std::to_string(i);
+        if(i>0) { set+=", "; use+=", "; }
+        use+=var;
+        if(q.params[i].type==ParamType::NUMBER) {
+            set+=var+"="+q.params[i].value;
+        } else {
+            set+=var+"="+quoteLiteralMySQL(q.params[i].value);
+        }
+    }
+    const std::string *cached=statements_.find(q.result);
+    std::string name;
+    if(cached) {
+        name=*cached;
+    } else {
+        name="gql_stmt"+std::to_string(statementId_++);
+        connection_->query("PREPARE "+name+" FROM "+quoteLiteralMySQL(q.result)).execute();
+        statements_.insert(q.result,name);
     }
+    connection_->query(set).execute();
+    return connection_->query("EXECUTE "+name+" USING "+use).store();
 }
 
 /// Connect to a MySQL database
@@ -451,21 +663,57 @@ void GQL_SQL::DBQuery::MySQL::connect()
         connection_->set_option(scno);
         connection_->connect(db_.c_str(),server_.c_str(),user_.c_str(),password_.c_str(),port_);
         parser_=std::shared_ptr<GQLParser::Parser>(new GQLParser::ParserMySQL(deftable_,tables_,extendedFunctions_));
+        parser_->parameterizeSet(prepare_);
+        parser_->maxRowsSet(maxRows_);
+        parser_->timeoutSet(timeout_);
+        statements_=StatementCache<std::string>(statementCacheSize_,[this](const std::string &name) {
+            try {
+                connection_->query("DEALLOCATE PREPARE "+name).execute();
+            } catch(const mysqlpp::Exception &ex) {
+                LOG(WARNING) << "cannot deallocate " << name << ": " << ex.what();
+            }
+        });
         
         connection_->query("SET NAMES 'utf8';");
-        auto query=connection_->query("DESCRIBE `"+deftable_+"`");
-        defTableColumns_.clear();
-
-        auto rows=query.store();
-        for(const auto &r:rows) {
-            defTableColumns_.insert(r[0].data());
+        if(!schemaCached()) {
+            // one round trip for all tables
+            std::string in="";
+            schema_.clear();
+            for(const auto &t:schemaTables()) {
+                if(in!="") { in+=","; }
+                in+=quoteLiteralMySQL(t);
+                schema_[t]=TableSchema();
+            }
+            auto query=connection_->query("SELECT table_name, column_name, column_type FROM information_schema.columns"
+                                          " WHERE table_schema=DATABASE() AND table_name IN ("+in+")");
+            auto rows=query.store();
+            for(const auto &r:rows) {
+                schema_[r[0].c_str()][r[1].c_str()]=r[2].c_str();
+            }
+            schemaCache();
         }
+        parser_->schemaSet(schema_);
     } catch(const mysqlpp::ConnectionFailed &) {
         // ignore for now, isConnected() returns false and will be dealt
         // with during execute() to set a reasonable error.
     }
 }
 
+/// Stop the running query. The connection is busy until the query returns,
+/// so KILL QUERY is sent on a second connection with the same credentials.
+void GQL_SQL::DBQuery::MySQL::interrupt() const
+{
+    if(!connection_) { return; }
+    try {
+        mysqlpp::Connection killer(false);
+        if(killer.connect(db_.c_str(),server_.c_str(),user_.c_str(),password_.c_str(),port_)) {
+            killer.query("KILL QUERY "+std::to_string(connection_->thread_id())).execute();
+        }
+    } catch(const mysqlpp::Exception &ex) {
+        LOG(WARNING) << "cannot stop query: " << ex.what();
+    }
+}
+
 /// Return true if connected to a DB
 bool GQL_SQL::DBQuery::MySQL::isConnected() const 
 {
@@ -473,6 +721,7 @@ bool GQL_SQL::DBQuery::MySQL::isConnected() const
 }
 
 GQL_SQL::DBQuery::MySQL::~MySQL() {
+    asyncStop();
     if(connection_) {
         if(connection_->connected()) { connection_->disconnect(); }
 	delete connection_;
@@ -21,6 +21,7 @@
 
 
 #include <iostream>
+#include <algorithm>
 #include <cstdint>
 #include <unordered_map>
 #include <exception>
@@ -59,11 +60,93 @@ static std::string quoteString(const std::string &s)
     return quote+s+quote;
 }
 
-/// Convert an expression to a valid PostgreSQL expression.
-static std::string postgresqlExpr(GQL_SQL::GQLParser::Query::Expr::CPtr qe,std::set<std::string>&tables)
+/// Replace a literal by a placeholder and add its value to params.
+/// Strings are left untyped so PostgreSQL infers the type from the context
+/// like it does for literals, all others are cast explicitly.
+static std::string postgresqlParam(GQL_SQL::ParamType tp,const std::string &value,std::vector<GQL_SQL::Param> &params)
 {
-    std::string r;
-    switch(qe->tp()) {
+    params.push_back(GQL_SQL::Param{tp,value});
+    std::string r="$"+std::to_string(params.size());
+    switch(tp) {
+    case GQL_SQL::ParamType::STRING: break;
+    case GQL_SQL::ParamType::NUMBER:
+        r+=value.find_first_of(".eE")==std::string::npos?"::int8":"::numeric";
+        break;
+    case GQL_SQL::ParamType::DATE: r+="::date"; break;
+    case GQL_SQL::ParamType::DATETIME: r+="::timestamp"; break;
+    case GQL_SQL::ParamType::TIMEOFDAY: r+="::time"; break;
+    case GQL_SQL::ParamType::ARRAY: break;
+    }
+    return r;
+}
+
+/// Replace the literals of an IN set by a single array parameter, so that the
+/// query is the same for any number of values.
+static std::string postgresqlArrayParam(const GQL_SQL::GQLParser::Query::Expr &in,std::vector<GQL_SQL::Param> &params)
+{
+    std::string value="{";
+    bool integer=true;
+    for(size_t i=1;i<in.sub().size();i++) {
+        const auto &l=*in.sub()[i];
+        // dates and times keep their value in a sub expression
+        const std::string &v=l.sub().size()>0?l.sub()[0]->data():l.data();
+        integer=integer&&v.find_first_of(".eE")==std::string::npos;
+        if(i>1) { value+=","; }
+        value+="\"";
+        for(char c:v) {
+            if(c=='"'||c=='\\') { value+="\\"; }
+            value+=c;
+        }
+        value+="\"";
+    }
+    params.push_back(GQL_SQL::Param{GQL_SQL::ParamType::ARRAY,value+"}"});
+    std::string r="$"+std::to_string(params.size());
+    switch(in.sub()[1]->tp()) {
+    case GQL_SQL::GQLParser::TokenType::NUMBER: r+=integer?"::int8[]":"::numeric[]"; break;
+    case GQL_SQL::GQLParser::TokenType::DATE: r+="::date[]"; break;
+    case GQL_SQL::GQLParser::TokenType::DATETIME: r+="::timestamp[]"; break;
+    case GQL_SQL::GQLParser::TokenType::TIMEOFDAY: r+="::time[]"; break;
+    default: break; // strings are left untyped, see postgresqlParam()
+    }
+    return r;
+}
+
+/// LIKE pattern for the string s, PATTERN_PREFIX and PATTERN_SUFFIX of flags
+/// tell where to add '%', the wildcards of s are escaped with the default '\'
+static std::string postgresqlLikePattern(const std::string &s,unsigned flags)
+{
+    std::string p=flags&GQL_SQL::GQLParser::ExprWriter::PATTERN_SUFFIX?"%":"";
+    for(char c:s) {
+        if(c=='%'||c=='_'||c=='\\') { p+='\\'; }
+        p+=c;
+    }
+    if(flags&GQL_SQL::GQLParser::ExprWriter::PATTERN_PREFIX) { p+='%'; }
+    return p;
+}
+
+/// Write 'x starts with', 'ends with' or 'contains' a literal as LIKE. With a
+/// constant prefix the planner can use a btree index of x with text_pattern_ops
+/// (or the C collation).
+static void postgresqlLike(const GQL_SQL::GQLParser::Query::Expr &qe,GQL_SQL::GQLParser::ExprWriter &w)
+{
+    unsigned pattern=GQL_SQL::GQLParser::ExprWriter::PATTERN_PREFIX|GQL_SQL::GQLParser::ExprWriter::PATTERN_SUFFIX;
+    if(qe.tp()==GQL_SQL::GQLParser::TokenType::STARTS) {
+        pattern=GQL_SQL::GQLParser::ExprWriter::PATTERN_PREFIX;
+    } else if(qe.tp()==GQL_SQL::GQLParser::TokenType::ENDS) {
+        pattern=GQL_SQL::GQLParser::ExprWriter::PATTERN_SUFFIX;
+    }
+    w.text("(");
+    w.sub(qe.sub()[0]);
+    w.text(" LIKE ");
+    w.sub(qe.sub()[1],pattern);
+    w.text(")");
+}
+
+/// Write one expression as valid PostgreSQL expression, see postgresqlExpr().
+static void postgresqlNode(const GQL_SQL::GQLParser::Query::Expr &qe,GQL_SQL::GQLParser::ExprWriter &w,
+                           std::set<std::string>&tables,std::vector<GQL_SQL::Param> *params)
+{
+    switch(qe.tp()) {
     case GQL_SQL::GQLParser::TokenType::ASC:
     case GQL_SQL::GQLParser::TokenType::BY:
     case GQL_SQL::GQLParser::TokenType::COMMA:
@@ -84,31 +167,37 @@ static std::string postgresqlExpr(GQL_SQL::GQLParser::Query::Expr::CPtr qe,std::
     case GQL_SQL::GQLParser::TokenType::TIMESTAMP:
     case GQL_SQL::GQLParser::TokenType::WHERE:
     case GQL_SQL::GQLParser::TokenType::_UNDEFINED:
-        LOG(FATAL) << "got unusable token type " << qe->tp();
+        LOG(FATAL) << "got unusable token type " << qe.tp();
 
     case GQL_SQL::GQLParser::TokenType::GQL_FALSE:
-        r="FALSE";
+        w.text("FALSE");
         break;
     case GQL_SQL::GQLParser::TokenType::GQL_TRUE:
-        r="TRUE";
+        w.text("TRUE");
         break;
 
     case GQL_SQL::GQLParser::TokenType::IS_NULL:
-        r="("+postgresqlExpr(qe->sub()[0],tables)+" IS NULL)";
+        w.text("(");
+        w.sub(qe.sub()[0]);
+        w.text(" IS NULL)");
         break;
 
     case GQL_SQL::GQLParser::TokenType::IS_NOT_NULL:
-        r="("+postgresqlExpr(qe->sub()[0],tables)+" IS NOT NULL)";
+        w.text("(");
+        w.sub(qe.sub()[0]);
+        w.text(" IS NOT NULL)");
         break;
 
 
     case GQL_SQL::GQLParser::TokenType::PLUS:
     case GQL_SQL::GQLParser::TokenType::MINUS:
-        if(qe->sub().size()==1) {
-            if(qe->tp()==GQL_SQL::GQLParser::TokenType::PLUS) {
-                r+=postgresqlExpr(qe->sub()[0],tables);
+        if(qe.sub().size()==1) {
+            if(qe.tp()==GQL_SQL::GQLParser::TokenType::PLUS) {
+                w.sub(qe.sub()[0]);
             } else {
-                r+="(-"+postgresqlExpr(qe->sub()[0],tables)+")";
+                w.text("(-");
+                w.sub(qe.sub()[0]);
+                w.text(")");
             }
             break;
         }
@@ -121,130 +210,197 @@ static std::string postgresqlExpr(GQL_SQL::GQLParser::Query::Expr::CPtr qe,std::
     case GQL_SQL::GQLParser::TokenType::GE:
     case GQL_SQL::GQLParser::TokenType::EQ:
     case GQL_SQL::GQLParser::TokenType::NE:
-        assert(qe->sub().size()==2);
-        r+="("+postgresqlExpr(qe->sub()[0],tables)+qe->data()+postgresqlExpr(qe->sub()[1],tables)+")";
+        assert(qe.sub().size()==2);
+        w.text("(");
+        w.sub(qe.sub()[0]);
+        w.text(qe.data());
+        w.sub(qe.sub()[1]);
+        w.text(")");
         break;
 
     case GQL_SQL::GQLParser::TokenType::DATE:
-        r+="date "+qe->sub()[0]->to_string();
+        if(params) { w.text(postgresqlParam(GQL_SQL::ParamType::DATE,qe.sub()[0]->data(),*params)); break; }
+        w.text("date "+qe.sub()[0]->to_string());
         break;
 
     case GQL_SQL::GQLParser::TokenType::DATETIME:
-        r+="timestamp "+qe->sub()[0]->to_string();
+        if(params) { w.text(postgresqlParam(GQL_SQL::ParamType::DATETIME,qe.sub()[0]->data(),*params)); break; }
+        w.text("timestamp "+qe.sub()[0]->to_string());
         break;
 
     case GQL_SQL::GQLParser::TokenType::TIMEOFDAY:
-        r+="time "+qe->sub()[0]->to_string();
+        if(params) { w.text(postgresqlParam(GQL_SQL::ParamType::TIMEOFDAY,qe.sub()[0]->data(),*params)); break; }
+        w.text("time "+qe.sub()[0]->to_string());
         break;
 
     case GQL_SQL::GQLParser::TokenType::LIKE:
+        assert(qe.sub().size()==2);
+        w.text("(");
+        w.sub(qe.sub()[0]);
+        w.text(" like ");
+        w.sub(qe.sub()[1]);
+        w.text(")");
+        break;
     case GQL_SQL::GQLParser::TokenType::AND:
     case GQL_SQL::GQLParser::TokenType::OR:
-        assert(qe->sub().size()==2);
-        r+="("+postgresqlExpr(qe->sub()[0],tables)+" "+qe->data()+" "+postgresqlExpr(qe->sub()[1],tables)+")";
+        {
+            // a chain of the same operator is written without nesting, the
+            // parser stack of the database may be too small for long filters
+            assert(qe.sub().size()==2);
+            const auto &l=qe.sub()[0];
+            bool parens=!(w.flags()&GQL_SQL::GQLParser::ExprWriter::NO_PARENS);
+            if(parens) { w.text("("); }
+            w.sub(l,l->tp()==qe.tp()?GQL_SQL::GQLParser::ExprWriter::NO_PARENS:0);
+            w.text(qe.tp()==GQL_SQL::GQLParser::TokenType::AND?" and ":" or ");
+            w.sub(qe.sub()[1]);
+            if(parens) { w.text(")"); }
+        }
+        break;
+    case GQL_SQL::GQLParser::TokenType::IN_SET:
+        w.text("(");
+        w.sub(qe.sub()[0]);
+        if(params) {
+            w.text(" = ANY("+postgresqlArrayParam(qe,*params)+"))");
+            break;
+        }
+        w.text(" IN (");
+        for(size_t i=1;i<qe.sub().size();i++) {
+            if(i>1) { w.text(","); }
+            w.sub(qe.sub()[i]);
+        }
+        w.text("))");
         break;
     case GQL_SQL::GQLParser::TokenType::NOT:
-        assert(qe->sub().size()==1);
-        r+="(not "+postgresqlExpr(qe->sub()[0],tables)+")";
+        assert(qe.sub().size()==1);
+        w.text("(not ");
+        w.sub(qe.sub()[0]);
+        w.text(")");
         break;
     case GQL_SQL::GQLParser::TokenType::NUMBER:
-        r=qe->data();
+        if(params) { w.text(postgresqlParam(GQL_SQL::ParamType::NUMBER,qe.data(),*params)); break; }
+        w.text(qe.data());
         break;
     case GQL_SQL::GQLParser::TokenType::STRING:
-        r=quoteString(qe->data());
+        if(w.flags()&(GQL_SQL::GQLParser::ExprWriter::PATTERN_PREFIX|GQL_SQL::GQLParser::ExprWriter::PATTERN_SUFFIX)) {
+            std::string pattern=postgresqlLikePattern(qe.data(),w.flags());
+            w.text(params?postgresqlParam(GQL_SQL::ParamType::STRING,pattern,*params):quoteString(pattern));
+            break;
+        }
+        if(params) { w.text(postgresqlParam(GQL_SQL::ParamType::STRING,qe.data(),*params)); break; }
+        w.text(quoteString(qe.data()));
         break;
         
     case GQL_SQL::GQLParser::TokenType::STARTS:
-        r="(LEFT(";
-        r+=postgresqlExpr(qe->sub()[0],tables);
-        r+=",LENGTH(";
-        r+=postgresqlExpr(qe->sub()[1],tables);
-        r+="))=";
-        r+=postgresqlExpr(qe->sub()[1],tables);
-        r+=")";
+        if(qe.sub()[1]->tp()==GQL_SQL::GQLParser::TokenType::STRING) {
+            postgresqlLike(qe,w);
+            break;
+        }
+        w.text("(LEFT(");
+        w.sub(qe.sub()[0]);
+        w.text(",LENGTH(");
+        w.sub(qe.sub()[1]);
+        w.text("))=");
+        w.sub(qe.sub()[1]);
+        w.text(")");
         break;
 
     case GQL_SQL::GQLParser::TokenType::MATCHES:
-        r="(";
-        r+=postgresqlExpr(qe->sub()[0],tables);
-        r+=" ~ CONCAT('^',";
-        r+=postgresqlExpr(qe->sub()[1],tables);
-        r+=",'$'))";
+        w.text("(");
+        w.sub(qe.sub()[0]);
+        // CONCAT takes any type, an untyped parameter needs a cast
+        w.text(" ~ CONCAT('^',CAST(");
+        w.sub(qe.sub()[1]);
+        w.text(" AS text),'$'))");
         break;
 
     case GQL_SQL::GQLParser::TokenType::ENDS:
-        r="(RIGHT(";
-        r+=postgresqlExpr(qe->sub()[0],tables);
-        r+=",LENGTH(";
-        r+=postgresqlExpr(qe->sub()[1],tables);
-        r+="))=";
-        r+=postgresqlExpr(qe->sub()[1],tables);
-        r+=")";
+        if(qe.sub()[1]->tp()==GQL_SQL::GQLParser::TokenType::STRING) {
+            postgresqlLike(qe,w);
+            break;
+        }
+        w.text("(RIGHT(");
+        w.sub(qe.sub()[0]);
+        w.text(",LENGTH(");
+        w.sub(qe.sub()[1]);
+        w.text("))=");
+        w.sub(qe.sub()[1]);
+        w.text(")");
         break;
 
     case GQL_SQL::GQLParser::TokenType::CONTAINS:
-        r="(POSITION(";
-        r+=postgresqlExpr(qe->sub()[1],tables);
-        r+=" IN ";
-        r+=postgresqlExpr(qe->sub()[0],tables);
-        r+=")>0)";
+        if(qe.sub()[1]->tp()==GQL_SQL::GQLParser::TokenType::STRING) {
+            postgresqlLike(qe,w);
+            break;
+        }
+        w.text("(POSITION(");
+        w.sub(qe.sub()[1]);
+        w.text(" IN ");
+        w.sub(qe.sub()[0]);
+        w.text(")>0)");
         break;
 
     case GQL_SQL::GQLParser::TokenType::IDENTIFIER:
-        if(qe->sub().size()==0 && !qe->noarg()) {
-            auto dot=qe->data().find(".");
-            if(dot!=std::string::npos && qe->data().rfind(".")==dot) {
-                auto tbl=qe->data().substr(0,dot);
+        if(qe.sub().size()==0 && !qe.noarg()) {
+            auto dot=qe.data().find(".");
+            if(dot!=std::string::npos && qe.data().rfind(".")==dot) {
+                auto tbl=qe.data().substr(0,dot);
                 tables.insert(tbl);
-                r=quoteIdentPostgreSQL(tbl);
-                r+=".";
-                r+=quoteIdentPostgreSQL(qe->data().substr(dot+1));
+                w.text(quoteIdentPostgreSQL(tbl));
+                w.text(".");
+                w.text(quoteIdentPostgreSQL(qe.data().substr(dot+1)));
             } else {
-                r=quoteIdentPostgreSQL(qe->data());
+                w.text(quoteIdentPostgreSQL(qe.data()));
                 tables.insert("");
             }
         } else {
-            std::string suffix="";
-            std::string sep=", ";
-            if(qe->data()=="starts") {
-                r="(INSTR";
+            const char *suffix="";
+            const char *sep=", ";
+            if(qe.data()=="starts") {
+                w.text("(INSTR");
                 suffix="=1)";
-            } else if(qe->data()=="contains") {
-                r="(INSTR";
+            } else if(qe.data()=="contains") {
+                w.text("(INSTR");
                 suffix=">0)";
-            } else if(extracts.count(qe->data())) {
-                r="(EXTRACT("+qe->data()+" FROM";
+            } else if(extracts.count(qe.data())) {
+                w.text("(EXTRACT("+qe.data()+" FROM");
                 suffix="))";
-            } else if(qe->data()=="second") {
-                r="floor(EXTRACT(SECONDS FROM";
+            } else if(qe.data()=="second") {
+                w.text("floor(EXTRACT(SECONDS FROM");
                 suffix="))";
-            } else if(qe->data()=="millisecond") {
-                r="(EXTRACT(MILLISECONDS FROM";
+            } else if(qe.data()=="millisecond") {
+                w.text("(EXTRACT(MILLISECONDS FROM");
                 suffix=")::int % 1000)";
-            } else if(qe->data()=="dateDiff") {
-                r="(EXTRACT(DAY FROM ";
+            } else if(qe.data()=="dateDiff") {
+                w.text("(EXTRACT(DAY FROM ");
                 sep="-";
                 suffix="))";
-            } else if(qe->data()=="toDate") {
-                r="date";
+            } else if(qe.data()=="toDate") {
+                w.text("date");
             } else {
-                r=qe->data();
+                w.text(qe.data());
             }
-            r+="(";
+            w.text("(");
             int first=1;
-            for(auto e:qe->sub()) {
-                if(!first) { r+=sep; }
+            for(const auto &e:qe.sub()) {
+                if(!first) { w.text(sep); }
                 first=0;
-                r+=postgresqlExpr(e,tables);
-            }
-            if(r[r.size()-1]==' ') {
-                r=r.substr(0,r.length()-1);
+                w.sub(e);
             }
-            r+=")";
-            r+=suffix;
+            w.text(")");
+            w.text(suffix);
         }
     }
-    return r;
+}
+
+/// Append qe as valid PostgreSQL expression to r.
+/// If params is set literals are replaced by placeholders and added to params.
+static void postgresqlExpr(std::string &r,const GQL_SQL::GQLParser::Query::Expr::CPtr &qe,std::set<std::string>&tables,
+                           std::vector<GQL_SQL::Param> *params)
+{
+    GQL_SQL::GQLParser::ExprWriter w(r);
+    w.run(*qe,[&](const GQL_SQL::GQLParser::Query::Expr &e,GQL_SQL::GQLParser::ExprWriter &ew) {
+        postgresqlNode(e,ew,tables,params);
+    });
 }
 
 /// Create the PostgreSQL query string that can then be sent to a MySQL DB
@@ -259,24 +415,24 @@ void GQL_SQL::GQLParser::ParserPostgreSQL::createResult()
         r="select ";
         for(auto i:query_->pivot) {
             if(r!="select ") { r+=", "; }
-            r+=" "+quoteIdentPostgreSQL(i.token);
+            r+=" "+quoteIdentPostgreSQL(i.token.to_string());
         }
         if(query_->pivot.size()) {
             for(auto i:query_->group) {
-                r+=", "+quoteIdentPostgreSQL(i.token);
+                r+=", "+quoteIdentPostgreSQL(i.token.to_string());
             }
         }
         
         for(unsigned int i=0;i<query_->select.size();i++) {
             if(r!="select ") { r+=", "; }
             auto s=query_->select[i];
-            r+=postgresqlExpr(s.expr,tables);
+            postgresqlExpr(r,s.expr,tables,0);
         }
     }
     std::string qstring="";
     if(query_->where) {
         qstring=" where ";
-        qstring+=postgresqlExpr(query_->where,tables);
+        postgresqlExpr(qstring,query_->where,tables,parameterize_?&res_.params:0);
     }
     r+=" from ";
     bool addedTable=false;
@@ -304,14 +460,14 @@ void GQL_SQL::GQLParser::ParserPostgreSQL::createResult()
         if(!first) { r+=","; }
         else { r+=" GROUP BY ";first=false; }
         first=false;
-        r+=" "+quoteIdentPostgreSQL(i.token);
+        r+=" "+quoteIdentPostgreSQL(i.token.to_string());
     }
 
     for(auto i:query_->group) {
         if(!first) { r+=","; }
         else { r+=" GROUP BY ";first=false; }
         first=false;
-        r+=" "+quoteIdentPostgreSQL(i.token);
+        r+=" "+quoteIdentPostgreSQL(i.token.to_string());
     }
 
     first=1;
@@ -319,13 +475,16 @@ void GQL_SQL::GQLParser::ParserPostgreSQL::createResult()
         if(!first) { r+=", "; }
         else { r+=" ORDER BY "; }
         first=false;
-        r+=postgresqlExpr(o.expr,tables);
+        postgresqlExpr(r,o.expr,tables,0);
         if(o.desc) { r+=" DESC"; }
     }
-    if(query_->limit) {
-        r+=" LIMIT "+std::to_string(query_->limit);
+    // pivot queries are limited after pivoting, see DB::pivotTable()
+    bool pivot=query_->hasPivotClause();
+    uint64_t limit=sqlLimit();
+    if(limit) {
+        r+=" LIMIT "+std::to_string(limit);
     }
-    if(query_->offset) {
+    if(query_->offset&&!pivot) {
         r+=" OFFSET "+std::to_string(query_->offset);
     }
     res_.result=r;
@@ -343,14 +502,36 @@ void GQL_SQL::DBQuery::PostgreSQL::connect()
         options+=" password="+password_;
         connection_=new pqxx::connection(options);
         parser_=std::shared_ptr<GQLParser::Parser>(new GQLParser::ParserPostgreSQL(deftable_,tables_,extendedFunctions_));
+        parser_->parameterizeSet(prepare_);
+        parser_->maxRowsSet(maxRows_);
+        statements_=StatementCache<std::string>(statementCacheSize_,[this](const std::string &name) {
+            try {
+                connection_->unprepare(name);
+            } catch(const std::exception &ex) {
+                LOG(WARNING) << "cannot deallocate " << name << ": " << ex.what();
+            }
+        });
+        baseTypes_.clear();
         
-        pqxx::work txn{*connection_};
-        pqxx::result r=txn.exec("select column_name from INFORMATION_SCHEMA.COLUMNS where table_name = '"+deftable_+"'");
-        defTableColumns_.clear();
-        for (auto row: r) {
-            defTableColumns_.insert(row[0].as<std::string>());
+        if(!schemaCached()) {
+            // one round trip for all tables
+            pqxx::work txn{*connection_};
+            std::string in="";
+            schema_.clear();
+            for(const auto &t:schemaTables()) {
+                if(in!="") { in+=","; }
+                in+=txn.quote(t);
+                schema_[t]=TableSchema();
+            }
+            pqxx::result r=txn.exec("select table_name, column_name, data_type from INFORMATION_SCHEMA.COLUMNS"
+                                    " where table_schema = ANY(current_schemas(false)) and table_name in ("+in+")");
+            for (auto row: r) {
+                schema_[row[0].as<std::string>()][row[1].as<std::string>()]=row[2].as<std::string>();
+            }
+            txn.commit();
+            schemaCache();
         }
-        txn.commit();
+        parser_->schemaSet(schema_);
     } catch(const pqxx::broken_connection &) {
         // ignore for now, isConnected() returns false and will be dealt
         // with during execute() to set a reasonable error.
@@ -358,6 +539,7 @@ void GQL_SQL::DBQuery::PostgreSQL::connect()
 }
 
 GQL_SQL::DBQuery::PostgreSQL::~PostgreSQL() {
+    asyncStop();
     if(connection_) {
 	delete connection_;
     }
@@ -370,162 +552,353 @@ enum class PG_TYPES {
     BOOL=2,
     FLOAT=3,
     DATE=4, // YYYY-MM-DD
-    TIME=5, // YYYY-MM-DD
-    DATETIME=6, // YYYY-MM-DD
+    TIME=5, // HH:MM:SS.mmm
+    DATETIME=6, // YYYY-MM-DD HH:MM:SS.mmm
+};
+
+/// A built in PostgreSQL type
+struct PGType {
+    uint32_t oid;   ///< PostgreSQL type number
+    PG_TYPES type;  ///< how values of this type are converted
 };
 
-/// Map PostgreSQL type numbers to types used in this code
-const static std::map<uint32_t,PG_TYPES> pgtypes {
+/// Built in PostgreSQL types, sorted by oid (see getpysqlcatalog.py)
+static constexpr PGType pgtypes[] {
 #include "postgresql.pg_type"
 };
 
+/// Number of entries in pgtypes
+static constexpr size_t pgtypesSize=sizeof(pgtypes)/sizeof(pgtypes[0]);
+
+/// Returns true if pgtypes is sorted starting at index i
+static constexpr bool pgtypesSorted(size_t i=1)
+{
+    return i>=pgtypesSize || (pgtypes[i-1].oid<pgtypes[i].oid && pgtypesSorted(i+1));
+}
+
+static_assert(pgtypesSorted(),"postgresql.pg_type must be sorted by oid");
+
+/// oid of the text type, used for types that are not known
+static const uint32_t PG_TEXT_OID=25;
+
+/// Returns the built in type with the given oid or 0 if the oid is not a built in type
+static const PGType *pgtypeFind(uint32_t oid)
+{
+    auto t=std::lower_bound(pgtypes,pgtypes+pgtypesSize,oid,
+                            [](const PGType &a,uint32_t o) { return a.oid<o; });
+    return t!=pgtypes+pgtypesSize && t->oid==oid ? t : 0;
+}
+
+/// Formats used to parse the dates returned by PostgreSQL
+struct PGDateFormats {
+    UErrorCode status=U_ZERO_ERROR;  ///< result of creating the formats
+    SimpleDateFormat datetime{icu::UnicodeString::fromUTF8("yyyy-MM-dd HH:mm:ss.SSS"),status};
+    ///< timestamp
+    SimpleDateFormat datetimetz{icu::UnicodeString::fromUTF8("yyyy-MM-dd HH:mm:ssX"),status};
+    ///< timestamp with time zone
+    SimpleDateFormat date{icu::UnicodeString::fromUTF8("yyyy-MM-dd"),status};
+    ///< date
+};
+
+/// Converts a PostgreSQL field to a json value
+typedef void (*PGConverter)(const pqxx::field &c,Json::Value &v,const PGDateFormats &fmt);
+
+static void pgString(const pqxx::field &c,Json::Value &v,const PGDateFormats &)
+{
+    v=Json::Value(c.c_str(),c.c_str()+c.size());
+}
+
+static void pgBool(const pqxx::field &c,Json::Value &v,const PGDateFormats &)
+{
+    v=Json::Value(c.as<bool>());
+}
+
+static void pgInteger(const pqxx::field &c,Json::Value &v,const PGDateFormats &)
+{
+    v=Json::Value(static_cast<Json::Int64>(c.as<int64_t>()));
+}
+
+static void pgFloat(const pqxx::field &c,Json::Value &v,const PGDateFormats &)
+{
+    v=Json::Value(c.as<double>());
+}
+
+static void pgTime(const pqxx::field &c,Json::Value &v,const PGDateFormats &)
+{
+    int hour=0,min=0,sec=0,milli=0;
+    sscanf(c.c_str(),"%d:%d:%d.%d",&hour,&min,&sec,&milli);
+    v=Json::Value((hour*3600+min*60+sec)+milli/1000.0);
+}
+
+static void pgDate(const pqxx::field &c,Json::Value &v,const PGDateFormats &fmt)
+{
+    std::string cs=c.as<std::string>();
+    if(cs=="0000-00-00") {
+        v=Json::Value(static_cast<Json::Int64>(GQL_SQL::DBQuery::MIN_DATE));
+        return;
+    }
+    UErrorCode udres=U_ZERO_ERROR;
+    auto ud=fmt.date.parse(icu::UnicodeString::fromUTF8(cs),udres);
+    if(U_SUCCESS(udres)) {
+        v=Json::Value(ud/1000.0);
+    } else {
+        v=Json::Value(0); // FIXME? throw error instead?
+    }
+}
+
+static void pgDatetime(const pqxx::field &c,Json::Value &v,const PGDateFormats &fmt)
+{
+    std::string cs=c.as<std::string>();
+    if(cs=="0000-00-00 00:00:00.000") {
+        v=Json::Value(static_cast<Json::Int64>(GQL_SQL::DBQuery::MIN_DATE));
+        return;
+    }
+    UErrorCode udres=U_ZERO_ERROR;
+    auto ucs=icu::UnicodeString::fromUTF8(cs);
+    auto ud=fmt.datetime.parse(ucs,udres);
+    if(!U_SUCCESS(udres) && cs.length()>3 && (cs[cs.length()-3]=='+'||cs[cs.length()-3]=='-')) {
+        udres=U_ZERO_ERROR;
+        ud=fmt.datetimetz.parse(ucs,udres);
+    }
+    if(U_SUCCESS(udres)) {
+        v=Json::Value(ud/1000.0);
+    } else {
+        v=Json::Value(0); // FIXME? throw error instead?
+    }
+}
+
+/// NULL strings stay null
+static void pgNullString(const pqxx::field &,Json::Value &,const PGDateFormats &) { }
+
+/// NULL numbers, booleans and times are returned as 0
+static void pgNullZero(const pqxx::field &,Json::Value &v,const PGDateFormats &) { v=Json::Value(0); }
+
+/// NULL floats are returned as 0.0
+static void pgNullFloat(const pqxx::field &,Json::Value &v,const PGDateFormats &) { v=Json::Value(0.0); }
+
+/// NULL dates are returned as the smallest possible date
+static void pgNullDate(const pqxx::field &,Json::Value &v,const PGDateFormats &)
+{
+    v=Json::Value(static_cast<Json::Int64>(GQL_SQL::DBQuery::MIN_DATE));
+}
+
+/// How the values of a PG_TYPES are returned
+struct PGConversion {
+    const std::string *type;  ///< GQL column type
+    PGConverter convert;      ///< converts a value
+    PGConverter null;         ///< sets the value of a NULL field
+};
+
+/// Conversions, indexed by PG_TYPES
+static const PGConversion pgconversions[] {
+    { &GQL_SQL::DBQuery::TYPE_STRING,   pgString,   pgNullString }, // STRING
+    { &GQL_SQL::DBQuery::TYPE_NUMBER,   pgInteger,  pgNullZero   }, // INTEGER
+    { &GQL_SQL::DBQuery::TYPE_BOOLEAN,  pgBool,     pgNullZero   }, // BOOL
+    { &GQL_SQL::DBQuery::TYPE_NUMBER,   pgFloat,    pgNullFloat  }, // FLOAT
+    { &GQL_SQL::DBQuery::TYPE_DATE,     pgDate,     pgNullDate   }, // DATE
+    { &GQL_SQL::DBQuery::TYPE_TIME,     pgTime,     pgNullZero   }, // TIME
+    { &GQL_SQL::DBQuery::TYPE_DATETIME, pgDatetime, pgNullDate   }, // DATETIME
+};
+
+static_assert(sizeof(pgconversions)/sizeof(pgconversions[0])==static_cast<size_t>(PG_TYPES::DATETIME)+1,
+              "pgconversions must have one entry per PG_TYPES");
+
+/// Types created with CREATE DOMAIN/TYPE or by extensions do not have a fixed oid. Domains
+/// are converted like their base type, everything else (enums, arrays, ranges, ...) is
+/// returned as a string. The result is cached per connection.
+uint32_t GQL_SQL::DBQuery::PostgreSQL::baseType(uint32_t oid) const
+{
+    auto it=baseTypes_.find(oid);
+    if(it!=baseTypes_.end()) { return it->second; }
+    uint32_t base=oid;
+    // a domain may be based on another domain
+    for(int depth=0;depth<16 && !pgtypeFind(base);depth++) {
+        pqxx::work txn{*connection_};
+        pqxx::result r=txn.exec("select typbasetype from pg_type where oid="+std::to_string(base));
+        base=r.size()==1 ? r[0][0].as<uint32_t>() : 0;
+        if(base==0) { break; }
+    }
+    if(base==0 || !pgtypeFind(base)) {
+        VLOG(1) << "unknown PostgreSQL type " << oid << " returned as string";
+        base=PG_TEXT_OID;
+    }
+    baseTypes_[oid]=base;
+    return base;
+}
+
+/// SQLSTATE returned when executing an unknown prepared statement
+static const std::string PG_INVALID_STATEMENT="26000";
+
+/// Run a query with parameters. Each SQL query is prepared once per connection,
+/// the parameters are passed as text and converted by the casts in the query.
+std::string GQL_SQL::DBQuery::PostgreSQL::statement(const std::string &sql,bool &cached) const
+{
+    const std::string *name=statements_.find(sql);
+    cached=name!=0;
+    if(cached) { return *name; }
+    std::string n="gql_stmt"+std::to_string(statementId_++);
+    connection_->prepare(n,sql);
+    statements_.insert(sql,n);
+    return n;
+}
+
+pqxx::result GQL_SQL::DBQuery::PostgreSQL::executePrepared(const Result &q) const
+{
+    std::vector<std::string> values;
+    values.reserve(q.params.size());
+    for(const auto &p:q.params) { values.push_back(p.value); }
+    for(int attempt=0;;attempt++) {
+        bool cached;
+        std::string name=statement(q.result,cached);
+        try {
+            pqxx::work txn{*connection_};
+#if PQXX_VERSION_MAJOR>7 || (PQXX_VERSION_MAJOR==7 && PQXX_VERSION_MINOR>=6)
+            pqxx::params pv;
+            for(const auto &v:values) { pv.append(v); }
+            return txn.exec_prepared(name,pv);
+#else
+            return txn.exec_prepared(name,pqxx::prepare::make_dynamic_params(values));
+#endif
+        } catch(const pqxx::sql_error &ex) {
+            // statements are gone after the server connection was reset, prepare it again
+            if(!cached || attempt>0 || ex.sqlstate()!=PG_INVALID_STATEMENT) { throw; }
+            statements_.lost(q.result);
+        }
+    }
+}
+
+/// Send all queries in one pipeline, so the batch costs about one round trip.
+/// Queries with parameters use EXECUTE with the statement prepared on this
+/// connection. If a query fails the transaction is aborted, that query and all
+/// following ones are run again one by one to get the individual results.
+void GQL_SQL::DBQuery::PostgreSQL::getdataBatch(std::vector<BatchQuery> &queries) const
+{
+    size_t done=0;
+    std::vector<pqxx::result> rows(queries.size());
+    try {
+        serverTimeout();
+        std::vector<std::string> sql;
+        sql.reserve(queries.size());
+        for(const auto &q:queries) {
+            if(q.result.params.empty()) {
+                sql.push_back(q.result.result);
+            } else {
+                bool cached;
+                sql.push_back("EXECUTE "+statement(q.result.result,cached)+"(");
+            }
+        }
+        pqxx::work txn{*connection_};
+        for(size_t i=0;i<queries.size();i++) {
+            const auto &params=queries[i].result.params;
+            if(params.empty()) { continue; }
+            for(size_t p=0;p<params.size();p++) {
+                if(p>0) { sql[i]+=","; }
+                sql[i]+=txn.quote(params[p].value);
+            }
+            sql[i]+=")";
+        }
+        pqxx::pipeline pipe(txn);
+        std::vector<pqxx::pipeline::query_id> ids;
+        ids.reserve(queries.size());
+        for(const auto &s:sql) {
+            LOG(INFO) << "search: " << s;
+            ids.push_back(pipe.insert(s));
+        }
+        pipe.complete();
+        for(;done<queries.size();done++) {
+            rows[done]=pipe.retrieve(ids[done]);
+        }
+    } catch(const std::exception &ex) {
+        LOG(WARNING) << "pipeline failed at query " << done << ": " << ex.what();
+    }
+    for(size_t i=0;i<queries.size();i++) {
+        try {
+            if(i<done) {
+                resultToJson(rows[i],queries[i].tbl);
+            } else if(interrupted()) {
+                // the pipeline was cancelled, do not run the queries again
+                throw GQLError(ErrorReasons::OTHER,"query cancelled");
+            } else {
+                getdata(queries[i].result,queries[i].tbl);
+            }
+        } catch(...) {
+            queries[i].error=std::current_exception();
+        }
+    }
+}
+
 /// Return the data from the query in json format
-void GQL_SQL::DBQuery::PostgreSQL::getdata(const std::string &q,Json::Value &tbl) const
+void GQL_SQL::DBQuery::PostgreSQL::getdata(const Result &q,Json::Value &tbl) const
+{
+    LOG(INFO) << "search: " << q.result;
+    serverTimeout();
+    pqxx::result rows;
+    if(q.params.empty()) {
+        pqxx::work txn{*connection_};
+        rows=txn.exec(q.result);
+    } else {
+        rows=executePrepared(q);
+    }
+    resultToJson(rows,tbl);
+}
+
+/// The server stops queries running longer than statement_timeout (in ms, 0
+/// disables it) even if the client is gone, so the session gets the timeout
+/// in addition to the cancel by DB::guarded(). Only sent when it changed.
+void GQL_SQL::DBQuery::PostgreSQL::serverTimeout() const
+{
+    if(statementTimeout_==timeout_) { return; }
+    pqxx::nontransaction txn{*connection_};
+    txn.exec("SET statement_timeout TO "+std::to_string(timeout_));
+    statementTimeout_=timeout_;
+}
+
+/// Cancel the running query, the server returns an error for it
+void GQL_SQL::DBQuery::PostgreSQL::interrupt() const
+{
+    if(connection_) { connection_->cancel_query(); }
+}
+
+/// Convert the rows returned by PostgreSQL to json
+void GQL_SQL::DBQuery::PostgreSQL::resultToJson(const pqxx::result &rows,Json::Value &tbl) const
 {
-    LOG(INFO) << "search: " << q;
-    pqxx::work txn{*connection_};
-    pqxx::result rows=txn.exec(q);
     tbl["cols"]=Json::Value();
     Json::Value &cols=tbl["cols"];
     cols.resize(rows.columns());
-    std::vector<PG_TYPES> convs;
+    std::vector<const PGConversion *> convs;
     convs.resize(rows.columns());
 
     for (uint32_t i = 0; i < rows.columns(); i++) {
         cols[i]["id"]=rows.column_name(i);
-        convs[i]=pgtypes.find(rows.column_type(i))->second;
-        switch(convs[i]) {
-        case PG_TYPES::STRING:
-            cols[i]["type"]=TYPE_STRING;
-            break;
-        case PG_TYPES::INTEGER:
-            cols[i]["type"]=TYPE_NUMBER;
-            break;
-        case PG_TYPES::BOOL:
-            cols[i]["type"]=TYPE_BOOLEAN;
-            break;
-        case PG_TYPES::FLOAT:
-            cols[i]["type"]=TYPE_NUMBER;
-            break;
-        case PG_TYPES::DATE:
-            cols[i]["type"]=TYPE_DATE;
-            break;
-        case PG_TYPES::TIME:
-            cols[i]["type"]=TYPE_TIME;
-            break;
-        case PG_TYPES::DATETIME:
-            cols[i]["type"]=TYPE_DATETIME;
-            break;
-        }
+        uint32_t oid=rows.column_type(i);
+        const PGType *t=pgtypeFind(oid);
+        if(!t) { t=pgtypeFind(baseType(oid)); }
+        convs[i]=&pgconversions[static_cast<int>(t->type)];
+        cols[i]["type"]=*convs[i]->type;
         VLOG(1)<< "type=" << rows.column_type(i) 
                     << "  id=" << rows.column_name(i);
     }
 
-    icu::UnicodeString upattern=icu::UnicodeString::fromUTF8("yyyy-MM-dd HH:mm:ss.SSS");
-    icu::UnicodeString upatterntz=icu::UnicodeString::fromUTF8("yyyy-MM-dd HH:mm:ssX");
-    UErrorCode dateuce=U_ZERO_ERROR;
-    SimpleDateFormat datetimefmt(upattern, dateuce);
-    SimpleDateFormat datetimefmttz(upatterntz, dateuce);
-    upattern=icu::UnicodeString::fromUTF8("yyyy-MM-dd");
-    SimpleDateFormat datefmt(upattern, dateuce);
+    PGDateFormats fmt;
     tbl["rows"]=Json::Value();
     Json::Value &res=tbl["rows"];
     res.resize(static_cast<uint32_t>(rows.size()));
     int rcnt=0;
-    for(auto r:rows) {
+    uint64_t used=0;
+    for(const auto &r:rows) {
         res[rcnt]=Json::Value();
         res[rcnt]["c"]=Json::Value();
         Json::Value &v=res[rcnt]["c"];
         v.resize(r.size());
         uint32_t ccnt=0;
-        for(auto c:r) {
-            v[ccnt]=Json::Value();
-            if(c.is_null()) {
-                v[ccnt]["v"]=Json::Value::null;
-                switch(convs[ccnt]) {
-                case PG_TYPES::DATETIME:
-                case PG_TYPES::DATE:
-                    v[ccnt]["v"]=MIN_DATE;
-                    break;
-                case PG_TYPES::TIME:
-                case PG_TYPES::INTEGER:
-                case PG_TYPES::BOOL:
-                    v[ccnt]["v"]=0;
-                    break;
-                case PG_TYPES::FLOAT:
-                    v[ccnt]["v"]=0.0;
-                    break;
-                case PG_TYPES::STRING:
-                    break;
-                }
-
-            } else {
-                switch(convs[ccnt]) {
-                case PG_TYPES::STRING:
-                    v[ccnt]["v"]=c.as<std::string>();
-                    break;
-                case PG_TYPES::BOOL:
-                    v[ccnt]["v"]=Json::Value(c.as<bool>());
-                    break;
-                case PG_TYPES::INTEGER:
-                    v[ccnt]["v"]=Json::Value(static_cast<Json::Int64>(c.as<int64_t>()));
-                    break;
-                case PG_TYPES::FLOAT:
-                    v[ccnt]["v"]=(c.as<double>());
-                    break;
-                case PG_TYPES::TIME:
-                    {
-                        struct tm t;
-                        memset(&t,0,sizeof(t));
-                        int hour=0,min=0,sec=0,milli=0;
-                        sscanf(c.c_str(),"%d:%d:%d.%d",&hour,&min,&sec,&milli);
-                        v[ccnt]["v"]=(hour*3600+min*60+sec)+milli/1000.0;
-                    }
-                    break;
-                case PG_TYPES::DATE:
-                    {
-                        struct tm t;
-                        memset(&t,0,sizeof(t));
-                        ParsePosition pp(0);
-                        UErrorCode udres=U_ZERO_ERROR;
-                        auto ud=datefmt.parse(icu::UnicodeString::fromUTF8(c.as<std::string>()),udres);
-                        if(c.as<std::string>()=="0000-00-00") {
-                            v[ccnt]["v"]=MIN_DATE;
-                        } else if(U_SUCCESS(udres)) {
-                            v[ccnt]["v"]=ud/1000.0;
-                        } else {
-                            v[ccnt]["v"]=0; // FIXME? throw error instead?
-                        }
-                    }
-                    break;
-                case PG_TYPES::DATETIME:
-                    {
-                    struct tm t;
-                    memset(&t,0,sizeof(t));
-                    ParsePosition pp(0);
-                    UErrorCode udres=U_ZERO_ERROR;
-                    std::string cs=c.as<std::string>();
-                    auto ucs=icu::UnicodeString::fromUTF8(cs);
-
-                    auto ud=datetimefmt.parse(ucs,udres);
-                    if(!U_SUCCESS(udres) && (cs[cs.length()-3]=='+'||cs[cs.length()-3]=='-')) {
-                        udres=U_ZERO_ERROR;
-                        ud=datetimefmttz.parse(ucs,udres);
-                    }
-                    if(c.as<std::string>()=="0000-00-00 00:00:00.000") {
-                        v[ccnt]["v"]=MIN_DATE;
-                    } else if(U_SUCCESS(udres)) {
-                        v[ccnt]["v"]=ud/1000.0;
-                    } else {
-                        v[ccnt]["v"]=0; // FIXME? throw error instead?
-                    }
-                    }
-                    break;
-                }
-            }
+        for(const auto &c:r) {
+            Json::Value &cell=v[ccnt]["v"];
+            const PGConversion &conv=*convs[ccnt];
+            (c.is_null() ? conv.null : conv.convert)(c,cell,fmt);
             ++ccnt;
         }
         ++rcnt;
+        budget(static_cast<Json::ArrayIndex>(rcnt),v,used);
     }
 
 }
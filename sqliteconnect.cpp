@@ -0,0 +1,737 @@
+/** \file
+ * \brief SQLite connector for GQL
+ *
+ * SQLite runs in process, so there is no network round trip or connection
+ * setup. The database is opened read-only. Dates, datetimes and times are
+ * expected to be stored as ISO-8601 text (the format used by the SQLite date
+ * functions), numbers stored in a date column are taken as seconds since the
+ * epoch.
+ *
+ * \author Claudio Fleiner
+ * \copyright 2018 Claudio Fleiner
+ *
+ * **License:**
+ *
+ * > This program is free software: you can redistribute it and/or modify
+ * > it under the terms of the GNU Affero General Public License as published by
+ * > the Free Software Foundation, either version 3 of the License, or
+ * > (at your option) any later version.
+ * >
+ * > This program is distributed in the hope that it will be useful,
+ * > but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * > MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * > GNU Affero General Public License for more details.
+ * >
+ * > You should have received a copy of the GNU Affero General Public License
+ * > along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <regex>
+#include <unordered_map>
+#include <exception>
+#include <jsoncpp/json/json.h>
+#include <glog/logging.h>
+#include <boost/algorithm/string.hpp>
+#include <sqlite3.h>
+#include "libgqlsql.h"
+
+/// strftime() formats used to extract the given part of a date or time
+const static std::unordered_map<std::string,std::string> extracts {
+    { "year", "%Y" },
+    { "month", "%m" },
+    { "day", "%d" },
+    { "hour", "%H" },
+    { "minute", "%M" },
+    { "second", "%S" },
+};
+
+/// Quote an identifier for SQLite
+static std::string quoteIdentSQLite(const std::string &s)
+{
+    return "\""+boost::replace_all_copy(s,"\"","\"\"")+"\"";
+}
+
+/// Quote an string for SQLite (double quotes are identifiers)
+static std::string quoteString(const std::string &s)
+{
+    return "'"+boost::replace_all_copy(s,"'","''")+"'";
+}
+
+/// GLOB pattern of the strings starting with s, its wildcards are written as
+/// character classes
+static std::string sqliteGlobPrefix(const std::string &s)
+{
+    std::string p;
+    for(char c:s) {
+        if(c=='*'||c=='?'||c=='[') { p+='[';p+=c;p+=']'; } else { p+=c; }
+    }
+    return p+"*";
+}
+
+/// Write one expression as valid SQLite expression, see sqliteExpr().
+static void sqliteNode(const GQL_SQL::GQLParser::Query::Expr &qe,GQL_SQL::GQLParser::ExprWriter &w,
+                       std::set<std::string>&tables,std::vector<GQL_SQL::Param> *params)
+{
+    switch(qe.tp()) {
+    case GQL_SQL::GQLParser::TokenType::ASC:
+    case GQL_SQL::GQLParser::TokenType::BY:
+    case GQL_SQL::GQLParser::TokenType::COMMA:
+    case GQL_SQL::GQLParser::TokenType::DESC:
+    case GQL_SQL::GQLParser::TokenType::EOL:
+    case GQL_SQL::GQLParser::TokenType::ERROR:
+    case GQL_SQL::GQLParser::TokenType::FORMAT:
+    case GQL_SQL::GQLParser::TokenType::GROUP:
+    case GQL_SQL::GQLParser::TokenType::LABEL:
+    case GQL_SQL::GQLParser::TokenType::LIMIT:
+    case GQL_SQL::GQLParser::TokenType::OFFSET:
+    case GQL_SQL::GQLParser::TokenType::OPTIONS:
+    case GQL_SQL::GQLParser::TokenType::ORDER:
+    case GQL_SQL::GQLParser::TokenType::PIVOT:
+    case GQL_SQL::GQLParser::TokenType::P_CLOSE:
+    case GQL_SQL::GQLParser::TokenType::P_OPEN:
+    case GQL_SQL::GQLParser::TokenType::SELECT:
+    case GQL_SQL::GQLParser::TokenType::TIMESTAMP:
+    case GQL_SQL::GQLParser::TokenType::WHERE:
+    case GQL_SQL::GQLParser::TokenType::_UNDEFINED:
+        LOG(FATAL) << "got unusable token type " << qe.tp();
+
+    case GQL_SQL::GQLParser::TokenType::GQL_FALSE:
+        w.text("0");
+        break;
+    case GQL_SQL::GQLParser::TokenType::GQL_TRUE:
+        w.text("1");
+        break;
+
+    case GQL_SQL::GQLParser::TokenType::IS_NULL:
+        w.text("(");
+        w.sub(qe.sub()[0]);
+        w.text(" IS NULL)");
+        break;
+
+    case GQL_SQL::GQLParser::TokenType::IS_NOT_NULL:
+        w.text("(");
+        w.sub(qe.sub()[0]);
+        w.text(" IS NOT NULL)");
+        break;
+
+    case GQL_SQL::GQLParser::TokenType::PLUS:
+    case GQL_SQL::GQLParser::TokenType::MINUS:
+        if(qe.sub().size()==1) {
+            if(qe.tp()==GQL_SQL::GQLParser::TokenType::PLUS) {
+                w.sub(qe.sub()[0]);
+            } else {
+                w.text("(-");
+                w.sub(qe.sub()[0]);
+                w.text(")");
+            }
+            break;
+        }
+        FALLTHROUGH
+    case GQL_SQL::GQLParser::TokenType::TIMES:
+    case GQL_SQL::GQLParser::TokenType::LT:
+    case GQL_SQL::GQLParser::TokenType::LE:
+    case GQL_SQL::GQLParser::TokenType::GT:
+    case GQL_SQL::GQLParser::TokenType::GE:
+    case GQL_SQL::GQLParser::TokenType::EQ:
+    case GQL_SQL::GQLParser::TokenType::NE:
+        assert(qe.sub().size()==2);
+        w.text("(");
+        w.sub(qe.sub()[0]);
+        w.text(qe.data());
+        w.sub(qe.sub()[1]);
+        w.text(")");
+        break;
+
+    case GQL_SQL::GQLParser::TokenType::DIV:
+        // SQLite does an integer division for two integers
+        assert(qe.sub().size()==2);
+        w.text("(CAST(");
+        w.sub(qe.sub()[0]);
+        w.text(" AS REAL)/");
+        w.sub(qe.sub()[1]);
+        w.text(")");
+        break;
+
+    case GQL_SQL::GQLParser::TokenType::DATE:
+    case GQL_SQL::GQLParser::TokenType::DATETIME:
+    case GQL_SQL::GQLParser::TokenType::TIMEOFDAY:
+        // stored as text, ISO formats compare correctly as strings
+        if(params) {
+            params->push_back(GQL_SQL::Param{qe.tp()==GQL_SQL::GQLParser::TokenType::DATE?GQL_SQL::ParamType::DATE:
+                                             qe.tp()==GQL_SQL::GQLParser::TokenType::DATETIME?GQL_SQL::ParamType::DATETIME:
+                                             GQL_SQL::ParamType::TIMEOFDAY,qe.sub()[0]->data()});
+            w.text("?");
+            break;
+        }
+        w.text(quoteString(qe.sub()[0]->data()));
+        break;
+
+    case GQL_SQL::GQLParser::TokenType::LIKE:
+        assert(qe.sub().size()==2);
+        w.text("(");
+        w.sub(qe.sub()[0]);
+        w.text(" like ");
+        w.sub(qe.sub()[1]);
+        w.text(")");
+        break;
+    case GQL_SQL::GQLParser::TokenType::AND:
+    case GQL_SQL::GQLParser::TokenType::OR:
+        {
+            // a chain of the same operator is written without nesting, the
+            // parser stack of the database may be too small for long filters
+            assert(qe.sub().size()==2);
+            const auto &l=qe.sub()[0];
+            bool parens=!(w.flags()&GQL_SQL::GQLParser::ExprWriter::NO_PARENS);
+            if(parens) { w.text("("); }
+            w.sub(l,l->tp()==qe.tp()?GQL_SQL::GQLParser::ExprWriter::NO_PARENS:0);
+            w.text(qe.tp()==GQL_SQL::GQLParser::TokenType::AND?" and ":" or ");
+            w.sub(qe.sub()[1]);
+            if(parens) { w.text(")"); }
+        }
+        break;
+    case GQL_SQL::GQLParser::TokenType::IN_SET:
+        w.text("(");
+        w.sub(qe.sub()[0]);
+        w.text(" IN (");
+        for(size_t i=1;i<qe.sub().size();i++) {
+            if(i>1) { w.text(","); }
+            w.sub(qe.sub()[i]);
+        }
+        w.text("))");
+        break;
+    case GQL_SQL::GQLParser::TokenType::NOT:
+        assert(qe.sub().size()==1);
+        w.text("(not ");
+        w.sub(qe.sub()[0]);
+        w.text(")");
+        break;
+    case GQL_SQL::GQLParser::TokenType::NUMBER:
+        if(params) { params->push_back(GQL_SQL::Param{GQL_SQL::ParamType::NUMBER,qe.data()}); w.text("?"); break; }
+        w.text(qe.data());
+        break;
+    case GQL_SQL::GQLParser::TokenType::STRING:
+        if(w.flags()&GQL_SQL::GQLParser::ExprWriter::PATTERN_PREFIX) {
+            std::string pattern=sqliteGlobPrefix(qe.data());
+            if(params) { params->push_back(GQL_SQL::Param{GQL_SQL::ParamType::STRING,pattern}); w.text("?"); break; }
+            w.text(quoteString(pattern));
+            break;
+        }
+        if(params) { params->push_back(GQL_SQL::Param{GQL_SQL::ParamType::STRING,qe.data()}); w.text("?"); break; }
+        w.text(quoteString(qe.data()));
+        break;
+
+    case GQL_SQL::GQLParser::TokenType::STARTS:
+        if(qe.sub()[1]->tp()==GQL_SQL::GQLParser::TokenType::STRING) {
+            // GLOB is case sensitive (unlike LIKE) and uses an index of the column
+            w.text("(");
+            w.sub(qe.sub()[0]);
+            w.text(" GLOB ");
+            w.sub(qe.sub()[1],GQL_SQL::GQLParser::ExprWriter::PATTERN_PREFIX);
+            w.text(")");
+            break;
+        }
+        w.text("(substr(");
+        w.sub(qe.sub()[0]);
+        w.text(",1,length(");
+        w.sub(qe.sub()[1]);
+        w.text("))=");
+        w.sub(qe.sub()[1]);
+        w.text(")");
+        break;
+
+    case GQL_SQL::GQLParser::TokenType::MATCHES:
+        // REGEXP is provided by the connector and matches the complete string
+        w.text("(");
+        w.sub(qe.sub()[0]);
+        w.text(" REGEXP ");
+        w.sub(qe.sub()[1]);
+        w.text(")");
+        break;
+
+    case GQL_SQL::GQLParser::TokenType::ENDS:
+        w.text("(substr(");
+        w.sub(qe.sub()[0]);
+        w.text(",-length(");
+        w.sub(qe.sub()[1]);
+        w.text("))=");
+        w.sub(qe.sub()[1]);
+        w.text(")");
+        break;
+
+    case GQL_SQL::GQLParser::TokenType::CONTAINS:
+        w.text("(instr(");
+        w.sub(qe.sub()[0]);
+        w.text(",");
+        w.sub(qe.sub()[1]);
+        w.text(")>0)");
+        break;
+
+    case GQL_SQL::GQLParser::TokenType::IDENTIFIER:
+        if(qe.sub().size()==0 && !qe.noarg()) {
+            auto dot=qe.data().find(".");
+            if(dot!=std::string::npos && qe.data().rfind(".")==dot) {
+                auto tbl=qe.data().substr(0,dot);
+                tables.insert(tbl);
+                w.text(quoteIdentSQLite(tbl));
+                w.text(".");
+                w.text(quoteIdentSQLite(qe.data().substr(dot+1)));
+            } else {
+                w.text(quoteIdentSQLite(qe.data()));
+                tables.insert("");
+            }
+        } else {
+            const char *suffix="";
+            const char *sep=", ";
+            auto ex=extracts.find(qe.data());
+            if(ex!=extracts.end()) {
+                w.text("CAST(strftime('"+ex->second+"',");
+                suffix=") AS INTEGER)";
+            } else if(qe.data()=="millisecond") {
+                w.text("(CAST(strftime('%f',");
+                suffix=")*1000 AS INTEGER)%1000)";
+            } else if(qe.data()=="quarter") {
+                w.text("((CAST(strftime('%m',");
+                suffix=") AS INTEGER)+2)/3)";
+            } else if(qe.data()=="dayOfWeek") {
+                w.text("(CAST(strftime('%w',");
+                suffix=") AS INTEGER)+1)";
+            } else if(qe.data()=="now") {
+                w.text("datetime('now','localtime'");
+                suffix=")";
+            } else if(qe.data()=="dateDiff") {
+                w.text("CAST(julianday(date(");
+                sep="))-julianday(date(";
+                suffix=")) AS INTEGER)";
+            } else if(qe.data()=="toDate") {
+                // numbers are milliseconds since the epoch, date() would read them as julian days
+                w.text("(CASE WHEN typeof(");
+                w.sub(qe.sub()[0]);
+                w.text(") IN ('integer','real') THEN date((");
+                w.sub(qe.sub()[0]);
+                w.text(")/1000.0,'unixepoch','localtime') ELSE date(");
+                w.sub(qe.sub()[0]);
+                w.text(") END)");
+                return;
+            } else {
+                w.text(qe.data()+"(");
+                suffix=")";
+            }
+            int first=1;
+            for(const auto &e:qe.sub()) {
+                if(!first) { w.text(sep); }
+                first=0;
+                w.sub(e);
+            }
+            w.text(suffix);
+        }
+    }
+}
+
+/// Append qe as valid SQLite expression to r.
+/// If params is set literals are replaced by placeholders and added to params.
+static void sqliteExpr(std::string &r,const GQL_SQL::GQLParser::Query::Expr::CPtr &qe,std::set<std::string>&tables,
+                       std::vector<GQL_SQL::Param> *params)
+{
+    GQL_SQL::GQLParser::ExprWriter w(r);
+    w.run(*qe,[&](const GQL_SQL::GQLParser::Query::Expr &e,GQL_SQL::GQLParser::ExprWriter &ew) {
+        sqliteNode(e,ew,tables,params);
+    });
+}
+
+/// Create the SQLite query string
+void GQL_SQL::GQLParser::ParserSQLite::createResult()
+{
+    if(!query_) { return; }
+    std::string r="";
+    std::set<std::string> tables;
+    if(query_->selectStar) {
+        r="select * ";
+    } else if(query_->select.size()>0) {
+        r="select ";
+        for(auto i:query_->pivot) {
+            if(r!="select ") { r+=", "; }
+            r+=" "+quoteIdentSQLite(i.token.to_string());
+        }
+        if(query_->pivot.size()) {
+            for(auto i:query_->group) {
+                r+=", "+quoteIdentSQLite(i.token.to_string());
+            }
+        }
+
+        for(unsigned int i=0;i<query_->select.size();i++) {
+            if(r!="select ") { r+=", "; }
+            auto s=query_->select[i];
+            sqliteExpr(r,s.expr,tables,0);
+        }
+    }
+    std::string qstring="";
+    if(query_->where) {
+        qstring=" where ";
+        sqliteExpr(qstring,query_->where,tables,parameterize_?&res_.params:0);
+    }
+    r+=" from ";
+    bool addedTable=false;
+    if(tables.size()==0||tables.count("")>0||tables.count(defTable_)>0) {
+        r+=quoteIdentSQLite(defTable_);
+        tables.erase("");
+        tables.erase(defTable_);
+        addedTable=true;
+    }
+
+    for(auto t:tables) {
+        if(allowedTables_.count(t)==0) {
+            throw GQLError(ErrorReasons::ACCESS_DENIED,"table \""+t+"\" does not exists or is not accessible");
+        }
+        if(addedTable) { r+=", "; }
+        addedTable=true;
+        r+=quoteIdentSQLite(t);
+    }
+    r+=qstring;
+
+    // For a manual pivot we need to group by the pivot columns
+    bool first=1;
+    for(auto i:query_->pivot) {
+        if(!first) { r+=","; }
+        else { r+=" GROUP BY ";first=false; }
+        first=false;
+        r+=" "+quoteIdentSQLite(i.token.to_string());
+    }
+
+    for(auto i:query_->group) {
+        if(!first) { r+=","; }
+        else { r+=" GROUP BY ";first=false; }
+        first=false;
+        r+=" "+quoteIdentSQLite(i.token.to_string());
+    }
+
+    first=1;
+    for(const auto &o:query_->order) {
+        if(!first) { r+=", "; }
+        else { r+=" ORDER BY "; }
+        first=false;
+        sqliteExpr(r,o.expr,tables,0);
+        if(o.desc) { r+=" DESC"; }
+    }
+    // pivot queries are limited after pivoting, see DB::pivotTable()
+    bool pivot=query_->hasPivotClause();
+    uint64_t limit=sqlLimit();
+    if(limit) {
+        r+=" LIMIT "+std::to_string(limit);
+    } else if(query_->offset&&!pivot) {
+        r+=" LIMIT -1";
+    }
+    if(query_->offset&&!pivot) {
+        r+=" OFFSET "+std::to_string(query_->offset);
+    }
+    res_.result=r;
+}
+
+/// We are the SQLite connector
+std::string GQL_SQL::GQLParser::ParserSQLite::target() const { return "SQLite"; }
+
+GQL_SQL::GQLParser::ParserSQLite::~ParserSQLite() { }
+
+/// REGEXP operator for SQLite: true if the value matches the complete pattern
+static void sqliteRegexp(sqlite3_context *ctx,int argc,sqlite3_value **argv)
+{
+    if(argc!=2||sqlite3_value_type(argv[0])==SQLITE_NULL||sqlite3_value_type(argv[1])==SQLITE_NULL) {
+        sqlite3_result_null(ctx);
+        return;
+    }
+    // X REGEXP Y calls regexp(Y,X)
+    const char *pattern=reinterpret_cast<const char *>(sqlite3_value_text(argv[0]));
+    const char *text=reinterpret_cast<const char *>(sqlite3_value_text(argv[1]));
+    try {
+        sqlite3_result_int(ctx,std::regex_match(text,std::regex(pattern)));
+    } catch(const std::regex_error &ex) {
+        sqlite3_result_error(ctx,ex.what(),-1);
+    }
+}
+
+/// Connect to (open) a SQLite database
+void GQL_SQL::DBQuery::SQLite::connect()
+{
+    if(connection_) { return; }
+    if(sqlite3_open_v2(db_.c_str(),&connection_,SQLITE_OPEN_READONLY,0)!=SQLITE_OK) {
+        LOG(ERROR) << "cannot open sqlite db '" << db_ << "': " << sqlite3_errmsg(connection_);
+        sqlite3_close(connection_);
+        connection_=0;
+        return;
+    }
+    sqlite3_create_function(connection_,"regexp",2,SQLITE_UTF8|SQLITE_DETERMINISTIC,0,sqliteRegexp,0,0);
+#ifdef SQLITE_DBCONFIG_DQS_DML
+    // unknown "identifiers" must be an error and not silently become strings
+    sqlite3_db_config(connection_,SQLITE_DBCONFIG_DQS_DML,0,static_cast<int *>(0));
+#endif
+    parser_=std::shared_ptr<GQLParser::Parser>(new GQLParser::ParserSQLite(deftable_,tables_,extendedFunctions_));
+    parser_->parameterizeSet(prepare_);
+    parser_->maxRowsSet(maxRows_);
+    statements_=StatementCache<sqlite3_stmt *>(statementCacheSize_,[](sqlite3_stmt *const &st) { sqlite3_finalize(st); });
+
+    if(!schemaCached()) {
+        schema_.clear();
+        for(const auto &t:schemaTables()) {
+            TableSchema &ts=schema_[t];
+            sqlite3_stmt *stmt=0;
+            if(sqlite3_prepare_v2(connection_,("PRAGMA table_info("+quoteIdentSQLite(t)+")").c_str(),-1,&stmt,0)==SQLITE_OK) {
+                while(sqlite3_step(stmt)==SQLITE_ROW) {
+                    const unsigned char *type=sqlite3_column_text(stmt,2);
+                    ts[reinterpret_cast<const char *>(sqlite3_column_text(stmt,1))]=type?reinterpret_cast<const char *>(type):"";
+                }
+            }
+            sqlite3_finalize(stmt);
+        }
+        schemaCache();
+    }
+    parser_->schemaSet(schema_);
+}
+
+/// Return true if the db is open
+bool GQL_SQL::DBQuery::SQLite::isConnected() const
+{
+    return connection_!=0;
+}
+
+GQL_SQL::DBQuery::SQLite::~SQLite() {
+    asyncStop();
+    statements_.clear(true);
+    if(connection_) {
+        sqlite3_close(connection_);
+    }
+}
+
+/// Stop the running query, sqlite3_step() then returns SQLITE_INTERRUPT
+void GQL_SQL::DBQuery::SQLite::interrupt() const
+{
+    if(connection_) { sqlite3_interrupt(connection_); }
+}
+
+/// Types of the SQLite result columns
+enum class SQLITE_TYPES {
+    STRING=0,
+    NUMBER=1,
+    BOOL=2,
+    DATE=3,
+    TIME=4,
+    DATETIME=5,
+};
+
+/// Map a declared column type to the type used in this code, following the
+/// SQLite type affinity rules. Returns false if there is no declared type.
+static bool sqliteDeclType(const char *decl,SQLITE_TYPES &tp)
+{
+    if(!decl||!*decl) { return false; }
+    std::string d=boost::to_upper_copy(std::string(decl));
+    if(d.find("BOOL")!=std::string::npos) { tp=SQLITE_TYPES::BOOL; }
+    else if(d.find("DATETIME")!=std::string::npos||d.find("TIMESTAMP")!=std::string::npos) { tp=SQLITE_TYPES::DATETIME; }
+    else if(d.find("DATE")!=std::string::npos) { tp=SQLITE_TYPES::DATE; }
+    else if(d.find("TIME")!=std::string::npos) { tp=SQLITE_TYPES::TIME; }
+    else if(d.find("CHAR")!=std::string::npos||d.find("CLOB")!=std::string::npos||d.find("TEXT")!=std::string::npos) { tp=SQLITE_TYPES::STRING; }
+    else { tp=SQLITE_TYPES::NUMBER; }
+    return true;
+}
+
+/// Type of an expression without declared type (functions, aggregates)
+static bool sqliteExprType(const GQL_SQL::GQLParser::Query::Expr::CPtr &e,sqlite3 *db,const std::string &deftable,SQLITE_TYPES &tp)
+{
+    if(e->tp()!=GQL_SQL::GQLParser::TokenType::IDENTIFIER||(e->sub().size()==0&&!e->noarg())) { return false; }
+    if(e->data()=="toDate") { tp=SQLITE_TYPES::DATE;return true; }
+    if(e->data()=="now") { tp=SQLITE_TYPES::DATETIME;return true; }
+    if(e->data()=="upper"||e->data()=="lower") { tp=SQLITE_TYPES::STRING;return true; }
+    if((e->data()=="min"||e->data()=="max")&&e->sub().size()==1) {
+        // same type as the column
+        std::string name=e->sub()[0]->data();
+        std::string table=deftable;
+        auto dot=name.find('.');
+        if(dot!=std::string::npos) {
+            table=name.substr(0,dot);
+            name=name.substr(dot+1);
+        }
+        const char *decl=0;
+        return sqlite3_table_column_metadata(db,0,table.c_str(),name.c_str(),&decl,0,0,0,0)==SQLITE_OK
+                    &&sqliteDeclType(decl,tp);
+    }
+    return false;
+}
+
+/// Parse an ISO date (yyyy-MM-dd), datetime (yyyy-MM-dd HH:mm:ss.SSS) or
+/// time (HH:mm:ss.SSS). Dates are returned as seconds since the epoch in the
+/// local time zone, times as seconds since midnight.
+static bool parseIsoDateTime(SQLITE_TYPES tp,const char *s,double &res)
+{
+    int y=0,mo=0,d=0,h=0,mi=0,sec=0,n=0;
+    double frac=0;
+    if(tp==SQLITE_TYPES::TIME) {
+        if(sscanf(s,"%d:%d:%d%n",&h,&mi,&sec,&n)<3) { return false; }
+        if(s[n]=='.') { frac=atof(s+n); }
+        res=h*3600+mi*60+sec+frac;
+        return true;
+    }
+    if(sscanf(s,"%d-%d-%d%n",&y,&mo,&d,&n)<3) { return false; }
+    if(tp==SQLITE_TYPES::DATETIME&&(s[n]==' '||s[n]=='T')) {
+        int m=0;
+        if(sscanf(s+n+1,"%d:%d:%d%n",&h,&mi,&sec,&m)>=2) {
+            n+=1+m;
+            if(s[n]=='.') { frac=atof(s+n); }
+        }
+    }
+    struct tm t;
+    memset(&t,0,sizeof(t));
+    t.tm_year=y-1900;
+    t.tm_mon=mo-1;
+    t.tm_mday=d;
+    t.tm_hour=h;
+    t.tm_min=mi;
+    t.tm_sec=sec;
+    t.tm_isdst=-1;
+    res=static_cast<double>(mktime(&t))+frac;
+    return true;
+}
+
+/// Return the data from the query in json format.
+/// The values are read with the typed sqlite3_column_* functions.
+void GQL_SQL::DBQuery::SQLite::getdata(const Result &q,Json::Value &tbl) const
+{
+    LOG(INFO) << "search: " << q.result;
+    sqlite3_stmt *stmt=0;
+    sqlite3_stmt *const *st=q.params.empty()?0:statements_.find(q.result);
+    bool cached=st!=0;
+    if(cached) {
+        stmt=*st;
+    } else {
+        if(sqlite3_prepare_v2(connection_,q.result.c_str(),static_cast<int>(q.result.size()),&stmt,0)!=SQLITE_OK) {
+            std::string msg=sqlite3_errmsg(connection_);
+            sqlite3_finalize(stmt);
+            throw GQLError(ErrorReasons::INVALID_QUERY,msg);
+        }
+        // queries with parameters only depend on the shape of the GQL query, keep them
+        if(!q.params.empty()) {
+            statements_.insert(q.result,stmt);
+            cached=true;
+        }
+    }
+    ON_EXIT(if(cached) { sqlite3_reset(stmt);sqlite3_clear_bindings(stmt); } else { sqlite3_finalize(stmt); });
+
+    for(size_t i=0;i<q.params.size();i++) {
+        const Param &p=q.params[i];
+        int pi=static_cast<int>(i+1);
+        int rc=SQLITE_OK;
+        if(p.type==ParamType::NUMBER && p.value.find_first_of(".eE")==std::string::npos) {
+            try {
+                rc=sqlite3_bind_int64(stmt,pi,std::stoll(p.value));
+            } catch(const std::out_of_range &) {
+                rc=sqlite3_bind_double(stmt,pi,std::stod(p.value));
+            }
+        } else if(p.type==ParamType::NUMBER) {
+            rc=sqlite3_bind_double(stmt,pi,std::stod(p.value));
+        } else {
+            // q outlives the statement execution, no need for sqlite to copy the value
+            rc=sqlite3_bind_text(stmt,pi,p.value.c_str(),static_cast<int>(p.value.size()),0);
+        }
+        if(rc!=SQLITE_OK) {
+            throw GQLError(ErrorReasons::INVALID_QUERY,sqlite3_errmsg(connection_));
+        }
+    }
+
+    auto query=q.query;
+    uint32_t colcount=static_cast<uint32_t>(sqlite3_column_count(stmt));
+    // the first columns are the pivot and group columns, see createResult()
+    uint32_t selstart=query->selectStar?colcount:static_cast<uint32_t>(query->pivot.size()+(query->pivot.size()?query->group.size():0));
+
+    tbl["cols"]=Json::Value();
+    Json::Value &cols=tbl["cols"];
+    cols.resize(colcount);
+    std::vector<SQLITE_TYPES> convs(colcount,SQLITE_TYPES::STRING);
+    std::vector<bool> known(colcount,false);
+    for(uint32_t i=0;i<colcount;i++) {
+        int ci=static_cast<int>(i);
+        cols[i]["id"]=sqlite3_column_name(stmt,ci);
+        known[i]=sqliteDeclType(sqlite3_column_decltype(stmt,ci),convs[i]);
+        if(!known[i]&&i>=selstart&&i-selstart<query->select.size()) {
+            known[i]=sqliteExprType(query->select[i-selstart].expr,connection_,deftable_,convs[i]);
+        }
+    }
+
+    tbl["rows"]=Json::Value(Json::arrayValue);
+    Json::Value &res=tbl["rows"];
+    Json::ArrayIndex rcnt=0;
+    uint64_t used=0;
+    int rc;
+    while((rc=sqlite3_step(stmt))==SQLITE_ROW) {
+        Json::Value &v=res[rcnt]["c"];
+        v.resize(colcount);
+        for(uint32_t c=0;c<colcount;c++) {
+            int ci=static_cast<int>(c);
+            int storage=sqlite3_column_type(stmt,ci);
+            if(!known[c]&&storage!=SQLITE_NULL) {
+                // no declared type: use the storage class of the first value
+                convs[c]=(storage==SQLITE_INTEGER||storage==SQLITE_FLOAT)?SQLITE_TYPES::NUMBER:SQLITE_TYPES::STRING;
+                known[c]=true;
+            }
+            Json::Value &cell=v[c]["v"];
+            if(storage==SQLITE_NULL) {
+                cell=Json::Value::null;
+                continue;
+            }
+            switch(convs[c]) {
+            case SQLITE_TYPES::NUMBER:
+                if(storage==SQLITE_INTEGER) {
+                    cell=Json::Value(static_cast<Json::Int64>(sqlite3_column_int64(stmt,ci)));
+                } else {
+                    cell=sqlite3_column_double(stmt,ci);
+                }
+                break;
+            case SQLITE_TYPES::BOOL:
+                if(storage==SQLITE_TEXT) {
+                    std::string s=reinterpret_cast<const char *>(sqlite3_column_text(stmt,ci));
+                    cell=Json::Value(s=="1"||s=="true"||s=="True"||s=="TRUE");
+                } else {
+                    cell=Json::Value(sqlite3_column_int64(stmt,ci)!=0);
+                }
+                break;
+            case SQLITE_TYPES::DATE:
+            case SQLITE_TYPES::DATETIME:
+            case SQLITE_TYPES::TIME:
+                if(storage==SQLITE_TEXT) {
+                    double d=0;
+                    if(parseIsoDateTime(convs[c],reinterpret_cast<const char *>(sqlite3_column_text(stmt,ci)),d)) {
+                        cell=d;
+                    } else {
+                        throw GQLError(ErrorReasons::INVALID_REQUEST,"column '"+cols[c]["id"].asString()+"' has the invalid date/time value '"+
+                                       reinterpret_cast<const char *>(sqlite3_column_text(stmt,ci))+"'");
+                    }
+                } else {
+                    cell=sqlite3_column_double(stmt,ci);
+                }
+                break;
+            case SQLITE_TYPES::STRING:
+                {
+                    const char *s=reinterpret_cast<const char *>(sqlite3_column_text(stmt,ci));
+                    cell=Json::Value(s,s+sqlite3_column_bytes(stmt,ci));
+                }
+                break;
+            }
+        }
+        ++rcnt;
+        budget(rcnt,v,used);
+    }
+    if(rc!=SQLITE_DONE) {
+        throw GQLError(ErrorReasons::INVALID_REQUEST,sqlite3_errmsg(connection_));
+    }
+
+    for(uint32_t i=0;i<colcount;i++) {
+        switch(convs[i]) {
+        case SQLITE_TYPES::STRING: cols[i]["type"]=TYPE_STRING;break;
+        case SQLITE_TYPES::NUMBER: cols[i]["type"]=TYPE_NUMBER;break;
+        case SQLITE_TYPES::BOOL: cols[i]["type"]=TYPE_BOOLEAN;break;
+        case SQLITE_TYPES::DATE: cols[i]["type"]=TYPE_DATE;break;
+        case SQLITE_TYPES::TIME: cols[i]["type"]=TYPE_TIME;break;
+        case SQLITE_TYPES::DATETIME: cols[i]["type"]=TYPE_DATETIME;break;
+        }
+    }
+}
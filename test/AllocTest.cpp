@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+#include <new>
+#include <cstdlib>
+
+#include "libgqlsql.h"
+#include "FakeDB.h"
+
+/// number of heap allocations done since the start of the program
+static uint64_t allocations=0;
+
+// noinline: otherwise gcc complains about free() being used on memory
+// allocated with new after inlining
+__attribute__((noinline)) void *operator new(size_t size)
+{
+    allocations++;
+    void *p=malloc(size?size:1);
+    if(!p) { throw std::bad_alloc(); }
+    return p;
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void *p,size_t) noexcept { free(p); }
+
+/// Returns the number of allocations needed by f
+template<typename F> static uint64_t countAllocations(F f)
+{
+    uint64_t start=allocations;
+    f();
+    return allocations-start;
+}
+
+/// Returns the number of allocations per cell for a query on the fake DB,
+/// measured as the difference between two result sizes so that the
+/// parsing and per query setup cost is not included.
+template<typename F> static double allocationsPerCell(const std::string &gql,F output)
+{
+    const uint32_t small=1000;
+    const uint32_t large=3000;
+    FakeDB db(small);
+    db.connect();
+    uint64_t a[2];
+    for(int i=0;i<2;i++) {
+        db.rowsSet(i?large:small);
+        a[i]=countAllocations([&]() {
+            Json::Value r;
+            db.execute(gql,r);
+            EXPECT_EQ("ok",r["status"].asString()) << r;
+            output(r);
+        });
+    }
+    return static_cast<double>(a[1]-a[0])/((large-small)*4);
+}
+
+// The limits are the measured values (jsoncpp 1.9) rounded up. Most of the
+// allocations are done by jsoncpp itself when creating the cells (object,
+// member names and strings). If a change increases the number of allocations
+// make sure they are really needed before adjusting the limits.
+static const double LIMIT_EXECUTE=4.8;  ///< getdata and applyFormat
+static const double LIMIT_JSON=6.4;     ///< execute plus json output
+static const double LIMIT_HTML=4.8;     ///< execute plus html output
+static const uint64_t LIMIT_PARSE=16;   ///< parsing a query, expressions are arena allocated
+
+TEST(Allocations, Execute) {
+    double cell=allocationsPerCell("select c0,c1,c2,c3",[](const Json::Value &) { });
+    EXPECT_LE(cell,LIMIT_EXECUTE) << "allocations per cell: " << cell;
+}
+
+TEST(Allocations, Json) {
+    double cell=allocationsPerCell("select c0,c1,c2,c3",[](const Json::Value &r) {
+        std::ostringstream o;
+        GQL_SQL::DBQuery::outputJson(o,r);
+    });
+    EXPECT_LE(cell,LIMIT_JSON) << "allocations per cell: " << cell;
+}
+
+TEST(Allocations, Html) {
+    double cell=allocationsPerCell("select c0,c1,c2,c3",[](const Json::Value &r) {
+        std::ostringstream o;
+        GQL_SQL::DBQuery::outputHtml(o,"fake",r);
+    });
+    EXPECT_LE(cell,LIMIT_HTML) << "allocations per cell: " << cell;
+}
+
+TEST(Allocations, Tokenize) {
+    const std::string gql="select name, salary where dept='dev' or dept='ops' or dept='sales' order by name desc";
+    uint64_t n=countAllocations([&]() {
+        GQL_SQL::GQLParser::Tokenizer tok(gql);
+        while(tok.next().tt!=GQL_SQL::GQLParser::TokenType::EOL) { }
+    });
+    EXPECT_EQ(0,n); // tokens refer to the query string
+}
+
+TEST(Allocations, Parse) {
+    const std::string gql="select dept, sum(salary), max(age) where (age>30 and dept='dev') or "
+                          "(year(born)<1990 and name starts with 'A') group by dept order by sum(salary) desc limit 10";
+    GQL_SQL::GQLParser::Query::parse(gql); // static tables are set up by the first parse
+    uint64_t n=countAllocations([&]() {
+        auto q=GQL_SQL::GQLParser::Query::parse(gql);
+        EXPECT_TRUE(q.get());
+    });
+    EXPECT_LE(n,LIMIT_PARSE) << "allocations: " << n;
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,169 @@
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <unistd.h>
+#include <duckdb.h>
+
+#include "libgqlsql.h"
+
+/// Test database, created once for all tests
+static std::string dbfile;
+
+/// Create the test database in a temporary file
+static void createDB()
+{
+    char fname[]="/tmp/duckdbtestXXXXXX";
+    int fd=mkstemp(fname);
+    ASSERT_GE(fd,0);
+    close(fd);
+    unlink(fname); // duckdb does not accept an existing empty file
+    dbfile=std::string(fname)+".db";
+    duckdb_database db;
+    duckdb_connection con;
+    ASSERT_EQ(DuckDBSuccess,duckdb_open(dbfile.c_str(),&db));
+    ASSERT_EQ(DuckDBSuccess,duckdb_connect(db,&con));
+    const char *sql[]={
+        "CREATE TABLE people (name VARCHAR, dept VARCHAR, salary DECIMAL(9,2), age INTEGER, big BIGINT,"
+        "                     active BOOLEAN, born DATE, hired TIMESTAMP, lunch TIME, score DOUBLE)",
+        "INSERT INTO people VALUES ('Anna','dev',100.5,38,9000000000000000000,true,'1980-02-03','2010-05-06 07:08:09.250','12:00:00',1.5)",
+        "INSERT INTO people VALUES ('Bert','dev',80,28,1,false,'1990-11-30','2015-01-01 00:00:00','12:30:00',2)",
+        "INSERT INTO people VALUES ('Carl','ops',70,33,2,true,'1985-06-15','2012-12-31 23:59:59','11:45:30.5',NULL)",
+        "INSERT INTO people VALUES ('Dora','ops',NULL,43,3,true,'1975-01-01',NULL,NULL,4)",
+        "INSERT INTO people VALUES ('O''Neil and a name longer than twelve bytes','sales',50,25,4,false,NULL,'2018-03-04 05:06:07',NULL,5)",
+    };
+    for(auto s:sql) {
+        duckdb_result res;
+        EXPECT_EQ(DuckDBSuccess,duckdb_query(con,s,&res)) << duckdb_result_error(&res);
+        duckdb_destroy_result(&res);
+    }
+    duckdb_disconnect(&con);
+    duckdb_close(&db);
+}
+
+/// Open the test database
+static GQL_SQL::DBQuery::DB::Ptr openDB()
+{
+    if(dbfile=="") { createDB(); }
+    auto db=GQL_SQL::DBQuery::DB::Ptr(new GQL_SQL::DBQuery::DuckDB(URI(("duckdb://"+dbfile).c_str())));
+    db->deftableSet("people");
+    db->connect();
+    return db;
+}
+
+/// Run a query that is expected to succeed
+static Json::Value run(GQL_SQL::DBQuery::DB::Ptr db,const std::string &gql)
+{
+    Json::Value r;
+    db->execute(gql,r);
+    EXPECT_EQ("ok",r["status"].asString()) << gql << "\n" << r;
+    return r["table"];
+}
+
+/// Returns column c of the result as a comma separated string
+static std::string column(const Json::Value &tbl,Json::ArrayIndex c)
+{
+    std::string res;
+    for(const auto &r:tbl["rows"]) {
+        if(res!="") { res+=","; }
+        const Json::Value &v=r["c"][c]["v"];
+        res+=v.isNull()?"null":v.asString();
+    }
+    return res;
+}
+
+/// Returns the SQL created for a GQL query
+static std::string translate(const std::string &gql)
+{
+    GQL_SQL::GQLParser::ParserDuckDB p("people");
+    EXPECT_TRUE(p.parse(gql)) << gql;
+    return p.res().result;
+}
+
+TEST(DuckDB, Translate) {
+    EXPECT_EQ("select \"name\" from \"people\" where (\"name\"='it''s')",translate("select name where name=\"it's\""));
+    EXPECT_EQ("select year(\"born\"), (millisecond(\"hired\")%1000) from \"people\" OFFSET 3",
+              translate("select year(born),millisecond(hired) offset 3"));
+    EXPECT_EQ("select date_diff('day',CAST(\"born\" AS DATE),CAST(\"hired\" AS DATE)) from \"people\"",
+              translate("select dateDiff(hired,born)"));
+    EXPECT_EQ("select \"name\" from \"people\" where regexp_full_match(\"name\",'A.*') LIMIT 2",
+              translate("select name where name matches 'A.*' limit 2"));
+}
+
+TEST(DuckDB, Types) {
+    auto db=openDB();
+    ASSERT_TRUE(db->isConnected());
+    auto t=run(db,"select * options no_format");
+    const char *types[]={ "string","string","number","number","number","boolean","date","datetime","timeofday","number" };
+    ASSERT_EQ(10,t["cols"].size());
+    for(Json::ArrayIndex c=0;c<10;c++) {
+        EXPECT_EQ(types[c],t["cols"][c]["type"].asString()) << c;
+    }
+    EXPECT_EQ("O'Neil and a name longer than twelve bytes",t["rows"][4]["c"][0]["v"].asString());
+    EXPECT_EQ(100.5,t["rows"][0]["c"][2]["v"].asDouble());
+    EXPECT_TRUE(t["rows"][3]["c"][2]["v"].isNull());
+    EXPECT_EQ("9000000000000000000",t["rows"][0]["c"][4]["v"].asString());
+    EXPECT_EQ("true,false,true,true,false",column(t,5));
+    EXPECT_EQ("Date(1980,1,3)",t["rows"][0]["c"][6]["v"].asString());
+    EXPECT_EQ("Date(2010,4,6,7,8,9,250)",t["rows"][0]["c"][7]["v"].asString());
+    // times are returned as [hour,minute,second,millisecond]
+    EXPECT_EQ(12,t["rows"][0]["c"][8]["v"][0].asInt());
+    EXPECT_EQ(500,t["rows"][2]["c"][8]["v"][3].asInt());
+}
+
+TEST(DuckDB, Functions) {
+    auto db=openDB();
+    auto t=run(db,"select year(born),month(born),day(born),hour(hired),minute(hired),second(hired),millisecond(hired),"
+                  "quarter(born),dateDiff(hired,born),upper(name),dayOfWeek(born) where name='Anna'");
+    EXPECT_EQ("1980",column(t,0));
+    EXPECT_EQ("2",column(t,1));
+    EXPECT_EQ("3",column(t,2));
+    EXPECT_EQ("7",column(t,3));
+    EXPECT_EQ("8",column(t,4));
+    EXPECT_EQ("9",column(t,5));
+    EXPECT_EQ("250",column(t,6));
+    EXPECT_EQ("1",column(t,7));
+    EXPECT_EQ("11050",column(t,8));
+    EXPECT_EQ("ANNA",column(t,9));
+    EXPECT_EQ("1",column(t,10)); // 1980-02-03 was a Sunday
+    EXPECT_EQ("date",run(db,"select toDate(hired)")["cols"][0]["type"].asString());
+}
+
+TEST(DuckDB, Where) {
+    auto db=openDB();
+    EXPECT_EQ("Anna,Carl,Dora",column(run(db,"select name where active=true order by name"),0));
+    EXPECT_EQ("Dora",column(run(db,"select name where salary is null"),0));
+    EXPECT_EQ("Carl",column(run(db,"select name where name starts with 'C'"),0));
+    EXPECT_EQ("Anna,Dora",column(run(db,"select name where name ends with 'a' order by name"),0));
+    EXPECT_EQ("Anna,Bert",column(run(db,"select name where name matches '[A-B].*' order by name"),0));
+    EXPECT_EQ("Anna,Dora",column(run(db,"select name where born<date '1982-01-01' order by name"),0));
+    EXPECT_EQ("Anna,Carl",column(run(db,"select name where hired<datetime '2013-01-01 00:00:00' order by name"),0));
+    EXPECT_EQ("3.5",column(run(db,"select age/8 where name='Bert'"),0));
+}
+
+TEST(DuckDB, GroupPivot) {
+    auto db=openDB();
+    auto t=run(db,"select dept,count(name),sum(age) group by dept order by sum(age) desc");
+    EXPECT_EQ("ops,dev,sales",column(t,0));
+    EXPECT_EQ("2,2,1",column(t,1));
+    EXPECT_EQ("76,66,25",column(t,2));
+
+    t=run(db,"select dept,count(name) group by dept pivot active order by dept");
+    ASSERT_EQ(3,t["cols"].size());
+}
+
+TEST(DuckDB, Errors) {
+    auto db=openDB();
+    Json::Value r;
+    db->execute("select nosuchcolumn",r);
+    EXPECT_EQ("error",r["status"].asString());
+
+    auto bad=GQL_SQL::DBQuery::DB::Ptr(new GQL_SQL::DBQuery::DuckDB(URI("duckdb:///nonexistent/file.db")));
+    bad->connect();
+    EXPECT_FALSE(bad->isConnected());
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    int r=RUN_ALL_TESTS();
+    if(dbfile!="") { unlink(dbfile.c_str()); }
+    return r;
+}
@@ -0,0 +1,93 @@
+/** \file
+ * \brief In-process DB backend used by the tests and benchmarks
+ *
+ * FakeDB generates a result of a configurable shape without any database so
+ * that the formatting and output paths can be exercised (and measured) on
+ * their own. SQL is created by the MySQL parser but never executed.
+ */
+
+#pragma once
+
+#include "libgqlsql.h"
+
+//! DB backend returning generated rows
+/**
+ * The column types are given as a string with one character per column
+ * that is repeated as often as needed to create all columns:
+ *
+ * - i: integer number
+ * - f: floating point number
+ * - s: string
+ * - b: boolean
+ * - d: date
+ * - t: datetime
+ * - h: timeofday
+ *
+ * The number of columns is the number of columns of the query (pivot,
+ * group and select). Pivot columns have only 4 different values so
+ * that pivoting creates a reasonable number of columns.
+ */
+class FakeDB : public GQL_SQL::DBQuery::DB {
+    public:
+        FakeDB(uint32_t _rows,const std::string &_types="ifsb") :
+            DB(Json::Value(Json::objectValue)), rows_(_rows), types_(_types) { deftable_="fake"; }
+        ///< create a backend that returns _rows rows for every query
+        ~FakeDB() override { asyncStop(); }
+        ///< wait for queries queued with executeAsync()
+
+        bool isConnected() const override { return parser_!=0; }
+        ///< true once connect() got called
+        void connect() override {
+            parser_=std::shared_ptr<GQL_SQL::GQLParser::Parser>(
+                new GQL_SQL::GQLParser::ParserMySQL(deftable_,tables_,extendedFunctions_));
+        }
+        ///< create the parser, there is nothing to connect to
+
+        inline void rowsSet(uint32_t _rows) { rows_=_rows; }
+        ///< change the number of rows returned
+
+    protected:
+        void getdata(const GQL_SQL::Result &q,Json::Value &tbl) const override {
+            auto query=q.query;
+            Json::ArrayIndex pivots=static_cast<Json::ArrayIndex>(query->pivot.size());
+            Json::ArrayIndex ncols=static_cast<Json::ArrayIndex>(pivots+query->group.size()+query->select.size());
+            if(query->selectStar) { ncols=static_cast<Json::ArrayIndex>(types_.size()); }
+
+            Json::Value &cols=tbl["cols"];
+            cols.resize(ncols);
+            for(Json::ArrayIndex c=0;c<ncols;c++) {
+                cols[c]["id"]="c"+std::to_string(c);
+                switch(types_[c%types_.size()]) {
+                case 'i': case 'f': cols[c]["type"]=GQL_SQL::DBQuery::TYPE_NUMBER;break;
+                case 'b': cols[c]["type"]=GQL_SQL::DBQuery::TYPE_BOOLEAN;break;
+                case 'd': cols[c]["type"]=GQL_SQL::DBQuery::TYPE_DATE;break;
+                case 't': cols[c]["type"]=GQL_SQL::DBQuery::TYPE_DATETIME;break;
+                case 'h': cols[c]["type"]=GQL_SQL::DBQuery::TYPE_TIME;break;
+                default: cols[c]["type"]=GQL_SQL::DBQuery::TYPE_STRING;break;
+                }
+            }
+            Json::Value &rows=tbl["rows"];
+            rows.resize(rows_);
+            for(Json::ArrayIndex r=0;r<rows_;r++) {
+                Json::Value &v=rows[r]["c"];
+                v.resize(ncols);
+                for(Json::ArrayIndex c=0;c<ncols;c++) {
+                    Json::ArrayIndex n=c<pivots?r%4:r;
+                    switch(types_[c%types_.size()]) {
+                    case 'i': v[c]["v"]=Json::Value(static_cast<Json::Int64>(n));break;
+                    case 'f': v[c]["v"]=n*0.25;break;
+                    case 'b': v[c]["v"]=(n%3)==0;break;
+                    case 'd': v[c]["v"]=1514764800.0+86400.0*(n%10000);break;
+                    case 't': v[c]["v"]=1514764800.0+61.5*n;break;
+                    case 'h': v[c]["v"]=(n%86400)+0.5;break;
+                    default: v[c]["v"]=(n%2)?"some text":"<b>other</b> & text";break;
+                    }
+                }
+            }
+        }
+        ///< create rows_ rows of generated data
+
+    private:
+        uint32_t rows_;     ///< number of rows returned by getdata
+        std::string types_; ///< column types, see class description
+};
@@ -0,0 +1,141 @@
+/** \file
+ * \brief Benchmarks for the execute and output paths
+ *
+ * Uses FakeDB to create results of a given shape (rows, columns and type
+ * mix) and measures the time needed to format them (execute runs
+ * setLabelFormat, applyFormat and for pivot queries pivotTable) and to
+ * write them with each of the output functions.
+ *
+ * Besides the time per cell the number of bytes allocated per cell and the
+ * peak RSS of the process are reported. Run with `make bench`, all the
+ * usual google benchmark options (e.g. --benchmark_filter) are accepted.
+ */
+
+#include <benchmark/benchmark.h>
+#include <sys/resource.h>
+#include <new>
+#include <cstdlib>
+#include <sstream>
+
+#include "libgqlsql.h"
+#include "FakeDB.h"
+
+/// number of bytes allocated since the start of the program
+static uint64_t allocatedBytes=0;
+
+// noinline: otherwise gcc complains about free() being used on memory
+// allocated with new after inlining
+__attribute__((noinline)) void *operator new(size_t size)
+{
+    allocatedBytes+=size;
+    void *p=malloc(size?size:1);
+    if(!p) { throw std::bad_alloc(); }
+    return p;
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void *p,size_t) noexcept { free(p); }
+
+/// Type mixes used by the benchmarks, see FakeDB for the meaning of the characters
+static const char *typeMixes[]={ "ifsb", "i", "f", "s", "dth" };
+
+/// Select statement for ncols columns
+static std::string selectCols(int64_t ncols)
+{
+    std::string q="select ";
+    for(int64_t c=0;c<ncols;c++) {
+        if(c>0) { q+=","; }
+        q+="c"+std::to_string(c);
+    }
+    return q;
+}
+
+/// Add the counters time/cell, bytes/cell and peak RSS (of the whole process so far)
+static void setCounters(benchmark::State &state,int64_t cells,uint64_t bytes)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF,&ru);
+    state.counters["time/cell"]=benchmark::Counter(static_cast<double>(cells),
+                                              benchmark::Counter::kIsIterationInvariantRate|benchmark::Counter::kInvert);
+    state.counters["bytes/cell"]=static_cast<double>(bytes)/static_cast<double>(cells*state.iterations());
+    state.counters["peakRSS(kB)"]=static_cast<double>(ru.ru_maxrss);
+    state.SetLabel(typeMixes[state.range(2)]);
+}
+
+/// Query execution including formatting.
+/// Arguments: rows, columns, type mix
+static void BM_Execute(benchmark::State &state)
+{
+    FakeDB db(static_cast<uint32_t>(state.range(0)),typeMixes[state.range(2)]);
+    db.connect();
+    std::string q=selectCols(state.range(1));
+    uint64_t start=allocatedBytes;
+    for(auto _:state) {
+        Json::Value r;
+        db.execute(q,r);
+        benchmark::DoNotOptimize(r);
+    }
+    setCounters(state,state.range(0)*state.range(1),allocatedBytes-start);
+}
+BENCHMARK(BM_Execute)
+    ->ArgsProduct({{1000,100000},{4,16},{0,1,2,3,4}})
+    ->Unit(benchmark::kMillisecond);
+
+/// Pivot query, the first column is pivoted (4 values), the second grouped.
+/// Arguments: rows, columns, type mix
+static void BM_ExecutePivot(benchmark::State &state)
+{
+    FakeDB db(static_cast<uint32_t>(state.range(0)),typeMixes[state.range(2)]);
+    db.connect();
+    std::string q="select c0";
+    for(int64_t c=2;c<state.range(1);c++) { q+=",max(c"+std::to_string(c)+")"; }
+    q+=" group by c0 pivot c1";
+    uint64_t start=allocatedBytes;
+    for(auto _:state) {
+        Json::Value r;
+        db.execute(q,r);
+        benchmark::DoNotOptimize(r);
+    }
+    setCounters(state,state.range(0)*state.range(1),allocatedBytes-start);
+}
+BENCHMARK(BM_ExecutePivot)
+    ->ArgsProduct({{1000,100000},{4},{0}})
+    ->Unit(benchmark::kMillisecond);
+
+/// Output of a formatted result with one of the output functions
+template<void (*OUT)(std::ostream &,const Json::Value &)>
+static void BM_Output(benchmark::State &state)
+{
+    FakeDB db(static_cast<uint32_t>(state.range(0)),typeMixes[state.range(2)]);
+    db.connect();
+    Json::Value r;
+    db.execute(selectCols(state.range(1)),r);
+    uint64_t start=allocatedBytes;
+    for(auto _:state) {
+        std::ostringstream o;
+        OUT(o,r);
+        benchmark::DoNotOptimize(o);
+    }
+    setCounters(state,state.range(0)*state.range(1),allocatedBytes-start);
+}
+
+/// outputHtml takes a title as well
+static void outputHtml(std::ostream &o,const Json::Value &r)
+{
+    GQL_SQL::DBQuery::outputHtml(o,"fake",r);
+}
+
+BENCHMARK_TEMPLATE(BM_Output,GQL_SQL::DBQuery::outputJson)
+    ->ArgsProduct({{100000},{4},{0,4}})->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Output,GQL_SQL::DBQuery::outputJsonColumns)
+    ->ArgsProduct({{100000},{4},{0,4}})->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Output,outputHtml)
+    ->ArgsProduct({{100000},{4},{0,4}})->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Output,GQL_SQL::DBQuery::outputCsv)
+    ->ArgsProduct({{100000},{4},{0,4}})->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Output,GQL_SQL::DBQuery::outputTsv)
+    ->ArgsProduct({{100000},{4},{0,4}})->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Output,GQL_SQL::DBQuery::outputArrow)
+    ->ArgsProduct({{100000},{4},{0,4}})->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
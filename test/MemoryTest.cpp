@@ -0,0 +1,430 @@
+#include <gtest/gtest.h>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+#include "libgqlsql.h"
+
+/// Small inline fixture used by most tests
+static const char *people=R"({
+    "default":"people",
+    "fixtures":{
+        "people":{
+            "cols":[
+                {"id":"name","type":"string"},
+                {"id":"dept","type":"string"},
+                {"id":"salary","type":"number"},
+                {"id":"active","type":"boolean"},
+                {"id":"born","type":"date"}
+            ],
+            "rows":[
+                ["Anna","dev",100,true,"1980-02-03"],
+                ["Bert","dev",80,false,"1990-11-30"],
+                ["Carl","ops",70,true,"1985-06-15"],
+                ["Dora","ops",null,true,"1975-01-01"],
+                ["Emil","sales",50.5,false,null]
+            ]
+        }
+    }
+})";
+
+/// Create a memory DB from a json config
+static GQL_SQL::DBQuery::DB::Ptr makeDB(const std::string &config)
+{
+    Json::Value init;
+    std::istringstream(config) >> init;
+    auto db=GQL_SQL::DBQuery::DB::Ptr(new GQL_SQL::DBQuery::Memory(init));
+    db->deftableSet(init.get("default","").asString());
+    db->connect();
+    return db;
+}
+
+/// Run a query that is expected to succeed
+static Json::Value run(GQL_SQL::DBQuery::DB::Ptr db,const std::string &gql)
+{
+    Json::Value r;
+    db->execute(gql,r);
+    EXPECT_EQ("ok",r["status"].asString()) << gql << "\n" << r;
+    return r["table"];
+}
+
+/// Returns column c of the result as a comma separated string
+static std::string column(const Json::Value &tbl,Json::ArrayIndex c)
+{
+    std::string res;
+    for(const auto &r:tbl["rows"]) {
+        if(res!="") { res+=","; }
+        const Json::Value &v=r["c"][c]["v"];
+        res+=v.isNull()?"null":v.asString();
+    }
+    return res;
+}
+
+TEST(Memory, SelectStar) {
+    auto db=makeDB(people);
+    ASSERT_TRUE(db->isConnected());
+    auto t=run(db,"select *");
+    ASSERT_EQ(5,t["cols"].size());
+    EXPECT_EQ("salary",t["cols"][2]["id"].asString());
+    EXPECT_EQ("number",t["cols"][2]["type"].asString());
+    EXPECT_EQ("date",t["cols"][4]["type"].asString());
+    EXPECT_EQ("Anna,Bert,Carl,Dora,Emil",column(t,0));
+}
+
+TEST(Memory, Where) {
+    auto db=makeDB(people);
+    EXPECT_EQ("Anna,Bert",column(run(db,"select name where dept='dev'"),0));
+    EXPECT_EQ("Anna,Carl",column(run(db,"select name where salary>60 and active=true"),0));
+    EXPECT_EQ("Dora",column(run(db,"select name where salary is null"),0));
+    EXPECT_EQ("Bert,Carl,Emil",column(run(db,"select name where not salary>90 and not salary is null"),0));
+    EXPECT_EQ("Bert,Carl,Dora",column(run(db,"select name where name like '%r_'"),0));
+    EXPECT_EQ("Carl",column(run(db,"select name where name starts with 'C'"),0));
+    EXPECT_EQ("Anna,Dora",column(run(db,"select name where name ends with 'a'"),0));
+    EXPECT_EQ("Emil",column(run(db,"select name where dept contains 'al'"),0));
+    EXPECT_EQ("Anna,Bert",column(run(db,"select name where name matches '[A-B].*'"),0));
+    EXPECT_EQ("Anna,Dora",column(run(db,"select name where born<date '1982-01-01'"),0));
+    EXPECT_EQ("Carl",column(run(db,"select name where year(born)=1985 and month(born)=6"),0));
+    EXPECT_EQ("Anna,Carl,Emil",column(run(db,"select name where name='Carl' or dept='sales' or name='Anna' or name='x'"),0));
+    EXPECT_EQ("Dora",column(run(db,"select name where active=true and not (name='Anna' or name='Carl' or name='Emil')"),0));
+    EXPECT_EQ("Anna,Bert",column(run(db,"select name where (2*3)=6 and dept='dev'"),0));
+    EXPECT_EQ("",column(run(db,"select name where dept='dev' and 1>2"),0));
+}
+
+TEST(Memory, Expressions) {
+    auto db=makeDB(people);
+    auto t=run(db,"select upper(name),salary*2,salary/0,day(born) where dept='dev'");
+    EXPECT_EQ("ANNA,BERT",column(t,0));
+    EXPECT_EQ("200,160",column(t,1));
+    EXPECT_EQ("null,null",column(t,2));
+    EXPECT_EQ("3,30",column(t,3));
+    EXPECT_EQ("string",t["cols"][0]["type"].asString());
+}
+
+TEST(Memory, GroupOrderLimit) {
+    auto db=makeDB(people);
+    auto t=run(db,"select dept,count(name),sum(salary),max(name) group by dept order by sum(salary) desc");
+    EXPECT_EQ("dev,ops,sales",column(t,0));
+    EXPECT_EQ("2,2,1",column(t,1));
+    EXPECT_EQ("180,70,50.5",column(t,2));
+    EXPECT_EQ("Bert,Dora,Emil",column(t,3));
+
+    t=run(db,"select avg(salary),min(born)");
+    ASSERT_EQ(1,t["rows"].size());
+    EXPECT_EQ("75.125",column(t,0));
+
+    EXPECT_EQ("Bert,Carl",column(run(db,"select name order by name limit 2 offset 1"),0));
+    EXPECT_EQ("Emil,Dora",column(run(db,"select name order by name desc limit 2"),0));
+    EXPECT_EQ("0",column(run(db,"select count(name) where salary>1000"),0));
+
+    db->maxRowsSet(2);
+    Json::Value r;
+    db->execute("select name",r);
+    EXPECT_EQ("other",r["errors"][0]["reason"].asString()) << r;
+    EXPECT_EQ("Anna,Bert",column(run(db,"select name order by name limit 2"),0));
+}
+
+TEST(Memory, Pivot) {
+    auto db=makeDB(people);
+    auto t=run(db,"select dept,count(name) group by dept pivot active");
+    ASSERT_EQ(3,t["cols"].size());
+    // rows are in the order they first appear in the (pivot,group) sorted data
+    EXPECT_EQ("dev,sales,ops",column(t,0));
+    EXPECT_EQ("1,1,null",column(t,1));
+    EXPECT_EQ("1,null,2",column(t,2));
+
+    t=run(db,"select dept,count(name) group by dept pivot active limit 1 offset 1");
+    ASSERT_EQ(3,t["cols"].size());
+    EXPECT_EQ("sales",column(t,0));
+    EXPECT_EQ("1",column(t,1));
+    EXPECT_EQ("null",column(t,2));
+
+    // offset+limit must not wrap around
+    t=run(db,"select dept,count(name) group by dept pivot active limit 18446744073709551615 offset 1");
+    EXPECT_EQ("sales,ops",column(t,0));
+}
+
+/// Returns the result of a query in the columnar json format, parsed again
+static Json::Value jsonColumns(GQL_SQL::DBQuery::DB::Ptr db,const std::string &gql)
+{
+    Json::Value r;
+    db->execute(gql,r);
+    std::ostringstream o;
+    GQL_SQL::DBQuery::outputJsonColumns(o,r);
+    Json::Value res;
+    std::istringstream(o.str()) >> res;
+    return res;
+}
+
+TEST(Memory, JsonColumns) {
+    auto db=makeDB(people);
+    auto r=jsonColumns(db,"select name,salary where dept!='sales' order by name format salary '#,##0.0'");
+    EXPECT_EQ("ok",r["status"].asString());
+    EXPECT_EQ("0.7",r["version"].asString());
+    const Json::Value &t=r["table"];
+    EXPECT_EQ(4,t["nrows"].asInt());
+    ASSERT_EQ(2,t["cols"].size());
+    EXPECT_FALSE(t.isMember("rows"));
+
+    // one flat array per column, no 'f' array if no cell is formatted
+    const Json::Value &name=t["cols"][0];
+    EXPECT_EQ("name",name["id"].asString());
+    EXPECT_EQ("string",name["type"].asString());
+    ASSERT_EQ(4,name["v"].size());
+    EXPECT_EQ("Anna",name["v"][0].asString());
+    EXPECT_EQ("Dora",name["v"][3].asString());
+    EXPECT_FALSE(name.isMember("f"));
+
+    const Json::Value &salary=t["cols"][1];
+    EXPECT_EQ("number",salary["type"].asString());
+    EXPECT_EQ("#,##0.0",salary["pattern"].asString());
+    ASSERT_EQ(4,salary["v"].size());
+    EXPECT_EQ(100,salary["v"][0].asInt());
+    EXPECT_EQ(70,salary["v"][2].asInt());
+    EXPECT_TRUE(salary["v"][3].isNull());
+    ASSERT_EQ(4,salary["f"].size());
+    EXPECT_EQ("100.0",salary["f"][0].asString());
+    EXPECT_EQ("80.0",salary["f"][1].asString());
+
+    // without formats there is no 'f' array, an empty result has empty arrays
+    r=jsonColumns(db,"select salary where salary>1000 options no_format");
+    EXPECT_EQ(0,r["table"]["nrows"].asInt());
+    ASSERT_EQ(1,r["table"]["cols"].size());
+    EXPECT_TRUE(r["table"]["cols"][0]["v"].isArray());
+    EXPECT_EQ(0,r["table"]["cols"][0]["v"].size());
+    EXPECT_FALSE(r["table"]["cols"][0].isMember("f"));
+
+    // errors are passed through unchanged
+    r=jsonColumns(db,"select nosuchcolumn");
+    EXPECT_EQ("error",r["status"].asString());
+    EXPECT_EQ(1,r["errors"].size());
+}
+
+/// Minimal reader for the Arrow IPC stream written by outputArrow(): splits
+/// the stream into messages and reads their flatbuffer metadata
+struct ArrowReader {
+    //! a message of the stream
+    struct Message {
+        std::string meta;  ///< flatbuffer metadata
+        std::string body;  ///< body, the buffers of a record batch
+        size_t header=0;   ///< position of the header table in meta
+        uint8_t type=0;    ///< header type, 1 schema, 3 record batch
+    };
+    std::vector<Message> messages;  ///< all messages before the end marker
+    bool complete=false;            ///< true if the end marker was found
+
+    ArrowReader(const std::string &s) {
+        size_t p=0;
+        while(p+8<=s.size() && u32(s,p)==0xffffffff) {
+            uint32_t len=u32(s,p+4);
+            p+=8;
+            if(len==0) { complete=p==s.size(); return; }
+            Message m;
+            m.meta=s.substr(p,len);
+            p+=len;
+            size_t root=u32(m.meta,0);
+            m.type=static_cast<uint8_t>(m.meta[field(m.meta,root,1)]);
+            m.header=ref(m.meta,field(m.meta,root,2));
+            size_t bodylen=static_cast<size_t>(i64(m.meta,field(m.meta,root,3)));
+            m.body=s.substr(p,bodylen);
+            p+=bodylen;
+            messages.push_back(m);
+        }
+    }
+    //! little endian integers
+    static uint32_t u32(const std::string &b,size_t p) { uint32_t v;memcpy(&v,b.data()+p,4);return v; }
+    static uint16_t u16(const std::string &b,size_t p) { uint16_t v;memcpy(&v,b.data()+p,2);return v; }
+    static int64_t i64(const std::string &b,size_t p) { int64_t v;memcpy(&v,b.data()+p,8);return v; }
+    static size_t ref(const std::string &b,size_t p) { return p+u32(b,p); }
+    //! position of field slot of the table at t, 0 if it is not set
+    static size_t field(const std::string &b,size_t t,uint16_t slot) {
+        size_t vt=t-static_cast<size_t>(static_cast<int32_t>(u32(b,t)));
+        if(4+2*slot>=u16(b,vt)) { return 0; }
+        uint16_t o=u16(b,vt+4+2*slot);
+        return o?t+o:0;
+    }
+    //! the string referenced at p
+    static std::string str(const std::string &b,size_t p) { p=ref(b,p);return b.substr(p+4,u32(b,p)); }
+};
+
+/// Field of an Arrow schema
+struct ArrowField {
+    std::string name;  ///< column name
+    int type;          ///< Type union, 2 int, 3 float, 5 utf8, 6 bool, 8 date
+    int param;         ///< bit width for int, precision for float, unit for date
+};
+
+/// Read the fields of a schema message
+static std::vector<ArrowField> arrowSchema(const ArrowReader::Message &m)
+{
+    std::vector<ArrowField> res;
+    size_t v=ArrowReader::ref(m.meta,ArrowReader::field(m.meta,m.header,1));
+    for(uint32_t i=0;i<ArrowReader::u32(m.meta,v);i++) {
+        size_t f=ArrowReader::ref(m.meta,v+4+4*i);
+        ArrowField af;
+        af.name=ArrowReader::str(m.meta,ArrowReader::field(m.meta,f,0));
+        af.type=m.meta[ArrowReader::field(m.meta,f,2)];
+        size_t t=ArrowReader::ref(m.meta,ArrowReader::field(m.meta,f,3));
+        size_t p=ArrowReader::field(m.meta,t,0);
+        af.param=p?static_cast<int>(ArrowReader::u32(m.meta,p)&(af.type==2?0xffffffff:0xffff)):-1;
+        res.push_back(af);
+    }
+    return res;
+}
+
+/// Read the record batch message m: the number of rows, the null count of
+/// every column and the buffers (validity, [offsets,] values) of every column
+static int64_t arrowBatch(const ArrowReader::Message &m,std::vector<int64_t> &nulls,std::vector<std::string> &buffers)
+{
+    size_t n=ArrowReader::ref(m.meta,ArrowReader::field(m.meta,m.header,1));
+    for(uint32_t i=0;i<ArrowReader::u32(m.meta,n);i++) {
+        nulls.push_back(ArrowReader::i64(m.meta,n+4+16*i+8));
+    }
+    size_t b=ArrowReader::ref(m.meta,ArrowReader::field(m.meta,m.header,2));
+    for(uint32_t i=0;i<ArrowReader::u32(m.meta,b);i++) {
+        int64_t off=ArrowReader::i64(m.meta,b+4+16*i);
+        int64_t len=ArrowReader::i64(m.meta,b+4+16*i+8);
+        EXPECT_EQ(0,off%8);
+        buffers.push_back(m.body.substr(static_cast<size_t>(off),static_cast<size_t>(len)));
+    }
+    return ArrowReader::i64(m.meta,ArrowReader::field(m.meta,m.header,0));
+}
+
+/// Returns value i of a buffer of fixed size values
+template<typename T> static T arrowValue(const std::string &b,size_t i)
+{
+    T v;
+    memcpy(&v,b.data()+i*sizeof(T),sizeof(T));
+    return v;
+}
+
+/// Returns the query result as an Arrow stream
+static std::string arrow(GQL_SQL::DBQuery::DB::Ptr db,const std::string &gql)
+{
+    Json::Value r;
+    db->execute(gql,r);
+    std::ostringstream o;
+    GQL_SQL::DBQuery::outputArrow(o,r);
+    return o.str();
+}
+
+TEST(Memory, Arrow) {
+    auto db=makeDB(people);
+    ArrowReader s(arrow(db,"select name,salary,active,born,year(born) where dept!='sales' order by name options no_format"));
+    EXPECT_TRUE(s.complete);
+    ASSERT_EQ(2,s.messages.size());
+    ASSERT_EQ(1,s.messages[0].type);
+    ASSERT_EQ(3,s.messages[1].type);
+
+    auto fields=arrowSchema(s.messages[0]);
+    ASSERT_EQ(5,fields.size());
+    EXPECT_EQ("name",fields[0].name);
+    EXPECT_EQ(5,fields[0].type);     // Utf8
+    EXPECT_EQ(3,fields[1].type);     // FloatingPoint
+    EXPECT_EQ(2,fields[1].param);    // DOUBLE
+    EXPECT_EQ(6,fields[2].type);     // Bool
+    EXPECT_EQ(8,fields[3].type);     // Date
+    EXPECT_EQ(0,fields[3].param);    // DAY
+    EXPECT_EQ("year(born)",fields[4].name);
+    EXPECT_EQ(2,fields[4].type);     // Int
+    EXPECT_EQ(64,fields[4].param);
+
+    std::vector<int64_t> nulls;
+    std::vector<std::string> b;
+    EXPECT_EQ(4,arrowBatch(s.messages[1],nulls,b));
+    ASSERT_EQ(5,nulls.size());
+    EXPECT_EQ(std::vector<int64_t>({0,1,0,0,0}),nulls);
+    ASSERT_EQ(11,b.size());
+
+    // utf8: no validity, offsets, values
+    EXPECT_EQ(0,b[0].size());
+    EXPECT_EQ(0,arrowValue<int32_t>(b[1],0));
+    EXPECT_EQ(4,arrowValue<int32_t>(b[1],1));
+    EXPECT_EQ(16,arrowValue<int32_t>(b[1],4));
+    EXPECT_EQ("AnnaBertCarlDora",b[2]);
+    // double with Dora's salary null
+    EXPECT_EQ(0x07,b[3][0]);
+    EXPECT_EQ(100.0,arrowValue<double>(b[4],0));
+    EXPECT_EQ(70.0,arrowValue<double>(b[4],2));
+    // bool: Anna, Carl and Dora are active
+    EXPECT_EQ(0,b[5].size());
+    EXPECT_EQ(0x0d,b[6][0]);
+    // date32: days since 1970-01-01
+    EXPECT_EQ(3685,arrowValue<int32_t>(b[8],0));
+    EXPECT_EQ(7638,arrowValue<int32_t>(b[8],1));
+    EXPECT_EQ(1826,arrowValue<int32_t>(b[8],3));
+    // int64
+    EXPECT_EQ(1980,arrowValue<int64_t>(b[10],0));
+    EXPECT_EQ(1975,arrowValue<int64_t>(b[10],3));
+
+    // the type depends on the column only: whole numbers are still doubles
+    ArrowReader d(arrow(db,"select salary where dept='dev'"));
+    ASSERT_EQ(2,d.messages.size());
+    EXPECT_EQ(3,arrowSchema(d.messages[0])[0].type);
+
+    // an empty result has the schema and one empty batch
+    ArrowReader e(arrow(db,"select name,count(dept) where salary>1000 group by name"));
+    EXPECT_TRUE(e.complete);
+    ASSERT_EQ(2,e.messages.size());
+    fields=arrowSchema(e.messages[0]);
+    ASSERT_EQ(2,fields.size());
+    EXPECT_EQ(5,fields[0].type);
+    EXPECT_EQ(2,fields[1].type);
+    nulls.clear();
+    b.clear();
+    EXPECT_EQ(0,arrowBatch(e.messages[1],nulls,b));
+    EXPECT_EQ(std::vector<int64_t>({0,0}),nulls);
+}
+
+TEST(Memory, Errors) {
+    auto db=makeDB(people);
+    Json::Value r;
+    db->execute("select nosuchcolumn",r);
+    EXPECT_EQ("error",r["status"].asString());
+
+    auto bad=makeDB(R"({"default":"t","fixtures":{"t":"/nonexistent/file.csv"}})");
+    EXPECT_FALSE(bad->isConnected());
+    r=Json::Value();
+    bad->execute("select *",r);
+    EXPECT_EQ("error",r["status"].asString());
+}
+
+TEST(Memory, Csv) {
+    char fname[]="/tmp/memorytestXXXXXX.csv";
+    int fd=mkstemps(fname,4);
+    ASSERT_GE(fd,0);
+    close(fd);
+    {
+        std::ofstream f(fname);
+        f << "name,n:number,t:timeofday\n"
+          << "\"Smith, John\",1,12:30:00\n"
+          << "\"say \"\"hi\"\"\",,00:00:01\n";
+    }
+    auto db=makeDB(std::string(R"({"fixtures":{"csv":")")+fname+"\"}}");
+    unlink(fname);
+    auto t=run(db,"select name,n,hour(t) order by t");
+    EXPECT_EQ("say \"hi\",Smith, John",column(t,0));
+    EXPECT_EQ("null,1",column(t,1));
+    EXPECT_EQ("0,12",column(t,2));
+    EXPECT_EQ("timeofday",run(db,"select t")["cols"][0]["type"].asString());
+}
+
+TEST(Memory, Generator) {
+    const char *spec=R"({"fixtures":{"gen":{"generate":{"rows":1000,"seed":7,"columns":[
+        {"id":"id","type":"number"},
+        {"id":"cat","type":"string","distinct":5},
+        {"id":"d","type":"date","distinct":30}]}}}})";
+    auto db=makeDB(spec);
+    auto t=run(db,"select count(id),max(id)");
+    EXPECT_EQ("1000",column(t,0));
+    EXPECT_EQ("999",column(t,1));
+    t=run(db,"select cat,count(id) group by cat");
+    EXPECT_EQ(5,t["rows"].size());
+    // same spec, same data
+    EXPECT_EQ(column(t,1),column(run(makeDB(spec),"select cat,count(id) group by cat"),1));
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
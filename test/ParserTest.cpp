@@ -1,4 +1,5 @@
 #include <gtest/gtest.h>
+#include <algorithm>
 
 #include "libgqlsql.h"
 
@@ -47,6 +48,239 @@ TEST (Parser, Errors) {
     EXPECT_THROW(GQL_SQL::GQLParser::Query::parse("sum(salary + perks) "),GQL_SQL::GQLParser::SyntaxError);
 }
 
+TEST (Parser, Parameters) { 
+    const char *gql="select name, year(born)+1 where dept=\"it's\" and salary>=1.5 and born<date '2000-01-31' order by name";
+    GQL_SQL::GQLParser::ParserMySQL my("people");
+    my.parameterizeSet(true);
+    ASSERT_TRUE(my.parse(gql));
+    EXPECT_EQ("select `name`, (year(`born`)+1) from `people` where ((`dept`=?) and (`salary`>=?) and (`born`<CAST(? AS DATE))) ORDER BY `name`",
+              my.res().result);
+    ASSERT_EQ(3,my.res().params.size());
+    EXPECT_EQ("it's",my.res().params[0].value);
+    EXPECT_EQ(GQL_SQL::ParamType::STRING,my.res().params[0].type);
+    EXPECT_EQ("1.5",my.res().params[1].value);
+    EXPECT_EQ(GQL_SQL::ParamType::NUMBER,my.res().params[1].type);
+    EXPECT_EQ("2000-01-31",my.res().params[2].value);
+    EXPECT_EQ(GQL_SQL::ParamType::DATE,my.res().params[2].type);
+
+    // the run time limit is passed to MySQL as an optimizer hint
+    my.timeoutSet(1500);
+    ASSERT_TRUE(my.parse("select name limit 1"));
+    EXPECT_EQ("select /*+ MAX_EXECUTION_TIME(1500) */ `name` from `people` LIMIT 1",my.res().result);
+    my.timeoutSet(0);
+
+    GQL_SQL::GQLParser::ParserPostgreSQL pg("people");
+    pg.parameterizeSet(true);
+    ASSERT_TRUE(pg.parse(gql));
+    EXPECT_EQ("select \"name\", ((EXTRACT(year FROM(\"born\")))+1) from \"people\" where ((\"dept\"=$1) and (\"salary\">=$2::numeric) and (\"born\"<$3::date)) ORDER BY \"name\"",
+              pg.res().result);
+    ASSERT_EQ(3,pg.res().params.size());
+
+    // same shape, same SQL
+    std::string sql=pg.res().result;
+    ASSERT_TRUE(pg.parse("select name, year(born)+1 where dept='x' and salary>=7.25 and born<date '1990-01-01' order by name"));
+    EXPECT_EQ(sql,pg.res().result);
+    EXPECT_EQ("7.25",pg.res().params[1].value);
+
+    // without parameters the literals are part of the query
+    GQL_SQL::GQLParser::ParserPostgreSQL inl("people");
+    ASSERT_TRUE(inl.parse("select name where salary>3"));
+    EXPECT_EQ("select \"name\" from \"people\" where (\"salary\">3)",inl.res().result);
+    EXPECT_EQ(0,inl.res().params.size());
+
+    // chains of 'and' or 'or' are not nested, but mixed operators keep their grouping
+    ASSERT_TRUE(inl.parse("select name where a<1 or a<2 or a<3 and b=4 or (c<5 or c<6)"));
+    EXPECT_EQ("select \"name\" from \"people\" where ((((\"a\"<1) or (\"a\"<2) or (\"a\"<3)) and (\"b\"=4)) or ((\"c\"<5) or (\"c\"<6)))",
+              inl.res().result);
+
+    // IN sets are passed as one array to PostgreSQL, as a list of values to MySQL
+    gql="select name where dept='a' or dept=\"it's\" or age=3 or dept='c' or born=date '2000-01-31' or born=date '2000-02-01'";
+    ASSERT_TRUE(pg.parse(gql));
+    EXPECT_EQ("select \"name\" from \"people\" where ((\"dept\" = ANY($1)) or (\"age\"=$2::int8) or (\"born\" = ANY($3::date[])))",
+              pg.res().result);
+    ASSERT_EQ(3,pg.res().params.size());
+    EXPECT_EQ("{\"a\",\"it's\",\"c\"}",pg.res().params[0].value);
+    EXPECT_EQ(GQL_SQL::ParamType::ARRAY,pg.res().params[0].type);
+    EXPECT_EQ("{\"2000-01-31\",\"2000-02-01\"}",pg.res().params[2].value);
+    ASSERT_TRUE(pg.parse("select name where x=1.5 or x=2 or y='\\\"'"));
+    EXPECT_EQ("select \"name\" from \"people\" where ((\"x\" = ANY($1::numeric[])) or (\"y\"=$2))",pg.res().result);
+    ASSERT_TRUE(my.parse(gql));
+    EXPECT_EQ("select `name` from `people` where ((`dept` IN (?,?,?)) or (`age`=?) or (`born` IN (CAST(? AS DATE),CAST(? AS DATE))))",
+              my.res().result);
+    ASSERT_EQ(6,my.res().params.size());
+    EXPECT_EQ("c",my.res().params[2].value);
+    ASSERT_TRUE(inl.parse("select name where dept='a' or age=3 or dept='c' or born=date '2000-01-31' or born=date '2000-02-01'"));
+    EXPECT_EQ("select \"name\" from \"people\" where ((\"dept\" IN ('a','c')) or (\"age\"=3) or (\"born\" IN (date '2000-01-31',date '2000-02-01')))",
+              inl.res().result);
+}
+
+TEST (Parser, StringPatterns) { 
+    // literals become LIKE patterns, which can use an index for prefixes
+    GQL_SQL::GQLParser::ParserMySQL my("people");
+    ASSERT_TRUE(my.parse("select name where name starts with 'a_b' and name ends with '50%' and dept contains 'x!y'"));
+    EXPECT_EQ("select `name` from `people` where ((`name` LIKE 'a!_b%' ESCAPE '!') and (`name` LIKE '%50!%' ESCAPE '!') and (`dept` LIKE '%x!!y%' ESCAPE '!'))",
+              my.res().result);
+    my.parameterizeSet(true);
+    ASSERT_TRUE(my.parse("select name where upper(dept)='X' and name starts with 'An'"));
+    EXPECT_EQ("select `name` from `people` where ((upper(`dept`)=?) and (`name` LIKE ? ESCAPE '!'))",my.res().result);
+    ASSERT_EQ(2,my.res().params.size());
+    EXPECT_EQ("An%",my.res().params[1].value);
+    // other operands keep the functions
+    ASSERT_TRUE(my.parse("select name where name starts with dept"));
+    EXPECT_EQ("select `name` from `people` where (INSTR(`name`, `dept`)=1)",my.res().result);
+
+    GQL_SQL::GQLParser::ParserPostgreSQL pg("people");
+    ASSERT_TRUE(pg.parse("select name where name starts with 'a\\b_' and name ends with '%' and dept contains 'x'"));
+    EXPECT_EQ("select \"name\" from \"people\" where ((\"name\" LIKE 'a\\\\b\\_%') and (\"name\" LIKE '%\\%') and (\"dept\" LIKE '%x%'))",
+              pg.res().result);
+    pg.parameterizeSet(true);
+    ASSERT_TRUE(pg.parse("select name where name starts with 'An'"));
+    EXPECT_EQ("select \"name\" from \"people\" where (\"name\" LIKE $1)",pg.res().result);
+    EXPECT_EQ("An%",pg.res().params[0].value);
+    ASSERT_TRUE(pg.parse("select name where name ends with dept"));
+    EXPECT_EQ("select \"name\" from \"people\" where (RIGHT(\"name\",LENGTH(\"dept\"))=\"dept\")",pg.res().result);
+}
+
+TEST (Parser, Schema) { 
+    GQL_SQL::Schema schema;
+    schema["people"]["name"]="varchar(20)";
+    schema["people"]["Age"]="int";
+    schema["other"]=GQL_SQL::TableSchema(); // table does not exist, not checked
+    GQL_SQL::GQLParser::ParserMySQL p("people",{"other"});
+    p.schemaSet(schema);
+    EXPECT_TRUE(p.parse("select name, max(age) where age>3 group by name order by name"));
+    EXPECT_TRUE(p.parse("select `people.name`, `other.x`")) << p.res().errormsg;
+    EXPECT_FALSE(p.parse("select name where salary>3"));
+    EXPECT_NE(std::string::npos,p.res().errormsg.find("salary"));
+    EXPECT_FALSE(p.parse("select name group by dept"));
+    EXPECT_FALSE(p.parse("select `people.dept`"));
+    EXPECT_FALSE(p.parse("select name order by upper(nme)"));
+}
+
+TEST (Parser, LargeExpressions) { 
+    // long filters and deep nesting are parsed and printed without recursion
+    std::string gql="where a<0";
+    for(int i=1;i<10000;i++) { gql+=" or a<"+std::to_string(i); }
+    auto q=GQL_SQL::GQLParser::Query::parse(gql);
+    std::string r=q->where->to_string(false);
+    EXPECT_NE(std::string::npos,r.find("((a<0) or (a<1)) or (a<2)"));
+    EXPECT_NE(std::string::npos,r.find(" or (a<9999)"));
+    EXPECT_EQ(*q->where,*GQL_SQL::GQLParser::Query::parse("where "+r)->where);
+
+    std::string deep(20000,'(');
+    deep="select "+deep+"x"+std::string(20000,')');
+    EXPECT_EQ("x",GQL_SQL::GQLParser::Query::parse(deep)->select[0].expr->to_string());
+    std::string neg="select 1+";
+    for(int i=0;i<20000;i++) { neg+="- "; }
+    r=GQL_SQL::GQLParser::Query::parse(neg+"x")->select[0].expr->to_string();
+    EXPECT_EQ(20000,std::count(r.begin(),r.end(),'-'));
+
+    // precedence and associativity are those of the recursive descent parser
+    auto str=[](const char *s) { return GQL_SQL::GQLParser::Query::parse(s,true)->select[0].expr->to_string(); };
+    EXPECT_EQ("((a-b)-c)",str("select a-b-c"));
+    EXPECT_EQ("(a+(b*c))",str("select a+b*c"));
+    EXPECT_EQ("(((a=1)+2)*3)",str("select a=1+2*3"));
+    EXPECT_EQ("((a or b) and c)",str("select a or b and c"));
+    EXPECT_EQ("(not (a=b))",str("select not a=b"));
+    EXPECT_EQ("a",str("select not not a"));
+    EXPECT_EQ("like(a, like(b, c))",str("select a like b like c"));
+    EXPECT_EQ("(`is null`(a)/b)",str("select a is null / b"));
+    EXPECT_EQ("(f(a, b+c)*(-d))",str("select f(a,b+c)*-d"));
+    EXPECT_THROW(GQL_SQL::GQLParser::Query::parse("select not"),GQL_SQL::GQLParser::SyntaxError);
+    EXPECT_THROW(GQL_SQL::GQLParser::Query::parse("select (a"),GQL_SQL::GQLParser::SyntaxError);
+    EXPECT_THROW(GQL_SQL::GQLParser::Query::parse("select f(a,)"),GQL_SQL::GQLParser::SyntaxError);
+}
+
+TEST (Parser, InSets) { 
+    auto where=[](const std::string &s) { return GQL_SQL::GQLParser::Query::parse("where "+s)->where; };
+    auto in=where("a=1 or b='x' or 2=a or a='y' or b='z' or a=3");
+    // sets keep the place of their first comparison
+    ASSERT_EQ(GQL_SQL::GQLParser::TokenType::OR,in->tp());
+    EXPECT_EQ("(((a=1) or (a=2) or (a=3)) or ((b='x') or (b='z'))) or (a='y')",in->to_string(false));
+    const auto &set=in->sub()[0]->sub()[0];
+    ASSERT_EQ(GQL_SQL::GQLParser::TokenType::IN_SET,set->tp());
+    ASSERT_EQ(4,set->sub().size());
+    EXPECT_EQ("a",set->sub()[0]->data());
+    EXPECT_EQ("2",set->sub()[2]->data());
+    // the printed set is parsed to the same set
+    EXPECT_EQ(*in,*where(in->to_string()));
+
+    // chains are found below 'and' and 'not'
+    EXPECT_EQ("(d>1) and (not ((a=1) or (a=2)))",where("d>1 and not (a=1 or a=2)")->to_string(false));
+    EXPECT_EQ(GQL_SQL::GQLParser::TokenType::IN_SET,where("d>1 and not (a=1 or a=2)")->sub()[1]->sub()[0]->tp());
+
+    // nothing to fold
+    for(auto s:{ "a=1 or b=2","a=1 and a=2","a=b or a=c","upper(a)='x' or upper(a)='y'","a=1 or a!=2",
+                 "a=1 or (a=2 and c)","a=1 or not a=2","a=1 or a=date '2000-01-01'" }) {
+        auto e=where(s);
+        std::vector<GQL_SQL::GQLParser::Query::Expr::CPtr> todo{e};
+        while(!todo.empty()) {
+            auto c=todo.back();
+            todo.pop_back();
+            EXPECT_NE(GQL_SQL::GQLParser::TokenType::IN_SET,c->tp()) << s;
+            for(const auto &x:c->sub()) { todo.push_back(x); }
+        }
+    }
+}
+
+TEST (Parser, ConstantFolding) { 
+    auto where=[](const std::string &s) { return GQL_SQL::GQLParser::Query::parse("where "+s)->where; };
+    EXPECT_EQ("x>3",where("1=1 and x>3")->to_string(false));
+    EXPECT_EQ("x>600",where("x>(10*60)")->to_string(false));
+    EXPECT_EQ("x>3",where("x>(-(2-5))")->to_string(false));
+    EXPECT_EQ("x<(-4)",where("x<(1-5)")->to_string(false));
+    EXPECT_EQ("y and (x>1)",where("y and not (not x>1)")->to_string(false));
+    EXPECT_EQ("x",where("not true or x")->to_string(false));
+    EXPECT_EQ("x",where("1 is null or x")->to_string(false));
+    EXPECT_EQ("x",where("'a'<='a' and x")->to_string(false));
+    EXPECT_EQ(GQL_SQL::GQLParser::TokenType::IN_SET,where("a=1 or 1>2 or a=3")->tp());
+
+    // tautologies remove the where clause, contradictions make the query empty
+    EXPECT_FALSE(where("x or 1<2"));
+    EXPECT_FALSE(GQL_SQL::GQLParser::Query::parse("where x or 1<2")->filtersAll());
+    EXPECT_TRUE(GQL_SQL::GQLParser::Query::parse("where x and 1>2")->filtersAll());
+    EXPECT_TRUE(GQL_SQL::GQLParser::Query::parse("where false")->filtersAll());
+    EXPECT_FALSE(GQL_SQL::GQLParser::Query::parse("where x")->filtersAll());
+
+    // not folded: non exact divisions, large and non integer numbers, strings
+    // that are compared by the DB, and the select expressions
+    EXPECT_EQ("x>(7/2)",where("x>(7/2)")->to_string(false));
+    EXPECT_EQ("x>(1/0)",where("x>(1/0)")->to_string(false));
+    EXPECT_EQ("x>(1234567890+1)",where("x>(1234567890+1)")->to_string(false));
+    EXPECT_EQ("x>(1.5+1)",where("x>(1.5+1)")->to_string(false));
+    EXPECT_EQ("x and ('a'<'b')",where("x and 'a'<'b'")->to_string(false));
+    EXPECT_EQ("1+2",GQL_SQL::GQLParser::Query::parse("select 1+2 where 1=1")->select[0].expr->to_string(false));
+
+    GQL_SQL::GQLParser::ParserPostgreSQL pg("people");
+    pg.parameterizeSet(true);
+    ASSERT_TRUE(pg.parse("select name where age>(60*60) and 2>1"));
+    EXPECT_EQ("select \"name\" from \"people\" where (\"age\">$1::int8)",pg.res().result);
+    EXPECT_EQ("3600",pg.res().params[0].value);
+}
+
+TEST (Parser, DateRanges) { 
+    auto where=[](const std::string &s) { return GQL_SQL::GQLParser::Query::parse("where "+s)->where->to_string(false); };
+    EXPECT_EQ("(ts>=date '2023-01-01') and (ts<date '2024-01-01')",where("year(ts)=2023"));
+    EXPECT_EQ("(ts>=date '2023-05-01') and (ts<date '2023-06-01')",where("year(ts)=2023 and month(ts)=5"));
+    EXPECT_EQ("((x>1) and (ts>=date '2023-12-01')) and (ts<date '2024-01-01')",where("x>1 and month(ts)=12 and year(ts)=2023"));
+    EXPECT_EQ("ts>=date '2024-01-01'",where("2023<year(ts)"));
+    EXPECT_EQ("ts<date '2024-01-01'",where("year(ts)<=2023"));
+    EXPECT_EQ("(ts>=date '2024-12-31') and (ts<date '2025-01-01')",where("toDate(ts)=date '2024-12-31'"));
+    EXPECT_EQ("ts>=date '2024-03-01'",where("toDate(ts)>date '2024-02-29'"));
+    EXPECT_EQ("x or (not ((ts>=date '2000-01-01') and (ts<date '2001-01-01')))",where("x or not year(ts)=2000"));
+
+    // kept as they are
+    for(auto s:{ "year(ts)!=2023","year(ts)=0","year(ts)=month(ts)","month(ts)=5","year(ts)=2023.5",
+                 "toDate(ts)=date '2023-02-29'","year(upper(ts))=2023" }) {
+        EXPECT_EQ(std::string::npos,where(s).find(">=date")) << s;
+    }
+    EXPECT_EQ("((ts>=date '2023-01-01') and (ts<date '2024-01-01')) and (month(tt)=5)",where("year(ts)=2023 and month(tt)=5"));
+
+    GQL_SQL::GQLParser::ParserMySQL my("t");
+    ASSERT_TRUE(my.parse("select a where year(ts)=2023 and month(ts)=5"));
+    EXPECT_EQ("select `a` from `t` where ((`ts`>=date '2023-05-01') and (`ts`<date '2023-06-01'))",my.res().result);
+}
+
 int main(int argc, char **argv) {
       ::testing::InitGoogleTest(&argc, argv);
         return RUN_ALL_TESTS();
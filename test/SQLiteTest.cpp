@@ -0,0 +1,509 @@
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <fstream>
+#include <thread>
+#include <chrono>
+#include <stdexcept>
+#include <sqlite3.h>
+
+#include "libgqlsql.h"
+
+/// Test database, created once for all tests
+static std::string dbfile;
+
+/// Create the test database in a temporary file
+static void createDB()
+{
+    char fname[]="/tmp/sqlitetestXXXXXX.db";
+    int fd=mkstemps(fname,3);
+    ASSERT_GE(fd,0);
+    close(fd);
+    dbfile=fname;
+    sqlite3 *db;
+    ASSERT_EQ(SQLITE_OK,sqlite3_open(fname,&db));
+    const char *sql=
+        "CREATE TABLE people (name TEXT, dept VARCHAR(20), salary REAL, age INTEGER,"
+        "                     active BOOLEAN, born DATE, hired DATETIME, lunch TIME);"
+        "INSERT INTO people VALUES ('Anna','dev',100.5,38,1,'1980-02-03','2010-05-06 07:08:09.250','12:00:00');"
+        "INSERT INTO people VALUES ('Bert','dev',80,28,0,'1990-11-30','2015-01-01 00:00:00','12:30:00');"
+        "INSERT INTO people VALUES ('Carl','ops',70,33,1,'1985-06-15','2012-12-31 23:59:59','11:45:30.5');"
+        "INSERT INTO people VALUES ('Dora','ops',NULL,43,1,'1975-01-01',NULL,NULL);"
+        "INSERT INTO people VALUES ('O''Neil','sales',50,25,0,NULL,'2018-03-04 05:06:07',NULL);"
+        // a cross join of big and big2 takes long enough to be stopped
+        "CREATE TABLE big (x INTEGER);"
+        "INSERT INTO big WITH RECURSIVE n(x) AS (SELECT 1 UNION ALL SELECT x+1 FROM n WHERE x<20000) SELECT x FROM n;"
+        "CREATE VIEW big2 AS SELECT x AS y FROM big;"
+        // milliseconds since the epoch and a date SQLite does not know
+        "CREATE TABLE stamps (ms INTEGER, day DATE);"
+        "INSERT INTO stamps VALUES (1699963200000,'2023-11-14');"
+        "INSERT INTO stamps VALUES (0,'yesterday');";
+    char *err=0;
+    ASSERT_EQ(SQLITE_OK,sqlite3_exec(db,sql,0,0,&err)) << err;
+    sqlite3_close(db);
+}
+
+/// Open the test database
+static GQL_SQL::DBQuery::DB::Ptr openDB(const char *table="people")
+{
+    if(dbfile=="") { createDB(); }
+    auto db=GQL_SQL::DBQuery::DB::Ptr(new GQL_SQL::DBQuery::SQLite(URI(("sqlite://"+dbfile).c_str())));
+    db->deftableSet(table);
+    db->connect();
+    return db;
+}
+
+/// Run a query that is expected to succeed
+static Json::Value run(GQL_SQL::DBQuery::DB::Ptr db,const std::string &gql)
+{
+    Json::Value r;
+    db->execute(gql,r);
+    EXPECT_EQ("ok",r["status"].asString()) << gql << "\n" << r;
+    return r["table"];
+}
+
+/// Returns column c of the result as a comma separated string
+static std::string column(const Json::Value &tbl,Json::ArrayIndex c)
+{
+    std::string res;
+    for(const auto &r:tbl["rows"]) {
+        if(res!="") { res+=","; }
+        const Json::Value &v=r["c"][c]["v"];
+        res+=v.isNull()?"null":v.asString();
+    }
+    return res;
+}
+
+/// Returns the SQL created for a GQL query
+static std::string translate(const std::string &gql)
+{
+    GQL_SQL::GQLParser::ParserSQLite p("people",{"other"});
+    EXPECT_TRUE(p.parse(gql)) << gql;
+    return p.res().result;
+}
+
+TEST(SQLite, Translate) {
+    EXPECT_EQ("select \"name\" from \"people\" where (\"name\"='it''s')",translate("select name where name=\"it's\""));
+    EXPECT_EQ("select CAST(strftime('%Y',\"born\") AS INTEGER) from \"people\" LIMIT -1 OFFSET 3",
+              translate("select year(born) offset 3"));
+    EXPECT_EQ("select \"name\" from \"people\" where (\"born\"<'2000-01-01') LIMIT 2 OFFSET 1",
+              translate("select name where born<date '2000-01-01' limit 2 offset 1"));
+    EXPECT_EQ("select  \"dept\", \"age\", max(\"salary\") from \"people\" GROUP BY  \"dept\", \"age\"",
+              translate("select max(salary) group by age pivot dept"));
+    // pivot queries are limited after pivoting
+    EXPECT_EQ("select  \"dept\", \"age\", max(\"salary\") from \"people\" GROUP BY  \"dept\", \"age\"",
+              translate("select max(salary) group by age pivot dept limit 2 offset 1"));
+    EXPECT_EQ("select \"other\".\"x\" from \"other\"",translate("select `other.x`"));
+
+    // with a row limit the DB returns at most one row more
+    GQL_SQL::GQLParser::ParserSQLite p("people");
+    p.maxRowsSet(3);
+    ASSERT_TRUE(p.parse("select name"));
+    EXPECT_EQ("select \"name\" from \"people\" LIMIT 4",p.res().result);
+    ASSERT_TRUE(p.parse("select name limit 2 offset 5"));
+    EXPECT_EQ("select \"name\" from \"people\" LIMIT 2 OFFSET 5",p.res().result);
+    ASSERT_TRUE(p.parse("select count(name) group by age pivot dept limit 1 offset 1"));
+    EXPECT_EQ("select  \"dept\", \"age\", count(\"name\") from \"people\" GROUP BY  \"dept\", \"age\" LIMIT 4",p.res().result);
+}
+
+TEST(SQLite, Types) {
+    auto db=openDB();
+    ASSERT_TRUE(db->isConnected());
+    auto t=run(db,"select * options no_format");
+    const char *types[]={ "string","string","number","number","boolean","date","datetime","timeofday" };
+    ASSERT_EQ(8,t["cols"].size());
+    for(Json::ArrayIndex c=0;c<8;c++) {
+        EXPECT_EQ(types[c],t["cols"][c]["type"].asString()) << c;
+    }
+    EXPECT_EQ("Anna,Bert,Carl,Dora,O'Neil",column(t,0));
+    EXPECT_EQ(100.5,t["rows"][0]["c"][2]["v"].asDouble());
+    EXPECT_TRUE(t["rows"][3]["c"][2]["v"].isNull());
+    EXPECT_TRUE(t["rows"][0]["c"][3]["v"].isInt64());
+    EXPECT_EQ("true,false,true,true,false",column(t,4));
+    // times are returned as [hour,minute,second,millisecond]
+    EXPECT_EQ(12,t["rows"][0]["c"][7]["v"][0].asInt());
+    EXPECT_EQ(500,t["rows"][2]["c"][7]["v"][3].asInt());
+    EXPECT_EQ("Date(1980,1,3)",t["rows"][0]["c"][5]["v"].asString());
+    EXPECT_EQ("Date(2010,4,6,7,8,9,250)",t["rows"][0]["c"][6]["v"].asString());
+}
+
+TEST(SQLite, Functions) {
+    auto db=openDB();
+    auto t=run(db,"select year(born),month(born),day(born),hour(hired),minute(hired),second(hired),millisecond(hired),"
+                  "quarter(born),dateDiff(hired,born),upper(name) where name='Anna'");
+    EXPECT_EQ("1980",column(t,0));
+    EXPECT_EQ("2",column(t,1));
+    EXPECT_EQ("3",column(t,2));
+    EXPECT_EQ("7",column(t,3));
+    EXPECT_EQ("8",column(t,4));
+    EXPECT_EQ("9",column(t,5));
+    EXPECT_EQ("250",column(t,6));
+    EXPECT_EQ("1",column(t,7));
+    EXPECT_EQ("11050",column(t,8));
+    EXPECT_EQ("ANNA",column(t,9));
+    EXPECT_EQ("date",run(db,"select toDate(hired)")["cols"][0]["type"].asString());
+    EXPECT_EQ("date",run(db,"select max(born)")["cols"][0]["type"].asString());
+}
+
+TEST(SQLite, Dates) {
+    auto db=openDB("stamps");
+    // numbers are milliseconds since the epoch (noon UTC, the same day in most time zones)
+    EXPECT_EQ("Date(2023,10,14)",run(db,"select toDate(ms) where ms>0")["rows"][0]["c"][0]["v"].asString());
+    EXPECT_EQ("Date(1970,0,1)",run(db,"select toDate(43200000)")["rows"][0]["c"][0]["v"].asString());
+    EXPECT_EQ("Date(2023,10,14)",run(db,"select toDate(day) where ms>0")["rows"][0]["c"][0]["v"].asString());
+    Json::Value r;
+    db->execute("select ms,day",r);
+    EXPECT_EQ("error",r["status"].asString());
+    EXPECT_EQ("column 'day' has the invalid date/time value 'yesterday'",r["errors"][0]["message"].asString()) << r;
+}
+
+TEST(SQLite, Where) {
+    auto db=openDB();
+    EXPECT_EQ("Anna,Carl,Dora",column(run(db,"select name where active=true"),0));
+    EXPECT_EQ("Dora",column(run(db,"select name where salary is null"),0));
+    EXPECT_EQ("Carl",column(run(db,"select name where name starts with 'C'"),0));
+    EXPECT_EQ("",column(run(db,"select name where name starts with 'c'"),0));
+    EXPECT_EQ("O'Neil",column(run(db,"select name where name starts with \"O'\""),0));
+    EXPECT_EQ("",column(run(db,"select name where name starts with '?'"),0));
+    EXPECT_EQ("Anna,Bert,Carl,Dora,O'Neil",column(run(db,"select name where name starts with ''"),0));
+    EXPECT_EQ("Anna,Dora",column(run(db,"select name where name ends with 'a'"),0));
+    EXPECT_EQ("O'Neil",column(run(db,"select name where dept contains 'al'"),0));
+    EXPECT_EQ("Anna,Bert",column(run(db,"select name where name matches '[A-B].*'"),0));
+    EXPECT_EQ("",column(run(db,"select name where name matches 'A'"),0));
+    EXPECT_EQ("Anna,Dora",column(run(db,"select name where born<date '1982-01-01'"),0));
+    EXPECT_EQ("Anna,Carl",column(run(db,"select name where hired<datetime '2013-01-01 00:00:00'"),0));
+    EXPECT_EQ("3.5",column(run(db,"select age/8 where name='Bert'"),0));
+    // date functions compared with constants become ranges of the column
+    EXPECT_EQ("Carl",column(run(db,"select name where year(born)=1985 and month(born)=6"),0));
+    EXPECT_EQ("Carl",column(run(db,"select name where year(hired)=2012"),0));
+    EXPECT_EQ("Bert,O'Neil",column(run(db,"select name where year(hired)>2012"),0));
+    EXPECT_EQ("Carl",column(run(db,"select name where toDate(hired)=date '2012-12-31'"),0));
+}
+
+TEST(SQLite, LargeFilter) {
+    std::string gql="select name where age<0";
+    std::string sql="select \"name\" from \"people\" where ((\"age\"<0)";
+    for(int i=1;i<10000;i++) {
+        gql+=" or age<"+std::to_string(i);
+        sql+=" or (\"age\"<"+std::to_string(i)+")";
+    }
+    EXPECT_EQ(sql+")",translate(gql));
+    // SQLite limits the depth of expressions, so filters of this size run only
+    // if the chain is not nested
+    auto db=openDB();
+    gql="select name where age=38";
+    for(int i=0;i<800;i++) { gql+=" or age<"+std::to_string(-i); }
+    EXPECT_EQ("Anna",column(run(db,gql),0));
+
+    // comparisons with the same column become a single IN
+    gql="select name where age=38";
+    sql="select \"name\" from \"people\" where (\"age\" IN (38";
+    for(int i=0;i<10000;i++) {
+        gql+=" or age="+std::to_string(1000+i);
+        sql+=","+std::to_string(1000+i);
+    }
+    EXPECT_EQ(sql+"))",translate(gql));
+    EXPECT_EQ("Anna",column(run(db,gql),0));
+    EXPECT_EQ("Bert,Carl",column(run(db,"select name where name='Carl' or age=28 or name='Bert' or name='x'"),0));
+}
+
+TEST(SQLite, EmptyResult) {
+    auto db=openDB();
+    EXPECT_EQ("Anna,Dora",column(run(db,"select name where 1=1 and age>(30*1+5)"),0));
+    // a contradiction gives the same (empty) result as the DB
+    auto t=run(db,"select name,age,born,hired,lunch,active,max(salary) where 1>2 group by name,age,born,hired,lunch,active");
+    auto e=run(db,"select name,age,born,hired,lunch,active,max(salary) where age<0 group by name,age,born,hired,lunch,active");
+    EXPECT_EQ(0,t["rows"].size());
+    EXPECT_EQ(e,t);
+    // aggregates without 'group by' return one row
+    EXPECT_EQ("0",column(run(db,"select count(name) where age>1 and 1>2"),0));
+    EXPECT_EQ(8,run(db,"select * where false")["cols"].size());
+
+    // the DB is not needed for the empty result
+    char fname[]="/tmp/sqliteemptyXXXXXX.db";
+    int fd=mkstemps(fname,3);
+    ASSERT_GE(fd,0);
+    close(fd);
+    sqlite3 *s;
+    ASSERT_EQ(SQLITE_OK,sqlite3_open(fname,&s));
+    ASSERT_EQ(SQLITE_OK,sqlite3_exec(s,"CREATE TABLE t (a INTEGER)",0,0,0));
+    auto tdb=GQL_SQL::DBQuery::DB::Ptr(new GQL_SQL::DBQuery::SQLite(URI((std::string("sqlite://")+fname).c_str())));
+    tdb->deftableSet("t");
+    tdb->connect();
+    ASSERT_EQ(SQLITE_OK,sqlite3_exec(s,"DROP TABLE t",0,0,0));
+    sqlite3_close(s);
+    t=run(tdb,"select a where a=1 and 2=3");
+    EXPECT_EQ("number",t["cols"][0]["type"].asString());
+    EXPECT_EQ(0,t["rows"].size());
+    Json::Value r;
+    tdb->execute("select a where a=1",r);
+    EXPECT_EQ("error",r["status"].asString());
+    tdb->executeBatch({"select a where 1=2","select a"},r);
+    EXPECT_EQ("ok",r[0]["status"].asString());
+    EXPECT_EQ("error",r[1]["status"].asString());
+    unlink(fname);
+}
+
+TEST(SQLite, GroupPivot) {
+    auto db=openDB();
+    auto t=run(db,"select dept,count(name),sum(age) group by dept order by sum(age) desc");
+    EXPECT_EQ("ops,dev,sales",column(t,0));
+    EXPECT_EQ("2,2,1",column(t,1));
+    EXPECT_EQ("76,66,25",column(t,2));
+
+    t=run(db,"select dept,count(name) group by dept pivot active");
+    ASSERT_EQ(3,t["cols"].size());
+    EXPECT_EQ("dev,sales,ops",column(t,0));
+    EXPECT_EQ("1,1,null",column(t,1));
+    EXPECT_EQ("1,null,2",column(t,2));
+
+    // limit and offset select pivoted rows, the columns come from all rows
+    t=run(db,"select dept,count(name) group by dept pivot active limit 1 offset 1");
+    ASSERT_EQ(3,t["cols"].size());
+    EXPECT_EQ("sales",column(t,0));
+    EXPECT_EQ("1",column(t,1));
+    EXPECT_EQ("null",column(t,2));
+    t=run(db,"select dept,count(name) group by dept pivot active limit 2");
+    EXPECT_EQ("dev,sales",column(t,0));
+    EXPECT_EQ("",column(run(db,"select dept,count(name) group by dept pivot active offset 5"),0));
+}
+
+TEST(SQLite, Timeout) {
+    openDB();
+    auto db=GQL_SQL::DBQuery::DB::Ptr(new GQL_SQL::DBQuery::SQLite(URI(("sqlite://"+dbfile).c_str())));
+    db->deftableSet("people");
+    db->tableAdd("big");
+    db->tableAdd("big2");
+    db->connect();
+    const char *slow="select count(`big.x`) where `big2.y`>=`big.x`";
+    db->timeoutSet(50);
+    Json::Value r;
+    db->execute(slow,r);
+    EXPECT_EQ("error",r["status"].asString());
+    EXPECT_EQ("other",r["errors"][0]["reason"].asString()) << r;
+    EXPECT_EQ("query timed out after 50 ms",r["errors"][0]["message"].asString()) << r;
+    // the next query is not affected
+    EXPECT_EQ("5",column(run(db,"select count(name)"),0));
+
+    // cancel from another thread
+    db->timeoutSet(0);
+    // cancel() before the query started is ignored, so keep trying until it returned
+    std::atomic<bool> finished(false);
+    std::thread canceller([db,&finished]() {
+        while(!finished) {
+            db->cancel();
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    });
+    r=Json::Value();
+    db->execute(slow,r);
+    finished=true;
+    canceller.join();
+    EXPECT_EQ("query cancelled",r["errors"][0]["message"].asString()) << r;
+    db->cancel(); // no query running, ignored
+    EXPECT_EQ("5",column(run(db,"select count(name)"),0));
+}
+
+TEST(SQLite, Budget) {
+    auto db=openDB();
+    db->maxRowsSet(3);
+    Json::Value r;
+    db->execute("select name",r);
+    EXPECT_EQ("error",r["status"].asString());
+    EXPECT_EQ("other",r["errors"][0]["reason"].asString()) << r;
+    EXPECT_EQ("the result has more than 3 rows",r["errors"][0]["message"].asString()) << r;
+    EXPECT_EQ("Anna,Bert,Carl",column(run(db,"select name order by name limit 3"),0));
+    EXPECT_EQ("2,2,1",column(run(db,"select count(name) group by dept"),0));
+
+    db->maxRowsSet(0);
+    db->maxMemorySet(1000);
+    r=Json::Value();
+    db->execute("select *",r);
+    EXPECT_EQ("the result needs more than 1000 bytes",r["errors"][0]["message"].asString()) << r;
+    EXPECT_EQ("Anna",column(run(db,"select name limit 1"),0));
+}
+
+TEST(SQLite, Parameters) {
+    GQL_SQL::GQLParser::ParserSQLite p("people");
+    p.parameterizeSet(true);
+    ASSERT_TRUE(p.parse("select name where age>30 and born<date '1982-01-01' and name!=\"O'Neil\""));
+    EXPECT_EQ("select \"name\" from \"people\" where ((\"age\">?) and (\"born\"<?) and (\"name\"!=?))",p.res().result);
+    ASSERT_EQ(3,p.res().params.size());
+    EXPECT_EQ("O'Neil",p.res().params[2].value);
+
+    // the prepared statement is reused with different values
+    auto db=openDB();
+    EXPECT_EQ("Anna,Carl",column(run(db,"select name where (age>30 and salary!=70.5) or (name=\"O'Neil\" and age>99)"),0));
+    EXPECT_EQ("Carl,O'Neil",column(run(db,"select name where (age>30 and salary!=100.5) or (name=\"O'Neil\" and age>9)"),0));
+    EXPECT_EQ("Bert",column(run(db,"select name where hired>=datetime '2015-01-01 00:00:00' and hired<datetime '2016-01-01 00:00:00'"),0));
+    EXPECT_EQ("Bert",column(run(db,"select name where age=28.0"),0));
+}
+
+TEST(SQLite, StatementCache) {
+    if(dbfile=="") { createDB(); }
+    Json::Value init;
+    init["db"]=dbfile;
+    init["statement_cache"]=2;
+    auto db=GQL_SQL::DBQuery::DB::Ptr(new GQL_SQL::DBQuery::SQLite(init));
+    db->deftableSet("people");
+    db->connect();
+    EXPECT_EQ("Anna",column(run(db,"select name where age=38"),0));
+    EXPECT_EQ("Bert",column(run(db,"select name where age=28"),0));
+    auto stats=db->statementCacheStats();
+    EXPECT_EQ(1,stats.misses);
+    EXPECT_EQ(1,stats.hits);
+    EXPECT_EQ(0.5,stats.hitRate());
+
+    // queries without parameters are not cached
+    run(db,"select name");
+    EXPECT_EQ(1,db->statementCacheStats().misses);
+
+    run(db,"select name where age<30");
+    run(db,"select name where age>30");
+    // the cache holds 2 statements, age=? was the least recently used one
+    EXPECT_EQ(1,db->statementCacheStats().evictions);
+    EXPECT_EQ("Carl",column(run(db,"select name where age=33"),0));
+    EXPECT_EQ(4,db->statementCacheStats().misses);
+    EXPECT_EQ(2,db->statementCacheStats().evictions);
+}
+
+TEST(SQLite, Schema) {
+    auto db=openDB();
+    Json::Value r;
+    db->execute("select name where nosuchcolumn=1",r);
+    EXPECT_EQ("error",r["status"].asString());
+    EXPECT_NE(std::string::npos,r["errors"][0]["message"].asString().find("nosuchcolumn")) << r;
+    // column names are not case sensitive
+    EXPECT_EQ("Anna",column(run(db,"select NAME where AGE=38"),0));
+
+    // a second connection reads the schema from the cache file, use a copy of
+    // the DB because the schema of dbfile is already in the in-process cache
+    char fname[]="/tmp/sqliteschemaXXXXXX";
+    int fd=mkstemp(fname);
+    ASSERT_GE(fd,0);
+    close(fd);
+    std::string copy=std::string(fname)+".db";
+    {
+        std::ifstream src(dbfile,std::ios::binary);
+        std::ofstream dst(copy,std::ios::binary);
+        dst << src.rdbuf();
+    }
+    Json::Value init;
+    init["db"]=copy;
+    init["schema_ttl"]=0;
+    init["schema_cache"]=fname;
+    auto nocache=GQL_SQL::DBQuery::DB::Ptr(new GQL_SQL::DBQuery::SQLite(init));
+    nocache->deftableSet("people");
+    nocache->connect();
+    struct stat st;
+    ASSERT_EQ(0,stat(fname,&st));
+    EXPECT_EQ(0,st.st_size); // schema_ttl=0 disables the cache
+
+    init["schema_ttl"]=60;
+    auto first=GQL_SQL::DBQuery::DB::Ptr(new GQL_SQL::DBQuery::SQLite(init));
+    first->deftableSet("people");
+    first->connect();
+    Json::Value all;
+    std::ifstream(fname) >> all;
+    ASSERT_TRUE(all.isObject()) << all;
+    ASSERT_EQ(1,all.size());
+    std::string key=all.getMemberNames()[0];
+    EXPECT_EQ("?tables=people",key.substr(key.find('?'))) << key;
+    EXPECT_EQ("INTEGER",all[key]["tables"]["people"]["age"].asString());
+    auto second=GQL_SQL::DBQuery::DB::Ptr(new GQL_SQL::DBQuery::SQLite(init));
+    second->deftableSet("people");
+    second->connect();
+    EXPECT_EQ("Bert",column(run(second,"select name where age=28"),0));
+    // other tables of the same DB get their own entry
+    auto stamps=GQL_SQL::DBQuery::DB::Ptr(new GQL_SQL::DBQuery::SQLite(init));
+    stamps->deftableSet("stamps");
+    stamps->connect();
+    std::ifstream(fname) >> all;
+    ASSERT_EQ(2,all.size()) << all;
+    EXPECT_EQ("INTEGER",all[all.getMemberNames()[1]]["tables"]["stamps"]["ms"].asString()) << all;
+    unlink(fname);
+    unlink(copy.c_str());
+}
+
+TEST(SQLite, Async) {
+    auto db=openDB();
+    std::vector<std::future<Json::Value>> results;
+    for(auto age:{38,28,33,43,25}) {
+        results.push_back(db->executeAsync("select name where age="+std::to_string(age)));
+    }
+    std::string names;
+    for(auto &f:results) {
+        Json::Value r=f.get();
+        EXPECT_EQ("ok",r["status"].asString()) << r;
+        names+=column(r["table"],0)+",";
+    }
+    EXPECT_EQ("Anna,Bert,Carl,Dora,O'Neil,",names);
+
+    // callbacks run on the background thread in the order the queries were queued
+    std::promise<std::string> done;
+    auto order=std::make_shared<std::string>();
+    db->executeAsync("select count(name)",[order](Json::Value &r) { *order+=column(r["table"],0)+","; });
+    db->executeAsync("select nosuchcolumn",[order](Json::Value &r) { *order+=r["status"].asString()+","; });
+    db->executeAsync("select max(age)",[order,&done](Json::Value &r) {
+        *order+=column(r["table"],0);
+        done.set_value(*order);
+    });
+    EXPECT_EQ("5,error,43",done.get_future().get());
+
+    // a callback that throws does not stop the background thread
+    db->executeAsync("select count(name)",[](Json::Value &) { throw 42; });
+    db->executeAsync("select count(name)",[](Json::Value &) { throw std::runtime_error("callback"); });
+
+    // synchronous and asynchronous queries can be mixed
+    auto f=db->executeAsync("select name where age=25");
+    EXPECT_EQ("Anna",column(run(db,"select name where age=38"),0));
+    EXPECT_EQ("O'Neil",column(f.get()["table"],0));
+}
+
+TEST(SQLite, Batch) {
+    auto db=openDB();
+    Json::Value r;
+    db->executeBatch({"select name where age=38","select nosuchcolumn","select count(name)",
+                      "select dept,count(name) group by dept pivot active order by dept"},r);
+    ASSERT_EQ(4,r.size());
+    EXPECT_EQ("ok",r[0]["status"].asString());
+    EXPECT_EQ("Anna",column(r[0]["table"],0));
+    EXPECT_EQ("error",r[1]["status"].asString());
+    EXPECT_EQ("5",column(r[2]["table"],0));
+    EXPECT_EQ("ok",r[3]["status"].asString());
+    // results are the same as running the queries one by one
+    Json::Value single;
+    db->execute("select dept,count(name) group by dept pivot active order by dept",single);
+    EXPECT_EQ(single,r[3]);
+
+    // a query the parser rejects with an exception only fails itself
+    db->executeBatch({"select name where age=38","select name offset 99999999999999999999","select count(name)"},r);
+    ASSERT_EQ(3,r.size());
+    EXPECT_EQ("Anna",column(r[0]["table"],0));
+    EXPECT_EQ("error",r[1]["status"].asString());
+    EXPECT_EQ("invalid_request",r[1]["errors"][0]["reason"].asString()) << r[1];
+    EXPECT_EQ("5",column(r[2]["table"],0));
+
+    db->executeBatch({},r);
+    EXPECT_EQ(0,r.size());
+}
+
+TEST(SQLite, Errors) {
+    auto db=openDB();
+    Json::Value r;
+    db->execute("select nosuchcolumn",r);
+    EXPECT_EQ("error",r["status"].asString());
+
+    auto bad=GQL_SQL::DBQuery::DB::Ptr(new GQL_SQL::DBQuery::SQLite(URI("sqlite:///nonexistent/file.db")));
+    bad->connect();
+    EXPECT_FALSE(bad->isConnected());
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    int r=RUN_ALL_TESTS();
+    if(dbfile!="") { unlink(dbfile.c_str()); }
+    return r;
+}
@@ -1,4 +1,5 @@
 #include <gtest/gtest.h>
+#include <boost/algorithm/string.hpp>
 
 #include "libgqlsql.h"
 
@@ -57,6 +58,54 @@ TEST (Tokenizer, Strings) {
     EXPECT_EQ(Token(33,TokenType::EOL,""),t.next());
 }
 
+TEST (Tokenizer, AllKeywords) {
+    const std::pair<const char *,TokenType> keywords[]={
+        { "AND",TokenType::AND }, { "Asc",TokenType::ASC }, { "bY",TokenType::BY },
+        { "Date",TokenType::DATE }, { "DateTime",TokenType::DATETIME }, { "DESC",TokenType::DESC },
+        { "False",TokenType::GQL_FALSE }, { "FORMAT",TokenType::FORMAT }, { "Group",TokenType::GROUP },
+        { "LABEL",TokenType::LABEL }, { "Limit",TokenType::LIMIT }, { "NOT",TokenType::NOT },
+        { "Offset",TokenType::OFFSET }, { "OPTIONS",TokenType::OPTIONS }, { "OR",TokenType::OR },
+        { "Order",TokenType::ORDER }, { "PIVOT",TokenType::PIVOT }, { "Select",TokenType::SELECT },
+        { "TimeOfDay",TokenType::TIMEOFDAY }, { "TIMESTAMP",TokenType::TIMESTAMP },
+        { "True",TokenType::GQL_TRUE }, { "WHERE",TokenType::WHERE },
+    };
+    for(const auto &k:keywords) {
+        auto t=Tokenizer(k.first);
+        auto tok=t.next();
+        EXPECT_EQ(k.second,tok.tt) << k.first;
+        EXPECT_EQ(boost::algorithm::to_lower_copy(std::string(k.first)),tok.token) << k.first;
+    }
+    // similar to keywords but identifiers
+    for(auto id:{ "an","ands","selects","o","wher","limits","dates","timeofdays","orde_r","x" }) {
+        auto t=Tokenizer(id);
+        EXPECT_EQ(Token(1,TokenType::IDENTIFIER,id),t.next());
+    }
+}
+
+TEST (Tokenizer, ZeroCopy) {
+    std::string q="select Name where `my col`='x' and a<>b";
+    auto t=Tokenizer(q);
+    for(auto tok=t.next();tok.tt!=TokenType::EOL;tok=t.next()) {
+        if(tok.tt==TokenType::SELECT||tok.tt==TokenType::WHERE||tok.tt==TokenType::AND) { continue; }
+        // all other tokens refer to the query string itself
+        EXPECT_GE(tok.token.data(),q.data()) << tok;
+        EXPECT_LE(tok.token.data()+tok.token.size(),q.data()+q.size()) << tok;
+    }
+}
+
+TEST (Tokenizer, Unterminated) {
+    auto t=Tokenizer("a 'abc");
+    EXPECT_EQ(Token(1,TokenType::IDENTIFIER,"a"),t.next());
+    EXPECT_EQ(Token(3,TokenType::ERROR,"'abc"),t.next());
+    EXPECT_EQ(TokenType::EOL,t.next().tt);
+    t=Tokenizer("x `");
+    t.next();
+    EXPECT_EQ(Token(3,TokenType::ERROR,"`"),t.next());
+    t=Tokenizer("1!2");
+    EXPECT_EQ(Token(1,TokenType::NUMBER,"1"),t.next());
+    EXPECT_EQ(Token(2,TokenType::ERROR,"!"),t.next());
+}
+
 int main(int argc, char **argv) {
       ::testing::InitGoogleTest(&argc, argv);
         return RUN_ALL_TESTS();